@@ -692,14 +692,14 @@ INLINE static void calc_phase(OPLL_SLOT * slot, int32 lfo) {
 }
 
 /* EG */
-static void calc_envelope(OPLL_SLOT * slot, int32 lfo) {
 #define S2E(x) (SL2EG((int32)(x / SL_STEP)) << (EG_DP_BITS - EG_BITS))
 
-	static uint32 SL[16] = {
-		S2E(0.0), S2E(3.0), S2E(6.0), S2E(9.0), S2E(12.0), S2E(15.0), S2E(18.0), S2E(21.0),
-		S2E(24.0), S2E(27.0), S2E(30.0), S2E(33.0), S2E(36.0), S2E(39.0), S2E(42.0), S2E(48.0)
-	};
+static const uint32 SL[16] = {
+	S2E(0.0), S2E(3.0), S2E(6.0), S2E(9.0), S2E(12.0), S2E(15.0), S2E(18.0), S2E(21.0),
+	S2E(24.0), S2E(27.0), S2E(30.0), S2E(33.0), S2E(36.0), S2E(39.0), S2E(42.0), S2E(48.0)
+};
 
+static void calc_envelope(OPLL_SLOT * slot, int32 lfo) {
 	uint32 egout;
 
 	switch (slot->eg_mode) {
@@ -820,11 +820,320 @@ static INLINE int16 calc(OPLL * opll) {
 	return (int16)out;
 }
 
+/*************************************************************
+
+				 Block rendering
+
+  OPLL_fillbuf renders a run of samples at a time rather than calling calc()
+  for each. The LFOs are stepped for the whole block first, then every slot's
+  phase and envelope for the block, and only then the operators. The phase
+  and envelope passes are loops over whole blocks with the branches hoisted
+  out of them, which the compiler can vectorize; they work out a few samples
+  past the end of a short block, which are thrown away. Channels whose
+  carrier has finished (or which are masked) never reach the sine and dB
+  tables, and their slots are only moved on as far as the state needs. The
+  result is sample for sample, and the chip state bit for bit, what calc()
+  gives, as the slots don't depend on each other.
+
+*************************************************************/
+
+#define BLOCK_BITS 6
+#define BLOCK_SIZE (1 << BLOCK_BITS)
+
+/* the LFO outputs for a block; the chip is moved on by n samples, as update_ampm would */
+static void calc_ampm_block(OPLL * opll, int32 *lfo_pm, int32 *lfo_am, int32 n) {
+	uint32 pm_phase = opll->pm_phase;
+	uint32 am_phase = opll->am_phase;
+	int32 i;
+
+	for (i = 0; i < BLOCK_SIZE; i++) {
+		pm_phase = (pm_phase + pm_dphase) & (PM_DP_WIDTH - 1);
+		am_phase = (am_phase + am_dphase) & (AM_DP_WIDTH - 1);
+		lfo_pm[i] = pmtable[HIGHBITS(pm_phase, PM_DP_BITS - PM_PG_BITS)];
+		lfo_am[i] = amtable[HIGHBITS(am_phase, AM_DP_BITS - AM_PG_BITS)];
+	}
+
+	opll->pm_phase = (opll->pm_phase + (uint32)n * pm_dphase) & (PM_DP_WIDTH - 1);
+	opll->am_phase = (opll->am_phase + (uint32)n * am_dphase) & (AM_DP_WIDTH - 1);
+	opll->lfo_pm = lfo_pm[n - 1];
+	opll->lfo_am = lfo_am[n - 1];
+}
+
+/* PG for a block; pgout[i] is the slot's pgout after the i-th sample */
+static void calc_phase_block(OPLL_SLOT * slot, const int32 *lfo_pm, uint32 *pgout, int32 n) {
+	uint32 phase = slot->phase;
+	uint32 dphase = slot->dphase;
+	int32 i;
+
+	if (slot->patch.PM) {
+		for (i = 0; i < n; i++) {
+			phase = (phase + ((dphase * lfo_pm[i]) >> PM_AMP_BITS)) & (DP_WIDTH - 1);
+			pgout[i] = HIGHBITS(phase, DP_BASE_BITS);
+		}
+	} else {
+		/* DP_WIDTH divides 2^32, so the phase can be worked out for each sample on its own */
+		for (i = 0; i < BLOCK_SIZE; i++)
+			pgout[i] = HIGHBITS((phase + (uint32)(i + 1) * dphase) & (DP_WIDTH - 1), DP_BASE_BITS);
+		phase = (phase + (uint32)n * dphase) & (DP_WIDTH - 1);
+	}
+
+	slot->phase = phase;
+	slot->pgout = pgout[n - 1];
+}
+
+/* how many steps of dphase it takes from phase to reach limit, at most cap */
+INLINE static int32 steps_to(uint32 phase, uint32 dphase, uint32 limit, int32 cap) {
+	uint32 k;
+
+	if (phase >= limit)
+		return 0;
+	if (dphase == 0)
+		return cap;
+	k = (limit - phase + dphase - 1) / dphase;
+	return k < (uint32)cap ? (int32)k : cap;
+}
+
+/* the envelope of a slot going up or down at a steady rate, from sample i for m samples.
+   a run which starts the block does all of it, which is a loop the compiler can vectorize */
+INLINE static void fill_envelope(uint32 *egout, int32 i, int32 m, uint32 phase, uint32 dphase) {
+	int32 j;
+
+	if (i == 0) {
+		for (j = 0; j < BLOCK_SIZE; j++)
+			egout[j] = HIGHBITS(phase + (uint32)j * dphase, EG_DP_BITS - EG_BITS);
+	} else {
+		for (j = 0; j < m; j++)
+			egout[i + j] = HIGHBITS(phase + (uint32)j * dphase, EG_DP_BITS - EG_BITS);
+	}
+}
+
+/* EG for a block; egout[i] is the slot's egout after the i-th sample.
+   returns the sample on which the slot reached FINISH, n if it didn't */
+static int32 calc_envelope_block(OPLL_SLOT * slot, const int32 *lfo_am, uint32 *egout, int32 n) {
+	/* kept in locals: egout could alias the slot as far as the compiler knows */
+	uint32 phase = slot->eg_phase, dphase = slot->eg_dphase;
+	int32 i = 0, m, finish = n;
+	uint32 e, tll;
+
+	/* each mode works out up front how many samples it lasts, so the samples
+	   up to the one it changes on are a plain loop without a test in it */
+	while (i < n) {
+		switch (slot->eg_mode) {
+		case ATTACK:
+			if (slot->patch.AR == 15)
+				m = 0;
+			else {
+				/* the attack phase starts from 0, so it ends the first time it gets to EG_DP_WIDTH */
+				m = steps_to(phase + dphase, dphase, EG_DP_WIDTH, n - i);
+				for (; m > 0; m--, i++) {
+					egout[i] = AR_ADJUST_TABLE[HIGHBITS(phase, EG_DP_BITS - EG_BITS)];
+					phase += dphase;
+				}
+			}
+			if (i < n) {
+				egout[i++] = 0;
+				phase = 0;
+				slot->eg_mode = DECAY;
+				UPDATE_EG(slot);
+				dphase = slot->eg_dphase;
+			}
+			break;
+
+		case DECAY:
+			e = SL[slot->patch.SL];
+			m = steps_to(phase + dphase, dphase, e, n - i);
+			fill_envelope(egout, i, m, phase, dphase);
+			i += m;
+			phase += (uint32)m * dphase;
+			if (i < n) {
+				egout[i++] = HIGHBITS(phase, EG_DP_BITS - EG_BITS);
+				phase = e;
+				slot->eg_mode = slot->patch.EG ? SUSHOLD : SUSTINE;
+				UPDATE_EG(slot);
+				dphase = slot->eg_dphase;
+			}
+			break;
+
+		case SUSHOLD:
+			e = HIGHBITS(phase, EG_DP_BITS - EG_BITS);
+			if (slot->patch.EG == 0) {
+				egout[i++] = e;
+				slot->eg_mode = SUSTINE;
+				UPDATE_EG(slot);
+				dphase = slot->eg_dphase;
+			} else {
+				for (; i < n; i++)
+					egout[i] = e;
+			}
+			break;
+
+		case SUSTINE:
+		case RELEASE:
+			m = steps_to(phase, dphase, EG_DP_WIDTH, n - i);
+			fill_envelope(egout, i, m, phase, dphase);
+			i += m;
+			phase += (uint32)m * dphase;
+			if (i < n) {
+				egout[i] = (1 << EG_BITS) - 1;
+				phase += dphase;
+				slot->eg_mode = FINISH;
+				finish = i++;
+			}
+			break;
+
+		case FINISH:
+			if (finish == n)
+				finish = i;
+			/* fall through */
+		default:
+			for (; i < n; i++)
+				egout[i] = (1 << EG_BITS) - 1;
+			break;
+		}
+	}
+	slot->eg_phase = phase;
+
+	/* whatever is past the end of a short block only has to be something */
+	for (; i < BLOCK_SIZE; i++)
+		egout[i] = (1 << EG_BITS) - 1;
+
+	tll = slot->tll;
+	if (slot->patch.AM) {
+		/* a copy which the compiler knows isn't egout, or it won't vectorize the loop */
+		uint32 am[BLOCK_SIZE];
+		for (i = 0; i < BLOCK_SIZE; i++)
+			am[i] = lfo_am[i];
+		for (i = 0; i < BLOCK_SIZE; i++) {
+			e = EG2DB(egout[i] + tll) + am[i];
+			egout[i] = e >= DB_MUTE ? DB_MUTE - 1 : e;
+		}
+	} else {
+		for (i = 0; i < BLOCK_SIZE; i++) {
+			e = EG2DB(egout[i] + tll);
+			egout[i] = e >= DB_MUTE ? DB_MUTE - 1 : e;
+		}
+	}
+
+	slot->egout = egout[n - 1];
+	return finish;
+}
+
+/* moves a slot whose output isn't wanted through a block. one that stays put in its envelope, as a finished
+   or held slot does, only needs its phase moved on and its last egout worked out */
+static void skip_slot_block(OPLL_SLOT * slot, const int32 *lfo_pm, const int32 *lfo_am, uint32 *pgout, uint32 *egout, int32 n) {
+	uint32 sum, e;
+	int32 i;
+
+	if (slot->eg_mode != FINISH && slot->eg_mode != SETTLE && !(slot->eg_mode == SUSHOLD && slot->patch.EG)) {
+		calc_phase_block(slot, lfo_pm, pgout, n);
+		calc_envelope_block(slot, lfo_am, egout, n);
+		return;
+	}
+
+	if (slot->patch.PM) {
+		for (i = 0, sum = 0; i < n; i++)
+			sum += (slot->dphase * lfo_pm[i]) >> PM_AMP_BITS;
+	} else
+		sum = (uint32)n * slot->dphase;
+	slot->phase = (slot->phase + sum) & (DP_WIDTH - 1);
+	slot->pgout = HIGHBITS(slot->phase, DP_BASE_BITS);
+
+	if (slot->eg_mode == SUSHOLD)
+		e = HIGHBITS(slot->eg_phase, EG_DP_BITS - EG_BITS);
+	else
+		e = (1 << EG_BITS) - 1;
+	e = EG2DB(e + slot->tll);
+	if (slot->patch.AM)
+		e += lfo_am[n - 1];
+	slot->egout = e >= DB_MUTE ? DB_MUTE - 1 : e;
+}
+
+/* the operators of the channels for a block, as calc_slot_mod and calc_slot_car. channel ch plays for the
+   first playing[ch] samples */
+static void calc_channels_block(OPLL * opll, uint32 pgout[12][BLOCK_SIZE], uint32 egout[12][BLOCK_SIZE],
+								const int32 *playing, int32 *mix, int32 n) {
+	int32 fm[6][BLOCK_SIZE];
+	OPLL_SLOT *slot;
+	const uint32 *pg, *eg;
+	int32 i, ch, out, prev;
+
+	/* a modulator's feedback makes a chain of table lookups from each sample to the next. going through
+	   the channels for each sample rather than through the samples for each channel keeps one chain per
+	   channel in flight at once */
+	for (i = 0; i < n; i++) {
+		for (ch = 0; ch < 6; ch++) {
+			if (i >= playing[ch])
+				continue;
+			slot = MOD(opll, ch);
+			pg = pgout[ch << 1];
+			eg = egout[ch << 1];
+			slot->output[1] = slot->output[0];
+			if (eg[i] >= (DB_MUTE - 1))
+				slot->output[0] = 0;
+			else if (slot->patch.FB != 0)
+				slot->output[0] = DB2LIN_TABLE[slot->sintbl[(pg[i] + (wave2_4pi(slot->feedback) >> (7 - slot->patch.FB))) & (PG_WIDTH - 1)] + eg[i]];
+			else
+				slot->output[0] = DB2LIN_TABLE[slot->sintbl[pg[i]] + eg[i]];
+			fm[ch][i] = slot->feedback = (slot->output[1] + slot->output[0]) >> 1;
+		}
+	}
+
+	/* a carrier only carries its last output over, so its samples can go one after another */
+	for (ch = 0; ch < 6; ch++) {
+		slot = CAR(opll, ch);
+		pg = pgout[(ch << 1) | 1];
+		eg = egout[(ch << 1) | 1];
+		out = slot->output[0];
+		prev = slot->output[1];
+		for (i = 0; i < playing[ch]; i++) {
+			prev = out;
+			if (eg[i] >= (DB_MUTE - 1))
+				out = 0;
+			else
+				out = DB2LIN_TABLE[slot->sintbl[(pg[i] + wave2_8pi(fm[ch][i])) & (PG_WIDTH - 1)] + eg[i]];
+			mix[i] += (prev + out) >> 1;
+		}
+		slot->output[0] = out;
+		slot->output[1] = prev;
+	}
+}
+
 void OPLL_fillbuf(OPLL* opll, int32 *buf, int32 len, int shift) {
+	int32 lfo_pm[BLOCK_SIZE], lfo_am[BLOCK_SIZE], mix[BLOCK_SIZE];
+	uint32 pgout[12][BLOCK_SIZE], egout[12][BLOCK_SIZE];
+	int32 playing[6];
+	int32 i, n, ch, any;
+
 	while (len > 0) {
-		*buf += (calc(opll) + 32768) << shift;
-		buf++;
-		len--;
+		n = len < BLOCK_SIZE ? len : BLOCK_SIZE;
+
+		calc_ampm_block(opll, lfo_pm, lfo_am, n);
+
+		any = 0;
+		for (ch = 0; ch < 6; ch++) {
+			OPLL_SLOT *mod = MOD(opll, ch), *car = CAR(opll, ch);
+			if (car->eg_mode == FINISH || (opll->mask & OPLL_MASK_CH(ch))) {
+				skip_slot_block(mod, lfo_pm, lfo_am, pgout[ch << 1], egout[ch << 1], n);
+				skip_slot_block(car, lfo_pm, lfo_am, pgout[(ch << 1) | 1], egout[(ch << 1) | 1], n);
+				playing[ch] = 0;
+				continue;
+			}
+			calc_phase_block(mod, lfo_pm, pgout[ch << 1], n);
+			calc_envelope_block(mod, lfo_am, egout[ch << 1], n);
+			calc_phase_block(car, lfo_pm, pgout[(ch << 1) | 1], n);
+			/* calc() leaves a channel out from the sample its carrier finishes on */
+			playing[ch] = calc_envelope_block(car, lfo_am, egout[(ch << 1) | 1], n);
+			any |= playing[ch];
+		}
+
+		memset(mix, 0, n * sizeof(int32));
+		if (any)
+			calc_channels_block(opll, pgout, egout, playing, mix, n);
+
+		for (i = 0; i < n; i++)
+			buf[i] += ((int16)mix[i] + 32768) << shift;
+		buf += n;
+		len -= n;
 	}
 }
 
@@ -98,8 +98,8 @@ static DECLFR(UNLSB2000Read) {
 static DECLFW(UNLSB2000Write) {
 	switch(A) {
 	case 0x4027:	// PCM output
-		BWrite[0x4015](0x4015, 0x10);
-		BWrite[0x4011](0x4011, V >> 1);
+		FCEU_CPUWrite(0x4015, 0x10);
+		FCEU_CPUWrite(0x4011, V >> 1);
 		break;
 	case 0x4032:	// IRQ mask
 		IRQa &= ~V;
@@ -133,8 +133,8 @@ static void UNLSB2000Reset(void) {
 	preg[6] = 6;
 	preg[7] = 7;
 	IRQa = 0;
-//	BWrite[0x4017](0x4017,0xC0);
-//	BWrite[0x4015](0x4015,0x1F);
+//	FCEU_CPUWrite(0x4017,0xC0);
+//	FCEU_CPUWrite(0x4015,0x1F);
 }
 
 static void UNLSB2000Power(void) {
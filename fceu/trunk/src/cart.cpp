@@ -30,6 +30,7 @@
 #include "x6502.h"
 
 #include "file.h"
+#include "saveio.h"
 #include "utils/memory.h"
 
 
@@ -90,6 +91,7 @@ static INLINE void setpageptr(int s, uint32 A, uint8 *p, int ram) {
 			PRGIsRAM[AB + x] = 0;
 			Page[AB + x] = 0;
 		}
+	FCEU_UpdateCartReadPages(AB, s >> 1);
 }
 
 static uint8 nothing[8192];
@@ -103,6 +105,7 @@ void ResetCartMapping(void) {
 		PRGptr[x] = CHRptr[x] = 0;
 		PRGsize[x] = CHRsize[x] = 0;
 	}
+	FCEU_UpdateCartReadPages(0, 32);
 	for (x = 0; x < 8; x++) {
 		MMC5SPRVPage[x] = MMC5BGVPage[x] = VPageR[x] = nothing - 0x400 * x;
 	}
@@ -529,20 +532,19 @@ void FCEU_GeniePower(void) {
 }
 
 
-void FCEU_SaveGameSave(CartInfo *LocalHWInfo) {
-	if (LocalHWInfo->battery && LocalHWInfo->SaveGame[0]) {
-		FILE *sp;
+static void GameSaveWritten(const char *fname, bool ok, int tag) {
+	if (!ok)
+		FCEU_PrintError("WRAM file \"%s\" cannot be written to.\n", fname);
+}
 
-		std::string soot = FCEU_MakeFName(FCEUMKF_SAV, 0, "sav");
-		if ((sp = FCEUD_UTF8fopen(soot, "wb")) == NULL) {
-			FCEU_PrintError("WRAM file \"%s\" cannot be written to.\n", soot.c_str());
-		} else {
-			for (int x = 0; x < 4; x++)
-				if (LocalHWInfo->SaveGame[x]) {
-					fwrite(LocalHWInfo->SaveGame[x], 1,
-						   LocalHWInfo->SaveGameLen[x], sp);
-				}
-		}
+void FCEU_SaveGameSave(CartInfo *LocalHWInfo) {
+	if (LocalHWInfo->battery && LocalHWInfo->SaveGame[0] && useGameFiles) {
+		//copied here, written to disk by the i/o thread
+		EMUFILE_MEMORY *sp = FCEU_SaveIOBegin();
+		for (int x = 0; x < 4; x++)
+			if (LocalHWInfo->SaveGame[x])
+				sp->fwrite(LocalHWInfo->SaveGame[x], LocalHWInfo->SaveGameLen[x]);
+		FCEU_SaveIOCommit(FCEU_MakeFName(FCEUMKF_SAV, 0, "sav").c_str(), 0, 0, 0, GameSaveWritten, 0);
 	}
 }
 
@@ -550,9 +552,10 @@ void FCEU_SaveGameSave(CartInfo *LocalHWInfo) {
 int disableBatteryLoading = 0;
 
 void FCEU_LoadGameSave(CartInfo *LocalHWInfo) {
-	if (LocalHWInfo->battery && LocalHWInfo->SaveGame[0] && !disableBatteryLoading) {
+	if (LocalHWInfo->battery && LocalHWInfo->SaveGame[0] && !disableBatteryLoading && useGameFiles) {
 		FILE *sp;
 
+		FCEU_SaveIOFlush();
 		std::string soot = FCEU_MakeFName(FCEUMKF_SAV, 0, "sav");
 		sp = FCEUD_UTF8fopen(soot, "rb");
 		if (sp != NULL) {
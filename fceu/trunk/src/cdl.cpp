@@ -0,0 +1,411 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2002 Ben Parnell
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief Code/Data Logger: logging, .cdl file i/o and incremental autosave, shared by all drivers
+
+#include "types.h"
+#include "x6502.h"
+#include "fceu.h"
+#include "cart.h"
+#include "debug.h"
+#include "cdl.h"
+
+#include "x6502abbrev.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+volatile int codecount, datacount, undefinedcount;
+unsigned char *cdloggerdata;
+unsigned int cdloggerdataSize = 0;
+static int indirectnext;
+
+int debug_loggingCD;
+
+uint32 *cdlDirtyPRG = 0, *cdlDirtyCHR = 0;
+
+static std::string autosaveName;
+static FILE *autosaveFile = 0;
+static int autosaveInterval = 0;
+static int autosaveCounter = 0;
+
+//number of uint32 words in a dirty bitmap covering `size` bytes of log
+static uint32 DirtyWords(uint32 size)
+{
+	uint32 blocks = (size + (1<<CDL_BLOCK_SHIFT) - 1) >> CDL_BLOCK_SHIFT;
+	return (blocks + 31) >> 5;
+}
+
+//called by the cpu to perform logging if CDLogging is enabled
+void LogCDVectors(int which){
+	int j;
+	j = GetPRGAddress(which);
+	if(j == -1) return;
+
+	if(!(cdloggerdata[j] & 2)){
+		cdloggerdata[j] |= 0x0E; // we're in the last bank and recording it as data so 0x1110 or 0xE should be what we need
+		CDL_MARK_DIRTY(cdlDirtyPRG, j);
+		datacount++;
+		if(!(cdloggerdata[j] & 1))undefinedcount--;
+	}
+	j++;
+
+	if(!(cdloggerdata[j] & 2)){
+		cdloggerdata[j] |= 0x0E;
+		CDL_MARK_DIRTY(cdlDirtyPRG, j);
+		datacount++;
+		if(!(cdloggerdata[j] & 1))undefinedcount--;
+	}
+}
+
+void LogCDData(uint8 *opcode, uint16 A, int size) {
+	int i, j;
+	uint8 memop = 0;
+
+	if((j = GetPRGAddress(_PC)) != -1)
+		for (i = 0; i < size; i++) {
+			if(cdloggerdata[j+i] & 1)continue; //this has been logged so skip
+			cdloggerdata[j+i] |= 1;
+			cdloggerdata[j+i] |= ((_PC + i) >> 11) & 0x0c;
+			cdloggerdata[j+i] |= ((_PC & 0x8000) >> 8) ^ 0x80;	// 19/07/14 used last reserved bit, if bit 7 is 1, then code is running from lowe area (6000)
+			if(indirectnext)cdloggerdata[j+i] |= 0x10;
+			CDL_MARK_DIRTY(cdlDirtyPRG, j+i);
+			codecount++;
+			if(!(cdloggerdata[j+i] & 2))undefinedcount--;
+		}
+
+	//log instruction jumped to in an indirect jump
+	if(opcode[0] == 0x6c)
+		indirectnext = 1;
+	else
+		indirectnext = 0;
+
+	switch (optype[opcode[0]]) {
+		case 1:
+		case 4: memop = 0x20; break;
+	}
+
+	if((j = GetPRGAddress(A)) != -1) {
+		if(!(cdloggerdata[j] & 2)) {
+			cdloggerdata[j] |= 2;
+			cdloggerdata[j] |=(A>>11)&0x0c;
+			cdloggerdata[j] |= memop;
+			CDL_MARK_DIRTY(cdlDirtyPRG, j);
+			datacount++;
+			if(!(cdloggerdata[j] & 1))undefinedcount--;
+		}
+	}
+}
+
+void LogCDInstruction()
+{
+	uint8 opcode[3] = {0};
+	int size;
+
+	if (GameInfo->type==GIT_NSF)
+	{
+		if ((_PC >= 0x3801) && (_PC <= 0x3824)) return;
+	}
+
+	uint16 A = DecodeOperand(opcode, size);
+	LogCDData(opcode, A, size);
+}
+
+void LogDPCM(int romaddress, int dpcmsize){
+	int i = GetPRGAddress(romaddress);
+
+	if(i == -1)return;
+
+	for (int dpcmstart = i; dpcmstart < (i + dpcmsize); dpcmstart++) {
+		if(!(cdloggerdata[dpcmstart] & 0x40)) {
+			cdloggerdata[dpcmstart] |= 0x40;
+			CDL_MARK_DIRTY(cdlDirtyPRG, dpcmstart);
+
+			if(!(cdloggerdata[dpcmstart] & 2)){
+				datacount++;
+				cdloggerdata[dpcmstart] |= 2;
+				if(!(cdloggerdata[dpcmstart] & 1))undefinedcount--;
+			}
+		}
+	}
+}
+
+void FCEU_CDLFree()
+{
+	if (cdloggerdata)
+	{
+		free(cdloggerdata);
+		cdloggerdata = 0;
+		cdloggerdataSize = 0;
+	}
+	if (cdloggervdata)
+	{
+		free(cdloggervdata);
+		cdloggervdata = 0;
+		cdloggerVideoDataSize = 0;
+	}
+	free(cdlDirtyPRG);
+	free(cdlDirtyCHR);
+	cdlDirtyPRG = cdlDirtyCHR = 0;
+}
+
+void FCEU_CDLInit()
+{
+	FCEU_CDLFree();
+
+	cdloggerdataSize = PRGsize[0];
+	cdloggerdata = (unsigned char*)malloc(cdloggerdataSize);
+	if(!CHRram[0] || (CHRptr[0] == PRGptr[0])) {	// Some kind of workaround for my OneBus VRAM hack, will remove it if I find another solution for that
+		cdloggerVideoDataSize = CHRsize[0];
+		cdloggervdata = (unsigned char*)malloc(cdloggerVideoDataSize);
+	} else
+		cdloggerVideoDataSize = 0;
+
+	//one spare word, since GetPRGAddress lets through the address just past the end
+	cdlDirtyPRG = (uint32*)calloc(DirtyWords(cdloggerdataSize) + 1, 4);
+	cdlDirtyCHR = (uint32*)calloc(DirtyWords(cdloggerVideoDataSize) + 1, 4);
+
+	FCEU_CDLReset();
+}
+
+void FCEU_CDLReset()
+{
+	codecount = datacount = rendercount = vromreadcount = 0;
+	undefinedcount = cdloggerdataSize;
+	memset(cdloggerdata, 0, cdloggerdataSize);
+	memset(cdlDirtyPRG, 0xFF, DirtyWords(cdloggerdataSize) * 4);
+	if(cdloggerVideoDataSize != 0)
+	{
+		undefinedvromcount = cdloggerVideoDataSize;
+		memset(cdloggervdata, 0, cdloggerVideoDataSize);
+		memset(cdlDirtyCHR, 0xFF, DirtyWords(cdloggerVideoDataSize) * 4);
+	}
+}
+
+//counts the flags of one log a word at a time, so the mostly empty stretches go by quickly
+static void CountFlags(const uint8 *data, uint32 size, int &first, int &second, int &undefined)
+{
+	first = second = undefined = 0;
+	uint32 i = 0;
+	for(; i + 4 <= size; i += 4)
+	{
+		uint32 w;
+		memcpy(&w, data + i, 4);
+		if(!(w & 0x03030303))
+		{
+			undefined += 4;
+			continue;
+		}
+		for(int k = 0; k < 4; k++)
+		{
+			uint8 b = data[i+k];
+			if(b & 1) first++;
+			if(b & 2) second++;
+			if(!(b & 3)) undefined++;
+		}
+	}
+	for(; i < size; i++)
+	{
+		uint8 b = data[i];
+		if(b & 1) first++;
+		if(b & 2) second++;
+		if(!(b & 3)) undefined++;
+	}
+}
+
+void FCEU_CDLRecount()
+{
+	int a, b, c;
+	CountFlags(cdloggerdata, cdloggerdataSize, a, b, c);
+	codecount = a;
+	datacount = b;
+	undefinedcount = c;
+	if(cdloggerVideoDataSize != 0)
+	{
+		CountFlags(cdloggervdata, cdloggerVideoDataSize, a, b, c);
+		rendercount = a;
+		vromreadcount = b;
+		undefinedvromcount = c;
+	}
+}
+
+//ORs src into dst a word at a time, marking the blocks which gained flags as dirty
+static void MergeFlags(uint8 *dst, const uint8 *src, uint32 size, uint32 *dirty)
+{
+	uint32 i = 0;
+	for(; i + 4 <= size; i += 4)
+	{
+		uint32 d, s;
+		memcpy(&d, dst + i, 4);
+		memcpy(&s, src + i, 4);
+		if((d | s) != d)
+		{
+			d |= s;
+			memcpy(dst + i, &d, 4);
+			CDL_MARK_DIRTY(dirty, i);
+		}
+	}
+	for(; i < size; i++)
+	{
+		if((dst[i] | src[i]) != dst[i])
+		{
+			dst[i] |= src[i];
+			CDL_MARK_DIRTY(dirty, i);
+		}
+	}
+}
+
+void FCEUI_CDLStart()
+{
+	if(!GameInfo)
+		return;
+	if(!cdloggerdata)
+		FCEU_CDLInit();
+	FCEUI_SetLoggingCD(1);
+}
+
+void FCEUI_CDLPause()
+{
+	FCEUI_SetLoggingCD(0);
+}
+
+bool FCEUI_CDLLoad(const char *fname)
+{
+	if(!cdloggerdata)
+		return false;
+
+	FILE *FP = fopen(fname, "rb");
+	if (FP == NULL)
+		return false;
+
+	//a file of any other size is from another game, or cut short, and would merge in misaligned
+	uint32 total = cdloggerdataSize + cdloggerVideoDataSize;
+	uint8 *buf = (uint8*)malloc(total);
+	bool whole = fread(buf, 1, total, FP) == total && fgetc(FP) == EOF;
+	fclose(FP);
+	if(!whole)
+	{
+		free(buf);
+		return false;
+	}
+
+	MergeFlags(cdloggerdata, buf, cdloggerdataSize, cdlDirtyPRG);
+	if(cdloggerVideoDataSize != 0)
+		MergeFlags(cdloggervdata, buf + cdloggerdataSize, cdloggerVideoDataSize, cdlDirtyCHR);
+	free(buf);
+
+	FCEU_CDLRecount();
+	return true;
+}
+
+bool FCEUI_CDLSave(const char *fname)
+{
+	if(!cdloggerdata)
+		return false;
+
+	FILE *FP = fopen(fname, "wb");
+	if (FP == NULL)
+		return false;
+	fwrite(cdloggerdata, cdloggerdataSize, 1, FP);
+	if(cdloggerVideoDataSize != 0)
+		fwrite(cdloggervdata, cdloggerVideoDataSize, 1, FP);
+	fclose(FP);
+	return true;
+}
+
+void FCEUI_CDLSetAutoSave(const char *fname, int frames)
+{
+	FCEU_CDLFlush();
+	if(autosaveFile)
+	{
+		fclose(autosaveFile);
+		autosaveFile = 0;
+	}
+
+	autosaveName = fname ? fname : "";
+	autosaveInterval = frames;
+	autosaveCounter = 0;
+	if(autosaveName.empty() || !cdloggerdata)
+		return;
+
+	//the file must start out holding the whole log; after that only changed blocks are rewritten in place
+	if(!FCEUI_CDLSave(autosaveName.c_str()) || !(autosaveFile = fopen(autosaveName.c_str(), "r+b")))
+	{
+		FCEU_PrintError("Error opening CDL autosave file %s", autosaveName.c_str());
+		autosaveName.clear();
+		return;
+	}
+
+	memset(cdlDirtyPRG, 0, DirtyWords(cdloggerdataSize) * 4);
+	memset(cdlDirtyCHR, 0, DirtyWords(cdloggerVideoDataSize) * 4);
+}
+
+//writes the dirty blocks of one log at the given file offset and clears their dirty bits
+static void FlushBlocks(const uint8 *data, uint32 size, uint32 *dirty, long fileofs)
+{
+	uint32 words = DirtyWords(size);
+	for(uint32 w = 0; w < words; w++)
+	{
+		if(!dirty[w]) continue;
+		for(int bit = 0; bit < 32; bit++)
+		{
+			if(!(dirty[w] & (1<<bit))) continue;
+			uint32 start = ((w<<5) + bit) << CDL_BLOCK_SHIFT;
+			if(start >= size) break;
+			uint32 len = size - start;
+			if(len > (1<<CDL_BLOCK_SHIFT)) len = 1<<CDL_BLOCK_SHIFT;
+			fseek(autosaveFile, fileofs + start, SEEK_SET);
+			fwrite(data + start, 1, len, autosaveFile);
+		}
+		dirty[w] = 0;
+	}
+}
+
+void FCEU_CDLFlush()
+{
+	if(!autosaveFile || !cdloggerdata)
+		return;
+
+	FlushBlocks(cdloggerdata, cdloggerdataSize, cdlDirtyPRG, 0);
+	if(cdloggerVideoDataSize != 0)
+		FlushBlocks(cdloggervdata, cdloggerVideoDataSize, cdlDirtyCHR, cdloggerdataSize);
+	fflush(autosaveFile);
+}
+
+void FCEU_CDLFrameAdvance()
+{
+	if(!autosaveFile || autosaveInterval <= 0)
+		return;
+	if(++autosaveCounter < autosaveInterval)
+		return;
+	autosaveCounter = 0;
+	FCEU_CDLFlush();
+}
+
+void FCEU_CDLGameClosed()
+{
+	FCEUI_SetLoggingCD(0);
+	FCEUI_CDLSetAutoSave(NULL, 0);
+	FCEU_CDLFree();
+}
@@ -0,0 +1,64 @@
+#ifndef _CDL_H_
+#define _CDL_H_
+
+#include "types.h"
+
+//---------CDLogger
+//the code/data log is kept as one flag byte per byte of PRG (cdloggerdata) and of CHR (cdloggervdata),
+//which is also the layout of the .cdl file: the PRG log followed by the CHR log.
+
+//called by the cpu to perform logging if CDLogging is enabled
+void LogCDVectors(int which);
+void LogCDData(uint8 *opcode, uint16 A, int size);
+//decodes the instruction at PC and logs it; used when the debugger isn't already doing so
+void LogCDInstruction();
+void LogDPCM(int romaddress, int dpcmsize);
+
+extern volatile int codecount, datacount, undefinedcount;
+extern unsigned char *cdloggerdata;
+extern unsigned int cdloggerdataSize;
+
+extern volatile int rendercount, vromreadcount, undefinedvromcount;
+extern unsigned char *cdloggervdata;
+extern unsigned int cdloggerVideoDataSize;
+
+extern int debug_loggingCD;
+static INLINE void FCEUI_SetLoggingCD(int val) { debug_loggingCD = val; }
+static INLINE int FCEUI_GetLoggingCD() { return debug_loggingCD; }
+
+//the log is flushed to the autosave file in blocks of this many bytes; only blocks which gained flags are written
+#define CDL_BLOCK_SHIFT 10
+extern uint32 *cdlDirtyPRG, *cdlDirtyCHR;
+#define CDL_MARK_DIRTY(bitmap,addr) ((bitmap)[(addr)>>(CDL_BLOCK_SHIFT+5)] |= 1<<(((addr)>>CDL_BLOCK_SHIFT)&31))
+
+//(re)allocates a cleared log sized for the loaded game
+void FCEU_CDLInit();
+void FCEU_CDLFree();
+//clears all the flags
+void FCEU_CDLReset();
+//recomputes the code/data/undefined counters from the log
+void FCEU_CDLRecount();
+
+//starts logging, allocating the log first if needed
+void FCEUI_CDLStart();
+void FCEUI_CDLPause();
+
+//merges a .cdl file into the current log. returns false, merging nothing, if it could not be opened
+//or is not exactly the size of the log
+bool FCEUI_CDLLoad(const char *fname);
+//writes the whole log to a .cdl file
+bool FCEUI_CDLSave(const char *fname);
+
+//keeps fname up to date with the log, writing the changed blocks every `frames` frames and when the game is closed.
+//pass NULL to stop autosaving
+void FCEUI_CDLSetAutoSave(const char *fname, int frames);
+//writes the changed blocks to the autosave file now
+void FCEU_CDLFlush();
+
+//called once per emulated frame
+void FCEU_CDLFrameAdvance();
+//called when the game is closed: stops logging, flushes and closes the autosave file and frees the log
+void FCEU_CDLGameClosed();
+//-------
+
+#endif
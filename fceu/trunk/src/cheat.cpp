@@ -209,6 +209,7 @@ void FCEU_LoadGameCheats(FILE *override)
 		fp = override;
 	else
 	{
+		if(!useGameFiles) return;
 		fn=strdup(FCEU_MakeFName(FCEUMKF_CHEAT,0,0).c_str());
 		fp=FCEUD_UTF8fopen(fn,"rb");
 		free(fn);
@@ -934,7 +935,7 @@ int FCEU_CheatGetByte(uint32 A)
  //  if(CheatRPtrs[A>>10])
  //   return CheatRPtrs[A>>10][A]; //adelikat-commenting this stuff out so that lua can see frozen addresses, I hope this doesn't bork stuff.
    /*else*/ if(A < 0x10000)
-    return ARead[A](A);
+    return FCEU_CPURead(A);
    else
     return 0;
 }
@@ -944,7 +945,7 @@ void FCEU_CheatSetByte(uint32 A, uint8 V)
    if(CheatRPtrs[A>>10])
     CheatRPtrs[A>>10][A]=V;
    else if(A < 0x10000)
-    BWrite[A](A, V);
+    FCEU_CPUWrite(A, V);
 }
 
 void UpdateFrozenList(void)
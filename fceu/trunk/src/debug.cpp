@@ -291,7 +291,7 @@ uint8 GetMem(uint16 A) {
 	else if ((A >= 0x4018) && (A < 0x5000))	// AnS: changed the range, so MMC5 ExRAM can be watched in the Hexeditor
 		return 0xFF;
 	if (GameInfo)							//adelikat: 11/17/09: Prevent crash if this is called with no game loaded.
-		return ARead[A](A);
+		return FCEU_CPURead(A);
 	else return 0;
 }
 
@@ -386,69 +386,7 @@ int condition(watchpointinfo* wp)
 
 //---------------------
 
-volatile int codecount, datacount, undefinedcount;
-unsigned char *cdloggerdata;
-unsigned int cdloggerdataSize = 0;
-static int indirectnext;
-
-int debug_loggingCD;
-
-//called by the cpu to perform logging if CDLogging is enabled
-void LogCDVectors(int which){
-	int j;
-	j = GetPRGAddress(which);
-	if(j == -1) return;
-
-	if(!(cdloggerdata[j] & 2)){
-		cdloggerdata[j] |= 0x0E; // we're in the last bank and recording it as data so 0x1110 or 0xE should be what we need
-		datacount++;
-		if(!(cdloggerdata[j] & 1))undefinedcount--;
-	}
-	j++;
-
-	if(!(cdloggerdata[j] & 2)){
-		cdloggerdata[j] |= 0x0E;
-		datacount++;
-		if(!(cdloggerdata[j] & 1))undefinedcount--;
-	}
-}
-
-void LogCDData(uint8 *opcode, uint16 A, int size) {
-	int i, j;
-	uint8 memop = 0;
-
-	if((j = GetPRGAddress(_PC)) != -1)
-		for (i = 0; i < size; i++) {
-			if(cdloggerdata[j+i] & 1)continue; //this has been logged so skip
-			cdloggerdata[j+i] |= 1;
-			cdloggerdata[j+i] |= ((_PC + i) >> 11) & 0x0c;
-			cdloggerdata[j+i] |= ((_PC & 0x8000) >> 8) ^ 0x80;	// 19/07/14 used last reserved bit, if bit 7 is 1, then code is running from lowe area (6000)
-			if(indirectnext)cdloggerdata[j+i] |= 0x10;
-			codecount++;
-			if(!(cdloggerdata[j+i] & 2))undefinedcount--;
-		}
-
-	//log instruction jumped to in an indirect jump
-	if(opcode[0] == 0x6c)
-		indirectnext = 1;
-	else
-		indirectnext = 0;
-
-	switch (optype[opcode[0]]) {
-		case 1:
-		case 4: memop = 0x20; break;
-	}
-
-	if((j = GetPRGAddress(A)) != -1) {
-		if(!(cdloggerdata[j] & 2)) {
-			cdloggerdata[j] |= 2;
-			cdloggerdata[j] |=(A>>11)&0x0c;
-			cdloggerdata[j] |= memop;
-			datacount++;
-			if(!(cdloggerdata[j] & 1))undefinedcount--;
-		}
-	}
-}
+//the code/data logger lives in cdl.cpp
 
 //-----------debugger stuff
 
@@ -497,6 +435,11 @@ void IncrementInstructionsCounters()
 	total_instructions++;
 	delta_instructions++;
 }
+void AddInstructionsCounters(uint64 count)
+{
+	total_instructions += count;
+	delta_instructions += count;
+}
 
 void BreakHit(int bp_num, bool force)
 {
@@ -752,26 +695,27 @@ static void breakpoint(uint8 *opcode, uint16 A, int size) {
 }
 //bbit edited: this is the end of the inserted code
 
-void DebugCycle()
+static bool BreakpointsArmed()
 {
-	uint8 opcode[3] = {0};
-	uint16 A = 0, tmp;
-	int size;
+	return numWPs || dbgstate.step || dbgstate.runline || dbgstate.stepout || watchpoint[64].flags || dbgstate.badopbreak || break_on_cycles || break_on_instructions || break_asap;
+}
 
-	if (scanline == 240)
-	{
-		vblankScanLines = (PAL?int((double)timestamp / ((double)341 / (double)3.2)):timestamp / 114);	//114 approximates the number of timestamps per scanline during vblank.  Approx 2508. NTSC: (341 / 3.0) PAL: (341 / 3.2). Uses (3.? * cpu_cycles) / 341.0, and assumes 1 cpu cycle.
-		if (vblankScanLines) vblankPixel = 341 / vblankScanLines;	//341 pixels per scanline
-		//FCEUI_printf("vbPixel = %d",vblankPixel);					     //Debug
-		//FCEUI_printf("ts: %d line: %d\n", timestamp, vblankScanLines); //Debug
-	}
-	else
-		vblankScanLines = 0;
+bool DebugCycleNeeded()
+{
+	if (BreakpointsArmed())
+		return true;
+#ifdef WIN32
+	//see FCEUD_TraceInstruction below
+	extern volatile int logging;
+	if (logging)
+		return true;
+#endif
+	return false;
+}
 
-	if (GameInfo->type==GIT_NSF)
-	{
-		if ((_PC >= 0x3801) && (_PC <= 0x3824)) return;
-	}
+uint16 DecodeOperand(uint8 opcode[3], int &size)
+{
+	uint16 A = 0, tmp;
 
 	opcode[0] = GetMem(_PC);
 	size = opsize[opcode[0]];
@@ -803,12 +747,38 @@ void DebugCycle()
 		case 7: A = (opcode[1] | (opcode[2] << 8)) + _X; break;
 		case 8: A = opcode[1] + _Y; break;
 	}
+	return A;
+}
+
+void DebugCycle()
+{
+	uint8 opcode[3] = {0};
+	uint16 A;
+	int size;
+
+	if (scanline == 240)
+	{
+		vblankScanLines = (PAL?int((double)timestamp / ((double)341 / (double)3.2)):timestamp / 114);	//114 approximates the number of timestamps per scanline during vblank.  Approx 2508. NTSC: (341 / 3.0) PAL: (341 / 3.2). Uses (3.? * cpu_cycles) / 341.0, and assumes 1 cpu cycle.
+		if (vblankScanLines) vblankPixel = 341 / vblankScanLines;	//341 pixels per scanline
+		//FCEUI_printf("vbPixel = %d",vblankPixel);					     //Debug
+		//FCEUI_printf("ts: %d line: %d\n", timestamp, vblankScanLines); //Debug
+	}
+	else
+		vblankScanLines = 0;
+
+	if (GameInfo->type==GIT_NSF)
+	{
+		if ((_PC >= 0x3801) && (_PC <= 0x3824)) return;
+	}
+
+	A = DecodeOperand(opcode, size);
 	addressOfTheLastAccessedData = A;
 
-	if (numWPs || dbgstate.step || dbgstate.runline || dbgstate.stepout || watchpoint[64].flags || dbgstate.badopbreak || break_on_cycles || break_on_instructions || break_asap)
+	if (BreakpointsArmed())
 		breakpoint(opcode, A, size);
 
-	if(debug_loggingCD)
+	//debugger builds log code/data here, from the instruction decoded above; others go through LogCDInstruction
+	if (debug_loggingCD)
 		LogCDData(opcode, A, size);
 
 #ifdef WIN32
@@ -73,15 +73,7 @@ uint8 GetMem(uint16 A);
 uint8 GetPPUMem(uint8 A);
 
 //---------CDLogger
-void LogCDVectors(int which);
-void LogCDData(uint8 *opcode, uint16 A, int size);
-extern volatile int codecount, datacount, undefinedcount;
-extern unsigned char *cdloggerdata;
-extern unsigned int cdloggerdataSize;
-
-extern int debug_loggingCD;
-static INLINE void FCEUI_SetLoggingCD(int val) { debug_loggingCD = val; }
-static INLINE int FCEUI_GetLoggingCD() { return debug_loggingCD; }
+#include "cdl.h"
 //-------
 
 //-------tracing
@@ -95,6 +87,8 @@ static INLINE int FCEUI_GetLoggingCD() { return debug_loggingCD; }
 extern int iaPC;
 extern uint32 iapoffset; //mbg merge 7/18/06 changed from int
 void DebugCycle();
+//fetches the instruction at the PC into opcode and its length into size, and returns the address its operand refers to
+uint16 DecodeOperand(uint8 opcode[3], int &size);
 void BreakHit(int bp_num, bool force = false);
 
 extern bool break_asap;
@@ -111,6 +105,9 @@ extern void ResetCyclesCounter();
 extern void ResetInstructionsCounter();
 extern void ResetDebugStatisticsDeltaCounters();
 extern void IncrementInstructionsCounters();
+extern void AddInstructionsCounters(uint64 count);
+//whether DebugCycle has anything to do at every instruction, so that none of them may be skipped
+extern bool DebugCycleNeeded();
 //-------------
 
 //internal variables that debuggers will want access to
@@ -102,12 +102,25 @@ FCEUGI *FCEUI_LoadGame(const char *name, int OverwriteVidMode, bool silent = fal
 //name is the logical path to open; archiveFilename is the archive which contains name
 FCEUGI *FCEUI_LoadGameVirtual(const char *name, int OverwriteVidMode, bool silent = false);
 
+//same as FCEUI_LoadGame, except that the game is the size bytes at data rather than a file. name is what the game is
+//called, for the messages and for the names of the files kept beside it
+FCEUGI *FCEUI_LoadGameFromMemory(const void *data, int size, const char *name, int OverwriteVidMode, bool silent = false);
+
+//whether loading and closing a game reads and writes the files kept beside it: the battery save, the cheats, the
+//palette and the resume savestate. on by default. an FDS game can't do without files even so, for the BIOS
+void FCEUI_SetGameFiles(bool use);
+
 //general purpose emulator initialization. returns true if successful
 bool FCEUI_Initialize();
 
 //Emulates a frame.
 void FCEUI_Emulate(uint8 **, int32 **, int32 *, int);
 
+//shows each frame as it will be `frames` frames later if the input stays the same (0 to 8, 0 is off).
+//takes away that many frames of the game's own lag, for emulating that many more frames each frame
+void FCEUI_SetRunAhead(int frames);
+int FCEUI_GetRunAhead();
+
 //Closes currently loaded game
 void FCEUI_CloseGame(void);
 
@@ -231,9 +244,33 @@ uint32 FCEUI_CRC32(uint32 crc, uint8 *buf, uint32 len);
 
 void FCEUI_SetLowPass(int q);
 
+//skips the passes of loops in which the game just waits for an interrupt, instead of running them one by one.
+//on by default; the emulation comes out the same either way, only faster with it on
+void FCEUI_SetIdleLoopSkip(bool enable);
+bool FCEUI_GetIdleLoopSkip();
+
+//which CPU core runs the game: the interpreter; the recompiler, which is compiled in with scons JIT=1 and works on
+//x86-64; or the two in lockstep, each frame run by both from the same state and the states they end in compared, the
+//frame shown being the interpreter's, and a frame they differ in run again to find the first block they differ after.
+//FCEUI_SetCPUCore returns false, changing nothing, for a core which isn't there
+enum ECPUCORE
+{
+	CPUCORE_INTERPRETER,
+	CPUCORE_RECOMPILER,
+	CPUCORE_LOCKSTEP
+};
+bool FCEUI_SetCPUCore(int core);
+int FCEUI_GetCPUCore();
+//the frames the two cores came out of differently in lockstep, since the core was last set
+int FCEUI_GetLockstepMismatches();
+
 void FCEUI_NSFSetVis(int mode);
 int FCEUI_NSFChange(int amount);
 int FCEUI_NSFGetInfo(uint8 *name, uint8 *artist, uint8 *copyright, int maxlen);
+//renders track (counting from 1) of the loaded NSF to the WAV file fname as fast as it can be emulated, with no video.
+//a looping track is played `loops` times and faded out, and no track goes on for more than maxSeconds.
+//returns the number of samples written, or -1 on failure
+int FCEUI_NSFRender(int track, const char *fname, int loops, int maxSeconds);
 
 void FCEUI_VSUniToggleDIPView(void);
 void FCEUI_VSUniToggleDIP(int w);
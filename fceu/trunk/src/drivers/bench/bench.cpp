@@ -0,0 +1,46 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief fceux-bench, the benchmark without any of a port's video, sound or input
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../types.h"
+#include "../../driver.h"
+#include "../common/benchmark.h"
+
+int main(int argc, char *argv[])
+{
+	int frames = 600;
+	if(argc > 1)
+		frames = atoi(argv[1]);
+	if(argc > 2 || frames <= 0) {
+		fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+		return 1;
+	}
+
+	if(!FCEUI_Initialize())
+		return 1;
+	bool ok = RunBenchmark(stdout, frames);
+	FCEUI_Kill();
+	return ok ? 0 : 1;
+}
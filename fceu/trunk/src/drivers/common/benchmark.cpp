@@ -0,0 +1,726 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief a benchmark of the emulator on test ROMs which are assembled when it is run
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef WIN32
+#include <windows.h>
+#include <psapi.h>
+#include <direct.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "../../types.h"
+#include "../../driver.h"
+#include "../../fceu.h"
+#include "../../asm.h"
+#include "../../x6502.h"
+#include "../../utils/crc32.h"
+#include "../../version.h"
+#ifdef _S9XLUA_H
+#include "../../fceulua.h"
+#endif
+#include "vidblit.h"
+#include "benchmark.h"
+
+/* The test ROMs are written for the debugger's assembler.  A line is an
+   instruction, a label ending in ':' or ".db" and a list of bytes, and an
+   operand can refer to a label as @label.  $00 holds the frame count, $01
+   the controller and $0200 the sprites.  */
+
+static const char *BenchCommonSource[] = {
+	"reset:",
+	"SEI",
+	"CLD",
+	"LDX #$FF",
+	"TXS",
+	"INX",
+	"STX $2000",
+	"STX $2001",
+	"STX $4010",
+	"LDA #$40",
+	"STA $4017",
+	"vblank1:",
+	"BIT $2002",
+	"BPL @vblank1",
+	"TXA",
+	"clearram:",
+	"STA $00,X",
+	"STA $0100,X",
+	"STA $0300,X",
+	"STA $0400,X",
+	"STA $0500,X",
+	"STA $0600,X",
+	"STA $0700,X",
+	"INX",
+	"BNE @clearram",
+	"LDA #$F0",
+	"hidesprites:",
+	"STA $0200,X",
+	"INX",
+	"BNE @hidesprites",
+	"vblank2:",
+	"BIT $2002",
+	"BPL @vblank2",
+	"LDA #$3F",
+	"STA $2006",
+	"STX $2006",
+	"palette:",
+	"TXA",
+	"STA $2007",
+	"INX",
+	"CPX #$20",
+	"BNE @palette",
+	"LDA #$20",
+	"STA $2006",
+	"LDA #$00",
+	"STA $2006",
+	"TAX",
+	"LDY #$10",
+	"nametables:",
+	"STX $2007",
+	"INX",
+	"BNE @nametables",
+	"DEY",
+	"BNE @nametables",
+	"JMP @start",
+
+	"readpad:",
+	"LDA #$01",
+	"STA $4016",
+	"LDA #$00",
+	"STA $4016",
+	"LDX #$08",
+	"readpadbit:",
+	"LDA $4016",
+	"LSR",
+	"ROL $01",
+	"DEX",
+	"BNE @readpadbit",
+	"RTS",
+
+	/* 64 sprites moving with the frame count and the controller, bunched
+	   up so that scanlines have more than 8 */
+	"sprites:",
+	"LDX #$00",
+	"spriteloop:",
+	"TXA",
+	"CLC",
+	"ADC $00",
+	"STA $0200,X",
+	"TXA",
+	"STA $0201,X",
+	"AND #$03",
+	"STA $0202,X",
+	"TXA",
+	"EOR $01",
+	"SEC",
+	"SBC $00",
+	"STA $0203,X",
+	"INX",
+	"INX",
+	"INX",
+	"INX",
+	"BNE @spriteloop",
+	"RTS",
+	0
+};
+
+/* NROM: sprites and scrolling, with the CPU busy on RAM in between */
+static const char *BenchNROMSource[] = {
+	"start:",
+	"LDA #$80",
+	"STA $2000",
+	"LDA #$1E",
+	"STA $2001",
+	"work:",
+	"JSR @readpad",
+	"LDX #$00",
+	"workloop:",
+	"LDA $0300,X",
+	"ADC $01",
+	"EOR $00",
+	"STA $0300,X",
+	"INX",
+	"BNE @workloop",
+	"JMP @work",
+
+	"nmi:",
+	"PHA",
+	"TXA",
+	"PHA",
+	"TYA",
+	"PHA",
+	"LDA #$00",
+	"STA $2003",
+	"LDA #$02",
+	"STA $4014",
+	"INC $00",
+	"JSR @sprites",
+	"LDA $00",
+	"STA $2005",
+	"LSR",
+	"STA $2005",
+	"PLA",
+	"TAY",
+	"PLA",
+	"TAX",
+	"PLA",
+	"RTI",
+	"irq:",
+	"RTI",
+	0
+};
+
+/* NROM: every APU channel playing, the DMC looping over the program */
+static const char *BenchAPUSource[] = {
+	"start:",
+	"LDA #$0F",
+	"STA $4015",
+	"LDA #$BF",
+	"STA $4000",
+	"LDA #$7F",
+	"STA $4004",
+	"LDA #$FF",
+	"STA $4008",
+	"LDA #$3F",
+	"STA $400C",
+	"LDA #$00",
+	"STA $4003",
+	"STA $4007",
+	"STA $400B",
+	"STA $400F",
+	"STA $4012",
+	"LDA #$4F",
+	"STA $4010",
+	"LDA #$FF",
+	"STA $4013",
+	"LDA #$1F",
+	"STA $4015",
+	"LDA #$80",
+	"STA $2000",
+	"LDA #$0A",
+	"STA $2001",
+	"work:",
+	"JSR @readpad",
+	"LDX #$00",
+	"workloop:",
+	"LDA $0300,X",
+	"ADC $01",
+	"EOR $00",
+	"STA $0300,X",
+	"INX",
+	"BNE @workloop",
+	"JMP @work",
+
+	"nmi:",
+	"PHA",
+	"INC $00",
+	"LDA $00",
+	"STA $4002",
+	"EOR #$FF",
+	"STA $4006",
+	"ASL",
+	"STA $400A",
+	"LDA $00",
+	"AND #$0F",
+	"STA $400E",
+	"PLA",
+	"RTI",
+	"irq:",
+	"RTI",
+	0
+};
+
+/* MMC3: a scanline IRQ every 8 lines changing the scroll and the CHR bank,
+   PRG bank switching and WRAM */
+static const char *BenchMMC3Source[] = {
+	"start:",
+	"LDX #$00",
+	"banks:",
+	"STX $8000",
+	"LDA @banktable,X",
+	"STA $8001",
+	"INX",
+	"CPX #$08",
+	"BNE @banks",
+	"LDA #$00",
+	"STA $A000",
+	"LDA #$80",
+	"STA $A001",
+	"LDA #$07",
+	"STA $C000",
+	"STA $C001",
+	"STA $E001",
+	"CLI",
+	"LDA #$80",
+	"STA $2000",
+	"LDA #$1E",
+	"STA $2001",
+	"work:",
+	"JSR @readpad",
+	"LDX #$00",
+	"workloop:",
+	"LDA $8000,X",
+	"ADC $A000,X",
+	"EOR $01",
+	"STA $6000,X",
+	"INX",
+	"BNE @workloop",
+	"JMP @work",
+
+	"nmi:",
+	"PHA",
+	"TXA",
+	"PHA",
+	"TYA",
+	"PHA",
+	"LDA #$00",
+	"STA $2003",
+	"LDA #$02",
+	"STA $4014",
+	"INC $00",
+	"JSR @sprites",
+	"LDA $00",
+	"STA $02",
+	"LDA #$06",
+	"STA $8000",
+	"LDA $00",
+	"AND #$01",
+	"STA $8001",
+	"LDA #$00",
+	"STA $2005",
+	"STA $2005",
+	"PLA",
+	"TAY",
+	"PLA",
+	"TAX",
+	"PLA",
+	"RTI",
+
+	"irq:",
+	"PHA",
+	"STA $E000",
+	"STA $E001",
+	"INC $02",
+	"BIT $2002",
+	"LDA $02",
+	"STA $2005",
+	"LDA #$00",
+	"STA $8000",
+	"LDA $02",
+	"ASL",
+	"STA $8001",
+	"PLA",
+	"RTI",
+	"banktable:",
+	".db $00,$02,$04,$05,$06,$07,$00,$01",
+	0
+};
+
+struct BenchROM
+{
+	const char *name;
+	int mapper;
+	//in 16K and 8K banks
+	int prgBanks, chrBanks;
+	//the address the code is assembled to, in the last 16K of PRG
+	int origin;
+	const char **source;
+};
+
+static const BenchROM BenchROMs[] = {
+	{ "nrom", 0, 1, 1, 0xC000, BenchNROMSource },
+	{ "apu", 0, 1, 1, 0xC000, BenchAPUSource },
+	{ "mmc3", 4, 2, 2, 0xE000, BenchMMC3Source },
+};
+
+struct BenchFilter
+{
+	const char *name;
+	//the special filter and scale as the SDL port uses them
+	int specfilt, scale;
+};
+
+static const BenchFilter BenchFilters[] = {
+	{ "none", 0, 1 },
+	{ "hq2x", 1, 2 },
+	{ "ntsc", 3, 2 },
+};
+
+/* A Lua script with hooks on every frame and on the RAM the test ROMs are
+   busy with. */
+static const char BenchLuaScript[] =
+	"local n = 0\n"
+	"emu.registerbefore(function() n = n + 1 end)\n"
+	"emu.registerafter(function() n = n + memory.readbyte(0) end)\n"
+	"memory.registerwrite(0x0300, 0x100, function() n = n + 1 end)\n"
+	"while true do\n"
+	"	emu.frameadvance()\n"
+	"end\n";
+
+/* Assembles the lines of the sources to origin on, twice: the first time
+   to find where the labels are and the second to fill them in. */
+static bool AssembleSource(const char **const *sources, int origin, std::vector<uint8> &code, std::map<std::string, int> &labels)
+{
+	for(int pass = 0; pass < 2; pass++) {
+		int addr = origin;
+		code.clear();
+
+		for(const char **const *source = sources; *source; source++) {
+			for(const char **line = *source; *line; line++) {
+				std::string text = *line;
+
+				if(text[text.size() - 1] == ':') {
+					labels[text.substr(0, text.size() - 1)] = addr;
+					continue;
+				}
+
+				if(text.compare(0, 4, ".db ") == 0) {
+					const char *p = text.c_str() + 4;
+					unsigned int value;
+					int used;
+					while(sscanf(p, " $%2X%n", &value, &used) == 1) {
+						code.push_back(value);
+						addr++;
+						p += used;
+						if(*p == ',')
+							p++;
+					}
+					continue;
+				}
+
+				size_t at = text.find('@');
+				if(at != std::string::npos) {
+					size_t end = text.find_first_of(",) ", at);
+					if(end == std::string::npos)
+						end = text.size();
+					std::string label = text.substr(at + 1, end - at - 1);
+					// until the first pass is done, the label is taken to be here: an
+					// address above $FF and in reach of a branch
+					int value = addr;
+					if(pass == 1) {
+						if(!labels.count(label)) {
+							FCEUD_PrintError(("Benchmark ROM: unknown label " + label).c_str());
+							return false;
+						}
+						value = labels[label];
+					}
+					char hex[8];
+					sprintf(hex, "$%04X", value);
+					text.replace(at, end - at, hex);
+				}
+
+				uint8 opcode[3];
+				std::vector<char> buf(text.begin(), text.end());
+				buf.push_back(0);
+				if(Assemble(opcode, addr, &buf[0])) {
+					FCEUD_PrintError(("Benchmark ROM: can't assemble " + text).c_str());
+					return false;
+				}
+				int size = opsize[opcode[0]];
+				code.insert(code.end(), opcode, opcode + size);
+				addr += size;
+			}
+		}
+	}
+	return true;
+}
+
+/* Builds the iNES image of rom. */
+static bool BuildROM(const BenchROM &rom, std::vector<uint8> &image)
+{
+	const char **sources[] = { BenchCommonSource, rom.source, 0 };
+	std::vector<uint8> code;
+	std::map<std::string, int> labels;
+	if(!AssembleSource(sources, rom.origin, code, labels))
+		return false;
+
+	int prgSize = rom.prgBanks * 16384;
+	int chrSize = rom.chrBanks * 8192;
+	image.assign(16 + prgSize + chrSize, 0);
+	uint8 *header = &image[0];
+	uint8 *prg = header + 16;
+	uint8 *chr = prg + prgSize;
+
+	memcpy(header, "NES\x1a", 4);
+	header[4] = rom.prgBanks;
+	header[5] = rom.chrBanks;
+	header[6] = ((rom.mapper & 0xF) << 4) | 1;
+	header[7] = rom.mapper & 0xF0;
+
+	// the banks the code isn't in hold something for the MMC3 program to read, the CHR some
+	// busy looking tiles
+	for(int i = 0; i < prgSize; i++)
+		prg[i] = (uint8)((i * 0x9E37) >> 5);
+	for(int i = 0; i < chrSize; i++)
+		chr[i] = (uint8)(((i * 0x2F1B) >> 6) ^ (i >> 3));
+
+	uint8 *origin = prg + prgSize - 0x10000 + rom.origin;
+	memcpy(origin, &code[0], code.size());
+	uint8 *vectors = prg + prgSize - 6;
+	vectors[0] = labels["nmi"] & 0xFF;
+	vectors[1] = labels["nmi"] >> 8;
+	vectors[2] = labels["reset"] & 0xFF;
+	vectors[3] = labels["reset"] >> 8;
+	vectors[4] = labels["irq"] & 0xFF;
+	vectors[5] = labels["irq"] >> 8;
+	return true;
+}
+
+static bool WriteFile(const std::string &fname, const void *data, size_t len)
+{
+	FILE *fp = fopen(fname.c_str(), "wb");
+	if(!fp)
+		return false;
+	bool ok = fwrite(data, 1, len, fp) == len;
+	if(fclose(fp) != 0)
+		ok = false;
+	return ok;
+}
+
+static double GetSeconds()
+{
+#ifdef WIN32
+	LARGE_INTEGER count, freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+/* The most memory the process has used, in KB. It only ever grows, so it
+   tells of the whole benchmark rather than of any one run. */
+static long GetPeakRSS()
+{
+#ifdef WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return (long)(counters.PeakWorkingSetSize / 1024);
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
+
+/* Makes a new, empty directory for the benchmark's files and returns its
+   path in dir. */
+static bool MakeTempDir(std::string &dir)
+{
+#ifdef WIN32
+	char tmpdir[MAX_PATH + 1];
+	DWORD len = GetTempPathA(sizeof(tmpdir), tmpdir);
+	if(len == 0 || len > sizeof(tmpdir))
+		return false;
+	// _mktemp_s only makes up a name, so another one is tried if it is taken by then
+	for(int tries = 0; tries < 16; tries++) {
+		std::vector<char> name(tmpdir, tmpdir + len);
+		const char *pattern = "fceux-bench-XXXXXX";
+		name.insert(name.end(), pattern, pattern + strlen(pattern) + 1);
+		if(_mktemp_s(&name[0], name.size()) != 0)
+			return false;
+		if(_mkdir(&name[0]) == 0) {
+			dir = &name[0];
+			return true;
+		}
+	}
+	return false;
+#else
+	const char *tmpdir = getenv("TMPDIR");
+	std::string path = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp") + "/fceux-bench-XXXXXX";
+	std::vector<char> name(path.begin(), path.end());
+	name.push_back(0);
+	if(!mkdtemp(&name[0]))
+		return false;
+	dir = &name[0];
+	return true;
+#endif
+}
+
+static void RemoveTempFiles(const std::string &dir, const std::vector<std::string> &files)
+{
+#ifdef WIN32
+	for(size_t i = 0; i < files.size(); i++)
+		_unlink(files[i].c_str());
+	_rmdir(dir.c_str());
+#else
+	for(size_t i = 0; i < files.size(); i++)
+		unlink(files[i].c_str());
+	rmdir(dir.c_str());
+#endif
+}
+
+struct BenchResult
+{
+	double firstFrame;  // from the start of the load to the end of the first blit
+	double seconds;
+	uint64 cycles;
+	uint32 crc;
+};
+
+static bool RunOne(const std::string &path, const BenchFilter &filter, const std::string &luaScript, int frames, BenchResult &result)
+{
+	result.firstFrame = 0;
+	double loadStart = GetSeconds();
+	if(!FCEUI_LoadGame(path.c_str(), 1))
+		return false;
+
+	// the same input every time
+	uint32 joy = 0;
+	uint32 seed = 1;
+	FCEUI_SetInput(0, SI_GAMEPAD, &joy, 0);
+
+#ifdef _S9XLUA_H
+	if(!luaScript.empty() && !FCEU_LoadLuaCode(luaScript.c_str())) {
+		FCEUI_CloseGame();
+		return false;
+	}
+#endif
+
+	// filtered like a 32 bit screen would be
+	uint8 palette[256 * 4];
+	for(int i = 0; i < 256; i++)
+		FCEUD_GetPalette(i, &palette[i * 4], &palette[i * 4 + 1], &palette[i * 4 + 2]);
+	InitBlitToHigh(4, 0xFF0000, 0xFF00, 0xFF, 0, filter.specfilt, 0);
+	SetPaletteBlitToHigh(palette);
+	int pitch = 256 * 4 * filter.scale;
+	std::vector<uint8> screen(pitch * (240 + 2) * filter.scale);
+
+	uint64 cycles = timestampbase;
+	double start = GetSeconds();
+	for(int i = 0; i < frames; i++) {
+		uint8 *gfx;
+		int32 *sound;
+		int32 ssize;
+		seed = seed * 1103515245 + 12345;
+		joy = (seed >> 16) & 0xFF;
+		FCEUI_Emulate(&gfx, &sound, &ssize, 0);
+		Blit8ToHigh(gfx, &screen[0], 256, 240, pitch, filter.scale, filter.scale);
+		if(i == 0)
+			result.firstFrame = GetSeconds() - loadStart;
+	}
+	result.seconds = GetSeconds() - start;
+	result.cycles = timestampbase - cycles;
+	result.crc = CalcCRC32(0, RAM, 0x800);
+
+#ifdef _S9XLUA_H
+	if(!luaScript.empty())
+		FCEU_LuaStop();
+#endif
+	KillBlitToHigh();
+	FCEUI_CloseGame();
+	return true;
+}
+
+bool RunBenchmark(FILE *out, int frames)
+{
+	if(frames < 1) {
+		FCEUD_PrintError("The benchmark needs at least one frame per run.");
+		return false;
+	}
+
+	// the ROMs and the script are loaded from files like any other
+	std::string dir;
+	if(!MakeTempDir(dir)) {
+		FCEUD_PrintError("Couldn't create a directory for the benchmark ROMs.");
+		return false;
+	}
+
+	int romCount = sizeof(BenchROMs) / sizeof(BenchROMs[0]);
+	std::vector<std::string> files;
+	bool ok = true;
+	for(int i = 0; i < romCount && ok; i++) {
+		std::vector<uint8> image;
+		std::string fname = dir + "/" + BenchROMs[i].name + ".nes";
+		ok = BuildROM(BenchROMs[i], image) && WriteFile(fname, &image[0], image.size());
+		files.push_back(fname);
+	}
+	std::string luaScript = dir + "/hooks.lua";
+	files.push_back(luaScript);
+	ok = ok && WriteFile(luaScript, BenchLuaScript, strlen(BenchLuaScript));
+#ifdef _S9XLUA_H
+	int luaModes = 2;
+#else
+	int luaModes = 1;
+#endif
+
+	int oldppu = newppu;
+	fprintf(out, "{\n");
+	fprintf(out, "  \"version\": \"%s\",\n", FCEU_VERSION_STRING);
+	fprintf(out, "  \"frames\": %d,\n", frames);
+	fprintf(out, "  \"runs\": [");
+	bool first = true;
+	for(int rom = 0; rom < romCount && ok; rom++)
+	for(int ppu = 0; ppu < 2 && ok; ppu++)
+	for(int soundq = 0; soundq < 3 && ok; soundq++)
+	for(int filter = 0; filter < 3 && ok; filter++)
+	for(int lua = 0; lua < luaModes && ok; lua++) {
+		newppu = ppu;
+		FCEUI_SetSoundQuality(soundq);
+		FCEUI_Sound(48000);
+
+		BenchResult result;
+		ok = RunOne(files[rom], BenchFilters[filter], lua ? luaScript : "", frames, result);
+		if(!ok)
+			break;
+
+		fprintf(out, "%s\n    {\"rom\": \"%s\", \"newppu\": %d, \"soundq\": %d, \"filter\": \"%s\", \"lua\": %d, ",
+			first ? "" : ",", BenchROMs[rom].name, ppu, soundq, BenchFilters[filter].name, lua);
+		fprintf(out, "\"first_frame_ms\": %.3f, \"fps\": %.1f, \"ns_per_cycle\": %.3f, \"cycles\": %llu, \"ram_crc\": \"%08x\"}",
+			result.firstFrame * 1000, frames / result.seconds, result.seconds * 1e9 / (double)result.cycles,
+			(unsigned long long)result.cycles, result.crc);
+		fflush(out);
+		first = false;
+	}
+	fprintf(out, "\n  ],\n");
+	fprintf(out, "  \"peak_rss_kb\": %ld\n", GetPeakRSS());
+	fprintf(out, "}\n");
+	newppu = oldppu;
+
+	RemoveTempFiles(dir, files);
+
+	if(!ok)
+		FCEUD_PrintError("The benchmark couldn't be run.");
+	return ok;
+}
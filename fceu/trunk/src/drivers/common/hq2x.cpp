@@ -2896,8 +2896,10 @@ int hq2x_InitLUTs(void)
 {
   int i, j, k, r, g, b, Y, u, v;
 
+  // the tables never change; once built they are kept for the next time the filter is set up
+  if(LUT16to32) return(1);
   if(!(LUT16to32 = (int*)malloc(65536*sizeof(int)))) return(0); //mbg merge 7/17/06 added cast
-  if(!(RGBtoYUV = (int*)malloc(65536*sizeof(int)))) { free(LUT16to32); return(0); } //mbg merge 7/17/06 added cast
+  if(!(RGBtoYUV = (int*)malloc(65536*sizeof(int)))) { free(LUT16to32); LUT16to32=NULL; return(0); } //mbg merge 7/17/06 added cast
 
   for (i=0; i<65536; i++)
     LUT16to32[i] = ((i & 0xF800) << 8) + ((i & 0x07E0) << 5) + ((i & 0x001F) << 3);
@@ -2922,7 +2924,7 @@ void hq2x_Kill(void)
  free(LUT16to32);
  free(RGBtoYUV);
 
-// LUT16to32=RGBtoYUV=NULL;
+ LUT16to32=RGBtoYUV=NULL;
 }
 
 #ifdef FIFINONO
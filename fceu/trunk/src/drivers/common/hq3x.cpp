@@ -3836,8 +3836,10 @@ int hq3x_InitLUTs(void)
 {
   int i, j, k, r, g, b, Y, u, v;
 
+  // the tables never change; once built they are kept for the next time the filter is set up
+  if(LUT16to32) return(1);
   if(!(LUT16to32 = (int*)malloc(65536*sizeof(int)))) return(0); //mbg merge 7/17/06 
-  if(!(RGBtoYUV = (int*)malloc(65536*sizeof(int)))) { free(LUT16to32); return(0); } //mbg merge 7/17/06 
+  if(!(RGBtoYUV = (int*)malloc(65536*sizeof(int)))) { free(LUT16to32); LUT16to32=NULL; return(0); } //mbg merge 7/17/06 
 
   for (i=0; i<65536; i++)
     LUT16to32[i] = ((i & 0xF800) << 8) + ((i & 0x07E0) << 5) + ((i & 0x001F) << 3);
@@ -3861,5 +3863,6 @@ void hq3x_Kill(void)
 {
  free(LUT16to32);
  free(RGBtoYUV);
+ LUT16to32=RGBtoYUV=NULL;
 }
 
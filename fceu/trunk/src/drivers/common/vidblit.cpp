@@ -25,8 +25,14 @@
 
 #include "../../types.h"
 #include "../../utils/memory.h"
+#include "../../video.h"
+#include "../../fceulua.h"
 #include "nes_ntsc.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 nes_ntsc_t* nes_ntsc;
 uint8 burst_phase = 0;
 
@@ -48,6 +54,12 @@ static int silt;
 static int Bpp;	// BYTES per pixel
 static int highefx;
 
+#ifdef _S9XLUA_H
+static bool luagui = false;	// whether the Lua gui is drawn over the picture here
+static int luaguishift[3];	// where red, green and blue are in a pixel of the picture
+static uint32 luaguiline[256*3];	// a row of the gui or the picture to blend
+#endif
+
 #define BLUR_RED	20
 #define BLUR_GREEN	20
 #define BLUR_BLUE	10
@@ -206,6 +218,32 @@ int InitBlitToHigh(int b, uint32 rmask, uint32 gmask, uint32 bmask, int efx, int
  CBM[0]=rmask;
  CBM[1]=gmask;
  CBM[2]=bmask;
+
+#ifdef _S9XLUA_H
+ // The Lua gui is drawn over 32 bit pictures in true colour, after the
+ // filters, except for NTSC which doesn't keep to the NES's pixels.
+ // Otherwise the core draws it into XBuf.
+ luagui = false;
+ if(specbuf)
+ {
+  if(!specbuf32bpp)
+  {
+   // what hq2x/hq3x put out
+   luaguishift[0]=16;
+   luaguishift[1]=8;
+   luaguishift[2]=0;
+   luagui = true;
+  }
+ }
+ else if(Bpp == 4 && !nes_ntsc)
+ {
+  int cshiftr[3];
+
+  CalculateShift(CBM, cshiftr, luaguishift);
+  luagui = !cshiftr[0] && !cshiftr[1] && !cshiftr[2];
+ }
+ FCEU_LuaGuiTrueColour(luagui);
+#endif
  return(1);
 }
 
@@ -229,11 +267,7 @@ void KillBlitToHigh(void)
  }
  if(specbuf)
  {
- // -Video Modes Tag-
-  if(silt == 4)
-   hq3x_Kill();
-  else
-   hq2x_Kill();
+  // the hq2x/hq3x tables are left for the next InitBlitToHigh
   specbuf=NULL;
  }
  if (nes_ntsc) {
@@ -244,6 +278,13 @@ void KillBlitToHigh(void)
 	free(ntscblit);
 	ntscblit = NULL;
  }
+#ifdef _S9XLUA_H
+ if(luagui)
+ {
+  luagui = false;
+  FCEU_LuaGuiTrueColour(false);
+ }
+#endif
 }
 
 
@@ -284,19 +325,19 @@ void SetPaletteBlitToHigh(uint8 *src)
               }
 	     }
 	     else
-             for(x=0;x<65536;x++)
-             {
-              uint16 lower,upper;
-
-              lower=(src[((x&255)<<2)]>>cshiftr[0])<<cshiftl[0];
-              lower|=(src[((x&255)<<2)+1]>>cshiftr[1])<<cshiftl[1];
-              lower|=(src[((x&255)<<2)+2]>>cshiftr[2])<<cshiftl[2];
-              upper=(src[((x>>8)<<2)]>>cshiftr[0])<<cshiftl[0];
-              upper|=(src[((x>>8)<<2)+1]>>cshiftr[1])<<cshiftl[1];
-              upper|=(src[((x>>8)<<2)+2]>>cshiftr[2])<<cshiftl[2];
-
-              palettetranslate[x]=lower|(upper<<16);
-             }
+	     {
+              // each pair of pixels is two of the 256 colors put together
+              uint32 single[256];
+              for(x=0;x<256;x++)
+              {
+               single[x]=(src[x<<2]>>cshiftr[0])<<cshiftl[0];
+               single[x]|=(src[(x<<2)+1]>>cshiftr[1])<<cshiftl[1];
+               single[x]|=(src[(x<<2)+2]>>cshiftr[2])<<cshiftl[2];
+               single[x]&=0xFFFF;
+              }
+              for(x=0;x<65536;x++)
+               palettetranslate[x]=single[x&255]|(single[x>>8]<<16);
+	     }
 	    break;
     case 3:
     case 4:
@@ -482,7 +523,7 @@ void Blit8To8(uint8 *src, uint8 *dest, int xr, int yr, int pitch, int xscale, in
 
 /* Todo:  Make sure 24bpp code works right with big-endian cpus */
 
-void Blit8ToHigh(uint8 *src, uint8 *dest, int xr, int yr, int pitch, 
+static void BlitPicture(uint8 *src, uint8 *dest, int xr, int yr, int pitch,
 		 int xscale, int yscale)
 {
  int x,y;
@@ -909,3 +950,169 @@ void Blit8ToHigh(uint8 *src, uint8 *dest, int xr, int yr, int pitch,
   }
  }
 }
+
+#ifdef _S9XLUA_H
+// Blend a row of the gui, scaled like the picture, over a row of the picture.
+// Only red, green and blue are touched; whatever else a pixel holds stays.
+static void BlendLuaGuiRow(uint32 *dest, const uint32 *gui, int n)
+{
+ int x=0;
+
+#ifdef __SSE2__
+ if(luaguishift[0] == 16 && luaguishift[1] == 8 && luaguishift[2] == 0)
+ {
+  const __m128i zero=_mm_setzero_si128();
+  const __m128i alpha=_mm_set1_epi32(0xFF000000);
+  const __m128i c255=_mm_set1_epi16(255);
+  const __m128i c128=_mm_set1_epi16(128);
+
+  for(;x+4<=n;x+=4)
+  {
+   __m128i g=_mm_loadu_si128((const __m128i *)(gui+x));
+
+   if(_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(g,alpha),zero)) == 0xFFFF)
+    continue;
+
+   __m128i d=_mm_loadu_si128((const __m128i *)(dest+x));
+   __m128i glo=_mm_unpacklo_epi8(g,zero);
+   __m128i ghi=_mm_unpackhi_epi8(g,zero);
+   __m128i dlo=_mm_unpacklo_epi8(d,zero);
+   __m128i dhi=_mm_unpackhi_epi8(d,zero);
+   // each pixel's alpha in all four of its words
+   __m128i alo=_mm_shufflehi_epi16(_mm_shufflelo_epi16(glo,0xFF),0xFF);
+   __m128i ahi=_mm_shufflehi_epi16(_mm_shufflelo_epi16(ghi,0xFF),0xFF);
+
+   // (gui*a + picture*(255-a)) / 255, rounded; it fits in 16 bits
+   glo=_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(glo,alo),_mm_mullo_epi16(dlo,_mm_sub_epi16(c255,alo))),c128);
+   ghi=_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(ghi,ahi),_mm_mullo_epi16(dhi,_mm_sub_epi16(c255,ahi))),c128);
+   glo=_mm_srli_epi16(_mm_add_epi16(glo,_mm_srli_epi16(glo,8)),8);
+   ghi=_mm_srli_epi16(_mm_add_epi16(ghi,_mm_srli_epi16(ghi,8)),8);
+
+   g=_mm_packus_epi16(glo,ghi);
+   g=_mm_or_si128(_mm_andnot_si128(alpha,g),_mm_and_si128(alpha,d));
+   _mm_storeu_si128((__m128i *)(dest+x),g);
+  }
+ }
+#endif
+
+ for(;x<n;x++)
+ {
+  uint32 g=gui[x];
+  int a=g>>24;
+  int c;
+
+  if(!a)
+   continue;
+
+  uint32 d=dest[x];
+  for(c=0;c<3;c++)
+  {
+   int s=luaguishift[c];
+   int t=((g>>(16-8*c))&0xFF)*a+((d>>s)&0xFF)*(255-a)+128;
+
+   d=(d&~(0xFFu<<s))|((uint32)((t+(t>>8))>>8)<<s);
+  }
+  dest[x]=d;
+ }
+}
+
+// Draw the Lua gui over the picture Blit8ToHigh just put out.  Only a
+// picture of XBuf gets it, as that is what the gui was drawn for.
+static void BlitLuaGui(uint8 *src, uint8 *dest, int xr, int yr, int pitch,
+		 int xscale, int yscale)
+{
+ const uint32 *gui;
+ int x1,y1,x2,y2;
+ int xo,yo;
+ int rows;
+ int x,y,n;
+
+ if(!FCEU_LuaGuiOverlay(&gui,&x1,&y1,&x2,&y2))
+  return;
+ if(src < XBuf || src >= XBuf+256*240)
+  return;
+
+ xo=(src-XBuf)&255;
+ yo=(src-XBuf)>>8;
+
+ // -Video Modes Tag-
+ if(specbuf8bpp)
+  xscale=yscale=(silt == 2)?2:3;
+ else if(specbuf)
+  xscale=yscale=(silt == 4)?3:2;
+
+ rows=yscale;
+ if(!specbuf8bpp && !specbuf && (highefx&FVB_SCANLINES))
+  rows-=yscale>>1;
+
+ if(x1<xo) x1=xo;
+ if(y1<yo) y1=yo;
+ if(x2>=xo+xr) x2=xo+xr-1;
+ if(y2>=yo+yr) y2=yo+yr-1;
+ if(x1>x2 || y1>y2)
+  return;
+
+ for(y=y1;y<=y2;y++)
+ {
+  const uint32 *g=gui+y*256;
+  uint8 *d;
+  int r,xa,xb;
+
+  // only the part of the row drawn on
+  for(xa=x1;xa<=x2 && !(g[xa]>>24);xa++);
+  if(xa>x2)
+   continue;
+  for(xb=x2;!(g[xb]>>24);xb--);
+  g+=xa;
+  n=xb-xa+1;
+  d=dest+(y-yo)*yscale*pitch+(xa-xo)*xscale*4;
+
+  if(specbuf8bpp || specbuf)
+  {
+   // the filters put out different pixels for each NES pixel, so the gui is scaled to them
+   uint32 *l=luaguiline;
+
+   for(x=0;x<n;x++)
+   {
+    int too=xscale;
+    do
+    {
+     *l++=g[x];
+    } while(--too);
+   }
+   for(r=rows;r;r--,d+=pitch)
+    BlendLuaGuiRow((uint32 *)d,luaguiline,n*xscale);
+  }
+  else if(xscale == 1 && rows == 1)
+   BlendLuaGuiRow((uint32 *)d,g,n);
+  else
+  {
+   // every pixel put out for a NES pixel is the same, so one is blended and copied
+   for(x=0;x<n;x++)
+    luaguiline[x]=((uint32 *)d)[x*xscale];
+   BlendLuaGuiRow(luaguiline,g,n);
+   for(r=rows;r;r--,d+=pitch)
+    for(x=0;x<n;x++)
+     if(g[x]>>24)
+     {
+      int too=xscale;
+      uint32 *p=(uint32 *)d+x*xscale;
+      do
+      {
+       *p++=luaguiline[x];
+      } while(--too);
+     }
+  }
+ }
+}
+#endif
+
+void Blit8ToHigh(uint8 *src, uint8 *dest, int xr, int yr, int pitch,
+		 int xscale, int yscale)
+{
+ BlitPicture(src, dest, xr, yr, pitch, xscale, yscale);
+#ifdef _S9XLUA_H
+ if(luagui)
+  BlitLuaGui(src, dest, xr, yr, pitch, xscale, yscale);
+#endif
+}
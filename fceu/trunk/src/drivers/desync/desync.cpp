@@ -0,0 +1,703 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief fceux-desync, finds where two runs of a game and a movie first go apart
+
+/* Each run is a worker process playing the movie, started from this program
+   or from another build of it, and spoken to over its stdin and stdout in the
+   text protocol described in fceux-desync(6). A worker keeps, for each part of
+   the state, a crc chained over every frame since power-on, so two runs which
+   have the same chain at a frame went the same way all the way there. The
+   search doubles its steps from checkpoint to checkpoint until the chains
+   differ, halves its way back to the first frame that differs, then traces
+   that frame in both runs and compares them instruction by instruction. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../../types.h"
+#include "../../driver.h"
+#include "../../fceu.h"
+#include "../../state.h"
+#include "../../emufile.h"
+#include "../../movie.h"
+#include "../../trace.h"
+#include "../../x6502.h"
+#include "../../utils/crc32.h"
+#include "../../utils/endian.h"
+
+#define PROTOCOL_VERSION 1
+
+//without a movie, how far to look
+#define DEFAULT_FRAMES 3600
+
+/* What a run is set up with; the two runs differ in some of it. */
+struct RunSettings
+{
+	int newppu;
+	int cpucore;
+	int idleskip;
+	int reload;             // save and load a state after every frame
+};
+
+/* Where a worker stands: its frame and the crcs of the parts of its state. */
+struct WorkerStatus
+{
+	int frame;
+	uint32 chain[FCEUSS_PART_COUNT];   // chained over every frame since power-on
+	uint32 crc[FCEUSS_PART_COUNT];     // of this frame alone
+};
+
+/* A checkpoint a worker can go back to. */
+struct Checkpoint
+{
+	std::vector<uint8> state;
+	uint32 chain[FCEUSS_PART_COUNT];
+};
+
+struct Worker
+{
+	pid_t pid;
+	FILE *commands;
+	FILE *replies;
+};
+
+/* The worker: plays the movie as asked, one command a line, one reply a line. */
+
+static RunSettings settings;
+static int frame;
+static uint32 chain[FCEUSS_PART_COUNT];
+static uint32 crc[FCEUSS_PART_COUNT];
+static std::map<int, Checkpoint> checkpoints;
+
+static void Hash(void)
+{
+	FCEUSS_PartChecksums(crc);
+	for(int i = 0; i < FCEUSS_PART_COUNT; i++) {
+		uint8 b[4];
+		FCEU_en32lsb(b, crc[i]);
+		chain[i] = CalcCRC32(chain[i], b, 4);
+	}
+}
+
+static bool RunFrame(void)
+{
+	uint8 *gfx;
+	int32 *sound;
+	int32 ssize;
+	// drawn, like a frame someone watches, in case the desync is in what is only done then
+	FCEUI_Emulate(&gfx, &sound, &ssize, 0);
+	frame++;
+	if(settings.reload) {
+		EMUFILE_MEMORY ms;
+		if(!FCEUSS_SaveMS(&ms, 0))
+			return false;
+		ms.fseek(0, SEEK_SET);
+		if(!FCEUSS_LoadFP(&ms, SSLOADPARAM_NOBACKUP))
+			return false;
+	}
+	Hash();
+	return true;
+}
+
+static void ReplyStatus(FILE *out)
+{
+	fprintf(out, "ok %d", frame);
+	for(int i = 0; i < FCEUSS_PART_COUNT; i++)
+		fprintf(out, " %08x", chain[i]);
+	for(int i = 0; i < FCEUSS_PART_COUNT; i++)
+		fprintf(out, " %08x", crc[i]);
+	fputc('\n', out);
+}
+
+static int RunWorker(const char *rom, const char *movie)
+{
+	// the core writes its messages to stdout as well, which is where the replies go
+	FILE *out = fdopen(dup(1), "w");
+	dup2(2, 1);
+	if(!out)
+		return 1;
+
+	if(!FCEUI_Initialize())
+		return 1;
+	FCEUI_SetGameFiles(false);
+	FCEUI_Sound(0);
+	newppu = settings.newppu ? 1 : 0;
+	FCEUI_SetIdleLoopSkip(settings.idleskip != 0);
+	if(!FCEUI_LoadGame(rom, 1)) {
+		FCEUD_PrintError("Couldn't load the game.");
+		return 1;
+	}
+	if(!FCEUI_SetCPUCore(settings.cpucore)) {
+		FCEUD_PrintError("That CPU core isn't in this build.");
+		return 1;
+	}
+	int length = 0;
+	if(movie) {
+		if(!FCEUI_LoadMovie(movie, true, 0) || !FCEUMOV_Mode(MOVIEMODE_PLAY)) {
+			FCEUD_PrintError("Couldn't play the movie.");
+			return 1;
+		}
+		length = FCEUI_GetMovieLength();
+	}
+
+	frame = 0;
+	memset(chain, 0, sizeof(chain));
+	Hash();
+	fprintf(out, "fceux-desync %d %d\n", PROTOCOL_VERSION, length);
+	fflush(out);
+
+	char line[4096];
+	while(fgets(line, sizeof(line), stdin)) {
+		line[strcspn(line, "\r\n")] = 0;
+		char *arg = strchr(line, ' ');
+		if(arg)
+			*arg++ = 0;
+		else
+			arg = line + strlen(line);
+
+		if(!strcmp(line, "run")) {
+			int n = atoi(arg);
+			bool ok = true;
+			for(int i = 0; i < n && ok; i++)
+				ok = RunFrame();
+			if(ok)
+				ReplyStatus(out);
+			else
+				fprintf(out, "err couldn't reload the state\n");
+		} else if(!strcmp(line, "save")) {
+			Checkpoint &c = checkpoints[frame];
+			c.state.clear();
+			EMUFILE_MEMORY ms(&c.state);
+			if(FCEUSS_SaveMS(&ms, 0)) {
+				memcpy(c.chain, chain, sizeof(chain));
+				fprintf(out, "ok %d\n", frame);
+			} else {
+				checkpoints.erase(frame);
+				fprintf(out, "err couldn't save a state\n");
+			}
+		} else if(!strcmp(line, "seek")) {
+			std::map<int, Checkpoint>::iterator c = checkpoints.find(atoi(arg));
+			if(c == checkpoints.end())
+				fprintf(out, "err no checkpoint at frame %s\n", arg);
+			else {
+				EMUFILE_MEMORY ms(&c->second.state);
+				if(!FCEUSS_LoadFP(&ms, SSLOADPARAM_NOBACKUP))
+					fprintf(out, "err couldn't load the checkpoint\n");
+				else {
+					frame = c->first;
+					memcpy(chain, c->second.chain, sizeof(chain));
+					FCEUSS_PartChecksums(crc);
+					ReplyStatus(out);
+				}
+			}
+		} else if(!strcmp(line, "trace")) {
+			if(!FCEUI_TraceBegin(arg))
+				fprintf(out, "err couldn't write %s\n", arg);
+			else {
+				bool ok = RunFrame();
+				FCEUI_TraceEnd();
+				if(ok)
+					ReplyStatus(out);
+				else
+					fprintf(out, "err couldn't reload the state\n");
+			}
+		} else if(!strcmp(line, "state")) {
+			EMUFILE_MEMORY ms;
+			if(FCEUSS_SaveMS(&ms, 0)) {
+				fprintf(out, "ok ");
+				const uint8 *p = ms.buf();
+				for(int i = 0; i < ms.size(); i++)
+					fprintf(out, "%02x", p[i]);
+				fputc('\n', out);
+			} else
+				fprintf(out, "err couldn't save a state\n");
+		} else if(!strcmp(line, "quit"))
+			break;
+		else
+			fprintf(out, "err what is %s\n", line);
+		fflush(out);
+	}
+
+	FCEUI_StopMovie();
+	FCEUI_CloseGame();
+	FCEUI_Kill();
+	return 0;
+}
+
+/* The controller: starts the two workers and searches. */
+
+static Worker workers[2];
+static const char *sideNames[2] = { "a", "b" };
+
+static bool StartWorker(Worker &w, const char *binary, const RunSettings &s, const char *rom, const char *movie)
+{
+	char newppuArg[16], cpucoreArg[16], idleskipArg[16], reloadArg[16];
+	sprintf(newppuArg, "%d", s.newppu);
+	sprintf(cpucoreArg, "%d", s.cpucore);
+	sprintf(idleskipArg, "%d", s.idleskip);
+	sprintf(reloadArg, "%d", s.reload);
+	const char *args[] = {
+		binary, "--worker",
+		"--newppu", newppuArg, "--cpucore", cpucoreArg, "--idleskip", idleskipArg, "--reload", reloadArg,
+		rom, movie, 0
+	};
+
+	int commands[2], replies[2];
+	if(pipe(commands) != 0)
+		return false;
+	if(pipe(replies) != 0) {
+		close(commands[0]);
+		close(commands[1]);
+		return false;
+	}
+	pid_t pid = fork();
+	if(pid < 0)
+		return false;
+	if(pid == 0) {
+		if(workers[0].commands) {
+			fclose(workers[0].commands);
+			fclose(workers[0].replies);
+		}
+		dup2(commands[0], 0);
+		dup2(replies[1], 1);
+		close(commands[0]);
+		close(commands[1]);
+		close(replies[0]);
+		close(replies[1]);
+		execvp(binary, (char* const*)args);
+		fprintf(stderr, "Couldn't run %s: %s\n", binary, strerror(errno));
+		_exit(1);
+	}
+	close(commands[0]);
+	close(replies[1]);
+	w.pid = pid;
+	w.commands = fdopen(commands[1], "w");
+	w.replies = fdopen(replies[0], "r");
+	return w.commands && w.replies;
+}
+
+static void StopWorker(Worker &w)
+{
+	if(!w.pid)
+		return;
+	if(w.commands) {
+		fputs("quit\n", w.commands);
+		fclose(w.commands);
+	}
+	if(w.replies)
+		fclose(w.replies);
+	waitpid(w.pid, 0, 0);
+	w.pid = 0;
+}
+
+static bool ReadLine(FILE *f, std::string &line)
+{
+	line.clear();
+	int c;
+	while((c = getc(f)) != EOF && c != '\n')
+		line += (char)c;
+	return c != EOF || !line.empty();
+}
+
+/* Gives both workers the same command, so they work on it at once, and reads
+   both replies. false, having said so, if either one failed. */
+static bool Ask(const char *command, std::string reply[2])
+{
+	for(int i = 0; i < 2; i++) {
+		fprintf(workers[i].commands, "%s\n", command);
+		fflush(workers[i].commands);
+	}
+	bool ok = true;
+	for(int i = 0; i < 2; i++) {
+		if(!ReadLine(workers[i].replies, reply[i])) {
+			fprintf(stderr, "run %s went away\n", sideNames[i]);
+			ok = false;
+		} else if(reply[i].compare(0, 3, "ok ")) {
+			fprintf(stderr, "run %s: %s\n", sideNames[i], reply[i].c_str());
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+static bool ParseStatus(const std::string &reply, WorkerStatus &s)
+{
+	const char *p = reply.c_str() + 3;
+	char *end;
+	s.frame = strtol(p, &end, 10);
+	for(int i = 0; i < FCEUSS_PART_COUNT * 2; i++) {
+		if(*end != ' ')
+			return false;
+		uint32 v = strtoul(end + 1, &end, 16);
+		if(i < FCEUSS_PART_COUNT)
+			s.chain[i] = v;
+		else
+			s.crc[i - FCEUSS_PART_COUNT] = v;
+	}
+	return true;
+}
+
+static bool AskStatus(const char *command, WorkerStatus status[2])
+{
+	std::string reply[2];
+	if(!Ask(command, reply))
+		return false;
+	for(int i = 0; i < 2; i++)
+		if(!ParseStatus(reply[i], status[i])) {
+			fprintf(stderr, "run %s: %s\n", sideNames[i], reply[i].c_str());
+			return false;
+		}
+	return true;
+}
+
+static uint32 compared = (1 << FCEUSS_PART_COUNT) - 1;
+
+static bool Same(const WorkerStatus status[2])
+{
+	for(int i = 0; i < FCEUSS_PART_COUNT; i++)
+		if((compared & (1 << i)) && status[0].chain[i] != status[1].chain[i])
+			return false;
+	return true;
+}
+
+static bool Seek(int to)
+{
+	char command[32];
+	sprintf(command, "seek %d", to);
+	WorkerStatus status[2];
+	return AskStatus(command, status);
+}
+
+static bool Run(int frames, WorkerStatus status[2])
+{
+	char command[32];
+	sprintf(command, "run %d", frames);
+	return AskStatus(command, status);
+}
+
+static bool Save(void)
+{
+	std::string reply[2];
+	return Ask("save", reply);
+}
+
+/* Compares the traces of the first frame which differs, and says where they part. */
+static void CompareTraces(const std::string path[2])
+{
+	void *trace[2];
+	trace[0] = FCEUI_TraceOpen(path[0].c_str());
+	trace[1] = trace[0] ? FCEUI_TraceOpen(path[1].c_str()) : 0;
+	if(!trace[1]) {
+		if(trace[0])
+			FCEUI_TraceClose(trace[0]);
+		return;
+	}
+
+	FCEU_TRACE_RECORD rec[2], last;
+	char line[FCEU_TRACE_LINE_SIZE];
+	int count = 0, timing = -1;
+	bool more[2], differ = false;
+	for(;;) {
+		more[0] = FCEUI_TraceRead(trace[0], rec[0]);
+		more[1] = FCEUI_TraceRead(trace[1], rec[1]);
+		if(!more[0] || !more[1])
+			break;
+		const FCEU_TRACE_RECORD &a = rec[0], &b = rec[1];
+		int size = opsize[a.opcode[0]];
+		if(a.pc != b.pc || a.opcode[0] != b.opcode[0] || memcmp(a.opcode, b.opcode, size ? size : 1)
+			|| a.a != b.a || a.x != b.x || a.y != b.y || a.s != b.s || a.p != b.p || a.bank != b.bank) {
+			differ = true;
+			break;
+		}
+		if(timing < 0 && (a.cycle != b.cycle || a.scanline != b.scanline))
+			timing = count;
+		last = a;
+		count++;
+	}
+
+	if(differ || more[0] != more[1]) {
+		printf("first instruction which differs: %d of the frame\n", count + 1);
+		if(count) {
+			FCEUI_TraceFormat(last, line);
+			printf("  both: %s\n", line);
+		}
+		for(int i = 0; i < 2; i++) {
+			if(more[i]) {
+				FCEUI_TraceFormat(rec[i], line);
+				printf("  %s:    %s\n", sideNames[i], line);
+			} else
+				printf("  %s:    (the frame ends)\n", sideNames[i]);
+		}
+	} else
+		printf("the CPU ran the same %d instructions in both; they part outside of it\n", count);
+	if(timing >= 0)
+		printf("the cycle or scanline first differs at instruction %d\n", timing + 1);
+
+	FCEUI_TraceClose(trace[0]);
+	FCEUI_TraceClose(trace[1]);
+}
+
+static bool DecodeState(const std::string &reply, EMUFILE_MEMORY &ms)
+{
+	size_t len = (reply.size() - 3) / 2;
+	std::vector<uint8> bytes(len);
+	for(size_t i = 0; i < len; i++) {
+		char hex[3] = { reply[3 + i * 2], reply[4 + i * 2], 0 };
+		bytes[i] = (uint8)strtoul(hex, 0, 16);
+	}
+	if(len)
+		ms.fwrite(&bytes[0], len);
+	ms.fseek(0, SEEK_SET);
+	return len >= 16;
+}
+
+/* Says what differs in the states the two runs are in now. */
+static void CompareStates(const WorkerStatus status[2])
+{
+	printf("parts which differ:");
+	for(int i = 0; i < FCEUSS_PART_COUNT; i++)
+		if(status[0].crc[i] != status[1].crc[i])
+			printf(" %s", FCEUSS_PartName(i));
+	printf("\n");
+
+	std::string reply[2];
+	EMUFILE_MEMORY ms[2];
+	if(!Ask("state", reply) || !DecodeState(reply[0], ms[0]) || !DecodeState(reply[1], ms[1]))
+		return;
+	char desc[5];
+	uint32 offset;
+	if(FCEUSS_FirstDifference(ms[0], ms[1], desc, offset))
+		printf("first difference in the savestates: %s, byte %u\n", desc, offset);
+}
+
+static bool ParsePair(const char *arg, int v[2])
+{
+	char *end;
+	v[0] = v[1] = strtol(arg, &end, 10);
+	if(*end == ',')
+		v[1] = strtol(end + 1, &end, 10);
+	return end != arg && !*end;
+}
+
+static bool ParseParts(const char *arg)
+{
+	compared = 0;
+	std::string list = arg;
+	size_t pos = 0;
+	while(pos <= list.size()) {
+		size_t comma = list.find(',', pos);
+		if(comma == std::string::npos)
+			comma = list.size();
+		std::string name = list.substr(pos, comma - pos);
+		int i;
+		for(i = 0; i < FCEUSS_PART_COUNT; i++)
+			if(name == FCEUSS_PartName(i))
+				break;
+		if(i == FCEUSS_PART_COUNT)
+			return false;
+		compared |= 1 << i;
+		pos = comma + 1;
+	}
+	return true;
+}
+
+static void Usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] rom [movie]\n"
+		"  --frames n          look no further than frame n (the movie's length, or %d)\n"
+		"  --binary a[,b]      the fceux-desync each run is played by (this one)\n"
+		"  --newppu a[,b]      use the new PPU core: 0 or 1 (0)\n"
+		"  --cpucore a[,b]     0 the interpreter, 1 the recompiler, 2 both in lockstep (0)\n"
+		"  --idleskip a[,b]    skip idle loops: 0 or 1 (1)\n"
+		"  --reload a[,b]      save and load a state after every frame: 0 or 1 (0)\n"
+		"  --parts list        the parts of the state compared (cpu,ram,ppu,spram,apu,input,mapper)\n"
+		"  --traces dir        keep the traces of the frame which differs in dir\n",
+		name, DEFAULT_FRAMES);
+}
+
+int main(int argc, char *argv[])
+{
+	bool worker = false;
+	const char *rom = 0, *movie = 0, *traceDir = 0;
+	std::string binary[2];
+	binary[0] = binary[1] = argv[0];
+	RunSettings run[2];
+	int newppuArg[2] = { 0, 0 }, cpucoreArg[2] = { 0, 0 }, idleskipArg[2] = { 1, 1 }, reloadArg[2] = { 0, 0 };
+	int limit = 0;
+
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		bool ok = true;
+		if(arg == "--worker")
+			worker = true;
+		else if(arg == "--frames" && hasValue)
+			ok = (limit = atoi(argv[++i])) > 0;
+		else if(arg == "--binary" && hasValue) {
+			std::string value = argv[++i];
+			size_t comma = value.find(',');
+			binary[0] = value.substr(0, comma);
+			binary[1] = comma == std::string::npos ? binary[0] : value.substr(comma + 1);
+		}
+		else if(arg == "--newppu" && hasValue)
+			ok = ParsePair(argv[++i], newppuArg);
+		else if(arg == "--cpucore" && hasValue)
+			ok = ParsePair(argv[++i], cpucoreArg);
+		else if(arg == "--idleskip" && hasValue)
+			ok = ParsePair(argv[++i], idleskipArg);
+		else if(arg == "--reload" && hasValue)
+			ok = ParsePair(argv[++i], reloadArg);
+		else if(arg == "--parts" && hasValue)
+			ok = ParseParts(argv[++i]);
+		else if(arg == "--traces" && hasValue)
+			traceDir = argv[++i];
+		else if(!rom && arg[0] != '-')
+			rom = argv[i];
+		else if(!movie && arg[0] != '-')
+			movie = argv[i];
+		else
+			ok = false;
+		if(!ok) {
+			Usage(argv[0]);
+			return 2;
+		}
+	}
+	if(!rom) {
+		Usage(argv[0]);
+		return 2;
+	}
+	for(int i = 0; i < 2; i++) {
+		run[i].newppu = newppuArg[i];
+		run[i].cpucore = cpucoreArg[i];
+		run[i].idleskip = idleskipArg[i];
+		run[i].reload = reloadArg[i];
+	}
+
+	if(worker) {
+		settings = run[0];
+		return RunWorker(rom, movie);
+	}
+
+	// a worker which goes away is noticed by its replies ending
+	signal(SIGPIPE, SIG_IGN);
+
+	memset(workers, 0, sizeof(workers));
+	bool ok = true;
+	int length[2];
+	for(int i = 0; i < 2 && ok; i++) {
+		ok = StartWorker(workers[i], binary[i].c_str(), run[i], rom, movie);
+		std::string hello;
+		int version = 0;
+		if(ok && (!ReadLine(workers[i].replies, hello)
+			|| sscanf(hello.c_str(), "fceux-desync %d %d", &version, &length[i]) != 2 || version != PROTOCOL_VERSION)) {
+			fprintf(stderr, "run %s didn't start\n", sideNames[i]);
+			ok = false;
+		}
+	}
+	if(ok && !limit)
+		limit = movie ? (length[0] < length[1] ? length[0] : length[1]) : DEFAULT_FRAMES;
+
+	std::string dir;
+	if(ok && traceDir)
+		dir = traceDir;
+	else if(ok) {
+		char temp[] = "/tmp/fceux-desync.XXXXXX";
+		if(mkdtemp(temp))
+			dir = temp;
+		else {
+			fprintf(stderr, "Couldn't make a directory for the traces.\n");
+			ok = false;
+		}
+	}
+
+	// lo is the last frame known the same, and there is a checkpoint at it; hi the first known to differ
+	WorkerStatus status[2];
+	int lo = 0, hi = -1;
+	ok = ok && Save() && Run(0, status);
+	if(ok && !Same(status))
+		hi = 0;
+	for(int step = 1; ok && hi < 0 && lo < limit; step *= 2) {
+		int to = lo + step < limit ? lo + step : limit;
+		ok = Run(to - lo, status);
+		if(ok && Same(status))
+			ok = Save() && (lo = to, true);
+		else if(ok)
+			hi = to;
+	}
+	while(ok && hi - lo > 1) {
+		int mid = lo + (hi - lo) / 2;
+		ok = Seek(lo) && Run(mid - lo, status);
+		if(ok && Same(status))
+			ok = Save() && (lo = mid, true);
+		else if(ok)
+			hi = mid;
+	}
+
+	int result = ok ? 0 : 2;
+	if(ok && hi < 0)
+		printf("the runs are the same through frame %d\n", limit);
+	else if(ok && hi == 0) {
+		printf("the runs differ from power-on\n");
+		CompareStates(status);
+		result = 1;
+	} else if(ok) {
+		printf("first frame which differs: %d\n", hi);
+		std::string path[2];
+		char command[4096];
+		for(int i = 0; i < 2; i++)
+			path[i] = dir + "/" + sideNames[i] + ".trace";
+		for(int i = 0; i < 2 && ok; i++) {
+			snprintf(command, sizeof(command), "trace %s", path[i].c_str());
+			fprintf(workers[i].commands, "seek %d\n%s\n", lo, command);
+			fflush(workers[i].commands);
+		}
+		std::string reply[2][2];
+		for(int i = 0; i < 2 && ok; i++)
+			for(int j = 0; j < 2 && ok; j++)
+				ok = ReadLine(workers[i].replies, reply[i][j]) && !reply[i][j].compare(0, 3, "ok ");
+		ok = ok && ParseStatus(reply[0][1], status[0]) && ParseStatus(reply[1][1], status[1]);
+		if(ok) {
+			CompareTraces(path);
+			CompareStates(status);
+		} else
+			fprintf(stderr, "Couldn't trace frame %d.\n", hi);
+		result = ok ? 1 : 2;
+		if(!traceDir)
+			for(int i = 0; i < 2; i++)
+				unlink(path[i].c_str());
+	}
+	if(!traceDir && !dir.empty())
+		rmdir(dir.c_str());
+
+	StopWorker(workers[0]);
+	StopWorker(workers[1]);
+	return result;
+}
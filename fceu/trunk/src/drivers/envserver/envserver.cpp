@@ -0,0 +1,543 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief fceux-envserver, many copies of a game stepped together for training agents
+
+/* The emulator keeps its state in globals, so each environment is a worker
+   process of its own, forked once the game is loaded. The server hands each
+   request to all the workers at once through pipes and answers when every one
+   of them is done; the workers write what they have to show straight into the
+   shared memory, whose layout is described in fceux-envserver(6). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+#include "../../types.h"
+#include "../../driver.h"
+#include "../../fceu.h"
+#include "../../state.h"
+#include "../../emufile.h"
+#include "../../video.h"
+
+#define ENV_VERSION 1
+#define MAX_REWARDS 16
+
+#define SCREEN_WIDTH 256
+#define SCREEN_HEIGHT 240
+
+/* The start of the shared memory. All the numbers in it are in the host's
+   byte order, and all the offsets in bytes. */
+struct EnvHeader
+{
+	char magic[4];          // "FCEV"
+	uint32 version;
+	uint32 envs;
+	uint32 slotOffset;      // where the first environment's slot is
+	uint32 slotSize;        // and how far apart the slots are
+	// within a slot:
+	uint32 screenOffset;    // the frame, a palette index per pixel
+	uint32 grayOffset;      // the grayscale frame, or 0 if there is none
+	uint32 grayWidth;
+	uint32 grayHeight;
+	uint32 ramOffset;       // the 2KB of RAM
+	uint32 rewardOffset;    // the reward values, an int32 each
+	uint32 rewards;
+};
+
+/* The start of each slot. */
+struct EnvSlot
+{
+	uint32 frame;           // frames since the last reset
+	uint32 status;          // 0, or 1 if the last request failed
+	uint64 frames;          // frames run by the worker in all
+	uint64 cpuMicroseconds; // CPU time the worker has used in all
+};
+
+/* A RAM or WRAM address read for a reward, little endian if wider than a byte. */
+struct RewardHook
+{
+	uint32 address;
+	int bytes;
+};
+
+/* What the server asks of a worker. */
+struct WorkerCommand
+{
+	uint8 op;               // 'S' or 'R', as in the requests
+	uint8 frameskip;
+	uint8 action;
+};
+
+struct Worker
+{
+	pid_t pid;
+	int commands;           // the server's end of the pipes
+	int replies;
+};
+
+static std::vector<RewardHook> rewardHooks;
+static int grayFactor = 0;
+
+static EnvHeader *header;
+static uint8 *shared;
+static size_t sharedSize;
+
+static EMUFILE_MEMORY powerOn;
+static uint32 joy;
+
+static bool ReadAll(int fd, void *buf, size_t size)
+{
+	uint8 *p = (uint8*)buf;
+	while(size) {
+		ssize_t got = read(fd, p, size);
+		if(got < 0 && errno == EINTR)
+			continue;
+		if(got <= 0)
+			return false;
+		p += got;
+		size -= got;
+	}
+	return true;
+}
+
+static bool WriteAll(int fd, const void *buf, size_t size)
+{
+	const uint8 *p = (const uint8*)buf;
+	while(size) {
+		ssize_t put = write(fd, p, size);
+		if(put < 0 && errno == EINTR)
+			continue;
+		if(put <= 0)
+			return false;
+		p += put;
+		size -= put;
+	}
+	return true;
+}
+
+/* Works out where everything goes in a slot and in the shared memory. */
+static void Layout(EnvHeader &h, int envs)
+{
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "FCEV", 4);
+	h.version = ENV_VERSION;
+	h.envs = envs;
+
+	uint32 size = sizeof(EnvSlot);
+	h.screenOffset = size;
+	size += SCREEN_WIDTH * SCREEN_HEIGHT;
+	if(grayFactor) {
+		h.grayOffset = size;
+		h.grayWidth = SCREEN_WIDTH / grayFactor;
+		h.grayHeight = SCREEN_HEIGHT / grayFactor;
+		size += h.grayWidth * h.grayHeight;
+	}
+	h.ramOffset = size;
+	size += 0x800;
+	h.rewardOffset = size;
+	h.rewards = rewardHooks.size();
+	size += h.rewards * 4;
+
+	// a slot to a cache line, so that the workers don't write over each other's lines
+	h.slotSize = (size + 63) & ~63;
+	h.slotOffset = (sizeof(EnvHeader) + 63) & ~63;
+}
+
+static bool CreateShared(const char *path, int envs)
+{
+	EnvHeader h;
+	Layout(h, envs);
+	sharedSize = h.slotOffset + (size_t)h.slotSize * envs;
+
+	int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if(fd < 0)
+		return false;
+	bool ok = ftruncate(fd, sharedSize) == 0;
+	void *p = ok ? mmap(0, sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if(p == MAP_FAILED)
+		return false;
+
+	shared = (uint8*)p;
+	header = (EnvHeader*)p;
+	*header = h;
+	return true;
+}
+
+/* What a worker shows for its environment after a request. */
+static void Observe(EnvSlot *slot, const uint8 *gfx)
+{
+	uint8 *base = (uint8*)slot;
+	memcpy(base + header->screenOffset, gfx, SCREEN_WIDTH * SCREEN_HEIGHT);
+
+	if(grayFactor) {
+		// the palette may change from game to game and with the emphasis bits, so the table is made afresh each time
+		uint8 luma[256];
+		for(int i = 0; i < 256; i++) {
+			uint8 r, g, b;
+			FCEUD_GetPalette(i, &r, &g, &b);
+			luma[i] = (r * 77 + g * 150 + b * 29) >> 8;
+		}
+		uint8 *gray = base + header->grayOffset;
+		int area = grayFactor * grayFactor;
+		for(uint32 y = 0; y < header->grayHeight; y++)
+		for(uint32 x = 0; x < header->grayWidth; x++) {
+			const uint8 *src = gfx + y * grayFactor * SCREEN_WIDTH + x * grayFactor;
+			int sum = 0;
+			for(int dy = 0; dy < grayFactor; dy++)
+				for(int dx = 0; dx < grayFactor; dx++)
+					sum += luma[src[dy * SCREEN_WIDTH + dx]];
+			*gray++ = sum / area;
+		}
+	}
+
+	memcpy(base + header->ramOffset, RAM, 0x800);
+
+	int32 *rewards = (int32*)(base + header->rewardOffset);
+	for(size_t i = 0; i < rewardHooks.size(); i++) {
+		uint32 value = 0;
+		for(int b = rewardHooks[i].bytes - 1; b >= 0; b--)
+			value = (value << 8) | FCEU_CPUPeek(rewardHooks[i].address + b);
+		rewards[i] = (int32)value;
+	}
+
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) == 0)
+		slot->cpuMicroseconds = (uint64)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000
+			+ usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/* A worker: runs its environment for each command until the server goes away. */
+static void RunWorker(int env, int commands, int replies)
+{
+	EnvSlot *slot = (EnvSlot*)(shared + header->slotOffset + (size_t)header->slotSize * env);
+	uint8 *gfx = XBuf;
+	int32 *sound;
+	int32 ssize;
+
+	WorkerCommand cmd;
+	while(ReadAll(commands, &cmd, sizeof(cmd))) {
+		bool ok = true;
+		if(cmd.op == 'R') {
+			powerOn.fseek(0, SEEK_SET);
+			ok = FCEUSS_LoadFP(&powerOn, SSLOADPARAM_NOBACKUP);
+			// nothing is drawn yet at power-on, rather than the last frame before the reset
+			memset(XBuf, 0, SCREEN_WIDTH * SCREEN_HEIGHT);
+			gfx = XBuf;
+			slot->frame = 0;
+		} else {
+			// the frames before the last are emulated all the same, only not drawn
+			joy = cmd.action;
+			int frames = cmd.frameskip ? cmd.frameskip : 1;
+			for(int i = 0; i < frames; i++)
+				FCEUI_Emulate(&gfx, &sound, &ssize, i < frames - 1 ? 2 : 0);
+			slot->frame += frames;
+			slot->frames += frames;
+		}
+		Observe(slot, gfx);
+		slot->status = ok ? 0 : 1;
+
+		uint8 reply = ok ? 0 : 1;
+		if(!WriteAll(replies, &reply, 1))
+			break;
+	}
+	_exit(0);
+}
+
+static bool StartWorkers(std::vector<Worker> &workers)
+{
+	for(size_t i = 0; i < workers.size(); i++) {
+		int commands[2], replies[2];
+		if(pipe(commands) != 0)
+			return false;
+		if(pipe(replies) != 0) {
+			close(commands[0]);
+			close(commands[1]);
+			return false;
+		}
+
+		pid_t pid = fork();
+		if(pid < 0)
+			return false;
+		if(pid == 0) {
+			// only its own ends of its own pipes
+			for(size_t j = 0; j < i; j++) {
+				close(workers[j].commands);
+				close(workers[j].replies);
+			}
+			close(commands[1]);
+			close(replies[0]);
+			RunWorker(i, commands[0], replies[1]);
+		}
+		close(commands[0]);
+		close(replies[1]);
+		workers[i].pid = pid;
+		workers[i].commands = commands[1];
+		workers[i].replies = replies[0];
+	}
+	return true;
+}
+
+static void StopWorkers(std::vector<Worker> &workers)
+{
+	for(size_t i = 0; i < workers.size(); i++) {
+		if(!workers[i].pid)
+			continue;
+		close(workers[i].commands);
+		close(workers[i].replies);
+		waitpid(workers[i].pid, 0, 0);
+	}
+}
+
+/* Hands the commands to the workers which have one, then waits for all of them.
+   A 1 in the reply for each worker which failed, 0 if none did. */
+static uint8 Dispatch(std::vector<Worker> &workers, const std::vector<WorkerCommand> &cmds)
+{
+	uint8 status = 0;
+	for(size_t i = 0; i < workers.size(); i++)
+		if(cmds[i].op && !WriteAll(workers[i].commands, &cmds[i], sizeof(cmds[i])))
+			status = 1;
+	for(size_t i = 0; i < workers.size(); i++) {
+		uint8 reply;
+		if(cmds[i].op && (!ReadAll(workers[i].replies, &reply, 1) || reply))
+			status = 1;
+	}
+	return status;
+}
+
+/* Serves one client until it goes away. false if it asked the server to quit. */
+static bool Serve(int client, std::vector<Worker> &workers)
+{
+	int envs = workers.size();
+	std::vector<uint8> args(envs);
+	std::vector<WorkerCommand> cmds(envs);
+
+	uint8 op;
+	while(ReadAll(client, &op, 1)) {
+		uint8 status = 0;
+		switch(op) {
+		case 'S': {
+			uint8 frameskip;
+			if(!ReadAll(client, &frameskip, 1) || !ReadAll(client, &args[0], envs))
+				return true;
+			for(int i = 0; i < envs; i++) {
+				cmds[i].op = 'S';
+				cmds[i].frameskip = frameskip;
+				cmds[i].action = args[i];
+			}
+			status = Dispatch(workers, cmds);
+			break;
+		}
+		case 'R':
+			if(!ReadAll(client, &args[0], envs))
+				return true;
+			for(int i = 0; i < envs; i++) {
+				cmds[i].op = args[i] ? 'R' : 0;
+				cmds[i].frameskip = 0;
+				cmds[i].action = 0;
+			}
+			status = Dispatch(workers, cmds);
+			break;
+		case 'Q':
+			WriteAll(client, &status, 1);
+			return false;
+		default:
+			// there is no telling where the next request starts
+			return true;
+		}
+		if(!WriteAll(client, &status, 1))
+			return true;
+	}
+	return true;
+}
+
+static int Listen(const char *path)
+{
+	struct sockaddr_un addr;
+	if(strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0)
+		return -1;
+	unlink(path);
+	if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 1) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static bool ParseReward(const char *arg)
+{
+	char *end;
+	RewardHook hook;
+	hook.address = strtoul(arg, &end, 0);
+	hook.bytes = 1;
+	if(*end == ':')
+		hook.bytes = strtol(end + 1, &end, 0);
+	if(*end || hook.bytes < 1 || hook.bytes > 4 || rewardHooks.size() >= MAX_REWARDS)
+		return false;
+	// reading registers has side effects, so the value has to lie in RAM ($0000-$1FFF) or WRAM ($6000-$7FFF)
+	if(!(hook.address <= 0x2000u - hook.bytes || (hook.address >= 0x6000 && hook.address <= 0x8000u - hook.bytes)))
+		return false;
+	rewardHooks.push_back(hook);
+	return true;
+}
+
+static void Usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [options] rom\n"
+		"  --envs n            run n copies of the game (8)\n"
+		"  --socket path       listen for requests at path (fceux-env.sock)\n"
+		"  --shm path          the file shared with the client (/dev/shm/fceux-env)\n"
+		"  --gray n            add a grayscale frame scaled down by n: 1, 2, 4 or 8 (none)\n"
+		"  --reward addr[:n]   show the n byte value at addr after each request (up to %d);\n"
+		"                      addr is in RAM ($0000-$1FFF) or WRAM ($6000-$7FFF)\n"
+		"  --newppu {0|1}      use the new PPU core (0)\n",
+		name, MAX_REWARDS);
+}
+
+int main(int argc, char *argv[])
+{
+	int envs = 8;
+	const char *socketPath = "fceux-env.sock";
+	const char *shmPath = "/dev/shm/fceux-env";
+	const char *rom = 0;
+	int ppu = 0;
+
+	for(int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if(arg == "--envs" && hasValue)
+			envs = atoi(argv[++i]);
+		else if(arg == "--socket" && hasValue)
+			socketPath = argv[++i];
+		else if(arg == "--shm" && hasValue)
+			shmPath = argv[++i];
+		else if(arg == "--gray" && hasValue)
+			grayFactor = atoi(argv[++i]);
+		else if(arg == "--reward" && hasValue) {
+			if(!ParseReward(argv[++i])) {
+				Usage(argv[0]);
+				return 1;
+			}
+		}
+		else if(arg == "--newppu" && hasValue)
+			ppu = atoi(argv[++i]);
+		else if(!rom && arg[0] != '-')
+			rom = argv[i];
+		else {
+			Usage(argv[0]);
+			return 1;
+		}
+	}
+	bool grayOk = grayFactor == 0 || grayFactor == 1 || grayFactor == 2 || grayFactor == 4 || grayFactor == 8;
+	if(!rom || envs <= 0 || envs > 1024 || !grayOk) {
+		Usage(argv[0]);
+		return 1;
+	}
+
+	if(!FCEUI_Initialize())
+		return 1;
+	newppu = ppu ? 1 : 0;
+	// nobody listens
+	FCEUI_Sound(0);
+	if(!FCEUI_LoadGame(rom, 1)) {
+		FCEUD_PrintError("Couldn't load the game.");
+		return 1;
+	}
+	FCEUI_SetInput(0, SI_GAMEPAD, &joy, 0);
+	// what a reset goes back to, made once for everybody
+	if(!FCEUSS_SaveMS(&powerOn, 0)) {
+		FCEUD_PrintError("Couldn't save the power-on state.");
+		return 1;
+	}
+
+	if(!CreateShared(shmPath, envs)) {
+		FCEUD_PrintError("Couldn't create the shared memory.");
+		return 1;
+	}
+
+	// a client which goes away is only noticed by the write failing
+	signal(SIGPIPE, SIG_IGN);
+
+	std::vector<Worker> workers(envs);
+	memset(&workers[0], 0, sizeof(Worker) * envs);
+	bool ok = StartWorkers(workers);
+	if(!ok)
+		FCEUD_PrintError("Couldn't start the workers.");
+
+	// every environment starts out with something to show
+	std::vector<WorkerCommand> reset(envs);
+	for(int i = 0; i < envs; i++) {
+		reset[i].op = 'R';
+		reset[i].frameskip = 0;
+		reset[i].action = 0;
+	}
+	ok = ok && Dispatch(workers, reset) == 0;
+
+	int listener = ok ? Listen(socketPath) : -1;
+	if(ok && listener < 0) {
+		FCEUD_PrintError("Couldn't listen at the socket.");
+		ok = false;
+	}
+	if(ok)
+		fprintf(stderr, "%d copies of %s, listening at %s\n", envs, rom, socketPath);
+	bool running = ok;
+	while(running) {
+		int client = accept(listener, 0, 0);
+		if(client < 0) {
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		running = Serve(client, workers);
+		close(client);
+	}
+
+	StopWorkers(workers);
+	if(listener >= 0) {
+		close(listener);
+		unlink(socketPath);
+	}
+	munmap(shared, sharedSize);
+	unlink(shmPath);
+	FCEUI_CloseGame();
+	FCEUI_Kill();
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,185 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief libfceux, the C API of the emulator as a library on top of the null driver
+
+#include <string.h>
+
+#include "../../types.h"
+#include "../../driver.h"
+#include "../../fceu.h"
+#include "../../cheat.h"
+#include "../../state.h"
+#include "../../emufile.h"
+#include "../../video.h"
+#include "libfceux.h"
+
+static bool initialized = false;
+static bool loaded = false;
+
+// a byte for each pad, as the gamepads of both ports read it
+static uint32 pads = 0;
+
+static uint8 *frame = 0;
+static int32 *sound = 0;
+static int32 soundCount = 0;
+
+int fceux_api_version(void)
+{
+	return FCEUX_API_VERSION;
+}
+
+int fceux_init(void)
+{
+	if(initialized)
+		return 1;
+	if(!FCEUI_Initialize())
+		return 0;
+	FCEUI_SetGameFiles(false);
+	FCEUI_Sound(0);
+	initialized = true;
+	return 1;
+}
+
+void fceux_quit(void)
+{
+	if(!initialized)
+		return;
+	fceux_close_rom();
+	FCEUI_Kill();
+	initialized = false;
+}
+
+void fceux_set_files(const char *basedir)
+{
+	if(basedir)
+		FCEUI_SetBaseDirectory(basedir);
+	FCEUI_SetGameFiles(basedir != 0);
+}
+
+int fceux_load_rom(const void *data, size_t size, const char *name)
+{
+	if(!initialized || size > 0x7FFFFFFF)
+		return 0;
+	fceux_close_rom();
+	if(!FCEUI_LoadGameFromMemory(data, (int)size, name ? name : "game.nes", 1))
+		return 0;
+	FCEUI_SetInput(0, SI_GAMEPAD, &pads, 0);
+	FCEUI_SetInput(1, SI_GAMEPAD, &pads, 0);
+	loaded = true;
+	frame = XBuf;
+	soundCount = 0;
+	return 1;
+}
+
+void fceux_close_rom(void)
+{
+	if(!loaded)
+		return;
+	FCEUI_CloseGame();
+	loaded = false;
+	frame = XBuf;
+	soundCount = 0;
+}
+
+void fceux_set_input(int pad, unsigned char buttons)
+{
+	if(pad < 0 || pad > 1)
+		return;
+	pads = (pads & ~(0xFF << (pad * 8))) | ((uint32)buttons << (pad * 8));
+}
+
+void fceux_set_sound(int rate)
+{
+	FCEUI_Sound(rate > 0 ? rate : 0);
+}
+
+void fceux_run_frame(int skip)
+{
+	if(!loaded)
+		return;
+	FCEUI_Emulate(&frame, &sound, &soundCount, skip ? 2 : 0);
+	if(skip)
+		soundCount = 0;
+}
+
+const unsigned char *fceux_framebuffer(void)
+{
+	return frame ? frame : XBuf;
+}
+
+void fceux_palette(unsigned char rgb[256 * 3])
+{
+	for(int i = 0; i < 256; i++)
+		FCEUD_GetPalette(i, &rgb[i * 3], &rgb[i * 3 + 1], &rgb[i * 3 + 2]);
+}
+
+const int *fceux_audio(int *count)
+{
+	if(count)
+		*count = soundCount;
+	return (const int*)sound;
+}
+
+size_t fceux_save_state(void *buf, size_t size)
+{
+	if(!loaded)
+		return 0;
+	EMUFILE_MEMORY ms;
+	if(!FCEUSS_SaveMS(&ms, 0))
+		return 0;
+	size_t len = ms.size();
+	if(buf && len <= size)
+		memcpy(buf, ms.buf(), len);
+	return len;
+}
+
+int fceux_load_state(const void *buf, size_t size)
+{
+	if(!loaded || !buf || size > 0x7FFFFFFF)
+		return 0;
+	EMUFILE_MEMORY ms((void*)buf, (s32)size);
+	return FCEUSS_LoadFP(&ms, SSLOADPARAM_NOBACKUP) ? 1 : 0;
+}
+
+unsigned char fceux_read(unsigned short addr)
+{
+	if(!loaded)
+		return 0;
+	return FCEU_CheatGetByte(addr);
+}
+
+void fceux_write(unsigned short addr, unsigned char value)
+{
+	if(!loaded)
+		return;
+	FCEU_CheatSetByte(addr, value);
+}
+
+void fceux_reset(void)
+{
+	FCEUI_ResetNES();
+}
+
+void fceux_power(void)
+{
+	FCEUI_PowerNES();
+}
@@ -0,0 +1,90 @@
+/* libfceux - the emulator as a library, for programs which run games on their own
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _LIBFCEUX_H_
+#define _LIBFCEUX_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Built with "scons libfceux". There is one emulator per process: the
+   functions all work on it, and none of them may be called from two threads
+   at once. The functions returning int return 1 if they succeeded and 0 if
+   not. Unless fceux_set_files says otherwise, nothing reads or writes any
+   file; anything the emulator has to say goes to stderr. */
+
+/* Changes only when a function below changes or goes away. */
+#define FCEUX_API_VERSION 1
+int fceux_api_version(void);
+
+int fceux_init(void);
+void fceux_quit(void);
+
+/* Where the battery saves, cheats and palettes of games are kept (see
+   fceux(6)), and that they are read and written there as the emulator does;
+   0 to keep away from files again. An FDS game needs the BIOS from there. */
+void fceux_set_files(const char *basedir);
+
+/* Loads the game from the size bytes at data, which needn't outlive the call.
+   name is what the game is called, for the messages and the files. The game
+   starts at power-on. */
+int fceux_load_rom(const void *data, size_t size, const char *name);
+void fceux_close_rom(void);
+
+/* The buttons of pad 0 or 1 for the frames from now on: A 0x01, B 0x02,
+   select 0x04, start 0x08, up 0x10, down 0x20, left 0x40, right 0x80. */
+void fceux_set_input(int pad, unsigned char buttons);
+
+/* Sound at rate samples a second, or none if rate is 0, which is the
+   default. */
+void fceux_set_sound(int rate);
+
+/* Runs a frame. With skip, the frame is emulated all the same but neither
+   drawn nor heard. */
+void fceux_run_frame(int skip);
+
+/* The last frame drawn: 256x240 palette indices, a row after another. */
+const unsigned char *fceux_framebuffer(void);
+/* The colors of the palette indices: red, green and blue of each. */
+void fceux_palette(unsigned char rgb[256 * 3]);
+/* The sound of the last frame: *count mono samples. */
+const int *fceux_audio(int *count);
+
+/* Saves the state to the size bytes at buf, if it fits. Returns the size of
+   the state, so that a call with size 0 tells how big buf has to be. */
+size_t fceux_save_state(void *buf, size_t size);
+int fceux_load_state(const void *buf, size_t size);
+
+/* The CPU's view of memory, as the cheats and Lua scripts see it. */
+unsigned char fceux_read(unsigned short addr);
+void fceux_write(unsigned short addr, unsigned char value);
+
+/* Take effect at the next frame. */
+void fceux_reset(void);
+void fceux_power(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
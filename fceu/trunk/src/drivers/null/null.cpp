@@ -0,0 +1,139 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief the null driver: a port without any video, sound or input, for the programs which run the emulator on their own
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "../../types.h"
+#include "../../driver.h"
+#include "../../emufile.h"
+#include "../../file.h"
+
+bool turbo = false;
+int closeFinishedMovie = 0;
+
+static uint8 palette[256][3];
+
+/* Everything the emulator has to say goes to stderr, so that stdout is just
+   the results. */
+void FCEUD_Message(const char *text)
+{
+	fputs(text, stderr);
+}
+
+void FCEUD_PrintError(const char *errormsg)
+{
+	fprintf(stderr, "%s\n", errormsg);
+}
+
+FILE *FCEUD_UTF8fopen(const char *fn, const char *mode)
+{
+	return fopen(fn, mode);
+}
+
+EMUFILE_FILE* FCEUD_UTF8_fstream(const char *fn, const char *m)
+{
+	std::string mode = m;
+	if(mode.find('b') == std::string::npos)
+		mode += "b";
+	return new EMUFILE_FILE(fn, mode.c_str());
+}
+
+FCEUFILE* FCEUD_OpenArchiveIndex(ArchiveScanRecord& asr, std::string &fname, int innerIndex) { return 0; }
+FCEUFILE* FCEUD_OpenArchive(ArchiveScanRecord& asr, std::string& fname, std::string* innerFilename) { return 0; }
+ArchiveScanRecord FCEUD_ScanArchive(std::string fname) { return ArchiveScanRecord(); }
+
+void FCEUD_SetPalette(uint8 index, uint8 r, uint8 g, uint8 b)
+{
+	palette[index][0] = r;
+	palette[index][1] = g;
+	palette[index][2] = b;
+}
+
+void FCEUD_GetPalette(uint8 index, uint8 *r, uint8 *g, uint8 *b)
+{
+	*r = palette[index][0];
+	*g = palette[index][1];
+	*b = palette[index][2];
+}
+
+uint64 FCEUD_GetTime()
+{
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return (uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+uint64 FCEUD_GetTimeFreq(void) { return 1000000; }
+
+unsigned int *GetKeyboard(void)
+{
+	static unsigned int keys[256];
+	return keys;
+}
+
+void GetMouseData(uint32 (&d)[3])
+{
+	d[0] = d[1] = d[2] = 0;
+}
+
+const char *FCEUD_GetCompilerString()
+{
+#ifdef __GNUC__
+	return "g++ " __VERSION__;
+#else
+	return "unknown";
+#endif
+}
+
+int FCEUD_SendData(void *data, uint32 len) { return 0; }
+int FCEUD_RecvData(void *data, uint32 len) { return 0; }
+void FCEUD_NetworkClose(void) { }
+void FCEUD_NetplayText(uint8 *text) { }
+void FCEUD_SoundVolumeAdjust(int) { }
+void FCEUD_SoundToggle(void) { }
+void FCEUD_SetInput(bool fourscore, bool microphone, ESI port0, ESI port1, ESIFC fcexp) { }
+bool FCEUD_ShouldDrawInputAids() { return false; }
+void FCEUI_UseInputPreset(int preset) { }
+void FCEUI_AviVideoUpdate(const unsigned char* buffer) { }
+bool FCEUI_AviIsRecording(void) { return false; }
+bool FCEUI_AviEnableHUDrecording() { return false; }
+bool FCEUI_AviDisableMovieMessages() { return false; }
+void FCEUD_AviRecordTo(void) { }
+void FCEUD_AviStop(void) { }
+void FCEUD_SetEmulationSpeed(int cmd) { }
+bool FCEUD_PauseAfterPlayback() { return false; }
+void FCEUD_HideMenuToggle(void) { }
+void FCEUD_LoadStateFrom(void) { }
+void FCEUD_SaveStateAs(void) { }
+void FCEUD_MovieRecordTo(void) { }
+void FCEUD_MovieReplayFrom(void) { }
+int FCEUD_ShowStatusIcon(void) { return 0; }
+void FCEUD_ToggleStatusIcon(void) { }
+void FCEUD_TurboOn(void) { }
+void FCEUD_TurboOff(void) { }
+void FCEUD_TurboToggle(void) { }
+void FCEUD_VideoChanged() { }
+void FCEUD_DebugBreakpoint() { }
+void FCEUD_TraceInstruction() { }
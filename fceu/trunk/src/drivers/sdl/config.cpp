@@ -143,6 +143,8 @@ InitConfig()
 	config->addOption('g', "gamegenie", "SDL.GameGenie", 0);
 	config->addOption("pal", "SDL.PAL", 0);
 	config->addOption("frameskip", "SDL.Frameskip", 0);
+	config->addOption("runahead", "SDL.RunAhead", 0);
+	config->addOption("cpucore", "SDL.CPUCore", 0);
 	config->addOption("clipsides", "SDL.ClipSides", 0);
 	config->addOption("nospritelim", "SDL.DisableSpriteLimit", 1);
 
@@ -175,6 +177,7 @@ InitConfig()
 	config->addOption("noframe", "SDL.NoFrame", 0);
 	config->addOption("special", "SDL.SpecialFilter", 0);
 	config->addOption("showfps", "SDL.ShowFPS", 0);
+	config->addOption("perfstats", "SDL.ShowPerfStats", 0);
 
 	// OpenGL options
 	config->addOption("opengl", "SDL.OpenGL", 0);
@@ -211,6 +214,9 @@ InitConfig()
 	config->addOption("pauseframe", "SDL.PauseFrame", 0);
 	config->addOption("recordhud", "SDL.RecordHUD", 1);
 	config->addOption("moviemsg", "SDL.MovieMsg", 1);
+	// record a state hash track in new movies, and quit at the first desync from one
+	config->addOption("moviehashes", "SDL.MovieStateHashes", 0);
+	config->addOption("stopondesync", "SDL.StopOnDesync", 0);
     
 	// overwrite the config file?
 	config->addOption("no-config", "SDL.NoConfig", 0);
@@ -258,6 +264,35 @@ InitConfig()
     
 	// fm2 -> srt conversion
 	config->addOption("ripsubs", "SDL.RipSubs", "");
+
+	// binary cpu trace capture, and trace -> text conversion
+	config->addOption("tracelog", "SDL.TraceLog", "");
+	config->addOption("decodetrace", "SDL.DecodeTrace", "");
+
+	// code/data logger
+	config->addOption("cdl", "SDL.CDLFile", "");
+	config->addOption("cdlautosave", "SDL.CDLAutoSave", 600);
+
+	// per-frame savestate history, which lua scripts can rewind through
+	config->addOption("statehistory", "SDL.StateHistory", 0);
+	config->addOption("statehistorybudget", "SDL.StateHistoryBudget", 65536);
+
+	// the codec savestate files are compressed with: 0 zlib, 1 lz
+	config->addOption("statecodec", "SDL.StateCodec", 0);
+
+	// ROM database, which loading a game consults and --scan-library adds to
+	config->addOption("romdb", "SDL.RomDatabase", dir + "/romdb.dat");
+	config->addOption("scan-library", "SDL.ScanLibrary", "");
+
+	// headless rendering of NSF tracks to WAV files
+	config->addOption("nsf-render", "SDL.NSFRender", "");
+	config->addOption("nsf-jobs", "SDL.NSFJobs", 0);
+	config->addOption("nsf-loops", "SDL.NSFLoops", 2);
+	config->addOption("nsf-maxlength", "SDL.NSFMaxLength", 600);
+
+	// the built-in benchmark
+	config->addOption("benchmark", "SDL.Benchmark", "");
+	config->addOption("benchmarkframes", "SDL.BenchmarkFrames", 600);
 	
 	// enable new PPU core
 	config->addOption("newppu", "SDL.NewPPU", 0);
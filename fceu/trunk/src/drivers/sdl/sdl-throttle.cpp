@@ -3,6 +3,7 @@
 
 #include "sdl.h"
 #include "throttle.h"
+#include "../../perfstats.h"
 
 static const double Slowest = 0.015625; // 1/64x speed (around 1 fps on NTSC)
 static const double Fastest = 32;       // 32x speed   (around 1920 fps on NTSC)
@@ -44,6 +45,7 @@ RefreshThrottleFPS()
 int
 SpeedThrottle()
 {
+	FCEU_PERF_SCOPE(FCEU_PERF_THROTTLE);
 	if(g_fpsScale >= 32)
 	{
 		return 0; /* Done waiting */
@@ -27,6 +27,7 @@
 #include "../../fceu.h"
 #include "../../version.h"
 #include "../../video.h"
+#include "../../perfstats.h"
 
 #include "../../utils/memory.h"
 
@@ -166,7 +167,7 @@ InitVideo(FCEUGI *gi)
 	// XXX soules - const?  is this necessary?
 	const SDL_VideoInfo *vinf;
 	int error, flags = 0;
-	int doublebuf, xstretch, ystretch, xres, yres, show_fps;
+	int doublebuf, xstretch, ystretch, xres, yres, show_fps, show_perfstats;
 
 	FCEUI_printf("Initializing video...");
 
@@ -184,6 +185,7 @@ InitVideo(FCEUGI *gi)
 	g_config->getOption("SDL.ClipSides", &s_clipSides);
 	g_config->getOption("SDL.NoFrame", &noframe);
 	g_config->getOption("SDL.ShowFPS", &show_fps);
+	g_config->getOption("SDL.ShowPerfStats", &show_perfstats);
 
 	// check the starting, ending, and total scan lines
 	FCEUI_GetCurrentVidSystem(&s_srendline, &s_erendline);
@@ -227,6 +229,7 @@ InitVideo(FCEUGI *gi)
 
 	// check to see if we are showing FPS
 	FCEUI_SetShowFPS(show_fps);
+	FCEUI_SetShowPerfStats(show_perfstats);
     
 	// check if we are rendering fullscreen
 	if(s_fullscreen) {
@@ -612,6 +615,7 @@ void UnlockConsole(){}
 void
 BlitScreen(uint8 *XBuf)
 {
+	FCEU_PERF_SCOPE(FCEU_PERF_BLIT);
 	SDL_Surface *TmpScreen;
 	uint8 *dest;
 	int xo = 0, yo = 0;
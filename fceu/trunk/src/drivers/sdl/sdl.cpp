@@ -6,6 +6,12 @@
 #include "../../fceu.h"
 #include "../../movie.h"
 #include "../../version.h"
+#include "../../trace.h"
+#include "../../cdl.h"
+#include "../../statehistory.h"
+#include "../../state.h"
+#include "../../romdb.h"
+#include "../common/benchmark.h"
 #ifdef _S9XLUA_H
 #include "../../fceulua.h"
 #endif
@@ -45,6 +51,9 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/stat.h>
+#ifndef WIN32
+#include <sys/wait.h>
+#endif
 #include <iostream>
 #include <fstream>
 
@@ -71,6 +80,7 @@ int gametype = 0;
 int mutecapture;
 #endif
 static int noconfig;
+static std::string cdlFile;
 
 // -Video Modes Tag- : See --special
 static const char *DriverUsage=
@@ -88,6 +98,10 @@ static const char *DriverUsage=
 "                          4player\n"
 "--gamegenie    {0|1}   Enable emulated Game Genie.\n"
 "--frameskip    x       Set # of frames to skip per emulated frame.\n"
+"--runahead    {0-8}    Show each frame as it will be x frames later, which\n"
+"                         takes away up to x frames of the game's input lag.\n"
+"--cpucore      {0|1|2} Run the CPU through the interpreter, the recompiler,\n"
+"                         or both, comparing them each frame.\n"
 "--xres         x       Set horizontal resolution for full screen mode.\n"
 "--yres         x       Set vertical resolution for full screen mode.\n"
 "--autoscale    {0|1}   Enable autoscaling in fullscreen. \n"
@@ -103,6 +117,9 @@ static const char *DriverUsage=
 "                         (1 = hq2x 2 = Scale2x 3 = NTSC 2x 4 = hq3x\n"
 "                         5 = Scale3x)\n"
 "--palette      f       Load custom global palette from file f.\n"
+"--perfstats    {0|1}   Show the share of each frame's time taken by the CPU,\n"
+"                         PPU, APU, mapper, Lua, blitting and throttling\n"
+"                         (builds with PERFSTATS=1 only).\n"
 "--sound        {0|1}   Enable sound.\n"
 "--soundrate    x       Set sound playback rate to x Hz.\n"
 "--soundq      {0|1|2}  Set sound quality. (0 = Low 1 = High 2 = Very High)\n"
@@ -111,9 +128,34 @@ static const char *DriverUsage=
 "--soundrecord  f       Record sound to file f.\n"
 "--playmov      f       Play back a recorded FCM/FM2/FM3 movie from filename f.\n"
 "--pauseframe   x       Pause movie playback at frame x.\n"
+"--moviehashes  x       Record a hash of the state every x frames in new\n"
+"                         movies, for playback to find desyncs (0 = none).\n"
+"--stopondesync {0|1}   Quit with status 1 when a movie being played back\n"
+"                         desyncs from its state hashes.\n"
 "--fcmconvert   f       Convert fcm movie file f to fm2.\n"
 "--ripsubs      f       Convert movie's subtitles to srt\n"
 "--subtitles    {0|1}   Enable subtitle display\n"
+"--tracelog     f       Capture a binary CPU trace of the loaded game to f.\n"
+"--decodetrace  f       Convert binary CPU trace f to text (f.txt).\n"
+"--cdl          f       Run the Code/Data Logger, merging into cdl file f.\n"
+"--cdlautosave  x       Write new Code/Data Logger results to f every x frames.\n"
+"--statehistory x      Keep a savestate of each of the last x frames (and\n"
+"                         fewer of older ones) for lua's savestate.rewind.\n"
+"--statehistorybudget x Use at most x KB for the state history.\n"
+"--statecodec   {0|1}   Compress savestate files with zlib (0) or the faster\n"
+"                         lz codec (1).\n"
+"--scan-library d       Identify every ROM under directory d and add them to\n"
+"                         the ROM database.\n"
+"--romdb        f       Use ROM database f (default ~/.fceux/romdb.dat).\n"
+"--nsf-render   d       Render every track of the NSF to a WAV file in\n"
+"                         directory d, without video.\n"
+"--nsf-jobs     x       Render the NSF's tracks in x processes at once\n"
+"                         (0 = one per CPU).\n"
+"--nsf-loops    x       Play looping tracks x times before fading out.\n"
+"--nsf-maxlength x      Make no rendered track longer than x seconds.\n"
+"--benchmark    f       Run the built-in benchmark and write the results to f\n"
+"                         as JSON.\n"
+"--benchmarkframes x    Run each benchmark configuration for x frames.\n"
 "--fourscore    {0|1}   Enable fourscore emulation\n"
 "--no-config    {0|1}   Use default config file and do not save\n"
 "--net          s       Connect to server 's' for TCP/IP network play.\n"
@@ -227,6 +269,24 @@ int LoadGame(const char *path)
 	}
 	isloaded = 1;
 
+	// continue the code/data log of any earlier runs
+	if(cdlFile.size()) {
+		int interval;
+		g_config->getOption("SDL.CDLAutoSave", &interval);
+		FCEU_CDLInit();
+		FILE *existing = fopen(cdlFile.c_str(), "rb");
+		if(existing)
+			fclose(existing);
+		// a file which is there but won't load is left alone rather than written over
+		if(existing && !FCEUI_CDLLoad(cdlFile.c_str()))
+			FCEUD_PrintError("The code/data log file doesn't match this game; not logging.");
+		else
+		{
+			FCEUI_CDLSetAutoSave(cdlFile.c_str(), interval);
+			FCEUI_CDLStart();
+		}
+	}
+
 	FCEUD_NetworkConnect();
 	return 1;
 }
@@ -264,8 +324,112 @@ CloseGame()
 	return(1);
 }
 
+/**
+ * Renders the tracks first+1, first+1+step, ... of the loaded NSF to
+ * "dir/base - NN.wav".  Returns the number of tracks which failed.
+ */
+static int RenderNSFTracks(const std::string &base, const std::string &dir, int first, int step)
+{
+	int tracks, loops, maxlength, rate;
+	uint8 name[33], artist[33], copyright[33];
+	tracks = FCEUI_NSFGetInfo(name, artist, copyright, 32);
+	g_config->getOption("SDL.NSFLoops", &loops);
+	g_config->getOption("SDL.NSFMaxLength", &maxlength);
+	g_config->getOption("SDL.Sound.Rate", &rate);
+
+	int failed = 0;
+	for(int track = first + 1; track <= tracks; track += step) {
+		char suffix[32];
+		sprintf(suffix, " - %02d.wav", track);
+		std::string fname = dir + "/" + base + suffix;
+		int samples = FCEUI_NSFRender(track, fname.c_str(), loops, maxlength);
+		if(samples < 0) {
+			FCEUD_PrintError(("Couldn't render " + fname).c_str());
+			failed++;
+		} else {
+			int seconds = samples / rate;
+			printf("%s\t%d:%02d\n", fname.c_str(), seconds / 60, seconds % 60);
+		}
+		fflush(stdout);
+	}
+	return failed;
+}
+
+/**
+ * Renders every track of the NSF at path to a WAV file in dir, as fast as
+ * the tracks can be emulated.  The tracks are shared out over worker
+ * processes, which are forked with the NSF already loaded.
+ */
+static bool RenderNSF(const char *path, const std::string &dir)
+{
+	int rate, quality, volume, jobs;
+	g_config->getOption("SDL.Sound.Rate", &rate);
+	g_config->getOption("SDL.Sound.Quality", &quality);
+	g_config->getOption("SDL.Sound.Volume", &volume);
+	g_config->getOption("SDL.NSFJobs", &jobs);
+	FCEUI_SetSoundVolume(volume);
+	FCEUI_SetSoundQuality(quality);
+	FCEUI_Sound(rate);
+
+	FCEUGI *gi = FCEUI_LoadGame(path, 1);
+	if(!gi) {
+		return false;
+	}
+	if(gi->type != GIT_NSF) {
+		FCEUD_PrintError("--nsf-render needs an NSF file.");
+		FCEUI_CloseGame();
+		return false;
+	}
+
+	// the files are named after the NSF's file
+	std::string base = path;
+	size_t slash = base.find_last_of("/\\");
+	if(slash != std::string::npos)
+		base.erase(0, slash + 1);
+	size_t dot = base.rfind('.');
+	if(dot != std::string::npos && dot > 0)
+		base.erase(dot);
+
+	uint8 name[33], artist[33], copyright[33];
+	int tracks = FCEUI_NSFGetInfo(name, artist, copyright, 32);
+	int failed = 0;
+#ifndef WIN32
+	if(jobs <= 0)
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if(jobs > tracks)
+		jobs = tracks;
+	if(jobs < 1)
+		jobs = 1;
+
+	fflush(stdout);
+	for(int job = 0; job < jobs; job++) {
+		pid_t pid = fork();
+		if(pid == 0) {
+			_exit(RenderNSFTracks(base, dir, job, jobs) ? 1 : 0);
+		}
+		// without a worker, this one's share is rendered here
+		if(pid < 0)
+			failed += RenderNSFTracks(base, dir, job, jobs);
+	}
+	int status;
+	while(wait(&status) > 0) {
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed++;
+	}
+#else
+	failed = RenderNSFTracks(base, dir, 0, 1);
+#endif
+
+	FCEUI_CloseGame();
+	return failed == 0;
+}
+
 void FCEUD_Update(uint8 *XBuf, int32 *Buffer, int Count);
 
+//whether to quit at a movie's first desync, and whether it came to that
+static int stopOnDesync = 0;
+static bool desynced = false;
+
 static void DoFun(int frameskip, int periodic_saves)
 {
 	uint8 *gfx;
@@ -288,6 +452,12 @@ static void DoFun(int frameskip, int periodic_saves)
 	FCEUI_Emulate(&gfx, &sound, &ssize, fskipc);
 	FCEUD_Update(gfx, sound, ssize);
 
+	if(stopOnDesync && FCEUI_GetMovieDesyncFrame() >= 0) {
+		desynced = true;
+		CloseGame();
+		return;
+	}
+
 	if(opause!=FCEUI_EmulationPaused()) {
 		opause=FCEUI_EmulationPaused();
 		SilenceSound(opause);
@@ -792,6 +962,68 @@ int main(int argc, char *argv[])
 		SDL_Quit();
 		return 0;
 	}
+
+	// check for a binary cpu trace to convert to text
+	g_config->getOption("SDL.DecodeTrace", &s);
+	g_config->setOption("SDL.DecodeTrace", "");
+	if (!s.empty())
+	{
+		std::string outname = s + ".txt";
+		int count = FCEUI_TraceDecode(s.c_str(), outname.c_str());
+		if (count >= 0)
+			printf("%d instructions have been decoded to %s.\n", count, outname.c_str());
+
+		DriverKill();
+		SDL_Quit();
+		return 0;
+	}
+
+	// identify a whole ROM library into the ROM database
+	std::string romdb;
+	g_config->getOption("SDL.RomDatabase", &romdb);
+	g_config->getOption("SDL.ScanLibrary", &s);
+	g_config->setOption("SDL.ScanLibrary", "");
+	if (!s.empty())
+	{
+		std::vector<RomInfo> roms;
+		int count = FCEUI_ScanLibrary(s.c_str(), roms, 0);
+		for (int i = 0; i < count; i++)
+		{
+			char md5[33];
+			for (int j = 0; j < 16; j++)
+				sprintf(md5 + j * 2, "%02x", roms[i].md5[j]);
+			printf("%08x\t%s\t%d\t%s\t%s\n", roms[i].crc32, md5, roms[i].mapper, roms[i].board.c_str(), roms[i].path.c_str());
+		}
+		if (FCEUI_WriteRomDatabase(romdb.c_str(), roms))
+			printf("%d ROMs have been added to %s.\n", count, romdb.c_str());
+
+		DriverKill();
+		SDL_Quit();
+		return 0;
+	}
+	FCEUI_OpenRomDatabase(romdb.c_str());
+
+	// run the benchmark, which brings its own test ROMs
+	g_config->getOption("SDL.Benchmark", &s);
+	g_config->setOption("SDL.Benchmark", "");
+	if (!s.empty())
+	{
+		int frames;
+		bool ok = false;
+		g_config->getOption("SDL.BenchmarkFrames", &frames);
+		FILE *fp = FCEUD_UTF8fopen(s.c_str(), "w");
+		if (!fp)
+			FCEUD_PrintError("Couldn't open the benchmark results file.");
+		else
+		{
+			ok = RunBenchmark(fp, frames);
+			fclose(fp);
+		}
+
+		DriverKill();
+		SDL_Quit();
+		return ok ? 0 : -1;
+	}
    
 
 	// if we're not compiling w/ the gui, exit if a rom isn't specified
@@ -809,6 +1041,18 @@ int main(int argc, char *argv[])
 	// update the emu core
 	UpdateEMUCore(g_config);
 
+	// render every track of an NSF to WAV files, with no video or sound output
+	g_config->getOption("SDL.NSFRender", &s);
+	g_config->setOption("SDL.NSFRender", "");
+	if (!s.empty())
+	{
+		bool rendered = romIndex > 0 && RenderNSF(argv[romIndex], s);
+
+		DriverKill();
+		SDL_Quit();
+		return rendered ? 0 : -1;
+	}
+
 	
 	#ifdef CREATE_AVI
 	g_config->getOption("SDL.VideoLog", &s);
@@ -847,6 +1091,18 @@ int main(int argc, char *argv[])
 	}
 #endif
 
+	g_config->getOption("SDL.CDLFile", &cdlFile);
+	g_config->setOption("SDL.CDLFile", "");
+
+	int historyFrames, historyBudget;
+	g_config->getOption("SDL.StateHistory", &historyFrames);
+	g_config->getOption("SDL.StateHistoryBudget", &historyBudget);
+	FCEUI_SetStateHistory(historyFrames, historyBudget);
+
+	int codec;
+	g_config->getOption("SDL.StateCodec", &codec);
+	savestateCodec = codec == 1 ? FCEUSS_CODEC_LZ : FCEUSS_CODEC_ZLIB;
+
   if(romIndex >= 0)
 	{
 		// load the specified game
@@ -860,7 +1116,22 @@ int main(int argc, char *argv[])
 		g_config->save();
 
 	}
+
+	// start the binary cpu trace, now that there is a game to trace
+	g_config->getOption("SDL.TraceLog", &s);
+	g_config->setOption("SDL.TraceLog", "");
+	if (!s.empty() && GameInfo)
+	{
+		FCEUI_TraceBegin(s.c_str());
+	}
 	
+	// movies recorded from here on get a state hash track
+	{
+		int moviehashes;
+		g_config->getOption("SDL.MovieStateHashes", &moviehashes);
+		FCEUI_SetMovieStateHashInterval(moviehashes);
+	}
+
 	// movie playback
 	g_config->getOption("SDL.Movie", &s);
 	g_config->setOption("SDL.Movie", "");
@@ -908,6 +1179,18 @@ int main(int argc, char *argv[])
 	}
 
 	g_config->getOption("SDL.Frameskip", &frameskip);
+	{
+		int runahead;
+		g_config->getOption("SDL.RunAhead", &runahead);
+		FCEUI_SetRunAhead(runahead);
+	}
+	{
+		int cpucore;
+		g_config->getOption("SDL.CPUCore", &cpucore);
+		if (!FCEUI_SetCPUCore(cpucore))
+			FCEUD_PrintError("This CPU core isn't available in this build.");
+	}
+	g_config->getOption("SDL.StopOnDesync", &stopOnDesync);
 	// loop playing the game
 #ifdef _GTK
 	if(noGui == 0)
@@ -938,7 +1221,7 @@ int main(int argc, char *argv[])
 	// exit the infrastructure
 	FCEUI_Kill();
 	SDL_Quit();
-	return 0;
+	return desynced ? 1 : 0;
 }
 
 /**
@@ -205,41 +205,9 @@ BOOL CALLBACK CDLoggerCallB(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM lPara
 
 bool LoadCDLog(const char* nameo)
 {
-	FILE *FP;
-	int i,j;
-
-	FP = fopen(nameo, "rb");
-	if (FP == NULL)
+	if (!FCEUI_CDLLoad(nameo))
 		return false;
 
-	for(i = 0;i < (int)cdloggerdataSize;i++)
-	{
-		j = fgetc(FP);
-		if (j == EOF)
-			break;
-		if ((j & 1) && !(cdloggerdata[i] & 1))
-			codecount++; //if the new byte has something logged and
-		if ((j & 2) && !(cdloggerdata[i] & 2))
-			datacount++; //and the old one doesn't. Then increment
-		if ((j & 3) && !(cdloggerdata[i] & 3))
-			undefinedcount--; //the appropriate counter.
-		cdloggerdata[i] |= j;
-	}
-
-	if(cdloggerVideoDataSize != 0)
-	{
-		for(i = 0;i < (int)cdloggerVideoDataSize;i++)
-		{
-			j = fgetc(FP);
-			if(j == EOF)break;
-			if((j & 1) && !(cdloggervdata[i] & 1))rendercount++; //if the new byte has something logged and
-			if((j & 2) && !(cdloggervdata[i] & 2))vromreadcount++; //if the new byte has something logged and
-			if((j & 3) && !(cdloggervdata[i] & 3))undefinedvromcount--; //the appropriate counter.
-			cdloggervdata[i] |= j;
-		}
-	}
-
-	fclose(FP);
 	RenameCDLog(nameo);
 	UpdateCDLogger();
 	return true;
@@ -306,17 +274,8 @@ void SaveCDLogFile()
 		RenameCDLog(nameo);
 	}
 
-	FILE *FP;
-	FP = fopen(loadedcdfile, "wb");
-	if (FP == NULL)
-	{
+	if (!FCEUI_CDLSave(loadedcdfile))
 		FCEUD_PrintError("Error Saving File");
-		return;
-	}
-	fwrite(cdloggerdata, cdloggerdataSize, 1, FP);
-	if(cdloggerVideoDataSize != 0)
-		fwrite(cdloggervdata, cdloggerVideoDataSize, 1, FP);
-	fclose(FP);
 }
 
 // returns false if refused to start
@@ -551,41 +510,17 @@ void StartCDLogging()
 
 void FreeCDLog()
 {
-	if (cdloggerdata)
-	{
-		free(cdloggerdata);
-		cdloggerdata = 0;
-		cdloggerdataSize = 0;
-	}
-	if (cdloggervdata)
-	{
-		free(cdloggervdata);
-		cdloggervdata = 0;
-		cdloggerVideoDataSize = 0;
-	}
+	FCEU_CDLFree();
 }
 
 void InitCDLog()
 {
-	cdloggerdataSize = PRGsize[0];
-	cdloggerdata = (unsigned char*)malloc(cdloggerdataSize);
-	if(!CHRram[0] || (CHRptr[0] == PRGptr[0])) {	// Some kind of workaround for my OneBus VRAM hack, will remove it if I find another solution for that
-		cdloggerVideoDataSize = CHRsize[0];
-		cdloggervdata = (unsigned char*)malloc(cdloggerVideoDataSize);
-	} else
-		cdloggerVideoDataSize = 0;
+	FCEU_CDLInit();
 }
 
 void ResetCDLog()
 {
-	codecount = datacount = rendercount = vromreadcount = 0;
-	undefinedcount = cdloggerdataSize;
-	ZeroMemory(cdloggerdata, cdloggerdataSize);
-	if(cdloggerVideoDataSize != 0)
-	{
-		undefinedvromcount = cdloggerVideoDataSize;
-		ZeroMemory(cdloggervdata, cdloggerVideoDataSize);
-	}
+	FCEU_CDLReset();
 }
 
 void RenameCDLog(const char* newName)
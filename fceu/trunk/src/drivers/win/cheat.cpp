@@ -413,7 +413,7 @@ BOOL CALLBACK CheatConsoleCallB(HWND hwndDlg, UINT uMsg, WPARAM wParam, LPARAM l
 						break;
 						case CHEAT_CONTEXT_POKECHEATVALUE:
 							FCEUI_GetCheat(selcheat,&name,&a,&v,NULL,&s,NULL);
-							BWrite[a](a,v);
+							FCEU_CPUWrite(a,v);
 						break;
 						case CHEAT_CONTEXT_GOTOINHEXEDITOR:
 							DoMemView();
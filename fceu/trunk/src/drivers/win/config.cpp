@@ -440,6 +440,7 @@ static CFGSTRUCT fceuconfig[] =
 
 	AC(backupSavestates),
 	AC(compressSavestates),
+	AC(savestateCodec),
 	AC(pauseWhileActive),
 	AC(enableHUDrecording),
 	AC(disableMovieMessages),
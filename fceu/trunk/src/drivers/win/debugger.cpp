@@ -55,7 +55,6 @@ extern bool DebuggerWasUpdated;
 
 int childwnd;
 
-extern readfunc ARead[0x10000];
 int DbgPosX,DbgPosY;
 int DbgSizeX=-1,DbgSizeY=-1;
 int WP_edit=-1;
@@ -965,7 +965,7 @@ void InputData(char *input){
 		if (EditingMode == MODE_NES_MEMORY)
 		{
 			// RAM (system bus)
-			BWrite[addr](addr,data[i]);
+			FCEU_CPUWrite(addr,data[i]);
 		} else if (EditingMode == MODE_NES_PPU)
 		{
 			// PPU
@@ -1002,7 +1002,7 @@ if(input > 0xF)return;
 if(TempData != -1){
 addr = CursorStartAddy;
 data = input|(TempData<<4);
-if(EditingMode == MODE_NES_MEMORY)BWrite[addr](addr,data);
+if(EditingMode == MODE_NES_MEMORY)FCEU_CPUWrite(addr,data);
 if(EditingMode == MODE_NES_PPU){
 addr &= 0x3FFF;
 if(addr < 0x2000)VPage[addr>>10][addr] = data; //todo: detect if this is vrom and turn it red if so
@@ -1021,7 +1021,7 @@ if(i == 256)return;
 
 addr = CursorStartAddy;
 data = i;
-if(EditingMode == MODE_NES_MEMORY)BWrite[addr](addr,data);
+if(EditingMode == MODE_NES_MEMORY)FCEU_CPUWrite(addr,data);
 if(EditingMode == MODE_NES_FILE)ApplyPatch(addr,1,(uint8 *)&data);
 CursorStartAddy++;
 }
@@ -116,7 +116,7 @@ void GREENZONE::collectCurrentState()
 	if (!savestates[currFrameCounter].size())
 	{
 		EMUFILE_MEMORY ms(&savestates[currFrameCounter]);
-		FCEUSS_SaveMS(&ms, Z_DEFAULT_COMPRESSION);
+		FCEUSS_SaveMS(&ms, Z_DEFAULT_COMPRESSION, FCEUSS_CODEC_LZ);
 		ms.trim();
 	}
 	if (greenzoneSize <= currFrameCounter)
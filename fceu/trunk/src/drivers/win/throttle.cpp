@@ -20,6 +20,7 @@
 
 #include "../../types.h"
 #include "../../fceu.h"
+#include "../../perfstats.h"
 #include "windows.h"
 #include "driver.h"
 
@@ -69,6 +70,7 @@ void InitSpeedThrottle(void)
 
 int SpeedThrottle(void)
 {
+ FCEU_PERF_SCOPE(FCEU_PERF_THROTTLE);
  static uint64 ttime,ltime;
 
  waiter:
@@ -23,6 +23,7 @@
 #include "gui.h"
 #include "../../fceu.h"
 #include "../../video.h"
+#include "../../perfstats.h"
 #include "input.h"
 #include "mapinput.h"
 #include <math.h>
@@ -566,6 +567,7 @@ static void FCEUD_VerticalSync()
 //static uint8 *XBSave;
 void FCEUD_BlitScreen(uint8 *XBuf)
 {
+	FCEU_PERF_SCOPE(FCEU_PERF_BLIT);
 	xbsave = XBuf;
 
 	if(fullscreen)
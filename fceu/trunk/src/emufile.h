@@ -261,6 +261,78 @@ public:
 	virtual int size() { return (int)len; }
 };
 
+//a read-only EMUFILE over memory owned by someone else (a mapped file, for instance). nothing is copied
+class EMUFILE_MEMORY_VIEW : public EMUFILE {
+protected:
+	const u8* data;
+	s32 pos, len;
+
+public:
+
+	EMUFILE_MEMORY_VIEW(const void* buf, s32 size) : data((const u8*)buf), pos(0), len(size) { }
+
+	virtual EMUFILE* memwrap() { return this; }
+
+	virtual FILE *get_fp() { return NULL; }
+
+	virtual int fprintf(const char *format, ...) {
+		failbit = true;
+		return 0;
+	}
+
+	virtual int fgetc() {
+		if(pos >= len) {
+			failbit = true;
+			return -1;
+		}
+		return data[pos++];
+	}
+	virtual int fputc(int c) {
+		failbit = true;
+		return EOF;
+	}
+
+	virtual size_t _fread(const void *ptr, size_t bytes) {
+		u32 remain = len-pos;
+		u32 todo = std::min<u32>(remain,(u32)bytes);
+		memcpy((void*)ptr,data+pos,todo);
+		pos += todo;
+		if(todo<bytes)
+			failbit = true;
+		return todo;
+	}
+
+	virtual void fwrite(const void *ptr, size_t bytes) {
+		failbit = true;
+	}
+
+	virtual int fseek(int offset, int origin) {
+		switch(origin) {
+			case SEEK_SET:
+				pos = offset;
+				break;
+			case SEEK_CUR:
+				pos += offset;
+				break;
+			case SEEK_END:
+				pos = len+offset;
+				break;
+			default:
+				assert(false);
+		}
+		pos = std::max(0,std::min(pos,len));
+		return 0;
+	}
+
+	virtual int ftell() { return pos; }
+	virtual int size() { return (int)len; }
+	virtual void fflush() {}
+
+	virtual void truncate(s32 length) {
+		failbit = true;
+	}
+};
+
 class EMUFILE_FILE : public EMUFILE {
 protected:
 	FILE* fp;
@@ -42,7 +42,15 @@
 #include "input.h"
 #include "file.h"
 #include "vsuni.h"
+#include "trace.h"
+#include "saveio.h"
+#include "cdl.h"
+#include "statehistory.h"
+#include "perfstats.h"
 #include "ines.h"
+#include "debug.h"
+#include "emufile.h"
+#include "x6502jit.h"
 #ifdef WIN32
 #include "drivers/win/pref.h"
 #include "utils/xstring.h"
@@ -86,6 +94,7 @@ extern void RefreshThrottleFPS();
 #include <cstdlib>
 #include <cstdarg>
 #include <ctime>
+#include <algorithm>
 
 using namespace std;
 
@@ -96,6 +105,7 @@ bool AutoSS = false;        //Flagged true when the first auto-savestate is made
 bool movieSubtitles = true; //Toggle for displaying movie subtitles
 bool DebuggerWasUpdated = false; //To prevent the debugger from updating things without being updated.
 bool AutoResumePlay = false;
+bool useGameFiles = true;
 char romNameWhenClosingEmulator[2048] = {0};
 
 FCEUGI::FCEUGI()
@@ -148,7 +158,7 @@ static void FCEU_CloseGame(void)
 {
 	if (GameInfo)
 	{
-		if (AutoResumePlay)
+		if (AutoResumePlay && useGameFiles)
 		{
 			// save "-resume" savestate
 			FCEUSS_Save(FCEU_MakeFName(FCEUMKF_RESUMESTATE, 0, 0).c_str(), false);
@@ -165,17 +175,24 @@ static void FCEU_CloseGame(void)
 			FCEUD_NetworkClose();
 		}
 
+		FCEUI_TraceEnd();
+		FCEU_CDLGameClosed();
+		FCEU_StateHistoryGameClosed();
+
 		if (GameInfo->name) {
 			free(GameInfo->name);
 			GameInfo->name = NULL;
 		}
 
 		if (GameInfo->type != GIT_NSF) {
-			FCEU_FlushGameCheats(0, 0);
+			FCEU_FlushGameCheats(0, useGameFiles ? 0 : 1);
 		}
 
 		GameInterface(GI_CLOSE);
 
+		//the resume state and the battery ram are on disk before the game is gone
+		FCEU_SaveIOFlush();
+
 		FCEUI_StopMovie();
 
 		ResetExState(0, 0);
@@ -212,8 +229,8 @@ FCEUGI *GameInfo = NULL;
 void (*GameInterface)(GI h);
 void (*GameStateRestore)(int version);
 
-readfunc ARead[0x10000];
-writefunc BWrite[0x10000];
+FCEU_ReadPage ReadMap[0x100];
+FCEU_WritePage WriteMap[0x100];
 static readfunc *AReadG;
 static writefunc *BWriteG;
 static int RWWrap = 0;
@@ -249,6 +266,95 @@ static DECLFR(ANull) {
 	return(X.DB);
 }
 
+static DECLFR(ARAML);
+static DECLFR(ARAMH);
+static DECLFW(BRAML);
+static DECLFW(BRAMH);
+
+//a page with handlers per byte calls through these
+static DECLFR(APageBytes) {
+	return ReadMap[A >> 8].bytes[A & 0xFF](A);
+}
+
+static DECLFW(BPageBytes) {
+	WriteMap[A >> 8].bytes[A & 0xFF](A, V);
+}
+
+//the memory a page reads from, when all its handler does is read memory
+static uint8* DirectPage(int page, readfunc handler) {
+	uint32 A = page << 8;
+	if (handler == ARAML || handler == ARAMH)
+		return RAM ? RAM + (A & 0x7FF) : NULL;
+	if ((handler == CartBR || handler == CartBROB) && Page[A >> 11])
+		return Page[A >> 11] + A;
+	return NULL;
+}
+
+static void UpdateReadPage(int page) {
+	FCEU_ReadPage &p = ReadMap[page];
+	if (p.bytes) {
+		p.func = APageBytes;
+		p.direct = NULL;
+	} else {
+		p.func = p.handler;
+		p.direct = DirectPage(page, p.handler);
+	}
+	X6502_ForgetIdleLoop();
+}
+
+void FCEU_UpdateCartReadPages(int bank, int count) {
+	for (int page = bank << 3; page < (bank + count) << 3; page++)
+		if (!ReadMap[page].bytes)
+			ReadMap[page].direct = DirectPage(page, ReadMap[page].handler);
+	X6502_ForgetIdleLoop();
+}
+
+//sets the handlers of [start,end] in a page map: whole pages just get the handler, pages which are only partly
+//covered get a handler per byte, until they are all the same again
+template<typename FUNC, typename PAGE>
+static void MapHandlers(PAGE *map, int32 start, int32 end, FUNC func, void (*update)(int)) {
+	for (int page = start >> 8; page <= (end >> 8); page++) {
+		PAGE &p = map[page];
+		int lo = std::max<int>(start, page << 8) & 0xFF;
+		int hi = std::min<int>(end, (page << 8) | 0xFF) & 0xFF;
+		if (lo == 0 && hi == 0xFF) {
+			FCEU_gfree(p.bytes);
+			p.bytes = NULL;
+			p.handler = func;
+		} else {
+			if (!p.bytes) {
+				p.bytes = (FUNC*)FCEU_gmalloc(0x100 * sizeof(FUNC));
+				for (int x = 0; x < 0x100; x++)
+					p.bytes[x] = p.handler;
+			}
+			for (int x = lo; x <= hi; x++)
+				p.bytes[x] = func;
+			int x = 1;
+			while (x < 0x100 && p.bytes[x] == p.bytes[0])
+				x++;
+			if (x == 0x100) {
+				p.handler = p.bytes[0];
+				FCEU_gfree(p.bytes);
+				p.bytes = NULL;
+			}
+		}
+		update(page);
+	}
+}
+
+//the RAM a page writes to, when all its handler does is write RAM (and tell lua of it)
+static uint8* DirectWritePage(int page, writefunc handler) {
+	if (handler == BRAML || handler == BRAMH)
+		return RAM ? RAM + ((page << 8) & 0x7FF) : NULL;
+	return NULL;
+}
+
+static void UpdateWritePage(int page) {
+	FCEU_WritePage &p = WriteMap[page];
+	p.func = p.bytes ? BPageBytes : p.handler;
+	p.direct = p.bytes ? NULL : DirectWritePage(page, p.handler);
+}
+
 int AllocGenieRW(void) {
 	if (!(AReadG = (readfunc*)FCEU_malloc(0x8000 * sizeof(readfunc))))
 		return 0;
@@ -259,26 +365,33 @@ int AllocGenieRW(void) {
 }
 
 void FlushGenieRW(void) {
-	int32 x;
+	int32 x, y;
 
 	if (RWWrap) {
-		for (x = 0; x < 0x8000; x++) {
-			ARead[x + 0x8000] = AReadG[x];
-			BWrite[x + 0x8000] = BWriteG[x];
+		RWWrap = 0;
+		//in runs of the same handler, so the pages don't go through handlers per byte to get there
+		for (x = 0; x < 0x8000; x = y) {
+			for (y = x + 1; y < 0x8000 && AReadG[y] == AReadG[x]; y++) ;
+			SetReadHandler(x + 0x8000, y - 1 + 0x8000, AReadG[x]);
+		}
+		for (x = 0; x < 0x8000; x = y) {
+			for (y = x + 1; y < 0x8000 && BWriteG[y] == BWriteG[x]; y++) ;
+			SetWriteHandler(x + 0x8000, y - 1 + 0x8000, BWriteG[x]);
 		}
 		free(AReadG);
 		free(BWriteG);
 		AReadG = NULL;
 		BWriteG = NULL;
-		RWWrap = 0;
 	}
 }
 
 readfunc GetReadHandler(int32 a) {
 	if (a >= 0x8000 && RWWrap)
 		return AReadG[a - 0x8000];
-	else
-		return ARead[a];
+	else {
+		const FCEU_ReadPage &p = ReadMap[a >> 8];
+		return p.bytes ? p.bytes[a & 0xFF] : p.handler;
+	}
 }
 
 void SetReadHandler(int32 start, int32 end, readfunc func) {
@@ -287,23 +400,22 @@ void SetReadHandler(int32 start, int32 end, readfunc func) {
 	if (!func)
 		func = ANull;
 
-	if (RWWrap)
-		for (x = end; x >= start; x--) {
-			if (x >= 0x8000)
-				AReadG[x - 0x8000] = func;
-			else
-				ARead[x] = func;
-		}
-	else
-		for (x = end; x >= start; x--)
-			ARead[x] = func;
+	if (RWWrap && end >= 0x8000) {
+		for (x = end; x >= start && x >= 0x8000; x--)
+			AReadG[x - 0x8000] = func;
+		end = 0x7FFF;
+	}
+	if (start <= end)
+		MapHandlers(ReadMap, start, end, func, UpdateReadPage);
 }
 
 writefunc GetWriteHandler(int32 a) {
 	if (RWWrap && a >= 0x8000)
 		return BWriteG[a - 0x8000];
-	else
-		return BWrite[a];
+	else {
+		const FCEU_WritePage &p = WriteMap[a >> 8];
+		return p.bytes ? p.bytes[a & 0xFF] : p.handler;
+	}
 }
 
 void SetWriteHandler(int32 start, int32 end, writefunc func) {
@@ -312,16 +424,13 @@ void SetWriteHandler(int32 start, int32 end, writefunc func) {
 	if (!func)
 		func = BNull;
 
-	if (RWWrap)
-		for (x = end; x >= start; x--) {
-			if (x >= 0x8000)
-				BWriteG[x - 0x8000] = func;
-			else
-				BWrite[x] = func;
-		}
-	else
-		for (x = end; x >= start; x--)
-			BWrite[x] = func;
+	if (RWWrap && end >= 0x8000) {
+		for (x = end; x >= start && x >= 0x8000; x--)
+			BWriteG[x - 0x8000] = func;
+		end = 0x7FFF;
+	}
+	if (start <= end)
+		MapHandlers(WriteMap, start, end, func, UpdateWritePage);
 }
 
 uint8 *RAM;
@@ -390,32 +499,9 @@ int NSFLoad(const char *name, FCEUFILE *fp);
 //char lastLoadedGameName [2048] = {0,}; // hack for movie WRAM clearing on record from poweron
 
 //name should be UTF-8, hopefully, or else there may be trouble
-FCEUGI *FCEUI_LoadGameVirtual(const char *name, int OverwriteVidMode, bool silent)
+//loads the game from fp, which it closes. fullname is what the game is called in the messages
+static FCEUGI *LoadGameFrom(FCEUFILE *fp, const char *fullname, int OverwriteVidMode, bool silent)
 {
-	//----------
-	//attempt to open the files
-	FCEUFILE *fp;
-	char fullname[2048];	// this name contains both archive name and ROM file name
-
-	const char* romextensions[] = { "nes", "fds", 0 };
-	fp = FCEU_fopen(name, 0, "rb", 0, -1, romextensions);
-
-	if (!fp)
-	{
-		if (!silent)
-			FCEU_PrintError("Error opening \"%s\"!", name);
-		return 0;
-	} else if (fp->archiveFilename != "")
-	{
-		strcpy(fullname, fp->archiveFilename.c_str());
-		strcat(fullname, "|");
-		strcat(fullname, fp->filename.c_str());
-	} else
-	{
-		strcpy(fullname, name);
-	}
-
-	//file opened ok. start loading.
 	FCEU_printf("Loading %s...\n\n", fullname);
 	GetFileBase(fp->filename.c_str());
 	ResetGameLoaded();
@@ -509,7 +595,7 @@ FCEUGI *FCEUI_LoadGameVirtual(const char *name, int OverwriteVidMode, bool silen
 	if (GameInfo->type != GIT_NSF)
 		FCEU_LoadGameCheats(0);
 
-	if (AutoResumePlay)
+	if (AutoResumePlay && useGameFiles)
 	{
 		// load "-resume" savestate
 		if (FCEUSS_Load(FCEU_MakeFName(FCEUMKF_RESUMESTATE, 0, 0).c_str(), false))
@@ -530,6 +616,45 @@ FCEUGI *FCEUI_LoadGameVirtual(const char *name, int OverwriteVidMode, bool silen
 	return GameInfo;
 }
 
+FCEUGI *FCEUI_LoadGameVirtual(const char *name, int OverwriteVidMode, bool silent)
+{
+	//----------
+	//attempt to open the files
+	FCEUFILE *fp;
+	char fullname[2048];	// this name contains both archive name and ROM file name
+
+	const char* romextensions[] = { "nes", "fds", 0 };
+	fp = FCEU_fopen(name, 0, "rb", 0, -1, romextensions);
+
+	if (!fp)
+	{
+		if (!silent)
+			FCEU_PrintError("Error opening \"%s\"!", name);
+		return 0;
+	} else if (fp->archiveFilename != "")
+	{
+		strcpy(fullname, fp->archiveFilename.c_str());
+		strcat(fullname, "|");
+		strcat(fullname, fp->filename.c_str());
+	} else
+	{
+		strcpy(fullname, name);
+	}
+
+	return LoadGameFrom(fp, fullname, OverwriteVidMode, silent);
+}
+
+FCEUGI *FCEUI_LoadGameFromMemory(const void *data, int size, const char *name, int OverwriteVidMode, bool silent)
+{
+	FCEUFILE *fp = new FCEUFILE();
+	fp->filename = name;
+	fp->logicalPath = name;
+	fp->fullFilename = name;
+	fp->archiveIndex = -1;
+	fp->SetStream(new EMUFILE_MEMORY((void*)data, size));
+	return LoadGameFrom(fp, name, OverwriteVidMode, silent);
+}
+
 FCEUGI *FCEUI_LoadGame(const char *name, int OverwriteVidMode, bool silent)
 {
 	return FCEUI_LoadGameVirtual(name, OverwriteVidMode, silent);
@@ -571,12 +696,14 @@ bool FCEUI_Initialize() {
 }
 
 void FCEUI_Kill(void) {
+	FCEU_SaveIOKill();
 	#ifdef _S9XLUA_H
 	FCEU_LuaStop();
 	#endif
 	FCEU_KillVirtualVideo();
 	FCEU_KillGenie();
 	FreeBuffers();
+	X6502Jit_Kill();
 }
 
 int rapidAlternator = 0;
@@ -621,6 +748,194 @@ void AutoFire(void) {
 
 void UpdateAutosave(void);
 
+//---------run-ahead
+//most games take a frame or more to show what was pressed. with run-ahead, after each frame the emulation goes on for
+//runAheadFrames more with the same input, the last of which is shown in its place, and then goes back to where it was
+//by loading a state. the frames run ahead are emulated exactly but are otherwise thrown away: they aren't heard,
+//counted or drawn on, and there is no running ahead while a movie, lua, netplay or the debugger follows each frame.
+static int runAheadFrames = 0;
+static EMUFILE_MEMORY runAheadState;
+
+void FCEUI_SetRunAhead(int frames) {
+	runAheadFrames = std::max(0, std::min(frames, 8));
+}
+
+int FCEUI_GetRunAhead() {
+	return runAheadFrames;
+}
+
+//whether a frame can be run again from a state, or ahead and taken back, without anybody noticing
+static bool ReplayPossible() {
+	if (GameInfo->type == GIT_NSF || geniestage == 1)
+		return false;
+	if (!FCEUMOV_Mode(MOVIEMODE_INACTIVE) || FCEUnetplay || debug_loggingCD || FCEU_binaryTracing)
+		return false;
+	//zappers keep where they last saw light outside of savestates
+	if (InputScanlineHooked())
+		return false;
+#ifdef _S9XLUA_H
+	if (FCEU_LuaRunning())
+		return false;
+#endif
+#ifdef FCEUDEF_DEBUGGER
+	if (DebugCycleNeeded())
+		return false;
+#endif
+	return true;
+}
+
+static bool RunAheadPossible() {
+	return runAheadFrames && ReplayPossible();
+}
+
+static void RunAhead() {
+	//neither of these is in savestates
+	int lag = lagFlag;
+	uint64 base = timestampbase;
+
+	runAheadState.set_len(0);
+	if (!FCEUSS_SaveMS(&runAheadState, 0))
+		return;
+
+	FCEU_SoundHold(true);
+	FCEU_frameHidden = true;
+	for (int i = 1; i <= runAheadFrames; i++) {
+		if (geniestage != 1) FCEU_ApplyPeriodicCheats();
+		FCEUPPU_Loop(i < runAheadFrames);
+		timestampbase += timestamp;
+		timestamp = 0;
+		X6502_ForgetIdleLoop();
+	}
+	FCEU_frameHidden = false;
+
+	runAheadState.fseek(0, SEEK_SET);
+	FCEUSS_LoadFP(&runAheadState, SSLOADPARAM_NOBACKUP);
+	FCEU_SoundHold(false);
+	lagFlag = lag;
+	timestampbase = base;
+}
+//-------
+
+//---------cpu cores
+//in lockstep, each frame is first run from the same state by the interpreter and by the recompiler, hidden and
+//unheard as the frames run ahead are, and the states they end in are compared; then it's run for real by the
+//interpreter. a frame they differ in is run by both once more, the CPU's state logged before each block the
+//recompiler ran and each instruction the interpreter ran, and told of with the first block they came out of
+//differently, or with what of the savestates differed first if the CPU never did.
+static int cpuCore = CPUCORE_INTERPRETER;
+static int lockstepMismatches;
+static EMUFILE_MEMORY lockstepBefore, lockstepInterpreter, lockstepRecompiler;
+
+bool FCEUI_SetCPUCore(int core) {
+	if (core < CPUCORE_INTERPRETER || core > CPUCORE_LOCKSTEP)
+		return false;
+	if (core != CPUCORE_INTERPRETER && !X6502Jit_Init())
+		return false;
+	cpuCore = core;
+	lockstepMismatches = 0;
+	X6502_UseRecompiler(core == CPUCORE_RECOMPILER);
+	return true;
+}
+
+int FCEUI_GetCPUCore() {
+	return cpuCore;
+}
+
+int FCEUI_GetLockstepMismatches() {
+	return lockstepMismatches;
+}
+
+static void LockstepRun(bool recompiler, EMUFILE_MEMORY &after, std::vector<X6502Checkpoint> *log = NULL) {
+	lockstepBefore.fseek(0, SEEK_SET);
+	FCEUSS_LoadFP(&lockstepBefore, SSLOADPARAM_NOBACKUP);
+	X6502_ForgetIdleLoop();
+	X6502_UseRecompiler(recompiler);
+	X6502_LogCheckpoints(log);
+	FCEUPPU_Loop(1);
+	X6502_LogCheckpoints(NULL);
+	X6502_UseRecompiler(false);
+	timestampbase += timestamp;
+	timestamp = 0;
+	after.set_len(0);
+	FCEUSS_SaveMS(&after, 0);
+}
+
+static bool SameCheckpoint(const X6502Checkpoint &a, const X6502Checkpoint &b) {
+	return a.timestamp == b.timestamp && a.ram == b.ram && a.PC == b.PC && a.A == b.A && a.X == b.X && a.Y == b.Y
+		&& a.S == b.S && a.P == b.P;
+}
+
+//runs the frame again with both logging, and finds the first checkpoint of the recompiler's the interpreter came
+//through differently: block is where the recompiler's block before it began, instruction how many instructions
+//into the frame it is. the counts are taken from each log's first, as total_instructions isn't in savestates.
+//false if they never differed where both came through
+static bool LockstepLocate(uint32 &block, uint64 &instruction) {
+	std::vector<X6502Checkpoint> interpreter, recompiler;
+	LockstepRun(false, lockstepInterpreter, &interpreter);
+	LockstepRun(true, lockstepRecompiler, &recompiler);
+	if (interpreter.empty() || recompiler.empty())
+		return false;
+
+	uint64 base0 = interpreter[0].instructions, base1 = recompiler[0].instructions;
+	size_t i = 0;
+	for (size_t r = 0; r < recompiler.size(); r++) {
+		uint64 n = recompiler[r].instructions - base1;
+		while (i < interpreter.size() && interpreter[i].instructions - base0 < n)
+			i++;
+		if (i == interpreter.size())
+			break;
+		//an idle loop skipped leaves no checkpoints for the instructions it stands for
+		if (interpreter[i].instructions - base0 != n)
+			continue;
+		if (!SameCheckpoint(interpreter[i], recompiler[r])) {
+			block = r ? recompiler[r - 1].PC : recompiler[r].PC;
+			instruction = n;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void Lockstep() {
+	int lag = lagFlag;
+	uint64 base = timestampbase;
+
+	lockstepBefore.set_len(0);
+	if (!FCEUSS_SaveMS(&lockstepBefore, 0))
+		return;
+
+	FCEU_SoundHold(true);
+	FCEU_frameHidden = true;
+	LockstepRun(false, lockstepInterpreter);
+	LockstepRun(true, lockstepRecompiler);
+	char desc[5];
+	uint32 offset;
+	bool differ = FCEUSS_FirstDifference(lockstepInterpreter, lockstepRecompiler, desc, offset);
+	uint32 block;
+	uint64 instruction;
+	bool located = differ && LockstepLocate(block, instruction);
+	FCEU_frameHidden = false;
+
+	lockstepBefore.fseek(0, SEEK_SET);
+	FCEUSS_LoadFP(&lockstepBefore, SSLOADPARAM_NOBACKUP);
+	X6502_ForgetIdleLoop();
+	FCEU_SoundHold(false);
+	lagFlag = lag;
+	timestampbase = base;
+
+	if (located) {
+		lockstepMismatches++;
+		FCEU_printf("Lockstep: the recompiler differs from the interpreter at frame %d, first after the block at $%04X, %llu instructions into the frame\n",
+			currFrameCounter, block, (unsigned long long)instruction);
+		FCEU_DispMessage("Recompiler mismatch after $%04X", 0, block);
+	} else if (differ) {
+		lockstepMismatches++;
+		FCEU_printf("Lockstep: the recompiler differs from the interpreter at frame %d, first in %s+%u\n", currFrameCounter, desc, offset);
+		FCEU_DispMessage("Recompiler mismatch in %s+%u", 0, desc, offset);
+	}
+}
+//-------
+
 ///Emulates a single frame.
 
 ///Skip may be passed in, if FRAMESKIP is #defined, to cause this to emulate more than one frame
@@ -628,6 +943,9 @@ void FCEUI_Emulate(uint8 **pXBuf, int32 **SoundBuf, int32 *SoundBufSize, int ski
 	//skip initiates frame skip if 1, or frame skip and sound skip if 2
 	int r, ssize;
 
+	FCEU_PerfFrame();
+	FCEU_SaveIOPoll();
+
 	JustFrameAdvanced = false;
 
 	if (frameAdvanceRequested)
@@ -675,6 +993,7 @@ void FCEUI_Emulate(uint8 **pXBuf, int32 **SoundBuf, int32 *SoundBufSize, int ski
 
 	AutoFire();
 	UpdateAutosave();
+	FCEU_CDLFrameAdvance();
 
 #ifdef _S9XLUA_H
 	FCEU_LuaFrameBoundary();
@@ -688,7 +1007,13 @@ void FCEUI_Emulate(uint8 **pXBuf, int32 **SoundBuf, int32 *SoundBufSize, int ski
 #endif
 
 	if (geniestage != 1) FCEU_ApplyPeriodicCheats();
-	r = FCEUPPU_Loop(skip);
+	if (cpuCore == CPUCORE_LOCKSTEP && ReplayPossible())
+		Lockstep();
+	//when running ahead, the frame shown is the last one run ahead, so this one isn't put out
+	bool runAhead = !skip && RunAheadPossible();
+	FCEU_frameHidden = runAhead;
+	r = FCEUPPU_Loop(runAhead ? 1 : skip);
+	FCEU_frameHidden = false;
 
 	if (skip != 2) ssize = FlushEmulateSound();  //If skip = 2 we are skipping sound processing
 
@@ -711,6 +1036,13 @@ void FCEUI_Emulate(uint8 **pXBuf, int32 **SoundBuf, int32 *SoundBufSize, int ski
 
 	timestampbase += timestamp;
 	timestamp = 0;
+	//between frames anything may write memory: lua, cheats, the debugger, loading a state
+	X6502_ForgetIdleLoop();
+
+	if (runAhead) {
+		RunAhead();
+		FCEU_PutImage();
+	}
 
 	*pXBuf = skip ? 0 : XBuf;
 	if (skip == 2) { //If skip = 2, then bypass sound
@@ -740,6 +1072,8 @@ void FCEUI_Emulate(uint8 **pXBuf, int32 **SoundBuf, int32 *SoundBufSize, int ski
 
 	if (movieSubtitles)
 		ProcessSubtitles();
+
+	FCEU_StateHistoryFrameAdvance();
 }
 
 void FCEUI_CloseGame(void) {
@@ -921,6 +1255,10 @@ void FCEUI_SetGameGenie(bool a) {
 	FSettings.GameGenie = a;
 }
 
+void FCEUI_SetGameFiles(bool use) {
+	useGameFiles = use;
+}
+
 //this variable isn't used at all, snap is always name-based
 //void FCEUI_SetSnapName(bool a)
 //{
@@ -8,6 +8,8 @@ extern int newppu;
 void ResetGameLoaded(void);
 
 extern bool AutoResumePlay;
+//see FCEUI_SetGameFiles
+extern bool useGameFiles;
 extern char romNameWhenClosingEmulator[];
 
 #define DECLFR(x) uint8 x (uint32 A)
@@ -55,8 +57,51 @@ extern int EmulationPaused;
 
 uint8 FCEU_ReadRomByte(uint32 i);
 
-extern readfunc ARead[0x10000];
-extern writefunc BWrite[0x10000];
+//---------memory map
+//the CPU address space in 256 byte pages. a page which is plain RAM, or cart PRG read through CartBR, is read
+//straight from memory; any other page goes through its handler. the rare page which needs other handlers for some
+//of its bytes (cheats, boards decoding single registers) gets a handler per byte.
+struct FCEU_ReadPage
+{
+	uint8 *direct;		//the memory the page reads, or NULL
+	readfunc func;		//what reading the page calls when there is no direct pointer
+	readfunc handler;	//the handler of the whole page
+	readfunc *bytes;	//the handler of each byte, or NULL
+};
+
+struct FCEU_WritePage
+{
+	writefunc func;
+	writefunc handler;
+	writefunc *bytes;
+	uint8 *direct;		//the RAM the page writes, when all its handler does besides is tell lua, or NULL
+};
+
+extern FCEU_ReadPage ReadMap[0x100];
+extern FCEU_WritePage WriteMap[0x100];
+
+//access the CPU address space the way the CPU does
+static INLINE uint8 FCEU_CPURead(uint32 A) {
+	const FCEU_ReadPage &p = ReadMap[A >> 8];
+	return p.direct ? p.direct[A & 0xFF] : p.func(A);
+}
+
+//reads the CPU address space without side effects: RAM, and whatever pages are read straight from memory.
+//anything else would have to go through a handler, which may be a register, and reads as 0
+static INLINE uint8 FCEU_CPUPeek(uint32 A) {
+	if (A < 0x2000)
+		return RAM[A & 0x7FF];
+	const uint8 *direct = ReadMap[(A >> 8) & 0xFF].direct;
+	return direct ? direct[A & 0xFF] : 0;
+}
+
+static INLINE void FCEU_CPUWrite(uint32 A, uint8 V) {
+	WriteMap[A >> 8].func(A, V);
+}
+
+//called by the cart when the PRG mapped into `count` 2k banks from `bank` on has changed
+void FCEU_UpdateCartReadPages(int bank, int count);
+//-------
 
 enum GI {
 	GI_RESETM2	=1,
@@ -126,6 +171,8 @@ void FCEU_PutImage(void);
 #ifdef FRAMESKIP
 void FCEU_PutImageDummy(void);
 #endif
+//while set, the frames the PPU finishes aren't put out: nothing is drawn on them, counted or recorded (run-ahead)
+extern bool FCEU_frameHidden;
 
 extern uint8 Exit;
 extern uint8 pale;
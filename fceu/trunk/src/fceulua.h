@@ -28,6 +28,7 @@ enum LuaMemHookType
 	LUAMEMHOOK_COUNT
 };
 void CallRegisteredLuaMemHook(unsigned int address, int size, unsigned int value, LuaMemHookType hookType);
+bool IsLuaMemHookSet(LuaMemHookType hookType);
 
 struct LuaSaveData
 {
@@ -77,9 +78,14 @@ int FCEU_LuaSpeed();
 int FCEU_LuaFrameskip();
 int FCEU_LuaRerecordCountSkip();
 
-void FCEU_LuaGui(uint8 *XBuf);
+void FCEU_LuaGui(uint8 *XBuf, bool capture);
 void FCEU_LuaUpdatePalette();
 
+// The driver draws the gui over its true colour picture itself, rather than the core into XBuf in the palette's colours
+void FCEU_LuaGuiTrueColour(bool enable);
+// The gui for the driver to draw this frame: 256x240 ARGB pixels, and the rectangle of them (inclusive) drawn on
+bool FCEU_LuaGuiOverlay(const uint32 **pixels, int *x1, int *y1, int *x2, int *y2);
+
 struct lua_State* FCEU_GetLuaState();
 char* FCEU_GetLuaScriptName();
 
@@ -693,7 +693,7 @@ int FDSLoad(const char *name, FCEUFILE *fp) {
 		return(0);
 	}
 
-	if (!disableBatteryLoading) {
+	if (!disableBatteryLoading && useGameFiles) {
 		FCEUFILE *tp;
 		char *fn = strdup(FCEU_MakeFName(FCEUMKF_FDS, 0, 0).c_str());
 
@@ -776,7 +776,7 @@ void FDSClose(void) {
 	int x;
 	isFDS = false;
 
-	if (!DiskWritten) return;
+	if (!DiskWritten || !useGameFiles) return;
 
 	const std::string &fn = FCEU_MakeFName(FCEUMKF_FDS, 0, 0);
 	if (!(fp = FCEUD_UTF8fopen(fn.c_str(), "wb"))) {
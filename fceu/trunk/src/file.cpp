@@ -289,7 +289,14 @@ FCEUFILE * FCEU_fopen(const char *path, const char *ipsfn, char *mode, char *ext
 				return 0;
 			}
 
+			//a file starting like a ROM can't be a zip file, and looking for the zip directory at its end is slow
+			uint8 head[4] = {0};
+			fp->fread(head, 4);
+			fp->fseek(0,SEEK_SET);
+			bool rom = !memcmp(head, "NES\x1a", 4) || !memcmp(head, "FDS\x1a", 4) || !memcmp(head, "NESM", 4) || !memcmp(head, "UNIF", 4);
+
 			//try to read a zip file
+			if(!rom)
 			{
 				fceufp = TryUnzip(fileToOpen);
 				if(fceufp) {
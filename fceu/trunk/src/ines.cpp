@@ -37,6 +37,7 @@
 #include "cheat.h"
 #include "vsuni.h"
 #include "driver.h"
+#include "romdb.h"
 
 #include <cstdio>
 #include <cstdlib>
@@ -241,15 +242,20 @@ static struct BADINF BadROMImages[] =
 	#include "ines-bad.h"
 };
 
-void CheckBad(uint64 md5partial) {
+static const BADINF* FindBad(uint64 md5partial) {
 	int32 x = 0;
 	while (BadROMImages[x].name) {
-		if (BadROMImages[x].md5partial == md5partial) {
-			FCEU_PrintError("The copy game you have loaded, \"%s\", is bad, and will not work properly in FCEUX.", BadROMImages[x].name);
-			return;
-		}
+		if (BadROMImages[x].md5partial == md5partial)
+			return &BadROMImages[x];
 		x++;
 	}
+	return NULL;
+}
+
+void CheckBad(uint64 md5partial) {
+	const BADINF* bad = FindBad(md5partial);
+	if (bad)
+		FCEU_PrintError("The copy game you have loaded, \"%s\", is bad, and will not work properly in FCEUX.", bad->name);
 }
 
 
@@ -274,7 +280,9 @@ static const TMasterRomInfo sMasterRomInfo[] = {
 const TMasterRomInfo* MasterRomInfo;
 TMasterRomInfoParams MasterRomInfoParams;
 
-static void CheckHInfo(void) {
+//works out the corrections to the header from the image's hashes alone, without touching any emulator state.
+//returns the tofix bits
+static int FixHeaderInfo(uint32 crc32, uint64 partialmd5, int &mapper, int &mirroring, bool &battery, bool &hasCHR) {
 	/* ROM images that have the battery-backed bit set in the header that really
 	don't have battery-backed RAM is not that big of a problem, so I'll
 	treat this differently by only listing games that should have battery-backed RAM.
@@ -282,7 +290,7 @@ static void CheckHInfo(void) {
 	Lower 64 bits of the MD5 hash.
 	*/
 
-	static uint64 savie[] =
+	static const uint64 savie[] =
 	{
 		0xc04361e499748382LL,	/* AD&D Heroes of the Lance */
 		0xb72ee2337ced5792LL,	/* AD&D Hillsfar */
@@ -319,63 +327,39 @@ static void CheckHInfo(void) {
 		0						/* Abandon all hope if the game has 0 in the lower 64-bits of its MD5 hash */
 	};
 
-	static struct CHINF moo[] =
+	static const struct CHINF moo[] =
 	{
 		#include "ines-correct.h"
 	};
 	int32 tofix = 0, x;
-	uint64 partialmd5 = 0;
-
-	for (x = 0; x < 8; x++)
-		partialmd5 |= (uint64)iNESCart.MD5[15 - x] << (x * 8);
-	CheckBad(partialmd5);
-
-	MasterRomInfo = NULL;
-	for (int i = 0; i < ARRAY_SIZE(sMasterRomInfo); i++) {
-		const TMasterRomInfo& info = sMasterRomInfo[i];
-		if (info.md5lower != partialmd5)
-			continue;
-
-		MasterRomInfo = &info;
-		if (!info.params) break;
-
-		std::vector<std::string> toks = tokenize_str(info.params, ",");
-		for (int j = 0; j < (int)toks.size(); j++) {
-			std::vector<std::string> parts = tokenize_str(toks[j], "=");
-			MasterRomInfoParams[parts[0]] = parts[1];
-		}
-		break;
-	}
 
 	x = 0;
 	do {
-		if (moo[x].crc32 == iNESGameCRC32) {
+		if (moo[x].crc32 == crc32) {
 			if (moo[x].mapper >= 0) {
-				if (moo[x].mapper & 0x800 && VROM_size) {
-					VROM_size = 0;
-					free(VROM);
-					VROM = NULL;
+				if (moo[x].mapper & 0x800 && hasCHR) {
+					hasCHR = false;
 					tofix |= 8;
 				}
-				if (MapperNo != (moo[x].mapper & 0xFF)) {
+				if (mapper != (moo[x].mapper & 0xFF)) {
 					tofix |= 1;
-					MapperNo = moo[x].mapper & 0xFF;
+					mapper = moo[x].mapper & 0xFF;
 				}
 			}
 			if (moo[x].mirror >= 0) {
 				if (moo[x].mirror == 8) {
-					if (Mirroring == 2) {	/* Anything but hard-wired(four screen). */
+					if (mirroring == 2) {	/* Anything but hard-wired(four screen). */
 						tofix |= 2;
-						Mirroring = 0;
+						mirroring = 0;
 					}
-				} else if (Mirroring != moo[x].mirror) {
-					if (Mirroring != (moo[x].mirror & ~4))
+				} else if (mirroring != moo[x].mirror) {
+					if (mirroring != (moo[x].mirror & ~4))
 						if ((moo[x].mirror & ~4) <= 2)	/* Don't complain if one-screen mirroring
 														needs to be set(the iNES header can't
 														hold this information).
 														*/
 							tofix |= 2;
-					Mirroring = moo[x].mirror;
+					mirroring = moo[x].mirror;
 				}
 			}
 			break;
@@ -386,9 +370,9 @@ static void CheckHInfo(void) {
 	x = 0;
 	while (savie[x] != 0) {
 		if (savie[x] == partialmd5) {
-			if (!(head.ROM_type & 2)) {
+			if (!battery) {
 				tofix |= 4;
-				head.ROM_type |= 2;
+				battery = true;
 			}
 		}
 		x++;
@@ -397,14 +381,75 @@ static void CheckHInfo(void) {
 	/* Games that use these iNES mappers tend to have the four-screen bit set
 	when it should not be.
 	*/
-	if ((MapperNo == 118 || MapperNo == 24 || MapperNo == 26) && (Mirroring == 2)) {
-		Mirroring = 0;
+	if ((mapper == 118 || mapper == 24 || mapper == 26) && (mirroring == 2)) {
+		mirroring = 0;
 		tofix |= 2;
 	}
 
 	/* Four-screen mirroring implicitly set. */
-	if (MapperNo == 99)
-		Mirroring = 2;
+	if (mapper == 99)
+		mirroring = 2;
+
+	return tofix;
+}
+
+static void CheckHInfo(void) {
+	int32 tofix, x;
+	uint64 partialmd5 = 0;
+
+	for (x = 0; x < 8; x++)
+		partialmd5 |= (uint64)iNESCart.MD5[15 - x] << (x * 8);
+
+	int mapper = MapperNo, mirroring = Mirroring;
+	bool battery = (head.ROM_type & 2) != 0, hasCHR = VROM_size != 0;
+
+	//the database has the corrections worked out already for the images it has seen with this same header.
+	//VS games are left to the tables, as the database has them as they are once FCEU_VSUniCheck is done with them
+	RomInfo header, known;
+	header.headerMapper = mapper;
+	header.headerMirroring = mirroring;
+	header.headerBattery = battery;
+	header.headerCHR = hasCHR;
+	if (FCEU_RomDatabaseLookup(iNESGameCRC32, iNESCart.MD5, known, &header) && !known.vsuni) {
+		if (known.bad)
+			CheckBad(partialmd5);
+		tofix = known.fixes;
+		mapper = known.mapper;
+		mirroring = known.mirroring;
+		battery = known.battery;
+		if (tofix & RomInfo::FIX_NOCHR)
+			hasCHR = false;
+	} else {
+		CheckBad(partialmd5);
+		tofix = FixHeaderInfo(iNESGameCRC32, partialmd5, mapper, mirroring, battery, hasCHR);
+	}
+
+	if (!hasCHR && VROM_size) {
+		VROM_size = 0;
+		free(VROM);
+		VROM = NULL;
+	}
+	MapperNo = mapper;
+	Mirroring = mirroring;
+	if (battery)
+		head.ROM_type |= 2;
+
+	MasterRomInfo = NULL;
+	for (int i = 0; i < ARRAY_SIZE(sMasterRomInfo); i++) {
+		const TMasterRomInfo& info = sMasterRomInfo[i];
+		if (info.md5lower != partialmd5)
+			continue;
+
+		MasterRomInfo = &info;
+		if (!info.params) break;
+
+		std::vector<std::string> toks = tokenize_str(info.params, ",");
+		for (int j = 0; j < (int)toks.size(); j++) {
+			std::vector<std::string> parts = tokenize_str(toks[j], "=");
+			MasterRomInfoParams[parts[0]] = parts[1];
+		}
+		break;
+	}
 
 	if (tofix) {
 		char gigastr[768];
@@ -710,6 +755,25 @@ static BMAPPINGLocal bmap[] = {
 	{"",					0, NULL}
 };
 
+//for games not to the power of 2, so we just read enough
+//prg rom from it, but we have to keep ROM_size to the power of 2
+//since PRGCartMapping wants ROM_size to be to the power of 2
+//so instead if not to power of 2, we just use head.ROM_size when
+//we use FCEU_read
+static int RoundsPRGSize(int mapper) {
+	for (int i = 0; i != sizeof(not_power2) / sizeof(not_power2[0]); ++i)
+		if (not_power2[i] == mapper)
+			return false;
+	return true;
+}
+
+static const char* MapperName(int mapper) {
+	for (int mappertest = 0; mappertest < (sizeof bmap / sizeof bmap[0]) - 1; mappertest++)
+		if (bmap[mappertest].number == mapper)
+			return bmap[mappertest].name;
+	return "Not Listed";
+}
+
 int iNESLoad(const char *name, FCEUFILE *fp, int OverwriteVidMode) {
 	struct md5_context md5;
 
@@ -753,18 +817,7 @@ int iNESLoad(const char *name, FCEUFILE *fp, int OverwriteVidMode) {
 
 	VROM_size = uppow2(head.VROM_size | (iNES2?((head.Upper_ROM_VROM_size & 0xF0)<<4):0));
 
-	int round = true;
-	for (int i = 0; i != sizeof(not_power2) / sizeof(not_power2[0]); ++i) {
-		//for games not to the power of 2, so we just read enough
-		//prg rom from it, but we have to keep ROM_size to the power of 2
-		//since PRGCartMapping wants ROM_size to be to the power of 2
-		//so instead if not to power of 2, we just use head.ROM_size when
-		//we use FCEU_read
-		if (not_power2[i] == MapperNo) {
-			round = false;
-			break;
-		}
-	}
+	int round = RoundsPRGSize(MapperNo);
 
 	if ((ROM = (uint8*)FCEU_malloc(ROM_size << 14)) == NULL)
 		return 0;
@@ -795,14 +848,9 @@ int iNESLoad(const char *name, FCEUFILE *fp, int OverwriteVidMode) {
 		FCEU_fread(VROM, 0x2000, VROM_size, fp);
 
 	md5_starts(&md5);
-	md5_update(&md5, ROM, ROM_size << 14);
-
-	iNESGameCRC32 = CalcCRC32(0, ROM, ROM_size << 14);
-
-	if (VROM_size) {
-		iNESGameCRC32 = CalcCRC32(iNESGameCRC32, VROM, VROM_size << 13);
-		md5_update(&md5, VROM, VROM_size << 13);
-	}
+	iNESGameCRC32 = FCEU_HashBlock(0, &md5, ROM, ROM_size << 14);
+	if (VROM_size)
+		iNESGameCRC32 = FCEU_HashBlock(iNESGameCRC32, &md5, VROM, VROM_size << 13);
 	md5_finish(&md5, iNESCart.MD5);
 	memcpy(&GameInfo->MD5, &iNESCart.MD5, sizeof(iNESCart.MD5));
 
@@ -819,17 +867,8 @@ int iNESLoad(const char *name, FCEUFILE *fp, int OverwriteVidMode) {
 		FCEU_printf("\n");
 	}
 
-	char* mappername = "Not Listed";
-
-	for (int mappertest = 0; mappertest < (sizeof bmap / sizeof bmap[0]) - 1; mappertest++) {
-		if (bmap[mappertest].number == MapperNo) {
-			mappername = bmap[mappertest].name;
-			break;
-		}
-	}
-
 	FCEU_printf(" Mapper #:  %d\n", MapperNo);
-	FCEU_printf(" Mapper name: %s\n", mappername);
+	FCEU_printf(" Mapper name: %s\n", MapperName(MapperNo));
 	FCEU_printf(" Mirroring: %s\n", Mirroring == 2 ? "None (Four-screen)" : Mirroring ? "Vertical" : "Horizontal");
 	FCEU_printf(" Battery-backed: %s\n", (head.ROM_type & 2) ? "Yes" : "No");
 	FCEU_printf(" Trained: %s\n", (head.ROM_type & 4) ? "Yes" : "No");
@@ -909,6 +948,65 @@ int iNESLoad(const char *name, FCEUFILE *fp, int OverwriteVidMode) {
 	return 1;
 }
 
+//reads the image the way iNESLoad does and works out the same corrections, without loading anything
+bool iNESIdentify(FCEUFILE *fp, RomInfo &info) {
+	iNES_HEADER h;
+	if (FCEU_fread(&h, 1, 16, fp) != 16)
+		return false;
+	if (memcmp(&h, "NES\x1a", 4))
+		return false;
+	h.cleanup();
+
+	bool ines2 = ((h.ROM_type2 & 0x0C) == 0x08);
+	int mapper = (h.ROM_type >> 4) | (h.ROM_type2 & 0xF0);
+	if (ines2) mapper |= ((h.ROM_type3 & 0x0F) << 8);
+	int mirroring = (h.ROM_type & 8) ? 2 : (h.ROM_type & 1);
+
+	int not_round_size = h.ROM_size;
+	if (ines2) not_round_size |= ((h.Upper_ROM_VROM_size & 0x0F) << 8);
+	uint32 prgSize = (!h.ROM_size && !ines2) ? 256 : uppow2(not_round_size);
+	uint32 chrSize = uppow2(h.VROM_size | (ines2 ? ((h.Upper_ROM_VROM_size & 0xF0) << 4) : 0));
+
+	std::vector<uint8> data((prgSize << 14) + (chrSize << 13), 0xFF);
+	if (h.ROM_type & 4)	/* Trainer */
+		FCEU_fseek(fp, 512, SEEK_CUR);
+	FCEU_fread(&data[0], 0x4000, RoundsPRGSize(mapper) ? prgSize : not_round_size, fp);
+	if (chrSize)
+		FCEU_fread(&data[prgSize << 14], 0x2000, chrSize, fp);
+
+	struct md5_context md5;
+	md5_starts(&md5);
+	info.format = RomInfo::FORMAT_INES;
+	info.crc32 = FCEU_HashBlock(0, &md5, &data[0], data.size());
+	md5_finish(&md5, info.md5);
+
+	uint64 partialmd5 = 0, vsmd5 = 0;
+	for (int x = 0; x < 8; x++) {
+		partialmd5 |= (uint64)info.md5[15 - x] << (x * 8);
+		vsmd5 |= (uint64)info.md5[7 - x] << (x * 8);
+	}
+
+	info.headerMapper = mapper;
+	info.headerMirroring = mirroring;
+	info.headerBattery = (h.ROM_type & 2) != 0;
+	info.headerCHR = chrSize != 0;
+	info.bad = FindBad(partialmd5) != NULL;
+
+	bool battery = info.headerBattery, hasCHR = info.headerCHR;
+	info.fixes = FixHeaderInfo(info.crc32, partialmd5, mapper, mirroring, battery, hasCHR);
+
+	uint8 vsmirroring = mirroring;
+	info.vsuni = FCEU_VSUniLookup(vsmd5, &mapper, &vsmirroring);
+	mirroring = vsmirroring;
+
+	info.mapper = mapper;
+	info.submapper = ines2 ? (h.ROM_type3 >> 4) : 0;
+	info.mirroring = mirroring;
+	info.battery = battery;
+	info.board = MapperName(mapper);
+	return true;
+}
+
 // bbit edited: the whole function below was added
 int iNesSave() {
 	char name[2048];
@@ -377,6 +377,14 @@ void InputScanlineHook(uint8 *bg, uint8 *spr, uint32 linets, int final)
 	portFC.driver->SLHook(bg,spr,linets,final);
 }
 
+bool InputScanlineHooked()
+{
+	for(int port=0;port<2;port++)
+		if(joyports[port].driver->_SLHook)
+			return true;
+	return portFC.driver->_SLHook != 0;
+}
+
 #include <iostream>
 //binds JPorts[pad] to the driver specified in JPType[pad]
 static void SetInputStuff(int port)
@@ -100,6 +100,8 @@ extern void (*PStrobe[2])(void);
 
 //called from PPU on scanline events.
 extern void InputScanlineHook(uint8 *bg, uint8 *spr, uint32 linets, int final);
+//whether a device looks at the picture as it is drawn (like the zapper), so that the PPU has to draw it even in skipped frames
+bool InputScanlineHooked();
 
 void FCEU_DoSimpleCommand(int cmd);
 
@@ -21,6 +21,8 @@
 #include "driver.h"
 #include "cheat.h"
 #include "x6502.h"
+#include "statehistory.h"
+#include "perfstats.h"
 #include "utils/xstring.h"
 #include "utils/memory.h"
 #include "fceulua.h"
@@ -207,6 +209,9 @@ static uint8 luajoypads2[4]= { 0x00, 0x00, 0x00, 0x00 }; //0x
 static enum { GUI_USED_SINCE_LAST_DISPLAY, GUI_USED_SINCE_LAST_FRAME, GUI_CLEAR } gui_used = GUI_CLEAR;
 static uint8 *gui_data = NULL;
 static int gui_saw_current_palette = FALSE;
+// whether the driver draws the gui over the picture itself, in true colour, and whether it is to do so this frame
+static bool gui_truecolour = false;
+static bool gui_overlay = false;
 
 // Protects Lua calls from going nuts.
 // We set this to a big number like 1000 and decrement it
@@ -272,6 +277,7 @@ static void FCEU_LuaOnStop()
 		luajoypads2[i]= 0x00;
 	}
 	gui_used = GUI_CLEAR;
+	gui_overlay = false;
 	//if (wasPaused && !FCEUI_EmulationPaused())
 	//	FCEUI_ToggleEmulationPause();
 
@@ -1887,6 +1893,7 @@ static void CalculateMemHookRegions(LuaMemHookType hookType)
 
 static void CallRegisteredLuaMemHook_LuaMatch(unsigned int address, int size, unsigned int value, LuaMemHookType hookType)
 {
+	FCEU_PERF_SCOPE(FCEU_PERF_LUA);
 //	std::map<int, LuaContextInfo*>::iterator iter = luaContextInfo.begin();
 //	std::map<int, LuaContextInfo*>::iterator end = luaContextInfo.end();
 //	while(iter != end)
@@ -1951,6 +1958,11 @@ void CallRegisteredLuaMemHook(unsigned int address, int size, unsigned int value
 	}
 }
 
+bool IsLuaMemHookSet(LuaMemHookType hookType)
+{
+	return hookedRegions[hookType].NotEmpty();
+}
+
 void CallRegisteredLuaFunctions(LuaCallID calltype)
 {
 	assert((unsigned int)calltype < (unsigned int)LUACALL_COUNT);
@@ -1959,6 +1971,8 @@ void CallRegisteredLuaFunctions(LuaCallID calltype)
 	if (!L)
 		return;
 
+	FCEU_PERF_SCOPE(FCEU_PERF_LUA);
+
 	lua_settop(L, 0);
 	lua_getfield(L, LUA_REGISTRYINDEX, idstring);
 
@@ -2687,6 +2701,30 @@ static int savestate_registerload(lua_State *L) {
 	return 1;
 }
 
+// savestate.history(int capacity [, int budgetkb])
+//
+//   Keeps a savestate of every frame from now on, for savestate.rewind().
+//   The last capacity frames all have one, older frames are thinned out, and more so to stay under budgetkb kilobytes.
+//   A capacity of 0 turns it off.
+static int savestate_history(lua_State *L) {
+
+	FCEUI_SetStateHistory(luaL_checkinteger(L,1), luaL_optinteger(L,2,0));
+	return 0;
+}
+
+// int savestate.rewind(int frame)
+//
+//   Loads the state kept by savestate.history() for the last frame up to frame.
+//   Returns that frame, or nil if there is none.
+static int savestate_rewind(lua_State *L) {
+
+	int frame = FCEUI_StateHistoryLoad(luaL_checkinteger(L,1));
+	if (frame < 0)
+		return 0;
+	lua_pushinteger(L, frame);
+	return 1;
+}
+
 static int savestate_loadscriptdata(lua_State *L) {
 
 	const char *filename = savestateobj2filename(L,1);
@@ -2731,6 +2769,40 @@ int emu_lagcount(lua_State *L) {
 	return 1;
 }
 
+// table emu.perfstats([bool reset])
+//
+//   Gets where the time of the frames goes, as counter ticks per subsystem:
+//   {frames=n, frame={cpu=..., ppu=..., ...}, total={cpu=..., ...}}, with frame holding the last frame's ticks
+//   and total those of all frames since the counters were last reset.
+//   If reset is true, the counters are reset afterwards. Returns nil if fceux wasn't built with the counters.
+int emu_perfstats(lua_State *L) {
+
+	FCEUPerfStats stats;
+	if (!FCEUI_GetPerfStats(stats))
+		return 0;
+	if (lua_toboolean(L, 1))
+		FCEUI_ResetPerfStats();
+
+	lua_newtable(L);
+	lua_pushinteger(L, stats.frames);
+	lua_setfield(L, -2, "frames");
+	lua_newtable(L);
+	for (int i = 0; i < FCEU_PERF_COUNT; i++)
+	{
+		lua_pushnumber(L, (lua_Number)stats.frame[i]);
+		lua_setfield(L, -2, FCEUI_PerfStatName(i));
+	}
+	lua_setfield(L, -2, "frame");
+	lua_newtable(L);
+	for (int i = 0; i < FCEU_PERF_COUNT; i++)
+	{
+		lua_pushnumber(L, (lua_Number)stats.total[i]);
+		lua_setfield(L, -2, FCEUI_PerfStatName(i));
+	}
+	lua_setfield(L, -2, "total");
+	return 1;
+}
+
 // emu.lagged()
 //
 //   Returns true if the game is currently on a lag frame
@@ -2928,12 +3000,35 @@ static int movie_isfromsavestate (lua_State *L) {
 #define LUA_SCREEN_WIDTH    256
 #define LUA_SCREEN_HEIGHT   240
 
+// the rectangle of gui_data drawn on since it was last cleared, empty when x1 > x2
+static int gui_dirty_x1 = LUA_SCREEN_WIDTH, gui_dirty_y1 = LUA_SCREEN_HEIGHT, gui_dirty_x2 = -1, gui_dirty_y2 = -1;
+
+// grow the dirty rectangle to take in a rectangle of the screen
+static inline void gui_dirty(int x1, int y1, int x2, int y2) {
+	if (x1 < gui_dirty_x1) gui_dirty_x1 = x1;
+	if (y1 < gui_dirty_y1) gui_dirty_y1 = y1;
+	if (x2 > gui_dirty_x2) gui_dirty_x2 = x2;
+	if (y2 > gui_dirty_y2) gui_dirty_y2 = y2;
+}
+
+// clear what has been drawn on gui_data
+static void gui_clear() {
+	for (int y = gui_dirty_y1; y <= gui_dirty_y2; y++)
+		memset(&gui_data[(y*LUA_SCREEN_WIDTH+gui_dirty_x1)*4], 0, (gui_dirty_x2-gui_dirty_x1+1)*4);
+	gui_dirty_x1 = LUA_SCREEN_WIDTH;
+	gui_dirty_y1 = LUA_SCREEN_HEIGHT;
+	gui_dirty_x2 = gui_dirty_y2 = -1;
+}
+
 // Common code by the gui library: make sure the screen array is ready
 static void gui_prepare() {
 	if (!gui_data)
+	{
 		gui_data = (uint8*) FCEU_dmalloc(LUA_SCREEN_WIDTH*LUA_SCREEN_HEIGHT*4);
-	if (gui_used != GUI_USED_SINCE_LAST_DISPLAY)
 		memset(gui_data, 0, LUA_SCREEN_WIDTH*LUA_SCREEN_HEIGHT*4);
+	}
+	if (gui_used != GUI_USED_SINCE_LAST_DISPLAY)
+		gui_clear();
 	gui_used = GUI_USED_SINCE_LAST_DISPLAY;
 }
 
@@ -2983,10 +3078,16 @@ static inline bool gui_check_boundary(int x, int y) {
 	return !(x < 0 || x >= LUA_SCREEN_WIDTH || y < 0 || y >= LUA_SCREEN_HEIGHT);
 }
 
+// write a pixel to gui_data (do not check boundaries or mark it dirty, for when the caller has)
+static inline void gui_blendpixel(int x, int y, uint32 colour) {
+	blend32((uint32*) &gui_data[(y*LUA_SCREEN_WIDTH+x)*4], colour);
+}
+
 // write a pixel to gui_data (do not check boundaries for speedup)
 static inline void gui_drawpixel_fast(int x, int y, uint32 colour) {
 	//gui_prepare();
-	blend32((uint32*) &gui_data[(y*LUA_SCREEN_WIDTH+x)*4], colour);
+	gui_dirty(x, y, x, y);
+	gui_blendpixel(x, y, colour);
 }
 
 // write a pixel to gui_data (check boundaries)
@@ -3112,12 +3213,15 @@ static void gui_fillbox_internal(int x1, int y1, int x2, int y2, uint32 colour)
 		y2 = LUA_SCREEN_HEIGHT - 1;
 
 	//gui_prepare();
+	if (x1 > x2 || y1 > y2)
+		return;
+	gui_dirty(x1, y1, x2, y2);
 	int ix, iy;
 	for (iy = y1; iy <= y2; iy++)
 	{
 		for (ix = x1; ix <= x2; ix++)
 		{
-			gui_drawpixel_fast(ix, iy, colour);
+			gui_blendpixel(ix, iy, colour);
 		}
 	}
 }
@@ -4215,19 +4319,20 @@ static int gui_gdoverlay(lua_State *L) {
 		return 0; // out of screen or invalid size
 
 	gui_prepare();
+	gui_dirty(xStartDst, yStartDst, xStartDst+width-1, yStartDst+height-1);
 
 	const uint8* pix = (const uint8*)(&ptr[yStartSrc*pitch + (xStartSrc*(trueColor?4:1))]);
 	int bytesToNextLine = pitch - (width * (trueColor?4:1));
 	if (trueColor)
 		for (int y = yStartDst; y < height+yStartDst && y < LUA_SCREEN_HEIGHT; y++, pix += bytesToNextLine) {
 			for (int x = xStartDst; x < width+xStartDst && x < LUA_SCREEN_WIDTH; x++, pix += 4) {
-				gui_drawpixel_fast(x, y, LUA_BUILD_PIXEL(opacMap[pix[0]], pix[1], pix[2], pix[3]));
+				gui_blendpixel(x, y, LUA_BUILD_PIXEL(opacMap[pix[0]], pix[1], pix[2], pix[3]));
 			}
 		}
 	else
 		for (int y = yStartDst; y < height+yStartDst && y < LUA_SCREEN_HEIGHT; y++, pix += bytesToNextLine) {
 			for (int x = xStartDst; x < width+xStartDst && x < LUA_SCREEN_WIDTH; x++, pix++) {
-				gui_drawpixel_fast(x, y, LUA_BUILD_PIXEL(pal[*pix].a, pal[*pix].r, pal[*pix].g, pal[*pix].b));
+				gui_blendpixel(x, y, LUA_BUILD_PIXEL(pal[*pix].a, pal[*pix].r, pal[*pix].g, pal[*pix].b));
 			}
 		}
 
@@ -4453,6 +4558,75 @@ static int debugger_resetinstructionscount(lua_State *L)
 	return 0;
 }
 
+// debugger.startcdl()
+static int debugger_startcdl(lua_State *L)
+{
+	FCEUI_CDLStart();
+	return 0;
+}
+
+// debugger.pausecdl()
+static int debugger_pausecdl(lua_State *L)
+{
+	FCEUI_CDLPause();
+	return 0;
+}
+
+// debugger.resetcdl()
+static int debugger_resetcdl(lua_State *L)
+{
+	if (cdloggerdata)
+		FCEU_CDLReset();
+	return 0;
+}
+
+// bool debugger.loadcdl(string filename)
+static int debugger_loadcdl(lua_State *L)
+{
+	const char *filename = luaL_checkstring(L, 1);
+	if (!cdloggerdata && GameInfo)
+		FCEU_CDLInit();
+	lua_pushboolean(L, FCEUI_CDLLoad(filename));
+	return 1;
+}
+
+// bool debugger.savecdl(string filename)
+static int debugger_savecdl(lua_State *L)
+{
+	const char *filename = luaL_checkstring(L, 1);
+	lua_pushboolean(L, FCEUI_CDLSave(filename));
+	return 1;
+}
+
+// debugger.autosavecdl(string filename [, int frames])
+// pass nil to stop autosaving
+static int debugger_autosavecdl(lua_State *L)
+{
+	const char *filename = lua_isnil(L, 1) ? NULL : luaL_checkstring(L, 1);
+	int frames = luaL_optinteger(L, 2, 600);
+	FCEUI_CDLSetAutoSave(filename, frames);
+	return 0;
+}
+
+// table debugger.getcdlcounts()
+static int debugger_getcdlcounts(lua_State *L)
+{
+	lua_newtable(L);
+	lua_pushinteger(L, codecount);
+	lua_setfield(L, -2, "code");
+	lua_pushinteger(L, datacount);
+	lua_setfield(L, -2, "data");
+	lua_pushinteger(L, undefinedcount);
+	lua_setfield(L, -2, "undefined");
+	lua_pushinteger(L, rendercount);
+	lua_setfield(L, -2, "render");
+	lua_pushinteger(L, vromreadcount);
+	lua_setfield(L, -2, "vromread");
+	lua_pushinteger(L, undefinedvromcount);
+	lua_setfield(L, -2, "undefinedvrom");
+	return 1;
+}
+
 // TAS Editor functions library
 
 // bool taseditor.registerauto()
@@ -5351,6 +5525,7 @@ static const struct luaL_reg emulib [] = {
 	{"message", emu_message},
 	{"framecount", emu_framecount},
 	{"lagcount", emu_lagcount},
+	{"perfstats", emu_perfstats},
 	{"lagged", emu_lagged},
 	{"setlagflag", emu_setlagflag},
 	{"emulating", emu_emulating},
@@ -5442,6 +5617,8 @@ static const struct luaL_reg savestatelib[] = {
 	{"registersave", savestate_registersave},
 	{"registerload", savestate_registerload},
 	{"loadscriptdata", savestate_loadscriptdata},
+	{"history", savestate_history},
+	{"rewind", savestate_rewind},
 
 	{NULL,NULL}
 };
@@ -5525,6 +5702,13 @@ static const struct luaL_reg debuggerlib[] = {
 	{"getinstructionscount", debugger_getinstructionscount},
 	{"resetcyclescount", debugger_resetcyclescount},
 	{"resetinstructionscount", debugger_resetinstructionscount},
+	{"startcdl", debugger_startcdl},
+	{"pausecdl", debugger_pausecdl},
+	{"resetcdl", debugger_resetcdl},
+	{"loadcdl", debugger_loadcdl},
+	{"savecdl", debugger_savecdl},
+	{"autosavecdl", debugger_autosavecdl},
+	{"getcdlcounts", debugger_getcdlcounts},
 	{NULL,NULL}
 };
 
@@ -5584,6 +5768,8 @@ void FCEU_LuaFrameBoundary()
 	if (!L || !luaRunning)
 		return;
 
+	FCEU_PERF_SCOPE(FCEU_PERF_LUA);
+
 	// Our function needs calling
 	lua_settop(L,0);
 	lua_getfield(L, LUA_REGISTRYINDEX, frameAdvanceThread);
@@ -5930,11 +6116,15 @@ int FCEU_LuaRerecordCountSkip() {
 /**
  * Given an 8-bit screen with the indicated resolution,
  * draw the current GUI onto it.
+ * When the driver draws the GUI itself (see FCEU_LuaGuiTrueColour)
+ * it is left for the driver, unless the frame is being captured.
  *
  * Currently we only support 256x* resolutions.
  */
-void FCEU_LuaGui(uint8 *XBuf)
+void FCEU_LuaGui(uint8 *XBuf, bool capture)
 {
+	gui_overlay = false;
+
 	if (!L/* || !luaRunning*/)
 		return;
 
@@ -5967,29 +6157,36 @@ void FCEU_LuaGui(uint8 *XBuf)
 
 	if (gui_used == GUI_USED_SINCE_LAST_FRAME && !FCEUI_EmulationPaused())
 	{
-		memset(gui_data, 0, LUA_SCREEN_WIDTH*LUA_SCREEN_HEIGHT*4);
+		gui_clear();
 		gui_used = GUI_CLEAR;
 		return;
 	}
 
 	gui_used = GUI_USED_SINCE_LAST_FRAME;
 
+	if (gui_truecolour && !capture)
+	{
+		gui_overlay = true;
+		return;
+	}
+
 	int x, y;
 
-	for (y = 0; y < LUA_SCREEN_HEIGHT; y++)
+	for (y = gui_dirty_y1; y <= gui_dirty_y2; y++)
 	{
-		for (x=0; x < LUA_SCREEN_WIDTH; x++)
+		for (x = gui_dirty_x1; x <= gui_dirty_x2; x++)
 		{
-			const uint8 gui_alpha = gui_data[(y*LUA_SCREEN_WIDTH+x)*4+3];
+			const uint32 gui_pixel = *(uint32*) &gui_data[(y*LUA_SCREEN_WIDTH+x)*4];
+			const uint8 gui_alpha = LUA_PIXEL_A(gui_pixel);
 			if (gui_alpha == 0)
 			{
 				// do nothing
 				continue;
 			}
 
-			const uint8 gui_red   = gui_data[(y*LUA_SCREEN_WIDTH+x)*4+2];
-			const uint8 gui_green = gui_data[(y*LUA_SCREEN_WIDTH+x)*4+1];
-			const uint8 gui_blue  = gui_data[(y*LUA_SCREEN_WIDTH+x)*4];
+			const uint8 gui_red   = LUA_PIXEL_R(gui_pixel);
+			const uint8 gui_green = LUA_PIXEL_G(gui_pixel);
+			const uint8 gui_blue  = LUA_PIXEL_B(gui_pixel);
 
 			int r, g, b;
 			if (gui_alpha == 255) {
@@ -6014,6 +6211,23 @@ void FCEU_LuaGui(uint8 *XBuf)
 	return;
 }
 
+void FCEU_LuaGuiTrueColour(bool enable)
+{
+	gui_truecolour = enable;
+}
+
+bool FCEU_LuaGuiOverlay(const uint32 **pixels, int *x1, int *y1, int *x2, int *y2)
+{
+	if (!gui_overlay || gui_dirty_x1 > gui_dirty_x2)
+		return false;
+	*pixels = (const uint32*) gui_data;
+	*x1 = gui_dirty_x1;
+	*y1 = gui_dirty_y1;
+	*x2 = gui_dirty_x2;
+	*y2 = gui_dirty_y2;
+	return true;
+}
+
 
 lua_State* FCEU_GetLuaState() {
 	return L;
@@ -19,6 +19,8 @@
 #include "utils/guid.h"
 #include "utils/memory.h"
 #include "utils/xstring.h"
+#include "utils/mappedfile.h"
+#include "utils/crc32.h"
 #include <sstream>
 
 #ifdef CREATE_AVI
@@ -105,10 +107,20 @@ MovieData currMovieData;
 MovieData defaultMovieData;
 int currRerecordCount; // Keep the global value
 
+//the state hash interval of movies recorded from now on, and the first frame which didn't match its hash
+static int movieStateHashInterval = 0;
+static int movieDesyncFrame = -1;
+
+//timelines which read+write savestate loads replaced during this session, newest last.
+//savestates only carry the records the movie file may lack, the rest are found here or in the current movie
+#define MOVIE_RETAINED_BRANCHES 16
+static std::deque<MovieRecordList> retainedBranches;
+
 char lagcounterbuf[32] = {0};
 
 void MovieData::clearRecordRange(int start, int len)
 {
+	dropStateHashesAfter(start);
 	for(int i=0;i<len;i++)
 	{
 		records[i+start].clear();
@@ -117,30 +129,25 @@ void MovieData::clearRecordRange(int start, int len)
 
 void MovieData::eraseRecords(int at, int frames)
 {
+	dropStateHashesAfter(at);
 	if (at < (int)records.size())
 	{
-		if (frames == 1)
-		{
-			// erase 1 frame
-			records.erase(records.begin() + at);
-		} else
-		{
-			// erase many frames
-			if (at + frames > (int)records.size())
-				frames = (int)records.size() - at;
-			records.erase(records.begin() + at, records.begin() + (at + frames));
-		}
+		if (at + frames > (int)records.size())
+			frames = (int)records.size() - at;
+		records.erase(at, frames);
 	}
 }
 
 void MovieData::insertEmpty(int at, int frames)
 {
+	if (at != -1)
+		dropStateHashesAfter(at);
 	if (at == -1)
 	{
 		records.resize(records.size() + frames);
 	} else
 	{
-		records.insert(records.begin() + at, frames, MovieRecord());
+		records.insert(at, frames, MovieRecord());
 	}
 }
 
@@ -148,7 +155,8 @@ void MovieData::cloneRegion(int at, int frames)
 {
 	if (at < 0) return;
 
-	records.insert(records.begin() + at, frames, MovieRecord());
+	dropStateHashesAfter(at);
+	records.insert(at, frames, MovieRecord());
 
 	for(int i = 0; i < frames; i++)
 		records[i + at].Clone(records[i + at + frames]);
@@ -394,6 +402,7 @@ MovieData::MovieData()
 	, rerecordCount(0)
 	, binaryFlag(false)
 	, loadFrameCount(-1)
+	, stateHashInterval(0)
 	, microphone(false)
 {
 	memset(&romChecksum,0,sizeof(MD5DATA));
@@ -402,6 +411,12 @@ MovieData::MovieData()
 void MovieData::truncateAt(int frame)
 {
 	records.resize(frame);
+	dropStateHashesAfter(frame);
+}
+
+void MovieData::dropStateHashesAfter(int frame)
+{
+	stateHashes.erase(stateHashes.upper_bound(frame), stateHashes.end());
 }
 
 void MovieData::installValue(std::string& key, std::string& val)
@@ -455,6 +470,20 @@ void MovieData::installValue(std::string& key, std::string& val)
 	{
 		installInt(val, loadFrameCount);
 	}
+	else if(key == "stateHashInterval")
+		installInt(val,stateHashInterval);
+	else if(key == "stateHash")
+	{
+		unsigned int frame;
+		unsigned long long hash;
+		if(sscanf(val.c_str(), "%u %llx", &frame, &hash) == 2)
+			stateHashes[frame] = hash;
+	}
+}
+
+void MovieData::dumpStateHash(EMUFILE* os, int frame, uint64 hash)
+{
+	os->fprintf("stateHash %d %016llX\n", frame, (unsigned long long)hash);
 }
 
 int MovieData::dump(EMUFILE *os, bool binary)
@@ -490,22 +519,41 @@ int MovieData::dump(EMUFILE *os, bool binary)
 	if (this->loadFrameCount >= 0)
 		os->fprintf("length %d\n" , this->loadFrameCount);
 
+	if(stateHashInterval)
+		os->fprintf("stateHashInterval %d\n" , stateHashInterval);
+
+	//the hashes go just before the record of their frame, the way recording appends them, but a binary input log
+	//can't have anything between its records, so there they all go in the header
+	std::map<int,uint64>::iterator hash = stateHashes.begin();
 	if(binary)
 	{
+		for(;hash!=stateHashes.end();hash++)
+			dumpStateHash(os, hash->first, hash->second);
 		//put one | to start the binary dump
 		os->fputc('|');
 		for(int i=0;i<(int)records.size();i++)
-			records[i].dumpBinary(this, os, i);
+			records.read(i).dumpBinary(this, os, i);
 	} else
 	{
 		for(int i=0;i<(int)records.size();i++)
-			records[i].dump(this, os, i);
+		{
+			for(;hash!=stateHashes.end() && hash->first<=i;hash++)
+				dumpStateHash(os, hash->first, hash->second);
+			records.read(i).dump(this, os, i);
+		}
+		for(;hash!=stateHashes.end();hash++)
+			dumpStateHash(os, hash->first, hash->second);
 	}
 
 	int end = os->ftell();
 	return end-start;
 }
 
+void MovieData::dumpTrailer(EMUFILE* os)
+{
+	os->fprintf("frameCount %d\n", (int)records.size());
+}
+
 int FCEUMOV_GetFrame(void)
 {
 	return currFrameCounter;
@@ -556,7 +604,8 @@ bool FCEUMOV_Mode(int modemask)
 	return FCEUMOV_Mode((EMOVIEMODE)modemask);
 }
 
-static void LoadFM2_binarychunk(MovieData& movieData, EMUFILE* fp, int size)
+//the size of one record in a binary input log
+static int FM2_BinaryRecordSize(MovieData& movieData)
 {
 	int recordsize = 1; //1 for the command
 	if(movieData.fourscore)
@@ -572,6 +621,486 @@ static void LoadFM2_binarychunk(MovieData& movieData, EMUFILE* fp, int size)
 			}
 		}
 	}
+	return recordsize;
+}
+
+// ----------------------------------------------------------------------------
+//a movie file mapped into memory, along with where every chunk of records starts in it
+class MovieRecordSource
+{
+public:
+	MovieRecordSource() : refcount(0), binary(false), recordsize(0), count(0), end(0) {}
+
+	//how many chunks still refer to it
+	int refcount;
+	MappedFile file;
+	//only the port setup is used, to parse the records
+	MovieData format;
+	bool binary;
+	int recordsize;
+	int count;
+	//for text logs, the start of the line holding the chunk's first record
+	std::vector<uint64> chunkOffsets;
+	uint64 end;
+
+	int chunkLength(int chunk) { return std::min((int)MovieRecordList::CHUNK_SIZE, count - (chunk<<MovieRecordList::CHUNK_SHIFT)); }
+	void decode(int chunk, MovieRecord* recs, int n);
+};
+
+void MovieRecordSource::decode(int chunk, MovieRecord* recs, int n)
+{
+	uint64 start = chunkOffsets[chunk];
+	//a chunk is tiny, so a view starting at it keeps EMUFILE well away from its 2GB limit however big the file is
+	uint64 avail = std::min<uint64>(end - start, binary ? (uint64)n*recordsize : INT_MAX);
+	EMUFILE_MEMORY_VIEW is(file.data() + start, (s32)avail);
+
+	if(binary)
+	{
+		for(int i=0;i<n;i++)
+			recs[i].parseBinary(&format, &is);
+		return;
+	}
+
+	int i = 0;
+	while(i < n)
+	{
+		int c = is.fgetc();
+		if(c == -1)
+			break;
+		if(c == '|')
+			recs[i++].parse(&format, &is);
+		else if(c != 10 && c != 13 && c != ' ' && c != '\t')
+		{
+			//a key line among the records. it was installed when the file was indexed
+			while(c != -1 && c != 10 && c != 13)
+				c = is.fgetc();
+		}
+	}
+}
+
+MovieRecordList::MovieRecordList()
+	: count(0)
+	, hint(0)
+	, hashedBlocks(0)
+	, clean(0)
+{
+}
+
+MovieRecordList::MovieRecordList(const MovieRecordList& other)
+	: count(0)
+	, hint(0)
+	, hashedBlocks(0)
+	, clean(0)
+{
+	*this = other;
+}
+
+MovieRecordList& MovieRecordList::operator=(const MovieRecordList& other)
+{
+	if(this == &other)
+		return *this;
+
+	//share all the chunks; whichever list writes to one first gets its own copy of it
+	for(int i=0;i<(int)other.pieces.size();i++)
+		other.pieces[i].chunk->refs++;
+	release();
+	pieces = other.pieces;
+	starts = other.starts;
+	count = other.count;
+	hashes = other.hashes;
+	hashedBlocks = other.hashedBlocks;
+	clean = other.clean;
+	return *this;
+}
+
+MovieRecordList::~MovieRecordList()
+{
+	release();
+}
+
+void MovieRecordList::releaseChunk(Chunk* chunk)
+{
+	if(--chunk->refs)
+		return;
+	if(chunk->source && --chunk->source->refcount == 0)
+		delete chunk->source;
+	delete chunk;
+}
+
+void MovieRecordList::release()
+{
+	for(int i=0;i<(int)pieces.size();i++)
+		releaseChunk(pieces[i].chunk);
+	pieces.clear();
+	starts.clear();
+	while(!readCache.empty())
+	{
+		readCache.front()->cacheRefs--;
+		releaseChunk(readCache.front());
+		readCache.pop_front();
+	}
+	count = 0;
+	hint = 0;
+	hashedBlocks = 0;
+	clean = 0;
+}
+
+void MovieRecordList::modified(int index)
+{
+	clean = std::min(clean, index);
+	hashedBlocks = std::min(hashedBlocks, index >> CHUNK_SHIFT);
+}
+
+void MovieRecordList::loadChunk(Chunk* chunk)
+{
+	if(chunk->loaded)
+		return;
+	int n = chunk->source->chunkLength(chunk->sourceChunk);
+	chunk->recs.resize(n);
+	chunk->source->decode(chunk->sourceChunk, &chunk->recs[0], n);
+	chunk->loaded = true;
+}
+
+int MovieRecordList::findPiece(int index)
+{
+	//access is mostly sequential, so try the last piece and the one after it before searching
+	for(int i=hint;i<hint+2 && i<(int)pieces.size();i++)
+	{
+		if(index >= starts[i] && index < starts[i] + pieces[i].length)
+			return hint = i;
+	}
+	hint = (int)(std::upper_bound(starts.begin(), starts.end(), index) - starts.begin()) - 1;
+	return hint;
+}
+
+void MovieRecordList::updateStarts(int from)
+{
+	starts.resize(pieces.size());
+	int start = from ? starts[from-1] + pieces[from-1].length : 0;
+	for(int i=from;i<(int)pieces.size();i++)
+	{
+		starts[i] = start;
+		start += pieces[i].length;
+	}
+}
+
+//makes a piece begin at index, and returns it (or the number of pieces, when index is the end of the list)
+int MovieRecordList::splitAt(int index)
+{
+	if(index >= (int)count)
+		return (int)pieces.size();
+	int p = findPiece(index);
+	int offset = index - starts[p];
+	if(offset == 0)
+		return p;
+
+	//both halves go on referring to the same chunk
+	Piece right = pieces[p];
+	right.offset += offset;
+	right.length -= offset;
+	right.chunk->refs++;
+	pieces[p].length = offset;
+	pieces.insert(pieces.begin() + p + 1, right);
+	starts.insert(starts.begin() + p + 1, index);
+	return p+1;
+}
+
+//gives the piece a decoded chunk, which nothing else refers to, so that its records may be written
+void MovieRecordList::makeWritable(int p)
+{
+	Piece& piece = pieces[p];
+	Chunk* chunk = piece.chunk;
+	loadChunk(chunk);
+
+	if(chunk->refs - chunk->cacheRefs == 1)
+	{
+		//nobody else sees it, so it only has to stop claiming to match its source
+		if(chunk->source)
+		{
+			if(--chunk->source->refcount == 0)
+				delete chunk->source;
+			chunk->source = 0;
+			chunk->sourceChunk = -1;
+		}
+		return;
+	}
+
+	Chunk* copy = new Chunk();
+	copy->recs.assign(chunk->recs.begin() + piece.offset, chunk->recs.begin() + piece.offset + piece.length);
+	releaseChunk(chunk);
+	piece.chunk = copy;
+	piece.offset = 0;
+}
+
+//merges neighbouring pieces in [first,last] which fit in one chunk together, so edits don't leave ever smaller pieces behind
+void MovieRecordList::coalesce(int first, int last)
+{
+	first = std::max(first, 0);
+	last = std::min(last, (int)pieces.size() - 1);
+	for(int i=first;i<last;)
+	{
+		if(pieces[i].length + pieces[i+1].length > CHUNK_SIZE)
+		{
+			i++;
+			continue;
+		}
+
+		Piece& b = pieces[i+1];
+		if(pieces[i].chunk == b.chunk && pieces[i].offset + pieces[i].length == b.offset)
+		{
+			//the two halves of an earlier split
+			pieces[i].length += b.length;
+		}
+		else
+		{
+			makeWritable(i);
+			Piece& a = pieces[i];
+			//records past the end of the piece aren't referred to by anything
+			a.chunk->recs.resize(a.offset + a.length);
+			loadChunk(b.chunk);
+			a.chunk->recs.insert(a.chunk->recs.end(), b.chunk->recs.begin() + b.offset, b.chunk->recs.begin() + b.offset + b.length);
+			a.length += b.length;
+		}
+		releaseChunk(b.chunk);
+		pieces.erase(pieces.begin() + i + 1);
+		last--;
+	}
+	updateStarts(first);
+}
+
+void MovieRecordList::appendChunks(int frames, const MovieRecord& rec, std::vector<Piece>& out)
+{
+	while(frames > 0)
+	{
+		Piece piece;
+		piece.chunk = new Chunk();
+		piece.offset = 0;
+		piece.length = std::min((int)CHUNK_SIZE, frames);
+		piece.chunk->recs.assign(piece.length, rec);
+		out.push_back(piece);
+		frames -= piece.length;
+	}
+}
+
+MovieRecord& MovieRecordList::operator[](int index)
+{
+	modified(index);
+	int p = findPiece(index);
+	makeWritable(p);
+	Piece& piece = pieces[p];
+	return piece.chunk->recs[piece.offset + index - starts[p]];
+}
+
+MovieRecord& MovieRecordList::read(int index)
+{
+	int p = findPiece(index);
+	Piece& piece = pieces[p];
+	Chunk* chunk = piece.chunk;
+	if(!chunk->loaded)
+	{
+		loadChunk(chunk);
+		chunk->refs++;
+		chunk->cacheRefs++;
+		readCache.push_back(chunk);
+		if((int)readCache.size() > READ_CACHE_CHUNKS)
+		{
+			//drop the oldest chunk which was only read, if it still matches its source it can be decoded again
+			Chunk* old = readCache.front();
+			readCache.pop_front();
+			old->cacheRefs--;
+			if(old->source && old != chunk)
+			{
+				std::vector<MovieRecord>().swap(old->recs);
+				old->loaded = false;
+			}
+			releaseChunk(old);
+		}
+	}
+	return chunk->recs[piece.offset + index - starts[p]];
+}
+
+void MovieRecordList::resize(size_t newCount)
+{
+	if(newCount < count)
+	{
+		modified((int)newCount);
+		int p = splitAt((int)newCount);
+		for(int i=p;i<(int)pieces.size();i++)
+			releaseChunk(pieces[i].chunk);
+		pieces.resize(p);
+		starts.resize(p);
+		count = newCount;
+		hint = 0;
+		return;
+	}
+
+	int frames = (int)(newCount - count);
+	if(!frames)
+		return;
+
+	//the last chunk grows in place when it is ours alone, which is what recording does every frame
+	if(!pieces.empty())
+	{
+		Piece& last = pieces.back();
+		Chunk* chunk = last.chunk;
+		if(chunk->refs - chunk->cacheRefs == 1 && !chunk->source && last.length < CHUNK_SIZE)
+		{
+			int n = std::min(frames, CHUNK_SIZE - last.length);
+			//records left past the end of the piece by a truncation must not come back
+			chunk->recs.resize(last.offset + last.length);
+			chunk->recs.resize(last.offset + last.length + n);
+			last.length += n;
+			frames -= n;
+			count += n;
+		}
+	}
+
+	int from = (int)pieces.size();
+	appendChunks(frames, MovieRecord(), pieces);
+	count += frames;
+	updateStarts(from);
+}
+
+void MovieRecordList::reserve(size_t newCount)
+{
+	pieces.reserve((newCount + CHUNK_SIZE - 1) >> CHUNK_SHIFT);
+	starts.reserve((newCount + CHUNK_SIZE - 1) >> CHUNK_SHIFT);
+}
+
+void MovieRecordList::push_back(const MovieRecord& rec)
+{
+	resize(count+1);
+	(*this)[(int)count-1] = rec;
+}
+
+void MovieRecordList::clear()
+{
+	release();
+}
+
+void MovieRecordList::insert(int at, int frames, const MovieRecord& rec)
+{
+	if(frames <= 0)
+		return;
+	modified(at);
+	int p = splitAt(at);
+	std::vector<Piece> added;
+	appendChunks(frames, rec, added);
+	pieces.insert(pieces.begin() + p, added.begin(), added.end());
+	count += frames;
+	coalesce(p-1, p+(int)added.size());
+}
+
+void MovieRecordList::erase(int at, int frames)
+{
+	if(frames <= 0)
+		return;
+	modified(at);
+	int first = splitAt(at);
+	int last = splitAt(at + frames);
+	for(int i=first;i<last;i++)
+		releaseChunk(pieces[i].chunk);
+	pieces.erase(pieces.begin() + first, pieces.begin() + last);
+	count -= frames;
+	hint = 0;
+	coalesce(first-1, first);
+}
+
+void MovieRecordList::attach(MovieRecordSource* source, int newCount)
+{
+	release();
+	source->count = newCount;
+	for(int i=0;(i<<CHUNK_SHIFT) < newCount;i++)
+	{
+		Piece piece;
+		piece.chunk = new Chunk();
+		piece.chunk->loaded = false;
+		piece.chunk->source = source;
+		piece.chunk->sourceChunk = i;
+		source->refcount++;
+		piece.offset = 0;
+		piece.length = source->chunkLength(i);
+		pieces.push_back(piece);
+	}
+	count = newCount;
+	updateStarts(0);
+}
+
+void MovieRecordList::detach()
+{
+	//the cache only holds chunks which are about to stop being clean anyway
+	while(!readCache.empty())
+	{
+		readCache.front()->cacheRefs--;
+		releaseChunk(readCache.front());
+		readCache.pop_front();
+	}
+	for(int i=0;i<(int)pieces.size();i++)
+	{
+		if(pieces[i].chunk->source)
+			makeWritable(i);
+	}
+}
+
+bool MovieRecordList::isAttached() const
+{
+	for(int i=0;i<(int)pieces.size();i++)
+	{
+		if(pieces[i].chunk->source)
+			return true;
+	}
+	return false;
+}
+
+//feeds a record to the crc in a fixed layout, so hashes don't depend on struct padding or the port setup
+static uint32 HashRecord(uint32 crc, MovieRecord& rec)
+{
+	uint8 buf[5+2*12];
+	buf[0] = rec.commands;
+	for(int i=0;i<4;i++)
+		buf[1+i] = rec.joysticks[i];
+	for(int i=0;i<2;i++)
+	{
+		uint8* zap = buf + 5 + i*12;
+		zap[0] = rec.zappers[i].x;
+		zap[1] = rec.zappers[i].y;
+		zap[2] = rec.zappers[i].b;
+		zap[3] = rec.zappers[i].bogo;
+		FCEU_en32lsb(zap+4, (uint32)rec.zappers[i].zaphit);
+		FCEU_en32lsb(zap+8, (uint32)(rec.zappers[i].zaphit >> 32));
+	}
+	return CalcCRC32(crc, buf, sizeof(buf));
+}
+
+uint32 MovieRecordList::hashRange(int start, int end)
+{
+	uint32 crc = 0;
+	for(int i=start;i<end;i++)
+		crc = HashRecord(crc, read(i));
+	return crc;
+}
+
+uint32 MovieRecordList::blockHash(int block)
+{
+	int start = block << CHUNK_SHIFT;
+	if(start + CHUNK_SIZE > (int)count)
+		return hashRange(start, (int)count);
+
+	if(block >= hashedBlocks)
+	{
+		if((int)hashes.size() <= block)
+			hashes.resize(block+1);
+		for(int i=hashedBlocks;i<=block;i++)
+			hashes[i] = hashRange(i << CHUNK_SHIFT, (i+1) << CHUNK_SHIFT);
+		hashedBlocks = block+1;
+	}
+	return hashes[block];
+}
+// ----------------------------------------------------------------------------
+
+static void LoadFM2_binarychunk(MovieData& movieData, EMUFILE* fp, int size)
+{
+	int recordsize = FM2_BinaryRecordSize(movieData);
 
 	//find out how much remains in the file
 	int curr = fp->ftell();
@@ -709,6 +1238,146 @@ bool LoadFM2(MovieData& movieData, EMUFILE* fp, int size, bool stopAfterHeader)
 	return true;
 }
 
+//loads a movie by mapping its file and indexing where its records start in one pass over it. the records themselves
+//are only decoded once they are used, so huge input logs start playing at once and stream through little memory.
+//returns false if the file can't be mapped or doesn't look like a movie; LoadFM2 should be tried instead then.
+static bool LoadFM2_Mapped(MovieData& movieData, const char* fname)
+{
+	MovieRecordSource* source = new MovieRecordSource();
+	if(!source->file.open(fname))
+	{
+		delete source;
+		return false;
+	}
+
+	const uint8* data = source->file.data();
+	uint64 len = source->file.size();
+
+	//the header is parsed as usual, from a view of the start of the file. it stops just past the first record's pipe
+	EMUFILE_MEMORY_VIEW header(data, (s32)std::min<uint64>(len, INT_MAX));
+	if(!LoadFM2(movieData, &header, header.size(), true))
+	{
+		delete source;
+		return false;
+	}
+	uint64 pos = header.ftell();
+
+	source->format.fourscore = movieData.fourscore;
+	memcpy(source->format.ports, movieData.ports, sizeof(movieData.ports));
+	source->binary = movieData.binaryFlag;
+	source->end = len;
+
+	uint64 numRecords = 0;
+	uint64 limit = movieData.loadFrameCount >= 0 ? (uint64)movieData.loadFrameCount : INT_MAX;
+	if(pos > 0 && data[pos-1] == '|')
+	{
+		if(movieData.binaryFlag)
+		{
+			//fixed size records follow the pipe, so the index is just arithmetic
+			source->recordsize = FM2_BinaryRecordSize(movieData);
+			numRecords = std::min((len - pos) / source->recordsize, limit);
+			for(uint64 i=0;i<numRecords;i+=MovieRecordList::CHUNK_SIZE)
+				source->chunkOffsets.push_back(pos + i*source->recordsize);
+		}
+		else
+		{
+			uint64 line = pos-1;
+			while(line < len && numRecords < limit)
+			{
+				const uint8* p = data + line;
+				const uint8* nl = (const uint8*)memchr(p, '\n', (size_t)(len - line));
+				const uint8* next = nl ? nl+1 : data+len;
+				const uint8* eol = nl ? nl : data+len;
+				if(eol > p && eol[-1] == '\r') eol--;
+
+				while(p < eol && (*p == ' ' || *p == '\t')) p++;
+				if(p < eol && *p == '|')
+				{
+					if((numRecords & (MovieRecordList::CHUNK_SIZE-1)) == 0)
+						source->chunkOffsets.push_back(p - data);
+					numRecords++;
+				}
+				else if(p < eol)
+				{
+					//a key after the first record, such as the trailer
+					const uint8* q = p;
+					while(q < eol && *q != ' ' && *q != '\t') q++;
+					std::string key((const char*)p, q - p);
+					while(q < eol && (*q == ' ' || *q == '\t')) q++;
+					std::string value((const char*)q, eol - q);
+					movieData.installValue(key, value);
+				}
+				line = next - data;
+			}
+		}
+	}
+
+	if(numRecords)
+		movieData.records.attach(source, (int)numRecords);
+	else
+		delete source;
+	return true;
+}
+
+//works out how many records follow the header which LoadFM2 stopped after, without parsing them
+static int FM2_CountRecords(MovieData& movieData, EMUFILE* fp, int size)
+{
+	//LoadFM2 stops right after the first record's pipe. if it ran out of file instead, there are no records
+	int start = fp->ftell();
+	if(start <= 0)
+		return 0;
+	fp->fseek(start-1, SEEK_SET);
+	if(fp->fgetc() != '|')
+		return 0;
+
+	//TAS Editor projects say how long their input log is
+	if(movieData.loadFrameCount >= 0)
+		return movieData.loadFrameCount;
+
+	if(movieData.binaryFlag)
+		return (size - start) / FM2_BinaryRecordSize(movieData);
+
+	//text movies end with a frameCount line
+	char tail[65];
+	int tailLen = std::min(size - start, 64);
+	fp->fseek(size - tailLen, SEEK_SET);
+	tailLen = fp->fread(tail, tailLen);
+	tail[tailLen] = 0;
+	int e = tailLen;
+	while(e > 0 && (tail[e-1] == 10 || tail[e-1] == 13)) e--;
+	int b = e;
+	while(b > 0 && tail[b-1] != 10 && tail[b-1] != 13) b--;
+	if(b > 0 && !strncmp(tail+b, "frameCount ", 11))
+		return atoi(tail+b+11);
+
+	//older files don't, so count the lines which start with a pipe
+	std::vector<uint8> buf(65536);
+	int frames = 1;
+	bool linestart = false;
+	fp->fseek(start, SEEK_SET);
+	for(int remain = size - start; remain > 0; )
+	{
+		int got = fp->fread(&buf[0], std::min(remain, (int)buf.size()));
+		if(got <= 0)
+			break;
+		for(int i=0;i<got;i++)
+		{
+			uint8 c = buf[i];
+			if(c == 10 || c == 13)
+				linestart = true;
+			else if(c == '|' && linestart)
+			{
+				frames++;
+				linestart = false;
+			}
+			else if(c != ' ' && c != '\t')
+				linestart = false;
+		}
+		remain -= got;
+	}
+	return frames;
+}
+
 /// Stop movie playback.
 static void StopPlayback()
 {
@@ -733,6 +1402,7 @@ static void closeRecordingMovie()
 {
 	if(osRecordingMovie)
 	{
+		currMovieData.dumpTrailer(osRecordingMovie);
 		delete osRecordingMovie;
 		osRecordingMovie = 0;
 	}
@@ -758,6 +1428,7 @@ void FCEUI_StopMovie()
 		StopRecording();
 
 	curMovieFilename[0] = 0;			//No longer a current movie filename
+	retainedBranches.clear();
 	freshMovie = false;					//No longer a fresh movie loaded
 	if (bindSavestate) AutoSS = false;	//If bind movies to savestates is true, then there is no longer a valid auto-save to load
 
@@ -809,6 +1480,7 @@ void FCEUMOV_CreateCleanMovie()
 	currMovieData.ports[2] = portFC.type;
 	currMovieData.fds = isFDS;
 	currMovieData.PPUflag = (newppu != 0);
+	currMovieData.stateHashInterval = movieStateHashInterval;
 }
 void FCEUMOV_ClearCommands()
 {
@@ -848,6 +1520,7 @@ bool FCEUI_LoadMovie(const char *fname, bool _read_only, int _pauseframe)
 	//--------------
 
 	currMovieData = MovieData();
+	retainedBranches.clear();
 
 	strcpy(curMovieFilename, fname);
 	FCEUFILE *fp = FCEU_fopen(fname,0,"rb",0);
@@ -869,8 +1542,17 @@ bool FCEUI_LoadMovie(const char *fname, bool _read_only, int _pauseframe)
 	AddRecentMovieFile(name.c_str());
 #endif
 
-	LoadFM2(currMovieData, fp->stream, fp->size, false);
+	//plain files are mapped and decoded as they play; archives (and anything the mapped loader balks at) are read in full
+	bool loaded = false;
+	if(!fp->isArchive())
+		loaded = LoadFM2_Mapped(currMovieData, fname);
+	if(!loaded)
+	{
+		currMovieData = MovieData();
+		LoadFM2(currMovieData, fp->stream, fp->size, false);
+	}
 	LoadSubtitles(currMovieData);
+	currMovieData.records.markClean();
 	delete fp;
 
 	freshMovie = true;	//Movie has been loaded, so it must be unaltered
@@ -900,6 +1582,7 @@ bool FCEUI_LoadMovie(const char *fname, bool _read_only, int _pauseframe)
 
 	//stuff that should only happen when we're ready to positively commit to the replay
 	currFrameCounter = 0;
+	movieDesyncFrame = -1;
 	pauseframe = _pauseframe;
 	movie_readonly = _read_only;
 	movieMode = MOVIEMODE_PLAY;
@@ -928,6 +1611,8 @@ bool FCEUI_LoadMovie(const char *fname, bool _read_only, int _pauseframe)
 
 static void openRecordingMovie(const char* fname)
 {
+	//the movie may still be decoding its records from the file we are about to overwrite
+	currMovieData.records.detach();
 	osRecordingMovie = FCEUD_UTF8_fstream(fname, "wb");
 	if(!osRecordingMovie)
 		FCEU_PrintError("Error opening movie output file: %s",fname);
@@ -950,6 +1635,9 @@ void FCEUI_SaveMovie(const char *fname, EMOVIE_FLAG flags, std::wstring author)
 
 	FCEUI_StopMovie();
 
+	//the old movie is no longer needed, so don't bother decoding the rest of it
+	currMovieData.records.clear();
+	retainedBranches.clear();
 	openRecordingMovie(fname);
 
 	currFrameCounter = 0;
@@ -982,6 +1670,52 @@ void FCEUI_SaveMovie(const char *fname, EMOVIE_FLAG flags, std::wstring author)
 }
 
 
+//a hash of the state the movie's input has led to: the RAM in the upper half, the CPU, PPU, APU and mapper in the lower.
+//the input ports are left out, as the pads are read into them before the movie gets to say what they hold
+static uint64 MovieStateHash()
+{
+	uint32 crc[FCEUSS_PART_COUNT];
+	FCEUSS_PartChecksums(crc);
+	uint32 rest = 0;
+	for(int i=0;i<FCEUSS_PART_COUNT;i++)
+	{
+		if(i == FCEUSS_PART_RAM || i == FCEUSS_PART_INPUT)
+			continue;
+		uint8 b[4];
+		FCEU_en32lsb(b, crc[i]);
+		rest = CalcCRC32(rest, b, 4);
+	}
+	return ((uint64)crc[FCEUSS_PART_RAM] << 32) | rest;
+}
+
+//tells of the first frame whose state doesn't match the movie's hash of it
+static void CheckStateHash()
+{
+	if(movieDesyncFrame >= 0 || currMovieData.stateHashes.empty())
+		return;
+	std::map<int,uint64>::iterator hash = currMovieData.stateHashes.find(currFrameCounter);
+	if(hash == currMovieData.stateHashes.end())
+		return;
+	uint64 now = MovieStateHash();
+	if(now == hash->second)
+		return;
+	movieDesyncFrame = currFrameCounter;
+	FCEU_DispMessage("Movie desynced at frame %d.",0,currFrameCounter);
+	FCEU_PrintError("Movie desync at frame %d: the state hash is %016llX, the movie has %016llX.",
+		currFrameCounter, (unsigned long long)now, (unsigned long long)hash->second);
+}
+
+//adds the hash of the frame about to be recorded, if it is due one, to the movie and its file
+static void RecordStateHash()
+{
+	int interval = currMovieData.stateHashInterval;
+	if(interval <= 0 || currFrameCounter % interval || currMovieData.stateHashes.count(currFrameCounter))
+		return;
+	uint64 hash = MovieStateHash();
+	currMovieData.stateHashes[currFrameCounter] = hash;
+	MovieData::dumpStateHash(osRecordingMovie, currFrameCounter, hash);
+}
+
 //the main interaction point between the emulator and the movie system.
 //either dumps the current joystick state or loads one state from the movie
 void FCEUMOV_AddInputState()
@@ -1031,7 +1765,7 @@ void FCEUMOV_AddInputState()
 			portFC.driver->Update(portFC.ptr,portFC.attrib);
 		} else
 		{
-			MovieRecord* mr = &currMovieData.records[currFrameCounter];
+			MovieRecord* mr = &currMovieData.records.read(currFrameCounter);
 
 			//reset and power cycle if necessary
 			if(mr->command_power())
@@ -1049,6 +1783,9 @@ void FCEUMOV_AddInputState()
 			joyports[1].load(mr);
 		}
 
+		//recording took the hash once the frame's commands were done, as they are done as soon as they are given
+		CheckStateHash();
+
 		//if we are on the last frame, then pause the emulator if the player requested it
 		if (currFrameCounter == currMovieData.records.size()-1)
 		{
@@ -1077,11 +1814,19 @@ void FCEUMOV_AddInputState()
 		//Adelikat: in normal mode, this is done at the time of loading a savestate in read+write mode
 		//If the user chooses it can be delayed to here
 		if (fullSaveStateLoads && (currFrameCounter < (int)currMovieData.records.size()))
+		{
 			currMovieData.truncateAt(currFrameCounter);
+			//the file still has the frames we just dropped, so it has to be written again
+			closeRecordingMovie();
+			openRecordingMovie(curMovieFilename);
+			currMovieData.dump(osRecordingMovie, false/*currMovieData.binaryFlag*/);
+		}
 
+		RecordStateHash();
 		mr.dump(&currMovieData, osRecordingMovie,currMovieData.records.size());	// to disk
 
 		currMovieData.records.push_back(mr);
+		currMovieData.records.markClean();
 	}
 
 	currFrameCounter++;
@@ -1158,40 +1903,194 @@ void FCEU_DrawLagCounter(uint8 *XBuf)
 	}
 }
 
+//savestates made during a movie refer to it instead of carrying all of it: they hold the movie's guid and length,
+//a hash of each block of its records, and only the records from the first block which the movie file may lack.
+//the other records are taken back from the current movie (or a timeline it replaced) when their hashes match
+#define MOVIE_STATE_VERSION 1
+
+struct MovieStateRef
+{
+	MovieStateRef() : length(0), frame(0), frameHash(0), tailStart(0), movie(0) {}
+
+	FCEU_Guid guid;
+	int length;
+	//the frame the savestate was made on
+	int frame;
+	std::vector<uint32> blockHashes;
+	//hash of the records from the start of the block holding `frame` up to it
+	uint32 frameHash;
+	//the records [tailStart,length) which the savestate carries
+	int tailStart;
+	MovieRecordList tail;
+	//the whole savestated movie, for older savestates which stored one
+	MovieData* movie;
+};
+
+static void HashStateMovie(MovieStateRef& ref, MovieRecordList& records)
+{
+	ref.length = (int)records.size();
+	ref.blockHashes.resize((ref.length + MovieRecordList::CHUNK_SIZE - 1) >> MovieRecordList::CHUNK_SHIFT);
+	for(int i=0;i<(int)ref.blockHashes.size();i++)
+		ref.blockHashes[i] = records.blockHash(i);
+	ref.frameHash = 0;
+	if(ref.frame < ref.length)
+		ref.frameHash = records.hashRange(ref.frame & ~(MovieRecordList::CHUNK_SIZE-1), ref.frame);
+}
+
 int FCEUMOV_WriteState(EMUFILE* os)
 {
-	//we are supposed to dump the movie data into the savestate
-	if(movieMode == MOVIEMODE_RECORD || movieMode == MOVIEMODE_PLAY || movieMode == MOVIEMODE_FINISHED)
-		return currMovieData.dump(os, true);
-	else return 0;
+	//we are supposed to refer to the movie data from the savestate
+	if(!(movieMode == MOVIEMODE_RECORD || movieMode == MOVIEMODE_PLAY || movieMode == MOVIEMODE_FINISHED))
+		return 0;
+
+	MovieRecordList& records = currMovieData.records;
+	MovieStateRef ref;
+	ref.frame = currFrameCounter;
+	HashStateMovie(ref, records);
+	//the tail starts on a block boundary, so the block hashes cover everything before it
+	ref.tailStart = ref.length;
+	if(records.cleanLength() < ref.length)
+		ref.tailStart = records.cleanLength() & ~(MovieRecordList::CHUNK_SIZE-1);
+
+	int start = os->ftell();
+	write32le(MOVIE_STATE_VERSION, os);
+	os->fwrite((char*)currMovieData.guid.data, FCEU_Guid::size);
+	write32le(ref.length, os);
+	write32le(ref.frame, os);
+	write32le(ref.blockHashes.size(), os);
+	for(int i=0;i<(int)ref.blockHashes.size();i++)
+		write32le(ref.blockHashes[i], os);
+	write32le(ref.frameHash, os);
+	write32le(ref.tailStart, os);
+	//the tail is stored in the binary movie format, which depends on the ports
+	write8le(currMovieData.fourscore ? 1 : 0, os);
+	write32le(currMovieData.ports[0], os);
+	write32le(currMovieData.ports[1], os);
+	for(int i=ref.tailStart;i<ref.length;i++)
+		records.read(i).dumpBinary(&currMovieData, os, i);
+	return os->ftell() - start;
+}
+
+//whether the first `limit` records of the list are the savestated movie's, as far as its hashes tell
+static bool MatchesStateMovie(MovieStateRef& ref, MovieRecordList& records, int limit)
+{
+	if((int)records.size() < limit)
+		return false;
+	int blocks = limit >> MovieRecordList::CHUNK_SHIFT;
+	for(int i=0;i<blocks;i++)
+		if(records.blockHash(i) != ref.blockHashes[i])
+			return false;
+	int blockStart = blocks << MovieRecordList::CHUNK_SHIFT;
+	if(limit == blockStart)
+		return true;
+	uint32 hash = records.hashRange(blockStart, limit);
+	if(limit == ref.length)
+		return hash == ref.blockHashes[blocks];
+	if(limit == ref.frame)
+		return hash == ref.frameHash;
+	//no hash ends there
+	return false;
 }
 
-// returns
-int CheckTimelines(MovieData& stateMovie, MovieData& currMovie)
+//puts together the first `needed` records of the savestated movie
+static bool RebuildStateMovie(MovieStateRef& ref, int needed, MovieRecordList& records)
 {
-	// end_frame = min(urrMovie.records.size(), stateMovie.records.size(), currFrameCounter)
-	int end_frame = currMovie.records.size();
-	if (end_frame > (int)stateMovie.records.size())
-		end_frame = stateMovie.records.size();
+	if(ref.tailStart == 0)
+	{
+		records = ref.tail;
+		records.resize(needed);
+		return true;
+	}
+
+	int limit = std::min(needed, ref.tailStart);
+	MovieRecordList* from = 0;
+	if(MatchesStateMovie(ref, currMovieData.records, limit))
+		from = &currMovieData.records;
+	for(int i=(int)retainedBranches.size()-1;i>=0 && !from;i--)
+		if(MatchesStateMovie(ref, retainedBranches[i], limit))
+			from = &retainedBranches[i];
+	if(!from)
+		return false;
+
+	records = *from;
+	records.resize(limit);
+	for(int i=limit;i<needed;i++)
+		records.push_back(ref.tail.read(i - ref.tailStart));
+	return true;
+}
+
+// returns the first frame at which the current movie leaves the savestated movie's timeline, or -1.
+// outside of the savestate's tail this can only be told to the block
+int CheckTimelines(MovieStateRef& ref, MovieRecordList& records)
+{
+	// end_frame = min(records.size(), ref.length, currFrameCounter)
+	int end_frame = records.size();
+	if (end_frame > ref.length)
+		end_frame = ref.length;
 	if (end_frame > currFrameCounter)
 		end_frame = currFrameCounter;
 
-	for (int x = 0; x < end_frame; x++)
+	int blocks = (end_frame + MovieRecordList::CHUNK_SIZE - 1) >> MovieRecordList::CHUNK_SHIFT;
+	for (int i = 0; i < blocks; i++)
 	{
-		if (!stateMovie.records[x].Compare(currMovie.records[x]))
-			return x;
+		int blockStart = i << MovieRecordList::CHUNK_SHIFT;
+		int blockEnd = std::min(blockStart + MovieRecordList::CHUNK_SIZE, end_frame);
+		bool match;
+		if (blockEnd - blockStart == MovieRecordList::CHUNK_SIZE)
+			match = records.blockHash(i) == ref.blockHashes[i];
+		else if (blockEnd == ref.length)
+			match = records.hashRange(blockStart, blockEnd) == ref.blockHashes[i];
+		else if (blockEnd == ref.frame)
+			match = records.hashRange(blockStart, blockEnd) == ref.frameHash;
+		else
+			// the current movie ends first, which is a future event error
+			match = true;
+		if (match)
+			continue;
+
+		if (blockStart < ref.tailStart)
+			return blockStart;
+		for (int x = blockStart; x < blockEnd; x++)
+		{
+			//copied, since the two lists may share chunks
+			MovieRecord stateRecord = ref.tail.read(x - ref.tailStart);
+			if (!stateRecord.Compare(records.read(x)))
+				return x;
+		}
+		return blockStart;
 	}
 	// no mismatch found
 	return -1;
 }
 
 
-static bool load_successful;
+//the first frame at which two input logs differ, or the length of the shorter one
+static int FirstDifferentRecord(MovieRecordList& a, MovieRecordList& b)
+{
+	int len = (int)std::min(a.size(), b.size());
+	int blocks = len >> MovieRecordList::CHUNK_SHIFT;
+	int block = 0;
+	while(block < blocks && a.blockHash(block) == b.blockHash(block))
+		block++;
+	for(int x = block << MovieRecordList::CHUNK_SHIFT; x < len; x++)
+	{
+		//copied, since the two lists may share chunks
+		MovieRecord rec = a.read(x);
+		if(!rec.Compare(b.read(x)))
+			return x;
+	}
+	return len;
+}
 
-bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
+static bool SameRecords(MovieRecordList& a, MovieRecordList& b)
 {
-	load_successful = false;
+	return a.size() == b.size() && FirstDifferentRecord(a, b) == (int)a.size();
+}
+
+static bool load_successful;
 
+static bool LoadStateMovie(MovieStateRef& ref)
+{
 	if (!movie_readonly)
 	{
 		if (currMovieData.loadFrameCount >= 0)
@@ -1214,26 +2113,11 @@ bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
 		}
 	}
 
-	MovieData tempMovieData = MovieData();
-	std::ios::pos_type curr = is->ftell();
-	if(!LoadFM2(tempMovieData, is, size, false)) {
-		is->fseek((uint32)curr+size,SEEK_SET);
-		extern bool FCEU_state_loading_old_format;
-		if(FCEU_state_loading_old_format) {
-			if(movieMode == MOVIEMODE_PLAY || movieMode == MOVIEMODE_RECORD || movieMode == MOVIEMODE_FINISHED) {
-				//FCEUI_StopMovie();  //No reason to stop the movie, nothing destructive has happened yet.
-				FCEU_PrintError("You have tried to use an old savestate while playing a movie. This is unsupported (since the old savestate has old-format movie data in it which can't be converted on the fly)");
-			}
-		}
-		return false;
-	}
-
 	//----------------
 	//complex TAS logic for loadstate
 	//fully conforms to the savestate logic documented in the Laws of TAS
 	//http://tasvideos.org/LawsOfTAS/OnSavestates.html
 	//----------------
-
 	/*
 	Playback or Recording + Read-only
 
@@ -1281,11 +2165,11 @@ bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
 	if(movieMode == MOVIEMODE_PLAY || movieMode == MOVIEMODE_RECORD || movieMode == MOVIEMODE_FINISHED)
 	{
 		//handle moviefile mismatch
-		if(tempMovieData.guid != currMovieData.guid)
+		if(ref.guid != currMovieData.guid)
 		{
 			//mbg 8/18/08 - this code  can be used to turn the error message into an OK/CANCEL
 			#ifdef WIN32
-				std::string msg = "There is a mismatch between savestate's movie and current movie.\ncurrent: " + currMovieData.guid.toString() + "\nsavestate: " + tempMovieData.guid.toString() + "\n\nThis means that you have loaded a savestate belonging to a different movie than the one you are playing now.\n\nContinue loading this savestate anyway?";
+				std::string msg = "There is a mismatch between savestate's movie and current movie.\ncurrent: " + currMovieData.guid.toString() + "\nsavestate: " + ref.guid.toString() + "\n\nThis means that you have loaded a savestate belonging to a different movie than the one you are playing now.\n\nContinue loading this savestate anyway?";
 				extern HWND pwindow;
 				int result = MessageBox(pwindow,msg.c_str(),"Error loading savestate",MB_OKCANCEL);
 				if(result == IDCANCEL)
@@ -1301,22 +2185,40 @@ bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
 			#else
 				if (!backupSavestates) //If backups are disabled we can just resume normally since we can't restore so stop movie and inform user
 				{
-					FCEU_PrintError("Mismatch between savestate's movie and current movie.\ncurrent: %s\nsavestate: %s\nUnable to restore backup, movie playback stopped.\n",currMovieData.guid.toString().c_str(),tempMovieData.guid.toString().c_str());
+					FCEU_PrintError("Mismatch between savestate's movie and current movie.\ncurrent: %s\nsavestate: %s\nUnable to restore backup, movie playback stopped.\n",currMovieData.guid.toString().c_str(),ref.guid.toString().c_str());
 					FCEUI_StopMovie();
 				}
 				else
-				FCEU_PrintError("Mismatch between savestate's movie and current movie.\ncurrent: %s\nsavestate: %s\n",currMovieData.guid.toString().c_str(),tempMovieData.guid.toString().c_str());
+				FCEU_PrintError("Mismatch between savestate's movie and current movie.\ncurrent: %s\nsavestate: %s\n",currMovieData.guid.toString().c_str(),ref.guid.toString().c_str());
 
 				return false;
 			#endif
 		}
 
+		//in read+write mode the savestated movie replaces ours, so make sure it can be put together before anything is touched.
+		//unless the user selects a full copy option, it is truncated to the savestate's frame right away
+		MovieRecordList stateRecords;
+		if (!movie_readonly)
+		{
+			int needed = (currFrameCounter > ref.length || fullSaveStateLoads) ? ref.length : currFrameCounter;
+			if (!RebuildStateMovie(ref, needed, stateRecords))
+			{
+				if (!backupSavestates)	//If backups are disabled we can just resume normally since we can't restore so stop movie and inform user
+				{
+					FCEU_PrintError("Error: Savestate's movie can't be rebuilt, its first %d frames are not in the current movie.\nUnable to restore backup, movie playback stopped.", std::min(needed, ref.tailStart));
+					FCEUI_StopMovie();
+				} else
+					FCEU_PrintError("Error: Savestate's movie can't be rebuilt, its first %d frames are not in the current movie.", std::min(needed, ref.tailStart));
+				return false;
+			}
+		}
+
 		closeRecordingMovie();
 
 		if (movie_readonly)
 		{
 			// currFrameCounter at this point represents the savestate framecount
-			int frame_of_mismatch = CheckTimelines(tempMovieData, currMovieData);
+			int frame_of_mismatch = CheckTimelines(ref, currMovieData.records);
 			if (frame_of_mismatch >= 0)
 			{
 				// Wrong timeline, do apprioriate logic here
@@ -1329,7 +2231,7 @@ bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
 				return false;
 			} else if (movieMode == MOVIEMODE_FINISHED
 				&& currFrameCounter > (int)currMovieData.records.size()
-				&& currMovieData.records.size() == tempMovieData.records.size())
+				&& (int)currMovieData.records.size() == ref.length)
 			{
 				// special case (in MOVIEMODE_FINISHED mode)
 				// allow loading post-movie savestates that were made after finishing current movie
@@ -1345,16 +2247,16 @@ bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
 				} else
 					FCEU_PrintError("Savestate is from a frame (%d) after the final frame in the movie (%d). This is not permitted.", currFrameCounter, currMovieData.records.size()-1);
 				return false;
-			} else if (currFrameCounter > (int)tempMovieData.records.size())
+			} else if (currFrameCounter > ref.length)
 			{
 				// this is post-movie savestate, don't allow it
 				//TODO: turn frame counter to red to get attention
 				if (!backupSavestates)	//If backups are disabled we can just resume normally since we can't restore so stop movie and inform user
 				{
-					FCEU_PrintError("Error: Savestate is from a frame (%d) after the final frame in the savestated movie (%d). This is not permitted.\nUnable to restore backup, movie playback stopped.", currFrameCounter, tempMovieData.records.size()-1);
+					FCEU_PrintError("Error: Savestate is from a frame (%d) after the final frame in the savestated movie (%d). This is not permitted.\nUnable to restore backup, movie playback stopped.", currFrameCounter, ref.length-1);
 					FCEUI_StopMovie();
 				} else
-					FCEU_PrintError("Savestate is from a frame (%d) after the final frame in the savestated movie (%d). This is not permitted.", currFrameCounter, tempMovieData.records.size()-1);
+					FCEU_PrintError("Savestate is from a frame (%d) after the final frame in the savestated movie (%d). This is not permitted.", currFrameCounter, ref.length-1);
 				return false;
 			} else
 			{
@@ -1364,25 +2266,37 @@ bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
 		} else
 		{
 			//Read+Write mode
-			if (currFrameCounter > (int)tempMovieData.records.size())
+			//keep the timeline being replaced, older savestates may still need its records.
+			//nothing is lost when the savestated movie carries all of it, or it was kept already
+			int diverge = FirstDifferentRecord(currMovieData.records, stateRecords);
+			if (diverge < (int)currMovieData.records.size()
+				&& (retainedBranches.empty() || !SameRecords(retainedBranches.back(), currMovieData.records)))
+			{
+				retainedBranches.push_back(currMovieData.records);
+				if (retainedBranches.size() > MOVIE_RETAINED_BRANCHES)
+					retainedBranches.pop_front();
+			}
+			if (ref.movie)
+				currMovieData = *ref.movie;
+			currMovieData.records = stateRecords;
+			//the state hashes only hold as far as the input they were taken with
+			if (!ref.movie)
+				currMovieData.dropStateHashesAfter(diverge);
+
+			if (currFrameCounter > ref.length)
 			{
 				//This is a post movie savestate, handle it differently
 				//Replace movie contents but then switch to movie finished mode
-				currMovieData = tempMovieData;
 				openRecordingMovie(curMovieFilename);
 				currMovieData.dump(osRecordingMovie, false/*currMovieData.binaryFlag*/);
+				currMovieData.records.markClean();
 				FinishPlayback();
 			} else
 			{
-				//truncate before we copy, just to save some time, unless the user selects a full copy option
-				if (!fullSaveStateLoads)
-					//we can only assume this here since we have checked that the frame counter is not greater than the movie data
-					tempMovieData.truncateAt(currFrameCounter);
-				
-				currMovieData = tempMovieData;
 				FCEUMOV_IncrementRerecordCount();
 				openRecordingMovie(curMovieFilename);
 				currMovieData.dump(osRecordingMovie, false/*currMovieData.binaryFlag*/);
+				currMovieData.records.markClean();
 				movieMode = MOVIEMODE_RECORD;
 
 			}
@@ -1390,10 +2304,81 @@ bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
 	}
 
 	load_successful = true;
+	movieDesyncFrame = -1;
 
 	return true;
 }
 
+bool FCEUMOV_ReadStateRef(EMUFILE* is, uint32 size)
+{
+	load_successful = false;
+
+	MovieStateRef ref;
+	MovieData format;
+	int start = is->ftell();
+	uint32 version = 0, blocks = 0;
+	uint8 fourscore = 0;
+	bool ok = read32le(&version, is) && version == MOVIE_STATE_VERSION
+		&& is->fread((char*)ref.guid.data, FCEU_Guid::size) == FCEU_Guid::size
+		&& read32le(&ref.length, is) && read32le(&ref.frame, is) && read32le(&blocks, is)
+		&& ref.length >= 0 && ref.frame >= 0
+		&& blocks == (uint32)((ref.length + MovieRecordList::CHUNK_SIZE - 1) >> MovieRecordList::CHUNK_SHIFT)
+		&& blocks*4 <= size;
+	if(ok)
+	{
+		ref.blockHashes.resize(blocks);
+		for(uint32 i=0;i<blocks && ok;i++)
+			ok = read32le(&ref.blockHashes[i], is) != 0;
+		ok = ok && read32le(&ref.frameHash, is) && read32le(&ref.tailStart, is)
+			&& ref.tailStart >= 0 && ref.tailStart <= ref.length
+			&& (ref.tailStart == ref.length || (ref.tailStart & (MovieRecordList::CHUNK_SIZE-1)) == 0)
+			&& read8le(&fourscore, is) && read32le(&format.ports[0], is) && read32le(&format.ports[1], is);
+		format.fourscore = fourscore != 0;
+		for(int i=ref.tailStart;i<ref.length && ok;i++)
+		{
+			MovieRecord rec;
+			ok = rec.parseBinary(&format, is);
+			ref.tail.push_back(rec);
+		}
+	}
+	is->fseek(start+size, SEEK_SET);
+	if(!ok)
+	{
+		FCEU_PrintError("The savestate's movie information is damaged.");
+		return false;
+	}
+
+	return LoadStateMovie(ref);
+}
+
+bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
+{
+	load_successful = false;
+
+	MovieData tempMovieData = MovieData();
+	std::ios::pos_type curr = is->ftell();
+	if(!LoadFM2(tempMovieData, is, size, false)) {
+		is->fseek((uint32)curr+size,SEEK_SET);
+		extern bool FCEU_state_loading_old_format;
+		if(FCEU_state_loading_old_format) {
+			if(movieMode == MOVIEMODE_PLAY || movieMode == MOVIEMODE_RECORD || movieMode == MOVIEMODE_FINISHED) {
+				//FCEUI_StopMovie();  //No reason to stop the movie, nothing destructive has happened yet.
+				FCEU_PrintError("You have tried to use an old savestate while playing a movie. This is unsupported (since the old savestate has old-format movie data in it which can't be converted on the fly)");
+			}
+		}
+		return false;
+	}
+
+	//the whole movie is in the savestate, so it all counts as the tail
+	MovieStateRef ref;
+	ref.guid = tempMovieData.guid;
+	ref.frame = currFrameCounter;
+	HashStateMovie(ref, tempMovieData.records);
+	ref.tail = tempMovieData.records;
+	ref.movie = &tempMovieData;
+	return LoadStateMovie(ref);
+}
+
 void FCEUMOV_PreLoad(void)
 {
 	load_successful=0;
@@ -1454,6 +2439,16 @@ void FCEUI_ToggleInputDisplay(void)
 	}
 }
 
+void FCEUI_SetMovieStateHashInterval(int frames)
+{
+	movieStateHashInterval = frames > 0 ? frames : 0;
+}
+
+int FCEUI_GetMovieDesyncFrame()
+{
+	return movieDesyncFrame;
+}
+
 int FCEUI_GetMovieLength()
 {
 	return currMovieData.records.size();
@@ -1553,8 +2548,9 @@ string FCEUI_GetMovieName(void)
 
 bool FCEUI_MovieGetInfo(FCEUFILE* fp, MOVIE_INFO& info, bool skipFrameCount)
 {
+	//only the header is parsed; the length comes from the trailer, or the size of a binary input log
 	MovieData md;
-	if(!LoadFM2(md, fp->stream, fp->size, skipFrameCount))
+	if(!LoadFM2(md, fp->stream, fp->size, true))
 		return false;
 
 	info.movie_version = md.version;
@@ -1563,7 +2559,7 @@ bool FCEUI_MovieGetInfo(FCEUFILE* fp, MOVIE_INFO& info, bool skipFrameCount)
 	info.pal = md.palFlag;
 	info.ppuflag = md.PPUflag;
 	info.nosynchack = true;
-	info.num_frames = md.records.size();
+	info.num_frames = skipFrameCount ? 0 : FM2_CountRecords(md, fp->stream, fp->size);
 	info.md5_of_rom_used = md.romChecksum;
 	info.emu_version_used = md.emuVersion;
 	info.name_of_rom_used = md.romFilename;
@@ -1629,10 +2625,15 @@ void FCEU_DisplaySubtitles(char *format, ...)
 
 void FCEUI_CreateMovieFile(std::string fn)
 {
+	if (fn == curMovieFilename)
+		currMovieData.records.detach();						//a mapped movie can't read from a file being rewritten
 	MovieData md = currMovieData;							//Get current movie data
 	EMUFILE* outf = FCEUD_UTF8_fstream(fn, "wb");		//open/create file
 	md.dump(outf,false);									//dump movie data
+	md.dumpTrailer(outf);
 	delete outf;											//clean up, delete file object
+	if (fn == curMovieFilename)
+		currMovieData.records.markClean();
 }
 
 void FCEUI_MakeBackupMovie(bool dispMessage)
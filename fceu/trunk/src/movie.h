@@ -6,6 +6,7 @@
 #include "utils/md5.h"
 
 #include <vector>
+#include <deque>
 #include <map>
 #include <string>
 #include <ostream>
@@ -86,6 +87,9 @@ bool FCEUI_GetLagged(void);
 void FCEUI_SetLagFlag(bool value);
 
 int FCEUMOV_WriteState(EMUFILE* os);
+//reads the movie a savestate refers to (what FCEUMOV_WriteState writes)
+bool FCEUMOV_ReadStateRef(EMUFILE* is, uint32 size);
+//reads a whole movie stored in an older savestate
 bool FCEUMOV_ReadState(EMUFILE* is, uint32 size);
 void FCEUMOV_PreLoad();
 bool FCEUMOV_PostLoad();
@@ -162,6 +166,102 @@ private:
 	int mask(int bit) { return 1<<bit; }
 };
 
+class MovieRecordSource;
+
+//the input log of a movie. it behaves like the std::vector<MovieRecord> it replaces, but is a piece table: a list of
+//pieces, each a range of records in a refcounted chunk. copies share chunks and only copy one when writing to it, and
+//inserting or erasing frames splits and drops pieces instead of moving every record after them. chunks can also live
+//in a mapped movie file, to be decoded one at a time as they are reached.
+class MovieRecordList
+{
+public:
+	enum { CHUNK_SHIFT = 10, CHUNK_SIZE = 1<<CHUNK_SHIFT };
+	//how many clean chunks read() keeps decoded before discarding the oldest
+	enum { READ_CACHE_CHUNKS = 16 };
+
+	MovieRecordList();
+	MovieRecordList(const MovieRecordList& other);
+	MovieRecordList& operator=(const MovieRecordList& other);
+	~MovieRecordList();
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	//returns a record which may be modified. its chunk is copied first if it is shared, and stays in memory from now on
+	MovieRecord& operator[](int index);
+	//returns a record which will only be read. the reference is good until the next call; chunks which were only
+	//read this way may be dropped and decoded again later, so streaming through a huge movie needs little memory
+	MovieRecord& read(int index);
+
+	void resize(size_t newCount);
+	void reserve(size_t newCount);
+	void push_back(const MovieRecord& rec);
+	void clear();
+	void insert(int at, int frames, const MovieRecord& rec);
+	void erase(int at, int frames);
+
+	//takes records [0,count) from the source, to be decoded as they are needed
+	void attach(MovieRecordSource* source, int count);
+	//decodes everything still left in a source and lets go of it. do this before the source's file is rewritten
+	void detach();
+	bool isAttached() const;
+
+	//crc32 of records [start,end)
+	uint32 hashRange(int start, int end);
+	//crc32 of the records of block number `block` (CHUNK_SIZE records, or whatever is left of the last one).
+	//full blocks are hashed once and remembered until one of their records is modified
+	uint32 blockHash(int block);
+
+	//how many leading records are unchanged since the last markClean(). the movie code marks the list clean
+	//whenever its file holds exactly these records, so that savestates don't have to carry them
+	int cleanLength() const { return clean; }
+	void markClean() { clean = (int)count; }
+
+private:
+	struct Chunk
+	{
+		Chunk() : refs(1), cacheRefs(0), loaded(true), source(0), sourceChunk(-1) {}
+		//how many pieces (in any list) and read caches hold this chunk
+		int refs, cacheRefs;
+		std::vector<MovieRecord> recs;
+		//whether recs holds the records. a chunk which is still in its source may be dropped again after reading
+		bool loaded;
+		//where the records can be decoded from; none once they have been modified
+		MovieRecordSource* source;
+		int sourceChunk;
+	};
+
+	struct Piece
+	{
+		Chunk* chunk;
+		int offset, length;
+	};
+
+	static void releaseChunk(Chunk* chunk);
+	static void loadChunk(Chunk* chunk);
+	int findPiece(int index);
+	int splitAt(int index);
+	void makeWritable(int piece);
+	void coalesce(int first, int last);
+	void updateStarts(int from);
+	void appendChunks(int frames, const MovieRecord& rec, std::vector<Piece>& out);
+	void release();
+	//forgets the hashes and cleanness of everything from index on
+	void modified(int index);
+
+	std::vector<Piece> pieces;
+	//the index of the first record of each piece
+	std::vector<int> starts;
+	size_t count;
+	//the last piece found, since access is mostly sequential
+	int hint;
+	std::deque<Chunk*> readCache;
+	//hashes of the full blocks [0,hashedBlocks)
+	std::vector<uint32> hashes;
+	int hashedBlocks;
+	int clean;
+};
+
 class MovieData
 {
 public:
@@ -177,7 +277,7 @@ public:
 	MD5DATA romChecksum;
 	std::string romFilename;
 	std::vector<uint8> savestate;
-	std::vector<MovieRecord> records;
+	MovieRecordList records;
 	std::vector<std::wstring> comments;
 	std::vector<std::string> subtitles;
 	//this is the RERECORD COUNT. please rename variable.
@@ -191,6 +291,10 @@ public:
 
 	//which ports are defined for the movie
 	int ports[3];
+	//the state hash track: every stateHashInterval frames of recording, a hash of the state at the start of the frame,
+	//once its reset or power command is done, by frame. playback checks them to tell of a desync the frame it happens. an interval of 0 records none
+	int stateHashInterval;
+	std::map<int,uint64> stateHashes;
 	//whether fourscore is enabled
 	bool fourscore;
 	//whether microphone is enabled
@@ -227,8 +331,13 @@ public:
 	};
 
 	void truncateAt(int frame);
+	//forgets the state hashes after the frame, whose input has changed
+	void dropStateHashesAfter(int frame);
 	void installValue(std::string& key, std::string& val);
 	int dump(EMUFILE* os, bool binary);
+	//writes the "frameCount" line which ends a text movie file, so its length can be known without parsing it
+	void dumpTrailer(EMUFILE* os);
+	static void dumpStateHash(EMUFILE* os, int frame, uint64 hash);
 
 	void clearRecordRange(int start, int len);
 	void eraseRecords(int at, int frames = 1);
@@ -271,6 +380,10 @@ void FCEUI_MovieToggleReadOnly(void);
 bool FCEUI_GetMovieToggleReadOnly();
 void FCEUI_SetMovieToggleReadOnly(bool which);
 int FCEUI_GetMovieLength();
+//movies recorded from now on get a state hash every `frames` frames; 0, the default, for none
+void FCEUI_SetMovieStateHashInterval(int frames);
+//the frame of the first state hash which didn't match since the movie started playing or a state was loaded, or -1
+int FCEUI_GetMovieDesyncFrame();
 int FCEUI_GetMovieRerecordCount();
 std::string FCEUI_GetMovieName(void);
 void FCEUI_MovieToggleFrameDisplay();
@@ -29,6 +29,7 @@
 #include "nsf.h"
 #include "utils/general.h"
 #include "utils/memory.h"
+#include "utils/endian.h"
 #include "file.h"
 #include "fds.h"
 #include "cart.h"
@@ -47,6 +48,9 @@
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
+#include <vector>
+#include <map>
+#include <algorithm>
 
 static const int FIXED_EXWRAM_SIZE = 32768+8192;
 
@@ -436,23 +440,23 @@ static DECLFR(NSF_read)
 		{
 			memset(RAM,0x00,0x800);
 
-			BWrite[0x4015](0x4015,0x0);
+			FCEU_CPUWrite(0x4015,0x0);
 			for(x=0;x<0x14;x++)
-				BWrite[0x4000+x](0x4000+x,0);
-			BWrite[0x4015](0x4015,0xF);
+				FCEU_CPUWrite(0x4000+x,0);
+			FCEU_CPUWrite(0x4015,0xF);
 
 			if(NSFHeader.SoundChip&4)
 			{
-				BWrite[0x4017](0x4017,0xC0);  /* FDS BIOS writes $C0 */
-				BWrite[0x4089](0x4089,0x80);
-				BWrite[0x408A](0x408A,0xE8);
+				FCEU_CPUWrite(0x4017,0xC0);  /* FDS BIOS writes $C0 */
+				FCEU_CPUWrite(0x4089,0x80);
+				FCEU_CPUWrite(0x408A,0xE8);
 			}
 			else
 			{
 				memset(ExWRAM,0x00,8192);
-				BWrite[0x4017](0x4017,0xC0);
-				BWrite[0x4017](0x4017,0xC0);
-				BWrite[0x4017](0x4017,0x40);
+				FCEU_CPUWrite(0x4017,0xC0);
+				FCEU_CPUWrite(0x4017,0xC0);
+				FCEU_CPUWrite(0x4017,0x40);
 			}
 
 			if(BSon)
@@ -646,3 +650,203 @@ int FCEUI_NSFGetInfo(uint8 *name, uint8 *artist, uint8 *copyright, int maxlen)
 	strncpy((char*)copyright,(char*)NSFHeader.Copyright,maxlen); //mbg merge 7/17/06 added casts
 	return(NSFHeader.TotalSongs);
 }
+
+//samples this close to 0 count as silence
+static const int NSFRENDER_SILENCE_LEVEL = 8;
+//a track which has been silent this long has ended
+static const int NSFRENDER_SILENCE_SECONDS = 3;
+//two points of a track are taken to be the same when this much of the sound register writes before them match
+static const int NSFRENDER_LOOP_WINDOW_SECONDS = 3;
+//how long a looping track fades out for
+static const int NSFRENDER_FADE_SECONDS = 5;
+
+//the write handlers the tap passes the writes on to
+static std::vector<writefunc> NSFRenderWrites;
+//hash of the sound register writes of the current frame
+static uint32 NSFRenderHash;
+
+static DECLFW(NSFRenderTap)
+{
+	NSFRenderHash = (NSFRenderHash ^ ((A << 8) | V)) * 16777619;
+	NSFRenderWrites[A](A, V);
+}
+
+static void NSFRenderTapWrites(int32 start, int32 end)
+{
+	for(int32 a = start; a <= end; a++)
+		NSFRenderWrites[a] = GetWriteHandler(a);
+	SetWriteHandler(start, end, NSFRenderTap);
+}
+
+static void NSFRenderUntapWrites(int32 start, int32 end)
+{
+	int32 run = start;
+	for(int32 a = start + 1; a <= end + 1; a++)
+	{
+		if(a <= end && NSFRenderWrites[a] == NSFRenderWrites[run])
+			continue;
+		SetWriteHandler(run, a - 1, NSFRenderWrites[run]);
+		run = a;
+	}
+}
+
+static void NSFRenderHeader(uint8 *header, uint32 samples)
+{
+	memcpy(header, "RIFF", 4);
+	FCEU_en32lsb(header + 4, 36 + samples * 2);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	FCEU_en32lsb(header + 16, 16);
+	FCEU_en16lsb(header + 20, 1); //PCM
+	FCEU_en16lsb(header + 22, 1); //mono
+	FCEU_en32lsb(header + 24, FSettings.SndRate);
+	FCEU_en32lsb(header + 28, FSettings.SndRate * 2);
+	FCEU_en16lsb(header + 32, 2);
+	FCEU_en16lsb(header + 34, 16);
+	memcpy(header + 36, "data", 4);
+	FCEU_en32lsb(header + 40, samples * 2);
+}
+
+//the track ends when it has been silent for a while, or else after it has looped `loops` times and faded out.
+//the loop is found from the writes to the sound registers (including the expansion chips and the bank switching)
+//rather than from the sound: each frame's writes are hashed, and once a stretch of frames repeats a whole period
+//later, the start of the loop is where the repeating begins
+int FCEUI_NSFRender(int track, const char *fname, int loops, int maxSeconds)
+{
+	if(!GameInfo || GameInfo->type != GIT_NSF || track < 1 || track > NSFHeader.TotalSongs || !FSettings.SndRate)
+		return -1;
+
+	FILE *fp = FCEUD_UTF8fopen(fname, "wb");
+	if(!fp)
+		return -1;
+	uint8 header[44];
+	NSFRenderHeader(header, 0);
+	fwrite(header, 1, sizeof(header), fp);
+
+	PowerNES();
+	CurrentSong = track;
+	SongReload = 0xFF;
+
+	//in FDS mode $6000-$DFFF is RAM, and the player's variables would spoil the hashes
+	NSFRenderWrites.resize(0x10000);
+	NSFRenderTapWrites(0x4000, 0x5FFF);
+	if(!(NSFHeader.SoundChip & 4))
+		NSFRenderTapWrites(0x8000, 0xFFFF);
+
+	const int64 rate = FSettings.SndRate;
+	const int fps = (FCEUI_GetDesiredFPS() + (1 << 23)) >> 24;
+	const int window = NSFRENDER_LOOP_WINDOW_SECONDS * fps;
+	const int64 silenceLength = NSFRENDER_SILENCE_SECONDS * rate;
+	const int64 fadeLength = NSFRENDER_FADE_SECONDS * rate;
+	//fading out in time to finish by maxSeconds
+	const int64 fadeLatest = std::max((int64)0, (int64)maxSeconds * rate - fadeLength);
+
+	//the writes of the last `window` frames are keyed by a rolling hash of theirs
+	const uint64 mul = 0x9E3779B97F4A7C15ULL;
+	uint64 mulWindow = 1;
+	for(int i = 0; i < window; i++)
+		mulWindow *= mul;
+	uint64 key = 0;
+	//key -> the first frame it was seen at
+	std::map<uint64, int> seen;
+	std::vector<uint32> hashes;
+
+	int fadeFrame = -1;
+	int64 fadeStart = -1;
+	int64 produced = 0;
+	int written = 0;
+	//silence is only written out once something follows it
+	std::vector<int16> silence;
+	std::vector<uint8> out;
+	bool done = false;
+
+	for(int frame = 0; !done; frame++)
+	{
+		uint8 *gfx;
+		int32 *sound;
+		int32 ssize;
+		NSFRenderHash = 2166136261U;
+		FCEUI_Emulate(&gfx, &sound, &ssize, 1);
+		hashes.push_back(NSFRenderHash);
+
+		key = key * mul + NSFRenderHash;
+		if(frame >= window)
+			key -= hashes[frame - window] * mulWindow;
+		if(fadeFrame < 0 && frame >= window - 1)
+		{
+			std::pair<std::map<uint64, int>::iterator, bool> ins = seen.insert(std::make_pair(key, frame));
+			int period = frame - ins.first->second;
+			//a steady state repeats with any period, so short ones would be found in held notes
+			if(!ins.second && period >= window && 2 * period <= frame + 1)
+			{
+				int start = frame - 2 * period + 1;
+				int k;
+				for(k = start; k + period <= frame; k++)
+					if(hashes[k] != hashes[k + period])
+						break;
+				if(k + period > frame)
+				{
+					while(start > 0 && hashes[start - 1] == hashes[start - 1 + period])
+						start--;
+					fadeFrame = std::max(start + loops * period, frame + 1);
+				}
+			}
+		}
+		if(frame == fadeFrame)
+			fadeStart = produced;
+
+		out.clear();
+		for(int i = 0; i < ssize; i++)
+		{
+			if(fadeStart < 0 && produced >= fadeLatest)
+				fadeStart = produced;
+			int64 s = sound[i];
+			if(fadeStart >= 0)
+			{
+				int64 into = produced - fadeStart;
+				if(into >= fadeLength)
+				{
+					done = true;
+					break;
+				}
+				s = s * (fadeLength - into) / fadeLength;
+			}
+			if(s > 32767) s = 32767;
+			else if(s < -32768) s = -32768;
+			produced++;
+
+			if(s >= -NSFRENDER_SILENCE_LEVEL && s <= NSFRENDER_SILENCE_LEVEL)
+			{
+				silence.push_back((int16)s);
+				if((int64)silence.size() >= silenceLength)
+				{
+					done = true;
+					break;
+				}
+				continue;
+			}
+			for(size_t j = 0; j < silence.size(); j++)
+			{
+				out.resize(out.size() + 2);
+				FCEU_en16lsb(&out[out.size() - 2], silence[j]);
+			}
+			written += silence.size() + 1;
+			silence.clear();
+			out.resize(out.size() + 2);
+			FCEU_en16lsb(&out[out.size() - 2], (uint16)s);
+		}
+		if(!out.empty())
+			fwrite(&out[0], 1, out.size(), fp);
+	}
+
+	NSFRenderUntapWrites(0x4000, 0x5FFF);
+	if(!(NSFHeader.SoundChip & 4))
+		NSFRenderUntapWrites(0x8000, 0xFFFF);
+
+	NSFRenderHeader(header, written);
+	fseek(fp, 0, SEEK_SET);
+	fwrite(header, 1, sizeof(header), fp);
+	bool failed = ferror(fp) != 0;
+	if(fclose(fp) != 0 || failed)
+		return -1;
+	return written;
+}
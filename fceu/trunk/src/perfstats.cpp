@@ -0,0 +1,95 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief per-subsystem counters of where the time of a frame goes
+
+#include "types.h"
+#include "perfstats.h"
+
+#include <string.h>
+
+static const char *perfNames[FCEU_PERF_COUNT] = {
+	"other", "cpu", "ppu", "apu", "mapper", "lua", "blit", "throttle"
+};
+
+#ifdef FCEU_PERFSTATS
+
+int FCEU_perfCurrent = FCEU_PERF_OTHER;
+uint64 FCEU_perfLast = 0;
+uint64 FCEU_perfTicks[FCEU_PERF_COUNT];
+
+static FCEUPerfStats perfStats;
+//whether a frame has begun since the counters were reset; what comes before that isn't a whole frame
+static bool perfStarted = false;
+
+void FCEU_PerfFrame()
+{
+	//the subsystem running now (the driver's loop, when called from FCEUI_Emulate) gets its share of this frame
+	FCEU_PerfSwitch(FCEU_perfCurrent);
+	if(perfStarted)
+	{
+		for(int i = 0; i < FCEU_PERF_COUNT; i++)
+		{
+			perfStats.frame[i] = FCEU_perfTicks[i];
+			perfStats.total[i] += FCEU_perfTicks[i];
+		}
+		perfStats.frames++;
+	}
+	perfStarted = true;
+	memset(FCEU_perfTicks, 0, sizeof(FCEU_perfTicks));
+}
+
+bool FCEUI_GetPerfStats(FCEUPerfStats &stats)
+{
+	stats = perfStats;
+	return true;
+}
+
+void FCEUI_ResetPerfStats()
+{
+	memset(&perfStats, 0, sizeof(perfStats));
+	perfStarted = false;
+}
+
+#else
+
+void FCEU_PerfFrame()
+{
+}
+
+bool FCEUI_GetPerfStats(FCEUPerfStats &stats)
+{
+	memset(&stats, 0, sizeof(stats));
+	return false;
+}
+
+void FCEUI_ResetPerfStats()
+{
+}
+
+#endif
+
+const char *FCEUI_PerfStatName(int which)
+{
+	if(which < 0 || which >= FCEU_PERF_COUNT)
+		return "";
+	return perfNames[which];
+}
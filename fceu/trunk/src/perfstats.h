@@ -0,0 +1,98 @@
+#ifndef _PERFSTATS_H_
+#define _PERFSTATS_H_
+
+#include "types.h"
+
+//---------performance counters
+//where the time of a frame goes, per subsystem. the counters are only compiled in when FCEU_PERFSTATS is defined
+//(scons PERFSTATS=1); otherwise the scopes compile to nothing and FCEUI_GetPerfStats returns false.
+//time is counted in ticks of the host CPU's cycle counter where there is one, else in nanoseconds.
+//each subsystem is charged only its own time: the CPU running inside a PPU scanline is charged to the CPU, not the PPU.
+
+enum EFCEUPerf
+{
+	FCEU_PERF_OTHER,    //whatever is in none of the scopes: input, cheats, movies, the driver's own loop
+	FCEU_PERF_CPU,      //X6502_Run
+	FCEU_PERF_PPU,      //FCEUPPU_Loop with DoLine, or FCEUX_PPU_Loop
+	FCEU_PERF_APU,      //FlushEmulateSound
+	FCEU_PERF_MAPPER,   //MapIRQHook, GameHBIRQHook and GameHBIRQHook2
+	FCEU_PERF_LUA,      //the script itself, its frame callbacks and memory hooks
+	FCEU_PERF_BLIT,     //the driver putting the frame on the screen
+	FCEU_PERF_THROTTLE, //the driver waiting for the next frame
+	FCEU_PERF_COUNT
+};
+
+struct FCEUPerfStats
+{
+	//ticks spent in each subsystem in the last complete frame
+	uint64 frame[FCEU_PERF_COUNT];
+	//ticks spent in each subsystem in all the frames since the counters were reset
+	uint64 total[FCEU_PERF_COUNT];
+	uint32 frames;
+};
+
+//returns false, with all counts 0, if the counters weren't compiled in
+bool FCEUI_GetPerfStats(FCEUPerfStats &stats);
+void FCEUI_ResetPerfStats();
+//"cpu", "ppu", ...
+const char *FCEUI_PerfStatName(int which);
+
+//ends the frame: what was counted becomes the last frame's counts. FCEUI_Emulate calls this
+void FCEU_PerfFrame();
+
+#ifdef FCEU_PERFSTATS
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif !defined(__i386__) && !defined(__x86_64__)
+#include <time.h>
+#endif
+
+extern int FCEU_perfCurrent;
+extern uint64 FCEU_perfLast;
+extern uint64 FCEU_perfTicks[FCEU_PERF_COUNT];
+
+inline uint64 FCEU_PerfTicks()
+{
+#if defined(_MSC_VER)
+	return __rdtsc();
+#elif defined(__i386__) || defined(__x86_64__)
+	uint32 lo, hi;
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64)hi << 32) | lo;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+//charges the ticks since the last switch to the subsystem which was running, and makes `which` the one running
+inline void FCEU_PerfSwitch(int which)
+{
+	uint64 now = FCEU_PerfTicks();
+	FCEU_perfTicks[FCEU_perfCurrent] += now - FCEU_perfLast;
+	FCEU_perfLast = now;
+	FCEU_perfCurrent = which;
+}
+
+//counts the rest of the enclosing block towards `which`, handing back to whoever ran before at its end
+class FCEU_PerfScope
+{
+public:
+	FCEU_PerfScope(int which) : prev(FCEU_perfCurrent) { FCEU_PerfSwitch(which); }
+	~FCEU_PerfScope() { FCEU_PerfSwitch(prev); }
+private:
+	int prev;
+};
+
+#define FCEU_PERF_SCOPE(which) FCEU_PerfScope perfScope_(which)
+
+#else
+
+#define FCEU_PERF_SCOPE(which)
+
+#endif
+//-------
+
+#endif
@@ -36,6 +36,7 @@
 #include        "input.h"
 #include        "driver.h"
 #include        "debug.h"
+#include        "perfstats.h"
 
 #include        <cstring>
 #include        <cstdio>
@@ -65,9 +66,19 @@ static void RefreshSprites(void);
 static void CopySprites(uint8 *target);
 
 static void Fixit1(void);
-static uint32 ppulut1[256];
-static uint32 ppulut2[256];
-static uint32 ppulut3[128];
+//the bits of a tile byte spread out to the low bits of nibbles, the leftmost pixel in the lowest nibble
+#define PPULUT_BIT(x, y) (((uint32)((x) >> (7 - (y))) & 1u) << ((y) * 4))
+#define PPULUT1(x) (PPULUT_BIT(x, 0) | PPULUT_BIT(x, 1) | PPULUT_BIT(x, 2) | PPULUT_BIT(x, 3) | \
+	PPULUT_BIT(x, 4) | PPULUT_BIT(x, 5) | PPULUT_BIT(x, 6) | PPULUT_BIT(x, 7))
+#define PPULUT2(x) (PPULUT1(x) << 1)
+//the attribute bits of two tiles (xo | cc << 3) for the 8 pixels from xo on, in the high bits of the nibbles
+#define PPULUT3_PIXEL(i, pixel) (((uint32)(((i) >> 3) >> (((pixel) + ((i) & 7)) / 8 * 2)) & 3u) << (2 + (pixel) * 4))
+#define PPULUT3(i) (PPULUT3_PIXEL(i, 0) | PPULUT3_PIXEL(i, 1) | PPULUT3_PIXEL(i, 2) | PPULUT3_PIXEL(i, 3) | \
+	PPULUT3_PIXEL(i, 4) | PPULUT3_PIXEL(i, 5) | PPULUT3_PIXEL(i, 6) | PPULUT3_PIXEL(i, 7))
+
+static const uint32 ppulut1[256] = { FCEU_TABLE256(PPULUT1) };
+static const uint32 ppulut2[256] = { FCEU_TABLE256(PPULUT2) };
+static const uint32 ppulut3[128] = { FCEU_TABLE128(PPULUT3) };
 
 int test = 0;
 
@@ -276,32 +287,6 @@ struct PPUREGS {
 	}
 } ppur;
 
-static void makeppulut(void) {
-	int x;
-	int y;
-	int cc, xo, pixel;
-
-
-	for (x = 0; x < 256; x++) {
-		ppulut1[x] = 0;
-		for (y = 0; y < 8; y++)
-			ppulut1[x] |= ((x >> (7 - y)) & 1) << (y * 4);
-		ppulut2[x] = ppulut1[x] << 1;
-	}
-
-	for (cc = 0; cc < 16; cc++) {
-		for (xo = 0; xo < 8; xo++) {
-			ppulut3[xo | (cc << 3)] = 0;
-			for (pixel = 0; pixel < 8; pixel++) {
-				int shiftr;
-				shiftr = (pixel + xo) / 8;
-				shiftr *= 2;
-				ppulut3[xo | (cc << 3)] |= ((cc >> shiftr) & 3) << (2 + pixel * 4);
-			}
-		}
-	}
-}
-
 static int ppudead = 1;
 static int kook = 0;
 int fceuindbg = 0;
@@ -331,6 +316,18 @@ static uint8 deemp = 0;
 static int deempcnt[8];
 
 void (*GameHBIRQHook)(void), (*GameHBIRQHook2)(void);
+
+//the mapper's scanline hooks, counted as the mapper's time
+static INLINE void HBIRQHook(void) {
+	FCEU_PERF_SCOPE(FCEU_PERF_MAPPER);
+	GameHBIRQHook();
+}
+
+static INLINE void HBIRQHook2(void) {
+	FCEU_PERF_SCOPE(FCEU_PERF_MAPPER);
+	GameHBIRQHook2();
+}
+
 void (*PPU_hook)(uint32 A);
 
 uint8 vtoggle = 0;
@@ -441,6 +438,7 @@ int GetCHRAddress(int A) {
 				if (!(cdloggervdata[addr] & 1))	\
 				{ \
 					cdloggervdata[addr] |= 1; \
+					CDL_MARK_DIRTY(cdlDirtyCHR, addr); \
 					if (!(cdloggervdata[addr] & 2)) undefinedvromcount--; \
 					rendercount++; \
 				} \
@@ -665,6 +663,7 @@ static DECLFR(A2007) {
 		if (!DummyRead && (LogAddress != -1)) {
 			if (!(cdloggervdata[LogAddress] & 2)) {
 				cdloggervdata[LogAddress] |= 2;
+				CDL_MARK_DIRTY(cdlDirtyCHR, LogAddress);
 				if (!(cdloggervdata[LogAddress] & 1)) undefinedvromcount--;
 				vromreadcount++;
 			}
@@ -931,6 +930,15 @@ static int firsttile;
 int linestartts;	//no longer static so the debugger can see it
 static int tofix = 0;
 
+//set while a skipped frame is emulated: nothing is drawn to XBuf, the lines are drawn into skipline
+//instead, and then only while something could tell the difference (see RefreshLine)
+static int norender = 0;
+//whether the background of the lines needn't be drawn at all when sprite 0 can't hit on them
+static bool skipbg = false;
+//RefreshLine draws whole tiles from two tiles before the line up to two after it,
+//so it runs up to 16 bytes past the 256 of the line
+static uint8 skipline[256 + 16];
+
 static void ResetRL(uint8 *target) {
 	memset(target, 0xFF, 256);
 	InputScanlineHook(0, 0, 0, 0);
@@ -1002,15 +1010,178 @@ static void CheckSpriteHit(int p) {
 //Needed for zapper emulation and *gasp* sprite emulation.
 static int spork = 0;
 
+//the background shift registers, carried from one RefreshLine to the next
+static uint32 pshift[2];
+static uint32 atlatch;
+
+//what a background tile fetch has to do besides the plain fetch; RefreshTiles is instantiated for each combination in use
+#define PPUT_MMC5		1	//MMC5 background chr banks
+#define PPUT_MMC5SP		2	//MMC5 vertical split: the tiles come from exram
+#define PPUT_MMC5CHR1	4	//MMC5 extended attributes from exram
+#define PPUT_HOOK		8	//the mapper sees the fetches through PPU_hook
+#define PPUT_PEC586		16	//PEC-586 fetches one pattern byte for both planes
+#define PPUT_CDL		32	//the code/data logger marks the fetched chr
+
+typedef void (*PPUTILEFUNC)(uint8 *&Pout, int firsttile, int lasttile, uint32 &refreshaddr, uint32 vofs);
+
+//fetches tiles firsttile up to lasttile, drawing the 8 pixels of the tile two behind each one
+template<int FEATURES>
+static void RefreshTiles(uint8 *&Pout, int firsttile, int lasttile, uint32 &refreshaddr, uint32 vofs) {
+	uint8 *P = Pout;
+	uint32 raddr = refreshaddr;
+	uint32 pshift0 = pshift[0], pshift1 = pshift[1];
+	uint32 at = atlatch;
+	uint8 ys = 0;
+
+	if (FEATURES & PPUT_MMC5SP) {
+		ys = ((scanline >> 3) + MMC5HackSPScroll) & 0x1F;
+		if (ys >= 0x1E) ys -= 0x1E;
+	}
+
+	for (int X1 = firsttile; X1 < lasttile; X1++) {
+		uint8 *C;
+		uint8 cc;
+		uint32 vadr;
+
+		if (X1 >= 2) {
+			uint8 *S = PALRAM;
+			uint32 pixdata;
+
+			pixdata = ppulut1[(pshift0 >> (8 - XOffset)) & 0xFF] | ppulut2[(pshift1 >> (8 - XOffset)) & 0xFF];
+
+			pixdata |= ppulut3[XOffset | (at << 3)];
+
+			P[0] = S[pixdata & 0xF];
+			pixdata >>= 4;
+			P[1] = S[pixdata & 0xF];
+			pixdata >>= 4;
+			P[2] = S[pixdata & 0xF];
+			pixdata >>= 4;
+			P[3] = S[pixdata & 0xF];
+			pixdata >>= 4;
+			P[4] = S[pixdata & 0xF];
+			pixdata >>= 4;
+			P[5] = S[pixdata & 0xF];
+			pixdata >>= 4;
+			P[6] = S[pixdata & 0xF];
+			pixdata >>= 4;
+			P[7] = S[pixdata & 0xF];
+			P += 8;
+		}
+
+		if (FEATURES & PPUT_MMC5SP) {
+			vadr = (MMC5HackExNTARAMPtr[X1 | (ys << 5)] << 4) + (vofs & 7);
+			C = 0;
+		} else {
+			C = vnapage[(raddr >> 10) & 3];
+			vadr = (C[raddr & 0x3ff] << 4) + vofs;	// Fetch name table byte.
+		}
+
+		if (FEATURES & PPUT_HOOK)
+			PPU_hook(0x2000 | (raddr & 0xfff));
+
+		if (FEATURES & PPUT_MMC5SP) {
+			cc = MMC5HackExNTARAMPtr[0x3c0 + (X1 >> 2) + ((ys & 0x1C) << 1)];
+			cc = ((cc >> ((X1 & 2) + ((ys & 0x2) << 1))) & 3);
+		} else if (FEATURES & PPUT_MMC5CHR1) {
+			cc = (MMC5HackExNTARAMPtr[raddr & 0x3ff] & 0xC0) >> 6;
+		} else {
+			uint32 zz = raddr & 0x1F;
+			cc = C[0x3c0 + (zz >> 2) + ((raddr & 0x380) >> 4)];	// Fetch attribute table byte.
+			cc = ((cc >> ((zz & 2) + ((raddr & 0x40) >> 4))) & 3);
+		}
+
+		at >>= 2;
+		at |= cc << 2;
+
+		pshift0 <<= 8;
+		pshift1 <<= 8;
+
+		if (FEATURES & PPUT_MMC5SP) {
+			C = MMC5HackVROMPTR + vadr;
+			C += ((MMC5HackSPPage & 0x3f & MMC5HackVROMMask) << 12);
+		} else if (FEATURES & PPUT_MMC5CHR1) {
+			C = MMC5HackVROMPTR;
+			C += (((MMC5HackExNTARAMPtr[raddr & 0x3ff]) & 0x3f & MMC5HackVROMMask) << 12) + (vadr & 0xfff);
+			C += (MMC50x5130 & 0x3) << 18; //11-jun-2009 for kuja_killer
+		} else if (FEATURES & PPUT_MMC5)
+			C = MMC5BGVRAMADR(vadr);
+		else
+			C = VRAMADR(vadr);
+
+		if (FEATURES & PPUT_HOOK)
+			PPU_hook(vadr);
+
+		if (FEATURES & PPUT_PEC586) {
+			if (raddr & 1) {
+				if (FEATURES & PPUT_CDL)
+					RENDER_LOG(vadr + 8);
+				pshift0 |= C[8];
+				pshift1 |= C[8];
+			} else {
+				if (FEATURES & PPUT_CDL)
+					RENDER_LOG(vadr);
+				pshift0 |= C[0];
+				pshift1 |= C[0];
+			}
+		} else {
+			if (FEATURES & PPUT_CDL)
+				RENDER_LOG(vadr);
+			pshift0 |= C[0];
+			if (FEATURES & PPUT_CDL)
+				RENDER_LOG(vadr + 8);
+			pshift1 |= C[8];
+		}
+
+		if ((raddr & 0x1f) == 0x1f)
+			raddr ^= 0x41F;
+		else
+			raddr++;
+
+		if (FEATURES & PPUT_HOOK)
+			PPU_hook(0x2000 | (raddr & 0xfff));
+	}
+
+	pshift[0] = pshift0;
+	pshift[1] = pshift1;
+	atlatch = at;
+	refreshaddr = raddr;
+	Pout = P;
+}
+
+static PPUTILEFUNC GetRefreshTiles(int features) {
+	switch (features) {
+	#define PPUT_CASE(f) \
+		case f: return RefreshTiles<f>; \
+		case f | PPUT_CDL: return RefreshTiles<f | PPUT_CDL>;
+	PPUT_CASE(0)
+	PPUT_CASE(PPUT_PEC586)
+	PPUT_CASE(PPUT_HOOK)
+	PPUT_CASE(PPUT_HOOK | PPUT_PEC586)
+	PPUT_CASE(PPUT_MMC5)
+	PPUT_CASE(PPUT_MMC5 | PPUT_MMC5SP)
+	PPUT_CASE(PPUT_MMC5 | PPUT_MMC5CHR1)
+	#undef PPUT_CASE
+	}
+	return RefreshTiles<0>;
+}
+
+//moves RefreshAddr on past numtiles tiles the way fetching them does, for lines whose background isn't drawn
+static void SkipTiles(int numtiles) {
+	for (; numtiles > 0; numtiles--) {
+		if ((RefreshAddr & 0x1f) == 0x1f)
+			RefreshAddr ^= 0x41F;
+		else
+			RefreshAddr++;
+	}
+}
+
 // lasttile is really "second to last tile."
 static void RefreshLine(int lastpixel) {
-	static uint32 pshift[2];
-	static uint32 atlatch;
 	uint32 smorkus = RefreshAddr;
 
 	#define RefreshAddr smorkus
 	uint32 vofs;
-	int X1;
 
 	register uint8 *P = Pline;
 	int lasttile = lastpixel >> 3;
@@ -1032,6 +1203,20 @@ static void RefreshLine(int lastpixel) {
 
 	if (numtiles <= 0) return;
 
+	#define TOFIXNUM (272 - 0x4)
+
+	//with nothing to draw, the background only matters for a sprite 0 hit which is yet to come
+	if (skipbg && (sphitx == 0x100 || (PPU_status & 0x40))) {
+		if (ScreenON || SpriteON)
+			SkipTiles(numtiles);
+		firsttile = lasttile;
+		if (lastpixel >= TOFIXNUM && tofix) {
+			Fixit1();
+			tofix = 0;
+		}
+		return;
+	}
+
 	P = Pline;
 
 	vofs = 0;
@@ -1051,7 +1236,6 @@ static void RefreshLine(int lastpixel) {
 
 		firsttile = lasttile;
 
-		#define TOFIXNUM (272 - 0x4)
 		if (lastpixel >= TOFIXNUM && tofix) {
 			Fixit1();
 			tofix = 0;
@@ -1072,74 +1256,43 @@ static void RefreshLine(int lastpixel) {
 	//This high-level graphics MMC5 emulation code was written for MMC5 carts in "CL" mode.
 	//It's probably not totally correct for carts in "SL" mode.
 
-#define PPUT_MMC5
+	int features = 0;
 	if (MMC5Hack && geniestage != 1) {
-		if (MMC5HackCHRMode == 0 && (MMC5HackSPMode & 0x80)) {
-			int tochange = MMC5HackSPMode & 0x1F;
-			tochange -= firsttile;
-			for (X1 = firsttile; X1 < lasttile; X1++) {
-				if ((tochange <= 0 && MMC5HackSPMode & 0x40) || (tochange > 0 && !(MMC5HackSPMode & 0x40))) {
-					#define PPUT_MMC5SP
-					#include "pputile.inc"
-					#undef PPUT_MMC5SP
-				} else {
-					#include "pputile.inc"
-				}
-				tochange--;
-			}
-		} else if (MMC5HackCHRMode == 1 && (MMC5HackSPMode & 0x80)) {
-			int tochange = MMC5HackSPMode & 0x1F;
-			tochange -= firsttile;
-
-			#define PPUT_MMC5SP
-			#define PPUT_MMC5CHR1
-			for (X1 = firsttile; X1 < lasttile; X1++) {
-				#include "pputile.inc"
-			}
-			#undef PPUT_MMC5CHR1
-			#undef PPUT_MMC5SP
-		} else if (MMC5HackCHRMode == 1) {
-			#define PPUT_MMC5CHR1
-			for (X1 = firsttile; X1 < lasttile; X1++) {
-				#include "pputile.inc"
-			}
-			#undef PPUT_MMC5CHR1
-		} else {
-			for (X1 = firsttile; X1 < lasttile; X1++) {
-				#include "pputile.inc"
-			}
-		}
+		features = PPUT_MMC5;
+		if (MMC5HackCHRMode == 1)
+			features |= (MMC5HackSPMode & 0x80) ? PPUT_MMC5SP : PPUT_MMC5CHR1;
+		else if (MMC5HackCHRMode == 0 && (MMC5HackSPMode & 0x80))
+			features |= PPUT_MMC5SP;
+	} else {
+		if (PPU_hook)
+			features |= PPUT_HOOK;
+		if (PEC586Hack)
+			features |= PPUT_PEC586;
 	}
-	#undef PPUT_MMC5
-	else if (PPU_hook) {
+	if (ScreenON && debug_loggingCD)
+		features |= PPUT_CDL;
+
+	if (features & PPUT_HOOK)
 		norecurse = 1;
-		#define PPUT_HOOK
-		if (PEC586Hack) {
-			#define PPU_BGFETCH
-			for (X1 = firsttile; X1 < lasttile; X1++) {
-				#include "pputile.inc"
-			}
-			#undef PPU_BGFETCH
-		} else {
-			for (X1 = firsttile; X1 < lasttile; X1++) {
-				#include "pputile.inc"
-			}
-		}
-		#undef PPUT_HOOK
-		norecurse = 0;
-	} else {
-		if (PEC586Hack) {
-			#define PPU_BGFETCH
-			for (X1 = firsttile; X1 < lasttile; X1++) {
-				#include "pputile.inc"
-			}
-			#undef PPU_BGFETCH
+
+	if ((features & PPUT_MMC5SP) && MMC5HackCHRMode == 0) {
+		//the split covers the tiles left of MMC5HackSPMode & 0x1F, or from there on if 0x40 is set
+		int split = MMC5HackSPMode & 0x1F;
+		PPUTILEFUNC outside = GetRefreshTiles(features & ~PPUT_MMC5SP);
+		PPUTILEFUNC inside = GetRefreshTiles(features);
+		if (split < firsttile) split = firsttile;
+		if (split > lasttile) split = lasttile;
+		if (MMC5HackSPMode & 0x40) {
+			outside(P, firsttile, split, RefreshAddr, vofs);
+			inside(P, split, lasttile, RefreshAddr, vofs);
 		} else {
-			for (X1 = firsttile; X1 < lasttile; X1++) {
-				#include "pputile.inc"
-			}
+			inside(P, firsttile, split, RefreshAddr, vofs);
+			outside(P, split, lasttile, RefreshAddr, vofs);
 		}
-	}
+	} else
+		GetRefreshTiles(features)(P, firsttile, lasttile, RefreshAddr, vofs);
+
+	norecurse = 0;
 
 #undef vofs
 #undef RefreshAddr
@@ -1226,6 +1379,13 @@ static void DoLine(void) {
 	X6502_Run(256);
 	EndRL();
 
+	if (norender) {
+		//the line's sprites are done with all the same
+		if (SpriteON)
+			spork = 0;
+		goto drawn;
+	}
+
 	if (!renderbg) {// User asked to not display background data.
 		uint32 tem;
 		uint8 col;
@@ -1256,6 +1416,7 @@ static void DoLine(void) {
 		for (x = 63; x >= 0; x--)
 			*(uint32*)&target[x << 2] = ((*(uint32*)&target[x << 2]) & 0x3f3f3f3f) | 0x80808080;
 
+ drawn:
 	sphitx = 0x100;
 
 	if (ScreenON || SpriteON)
@@ -1265,7 +1426,7 @@ static void DoLine(void) {
 		X6502_Run(6);
 		Fixit2();
 		X6502_Run(4);
-		GameHBIRQHook();
+		HBIRQHook();
 		X6502_Run(85 - 16 - 10);
 	} else {
 		X6502_Run(6);	// Tried 65, caused problems with Slalom(maybe others)
@@ -1274,7 +1435,7 @@ static void DoLine(void) {
 
 		// A semi-hack for Star Trek: 25th Anniversary
 		if (GameHBIRQHook && (ScreenON || SpriteON) && ((PPU[0] & 0x38) != 0x18))
-			GameHBIRQHook();
+			HBIRQHook();
 	}
 
 	DEBUG(FCEUD_UpdateNTView(scanline, 0));
@@ -1282,10 +1443,10 @@ static void DoLine(void) {
 	if (SpriteON)
 		RefreshSprites();
 	if (GameHBIRQHook2 && (ScreenON || SpriteON))
-		GameHBIRQHook2();
+		HBIRQHook2();
 	scanline++;
 	if (scanline < 240) {
-		ResetRL(XBuf + (scanline << 8));
+		ResetRL(norender ? skipline : XBuf + (scanline << 8));
 	}
 	X6502_Run(16);
 }
@@ -1455,6 +1616,9 @@ static void RefreshSprites(void) {
 
 	FCEU_dwmemset(sprlinebuf, 0x80808080, 256);
 	numsprites--;
+	//with nothing to draw, only sprite 0 matters, for its hit
+	if (skipbg)
+		numsprites = 0;
 	spr = (SPRB*)SPRBUF + numsprites;
 
 	for (n = numsprites; n >= 0; n--, spr--) {
@@ -1646,7 +1810,6 @@ void FCEUPPU_SetVideoSystem(int w) {
 
 //Initializes the PPU
 void FCEUPPU_Init(void) {
-	makeppulut();
 }
 
 void PPU_ResetHooks() {
@@ -1667,37 +1830,33 @@ void FCEUPPU_Reset(void) {
 	spr_read.reset();
 }
 
-void FCEUPPU_Power(void) {
-	int x;
+//the registers repeat every 8 bytes up to $3FFF. decoding that here keeps the range down to one handler per page
+static readfunc PPURegRead[8] = { A200x, A200x, A2002, A200x, A2004, A200x, A200x, A2007 };
+static writefunc PPURegWrite[8] = { B2000, B2001, B2002, B2003, B2004, B2005, B2006, B2007 };
 
+static DECLFR(A2xxx) {
+	return PPURegRead[A & 7](A);
+}
+
+static DECLFW(B2xxx) {
+	PPURegWrite[A & 7](A, V);
+}
+
+void FCEUPPU_Power(void) {
 	memset(NTARAM, 0x00, 0x800);
 	memset(PALRAM, 0x00, 0x20);
 	memset(UPALRAM, 0x00, 0x03);
 	memset(SPRAM, 0x00, 0x100);
 	FCEUPPU_Reset();
 
-	for (x = 0x2000; x < 0x4000; x += 8) {
-		ARead[x] = A200x;
-		BWrite[x] = B2000;
-		ARead[x + 1] = A200x;
-		BWrite[x + 1] = B2001;
-		ARead[x + 2] = A2002;
-		BWrite[x + 2] = B2002;
-		ARead[x + 3] = A200x;
-		BWrite[x + 3] = B2003;
-		ARead[x + 4] = A2004;
-		BWrite[x + 4] = B2004;
-		ARead[x + 5] = A200x;
-		BWrite[x + 5] = B2005;
-		ARead[x + 6] = A200x;
-		BWrite[x + 6] = B2006;
-		ARead[x + 7] = A2007;
-		BWrite[x + 7] = B2007;
-	}
-	BWrite[0x4014] = B4014;
+	SetReadHandler(0x2000, 0x3FFF, A2xxx);
+	SetWriteHandler(0x2000, 0x3FFF, B2xxx);
+	SetWriteHandler(0x4014, 0x4014, B4014);
 }
 
 int FCEUPPU_Loop(int skip) {
+	FCEU_PERF_SCOPE(FCEU_PERF_PPU);
+
 	if ((newppu) && (GameInfo->type != GIT_NSF)) {
 		int FCEUX_PPU_Loop(int skip);
 		return FCEUX_PPU_Loop(skip);
@@ -1734,13 +1893,13 @@ int FCEUPPU_Loop(int skip) {
 
 			if (ScreenON || SpriteON) {
 				if (GameHBIRQHook && ((PPU[0] & 0x38) != 0x18))
-					GameHBIRQHook();
+					HBIRQHook();
 				if (PPU_hook)
 					for (x = 0; x < 42; x++) {
 						PPU_hook(0x2000); PPU_hook(0);
 					}
 				if (GameHBIRQHook2)
-					GameHBIRQHook2();
+					HBIRQHook2();
 			}
 			X6502_Run(85 - 16);
 			if (ScreenON || SpriteON) {
@@ -1750,37 +1909,18 @@ int FCEUPPU_Loop(int skip) {
 
 			//Clean this stuff up later.
 			spork = numsprites = 0;
-			ResetRL(XBuf);
+			#ifdef FRAMESKIP
+			//a skipped frame is emulated line by line like any other, only without drawing it
+			norender = skip && GameInfo->type != GIT_NSF;
+			skipbg = norender && !PPU_hook && !debug_loggingCD && !InputScanlineHooked();
+			#endif
+			ResetRL(norender ? skipline : XBuf);
 
 			X6502_Run(16 - kook);
 			kook ^= 1;
 		}
 		if (GameInfo->type == GIT_NSF)
 			X6502_Run((256 + 85) * 240);
-		#ifdef FRAMESKIP
-		else if (skip) {
-			int y;
-
-			y = SPRAM[0];
-			y++;
-
-			PPU_status |= 0x20;	// Fixes "Bee 52".  Does it break anything?
-			if (GameHBIRQHook) {
-				X6502_Run(256);
-				for (scanline = 0; scanline < 240; scanline++) {
-					if (ScreenON || SpriteON)
-						GameHBIRQHook();
-					if (scanline == y && SpriteON) PPU_status |= 0x40;
-					X6502_Run((scanline == 239) ? 85 : (256 + 85));
-				}
-			} else if (y < 240) {
-				X6502_Run((256 + 85) * y);
-				if (SpriteON) PPU_status |= 0x40;	// Quick and very dirty hack.
-				X6502_Run((256 + 85) * (240 - y));
-			} else
-				X6502_Run((256 + 85) * 240);
-		}
-		#endif
 		else {
 			int x, max, maxref;
 
@@ -1790,6 +1930,8 @@ int FCEUPPU_Loop(int skip) {
 				DEBUG(FCEUD_UpdatePPUView(scanline, 1));
 				DoLine();
 			}
+			norender = 0;
+			skipbg = false;
 			if (MMC5Hack) MMC5_hb(scanline);
 			for (x = 1, max = 0, maxref = 0; x < 7; x++) {
 				if (deempcnt[x] > max) {
@@ -1837,6 +1979,9 @@ SFORMAT FCEUPPU_STATEINFO[] = {
 	{ &TempAddrT, 2 | FCEUSTATE_RLSB, "TADD" },
 	{ &VRAMBuffer, 1, "VBUF" },
 	{ &PPUGenLatch, 1, "PGEN" },
+	//a sprite 0 found on the line after the last goes on to hit in the next frame
+	{ &sphitx, 4 | FCEUSTATE_RLSB, "SPHX" },
+	{ &sphitdata, 1, "SPHD" },
 	{ 0 }
 };
 
@@ -2054,6 +2199,19 @@ int FCEUX_PPU_Loop(int skip) {
 
 			oamcount = oamcounts[renderslot];
 
+			//in a skipped frame, the pixels are only worked out where sprite 0 could still hit,
+			//unless a zapper is looking at them
+			bool drawline = sl != 0;
+			#ifdef FRAMESKIP
+			if (skip && drawline && !InputScanlineHooked()) {
+				drawline = false;
+				if (!(PPU_status & 0x40))
+					for (int s = 0; s < oamcount; s++)
+						if (oams[renderslot][s][6] == 0)
+							drawline = true;
+			}
+			#endif
+
 			//the main scanline rendering loop:
 			//32 times, we will fetch a tile and then render 8 pixels.
 			//two of those tiles were read in the last scanline.
@@ -2062,7 +2220,7 @@ int FCEUX_PPU_Loop(int skip) {
 
 				//ok, we're also going to draw here.
 				//unless we're on the first dummy scanline
-				if (sl != 0) {
+				if (drawline) {
 					int xstart = xt << 3;
 					oamcount = oamcounts[renderslot];
 					uint8 * const target = XBuf + (yp << 8) + xstart;
@@ -2256,7 +2414,7 @@ int FCEUX_PPU_Loop(int skip) {
 					//kirby requires deferring this til somewhere in sprite [2,5..
 					//if (PPUON && GameHBIRQHook) {
 					if (GameHBIRQHook) {
-						GameHBIRQHook();
+						HBIRQHook();
 					}
 				}
 
@@ -2322,6 +2480,12 @@ int FCEUX_PPU_Loop(int skip) {
 	}
 
 finish:
+	#ifdef FRAMESKIP
+	if (skip) {
+		FCEU_PutImageDummy();
+		return 0;
+	}
+	#endif
 	FCEU_PutImage();
 
 	return 0;
@@ -0,0 +1,482 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief identifying ROM images without loading them, and the database of those already identified
+
+#include "types.h"
+#include "fceu.h"
+#include "file.h"
+#include "driver.h"
+#include "romdb.h"
+#include "utils/crc32.h"
+#include "utils/endian.h"
+#include "utils/mappedfile.h"
+#include "utils/task.h"
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <algorithm>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+
+//the database file:
+//	"FCDB", version, slot count (a power of 2), string table size
+//	the slots, ROMDB_SLOT_SIZE bytes each; an image goes in the first free slot from its CRC32 on
+//	the string table, starting with an empty string
+//slots:
+//	0  CRC32
+//	4  MD5
+//	20 mapper (0xFFFF for none), mapper in the header
+//	24 mirroring, mirroring in the header
+//	26 flags
+//	27 tofix bits in the low nibble, submapper in the high one
+//	28 offset of the board name in the string table
+#define ROMDB_VERSION 1
+#define ROMDB_HEADER_SIZE 16
+#define ROMDB_SLOT_SIZE 32
+
+#define ROMDB_USED          0x01
+#define ROMDB_BATTERY       0x02
+#define ROMDB_HEADERBATTERY 0x04
+#define ROMDB_HEADERCHR     0x08
+#define ROMDB_VSUNI         0x10
+#define ROMDB_BAD           0x20
+#define ROMDB_UNIF          0x40
+
+//how much is hashed at a time; small enough to still be in the cache when the MD5 gets to it
+#define HASH_SLICE 16384
+
+RomInfo::RomInfo()
+	: format(FORMAT_INES)
+	, crc32(0)
+	, mapper(-1)
+	, submapper(0)
+	, mirroring(0)
+	, battery(false)
+	, vsuni(false)
+	, bad(false)
+	, fixes(0)
+	, headerMapper(-1)
+	, headerMirroring(0)
+	, headerBattery(false)
+	, headerCHR(false)
+{
+	memset(md5, 0, sizeof(md5));
+}
+
+uint32 FCEU_HashBlock(uint32 crc, md5_context *md5, uint8 *buf, uint32 len)
+{
+	while(len)
+	{
+		uint32 n = std::min<uint32>(len, HASH_SLICE);
+		crc = CalcCRC32(crc, buf, n);
+		md5_update(md5, buf, n);
+		buf += n;
+		len -= n;
+	}
+	return crc;
+}
+
+bool FCEU_IdentifyROM(const char *path, RomInfo &info)
+{
+	const char* romextensions[] = { "nes", "unf", "unif", 0 };
+	FCEUFILE *fp = FCEU_fopen(path, 0, "rb", 0, -1, romextensions);
+	if(!fp)
+		return false;
+
+	info = RomInfo();
+	bool found = iNESIdentify(fp, info);
+	if(!found)
+	{
+		info = RomInfo();
+		FCEU_fseek(fp, 0, SEEK_SET);
+		found = UNIFIdentify(fp, info);
+	}
+	if(found)
+	{
+		if(fp->archiveFilename != "")
+			info.path = fp->archiveFilename + "|" + fp->filename;
+		else
+			info.path = path;
+	}
+	FCEU_fclose(fp);
+	return found;
+}
+
+static bool IsLibraryFile(const std::string &name)
+{
+	static const char* extensions[] = { ".nes", ".unf", ".unif", ".zip", ".gz", 0 };
+	for(int i = 0; extensions[i]; i++)
+	{
+		size_t len = strlen(extensions[i]);
+		if(name.size() > len && !strcasecmp(name.c_str() + name.size() - len, extensions[i]))
+			return true;
+	}
+	return false;
+}
+
+//collects the files under dir which could hold an image
+static void ListLibrary(const std::string &dir, std::vector<std::string> &files)
+{
+#ifdef WIN32
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &fd);
+	if(h == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		std::string name = fd.cFileName;
+		if(name == "." || name == "..")
+			continue;
+		std::string full = dir + PSS + name;
+		if(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			ListLibrary(full, files);
+		else if(IsLibraryFile(name))
+			files.push_back(full);
+	} while(FindNextFileA(h, &fd));
+	FindClose(h);
+#else
+	DIR *d = opendir(dir.c_str());
+	if(!d)
+		return;
+	struct dirent *de;
+	while((de = readdir(d)) != NULL)
+	{
+		std::string name = de->d_name;
+		if(name == "." || name == "..")
+			continue;
+		std::string full = dir + PSS + name;
+		struct stat st;
+		if(stat(full.c_str(), &st) == -1)
+			continue;
+		if(S_ISDIR(st.st_mode))
+			ListLibrary(full, files);
+		else if(S_ISREG(st.st_mode) && IsLibraryFile(name))
+			files.push_back(full);
+	}
+	closedir(d);
+#endif
+}
+
+//each worker takes every `step`th file from `first` on, so none of them need to share anything
+struct ScanJob
+{
+	const std::vector<std::string> *files;
+	std::vector<RomInfo> *results;
+	std::vector<char> *found;
+	size_t first, step;
+};
+
+static void* ScanWorker(void *param)
+{
+	ScanJob *job = (ScanJob*)param;
+	for(size_t i = job->first; i < job->files->size(); i += job->step)
+		(*job->found)[i] = FCEU_IdentifyROM((*job->files)[i].c_str(), (*job->results)[i]);
+	return 0;
+}
+
+int FCEUI_ScanLibrary(const char *dir, std::vector<RomInfo> &found, int threads)
+{
+	std::vector<std::string> files;
+	ListLibrary(dir, files);
+	std::sort(files.begin(), files.end());
+
+	if(threads <= 0)
+		threads = FCEU_GetCPUCount();
+	threads = std::max(1, std::min(threads, (int)files.size()));
+
+	std::vector<RomInfo> results(files.size());
+	std::vector<char> ok(files.size(), 0);
+	std::vector<ScanJob> jobs(threads);
+	std::vector<Task*> workers(threads);
+	for(int i = 0; i < threads; i++)
+	{
+		ScanJob &job = jobs[i];
+		job.files = &files;
+		job.results = &results;
+		job.found = &ok;
+		job.first = i;
+		job.step = threads;
+		workers[i] = new Task();
+		workers[i]->start(false);
+		workers[i]->execute(ScanWorker, &job);
+	}
+	for(int i = 0; i < threads; i++)
+	{
+		workers[i]->finish();
+		delete workers[i];
+	}
+
+	int count = 0;
+	for(size_t i = 0; i < files.size(); i++)
+	{
+		if(!ok[i])
+			continue;
+		found.push_back(results[i]);
+		count++;
+	}
+	return count;
+}
+
+static MappedFile romdb;
+static std::string romdbName;
+static uint32 romdbSlots, romdbStringsSize;
+
+static const uint8* RomDatabaseSlot(uint32 i)
+{
+	return romdb.data() + ROMDB_HEADER_SIZE + i * ROMDB_SLOT_SIZE;
+}
+
+static void DecodeSlot(const uint8 *slot, const char *strings, uint32 stringsSize, RomInfo &info)
+{
+	uint8 *p = (uint8*)slot;
+	uint8 flags = p[26];
+	info = RomInfo();
+	info.format = (flags & ROMDB_UNIF) ? RomInfo::FORMAT_UNIF : RomInfo::FORMAT_INES;
+	info.crc32 = FCEU_de32lsb(p);
+	memcpy(info.md5, p + 4, 16);
+	uint16 mapper = FCEU_de16lsb(p + 20), headerMapper = FCEU_de16lsb(p + 22);
+	info.mapper = mapper == 0xFFFF ? -1 : mapper;
+	info.headerMapper = headerMapper == 0xFFFF ? -1 : headerMapper;
+	info.mirroring = p[24];
+	info.headerMirroring = p[25];
+	info.battery = (flags & ROMDB_BATTERY) != 0;
+	info.headerBattery = (flags & ROMDB_HEADERBATTERY) != 0;
+	info.headerCHR = (flags & ROMDB_HEADERCHR) != 0;
+	info.vsuni = (flags & ROMDB_VSUNI) != 0;
+	info.bad = (flags & ROMDB_BAD) != 0;
+	info.fixes = p[27] & 0x0F;
+	info.submapper = p[27] >> 4;
+	uint32 board = FCEU_de32lsb(p + 28);
+	if(board < stringsSize)
+		info.board = strings + board;
+}
+
+static void EncodeSlot(uint8 *p, const RomInfo &info, uint32 board)
+{
+	uint8 flags = ROMDB_USED;
+	if(info.format == RomInfo::FORMAT_UNIF) flags |= ROMDB_UNIF;
+	if(info.battery) flags |= ROMDB_BATTERY;
+	if(info.headerBattery) flags |= ROMDB_HEADERBATTERY;
+	if(info.headerCHR) flags |= ROMDB_HEADERCHR;
+	if(info.vsuni) flags |= ROMDB_VSUNI;
+	if(info.bad) flags |= ROMDB_BAD;
+
+	FCEU_en32lsb(p, info.crc32);
+	memcpy(p + 4, info.md5, 16);
+	FCEU_en16lsb(p + 20, info.mapper < 0 ? 0xFFFF : info.mapper);
+	FCEU_en16lsb(p + 22, info.headerMapper < 0 ? 0xFFFF : info.headerMapper);
+	p[24] = info.mirroring;
+	p[25] = info.headerMirroring;
+	p[26] = flags;
+	p[27] = (info.fixes & 0x0F) | (info.submapper << 4);
+	FCEU_en32lsb(p + 28, board);
+}
+
+//checks the file is a database and that everything in it is where it says it is
+static bool ValidRomDatabase(const MappedFile &f, uint32 &slots, uint32 &stringsSize)
+{
+	if(f.size() < ROMDB_HEADER_SIZE || memcmp(f.data(), "FCDB", 4))
+		return false;
+	uint8 *p = (uint8*)f.data();
+	if(FCEU_de32lsb(p + 4) != ROMDB_VERSION)
+		return false;
+	slots = FCEU_de32lsb(p + 8);
+	stringsSize = FCEU_de32lsb(p + 12);
+	if(!slots || (slots & (slots - 1)) || slots > (1 << 24) || !stringsSize)
+		return false;
+	uint64 size = ROMDB_HEADER_SIZE + (uint64)slots * ROMDB_SLOT_SIZE + stringsSize;
+	if(f.size() < size)
+		return false;
+	//so every string in the table ends
+	return f.data()[size - 1] == 0;
+}
+
+bool FCEUI_OpenRomDatabase(const char *fname)
+{
+	romdb.close();
+	romdbName = "";
+	if(!fname)
+		return true;
+
+	if(!romdb.open(fname))
+		return false;
+	if(!ValidRomDatabase(romdb, romdbSlots, romdbStringsSize))
+	{
+		FCEU_PrintError("\"%s\" is not a ROM database.", fname);
+		romdb.close();
+		return false;
+	}
+	romdbName = fname;
+	return true;
+}
+
+bool FCEUI_RomDatabaseIsOpen()
+{
+	return romdb.isOpen();
+}
+
+//what tells apart entries for the same dump
+static std::string EntryKey(const RomInfo &info)
+{
+	uint8 key[28];
+	FCEU_en32lsb(key, info.crc32);
+	memcpy(key + 4, info.md5, 16);
+	FCEU_en32lsb(key + 20, info.headerMapper);
+	key[24] = info.format;
+	key[25] = info.headerMirroring;
+	key[26] = info.headerBattery;
+	key[27] = info.headerCHR;
+	return std::string((const char*)key, sizeof(key));
+}
+
+static bool SameHeader(const RomInfo &a, const RomInfo &b)
+{
+	return a.format == b.format && a.headerMapper == b.headerMapper && a.headerMirroring == b.headerMirroring
+		&& a.headerBattery == b.headerBattery && a.headerCHR == b.headerCHR;
+}
+
+bool FCEU_RomDatabaseLookup(uint32 crc32, const uint8 *md5, RomInfo &info, const RomInfo *header)
+{
+	if(!romdb.isOpen())
+		return false;
+
+	const char *strings = (const char*)RomDatabaseSlot(romdbSlots);
+	for(uint32 i = crc32 & (romdbSlots - 1), n = 0; n < romdbSlots; i = (i + 1) & (romdbSlots - 1), n++)
+	{
+		const uint8 *slot = RomDatabaseSlot(i);
+		if(!(slot[26] & ROMDB_USED))
+			return false;
+		if(FCEU_de32lsb((uint8*)slot) == crc32 && !memcmp(slot + 4, md5, 16))
+		{
+			DecodeSlot(slot, strings, romdbStringsSize, info);
+			if(!header || SameHeader(*header, info))
+				return true;
+		}
+	}
+	return false;
+}
+
+bool FCEUI_WriteRomDatabase(const char *fname, const std::vector<RomInfo> &roms)
+{
+	//what's in the file already stays, unless it was seen again
+	std::vector<RomInfo> all;
+	{
+		MappedFile old;
+		uint32 slots, stringsSize;
+		if(old.open(fname) && ValidRomDatabase(old, slots, stringsSize))
+		{
+			const uint8 *base = old.data() + ROMDB_HEADER_SIZE;
+			const char *strings = (const char*)(base + slots * ROMDB_SLOT_SIZE);
+			for(uint32 i = 0; i < slots; i++)
+			{
+				const uint8 *slot = base + i * ROMDB_SLOT_SIZE;
+				if(!(slot[26] & ROMDB_USED))
+					continue;
+				all.push_back(RomInfo());
+				DecodeSlot(slot, strings, stringsSize, all.back());
+			}
+		}
+	}
+	all.insert(all.end(), roms.begin(), roms.end());
+
+	std::map<std::string, size_t> unique;
+	for(size_t i = 0; i < all.size(); i++)
+		unique[EntryKey(all[i])] = i;
+
+	//no more than half full, so probes stay short
+	uint32 slots = 16;
+	while(slots < unique.size() * 2)
+		slots <<= 1;
+
+	std::vector<uint8> table(slots * ROMDB_SLOT_SIZE, 0);
+	std::string strings(1, '\0');
+	std::map<std::string, uint32> boards;
+	for(std::map<std::string, size_t>::iterator it = unique.begin(); it != unique.end(); ++it)
+	{
+		const RomInfo &info = all[it->second];
+		uint32 board = 0;
+		if(!info.board.empty())
+		{
+			std::map<std::string, uint32>::iterator b = boards.find(info.board);
+			if(b == boards.end())
+			{
+				board = strings.size();
+				boards[info.board] = board;
+				strings.append(info.board.c_str(), info.board.size() + 1);
+			}
+			else
+				board = b->second;
+		}
+
+		uint32 i = info.crc32 & (slots - 1);
+		while(table[i * ROMDB_SLOT_SIZE + 26] & ROMDB_USED)
+			i = (i + 1) & (slots - 1);
+		EncodeSlot(&table[i * ROMDB_SLOT_SIZE], info, board);
+	}
+
+	uint8 header[ROMDB_HEADER_SIZE];
+	memcpy(header, "FCDB", 4);
+	FCEU_en32lsb(header + 4, ROMDB_VERSION);
+	FCEU_en32lsb(header + 8, slots);
+	FCEU_en32lsb(header + 12, strings.size());
+
+	//the open database may be this very file, and can't stay mapped while it is replaced
+	bool reopen = romdb.isOpen() && romdbName == fname;
+	if(reopen)
+		romdb.close();
+
+	std::string tmpname = std::string(fname) + ".tmp";
+	FILE *fp = FCEUD_UTF8fopen(tmpname, "wb");
+	if(!fp)
+	{
+		FCEU_PrintError("Couldn't write the ROM database \"%s\".", fname);
+		if(reopen)
+			FCEUI_OpenRomDatabase(fname);
+		return false;
+	}
+	bool ok = fwrite(header, 1, ROMDB_HEADER_SIZE, fp) == ROMDB_HEADER_SIZE;
+	ok = ok && fwrite(&table[0], 1, table.size(), fp) == table.size();
+	ok = ok && fwrite(strings.data(), 1, strings.size(), fp) == strings.size();
+	ok = (fclose(fp) == 0) && ok;
+
+	if(ok)
+	{
+		remove(fname);
+		ok = rename(tmpname.c_str(), fname) == 0;
+	}
+	if(!ok)
+	{
+		remove(tmpname.c_str());
+		FCEU_PrintError("Couldn't write the ROM database \"%s\".", fname);
+	}
+
+	if(reopen)
+		FCEUI_OpenRomDatabase(fname);
+	return ok;
+}
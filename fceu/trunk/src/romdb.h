@@ -0,0 +1,85 @@
+#ifndef _ROMDB_H_
+#define _ROMDB_H_
+
+#include "types.h"
+#include "utils/md5.h"
+
+#include <string>
+#include <vector>
+
+struct FCEUFILE;
+
+//---------RomInfo
+//what identifying a ROM image tells about it, without loading it into the emulator
+struct RomInfo
+{
+	enum Format { FORMAT_INES, FORMAT_UNIF };
+
+	//corrections made to the image's own header (the tofix bits iNESLoad reports)
+	enum
+	{
+		FIX_MAPPER = 1,
+		FIX_MIRRORING = 2,
+		FIX_BATTERY = 4,
+		FIX_NOCHR = 8,
+	};
+
+	RomInfo();
+
+	Format format;
+	//CRC32 and MD5 of the PRG and CHR data, as iNESLoad and UNIFLoad compute them
+	uint32 crc32;
+	uint8 md5[16];
+	//the iNES mapper once corrected, or -1 for UNIF
+	int mapper, submapper;
+	//as in CartInfo::mirror for iNES, the MIRR chunk for UNIF
+	int mirroring;
+	bool battery;
+	//a VS Unisystem game
+	bool vsuni;
+	//one of the known bad dumps
+	bool bad;
+	int fixes;
+	//what the image's own header says, which the corrections were worked out from
+	int headerMapper, headerMirroring;
+	bool headerBattery, headerCHR;
+	//the UNIF board or the name of the iNES mapper
+	std::string board;
+	//where the image was found; not stored in the database
+	std::string path;
+};
+
+//adds buf to a CRC32 and an MD5 at once, a slice at a time so the data is only brought into the cache once.
+//returns the new CRC32
+uint32 FCEU_HashBlock(uint32 crc, md5_context *md5, uint8 *buf, uint32 len);
+
+//identify the image in fp, which must be positioned at its start. these only read the file and are safe to call from any thread.
+//return false if fp doesn't hold an image of their format
+bool iNESIdentify(FCEUFILE *fp, RomInfo &info);
+bool UNIFIdentify(FCEUFILE *fp, RomInfo &info);
+//-------
+
+//---------ROM database
+//the database file is a hash table keyed by CRC32 which is used straight from a memory mapping,
+//so a lookup costs a probe or two no matter how many images are in it and opening it reads nothing.
+
+//identifies the image at path, which may be inside an archive. returns false if it is not an iNES or UNIF image
+bool FCEU_IdentifyROM(const char *path, RomInfo &info);
+
+//identifies every image and archive under dir, on `threads` threads (0 for one per CPU).
+//returns the number of images found
+int FCEUI_ScanLibrary(const char *dir, std::vector<RomInfo> &found, int threads);
+
+//writes the images to the database file fname, keeping the entries it already has
+bool FCEUI_WriteRomDatabase(const char *fname, const std::vector<RomInfo> &roms);
+
+//sets the database which loading a game consults; pass NULL to close it
+bool FCEUI_OpenRomDatabase(const char *fname);
+bool FCEUI_RomDatabaseIsOpen();
+
+//finds an image in the open database by its hashes. the same dump can be in it more than once, under other headers
+//or as UNIF; given `header`, only the entry from an image of the same format with the same header values matches
+bool FCEU_RomDatabaseLookup(uint32 crc32, const uint8 *md5, RomInfo &info, const RomInfo *header = 0);
+//-------
+
+#endif
@@ -0,0 +1,248 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief the i/o thread which writes savestates and battery ram to disk
+
+#include "types.h"
+#include "driver.h"
+#include "saveio.h"
+#include "utils/task.h"
+
+#include <cstdio>
+#include <string>
+#include <deque>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+//how many snapshots may be queued or being written before FCEU_SaveIOBegin waits for them
+#define SAVEIO_MAX_JOBS 4
+
+struct SaveIOJob
+{
+	std::string fname;
+	EMUFILE_MEMORY snapshot;
+	std::vector<uint8> scratch;
+	FCEU_SAVEIO_ENCODER encode;
+	int level;
+	int codec;
+	FCEU_SAVEIO_DONE done;
+	int tag;
+	bool ok;
+};
+
+//only the emulation thread touches these
+static std::vector<SaveIOJob*> freeJobs;
+static SaveIOJob *current = 0;
+static int jobCount = 0;
+static Task *ioTask = 0;
+static bool ioTaskRunning = false;
+
+//shared with the i/o thread, under ioLock.
+//draining is set while SaveIOProc is running on the i/o thread, which it leaves when the queue is empty
+static FCEU_Mutex ioLock;
+static std::deque<SaveIOJob*> queued;
+static std::vector<SaveIOJob*> finished;
+static bool draining = false;
+
+static bool SyncFile(FILE *fp)
+{
+	if(fflush(fp) != 0 || ferror(fp))
+		return false;
+#ifdef WIN32
+	return _commit(_fileno(fp)) == 0;
+#else
+	return fsync(fileno(fp)) == 0;
+#endif
+}
+
+//renames from over to, replacing it in one step
+static bool MoveOver(const char *from, const char *to)
+{
+#ifdef WIN32
+	return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+//runs on the i/o thread
+static bool WriteJob(SaveIOJob *job)
+{
+	std::string tmp = job->fname + ".tmp";
+	EMUFILE_FILE *os = FCEUD_UTF8_fstream(tmp.c_str(), "wb");
+	if(!os || !os->get_fp())
+	{
+		delete os;
+		return false;
+	}
+
+	bool ok;
+	if(job->encode)
+		ok = job->encode(os, &job->snapshot, job->level, job->codec, job->scratch);
+	else
+	{
+		os->fwrite(job->snapshot.buf(), job->snapshot.size());
+		ok = true;
+	}
+	ok = ok && SyncFile(os->get_fp());
+	delete os;
+
+	if(ok)
+		ok = MoveOver(tmp.c_str(), job->fname.c_str());
+	if(!ok)
+		remove(tmp.c_str());
+	return ok;
+}
+
+//runs on the i/o thread until the queue is empty
+static void* SaveIOProc(void *)
+{
+	for(;;)
+	{
+		ioLock.lock();
+		if(queued.empty())
+		{
+			draining = false;
+			ioLock.unlock();
+			break;
+		}
+		SaveIOJob *job = queued.front();
+		queued.pop_front();
+		ioLock.unlock();
+
+		job->ok = WriteJob(job);
+
+		ioLock.lock();
+		finished.push_back(job);
+		ioLock.unlock();
+	}
+
+	return 0;
+}
+
+EMUFILE_MEMORY *FCEU_SaveIOBegin()
+{
+	FCEU_SaveIOCancel();
+
+	if(freeJobs.empty() && jobCount >= SAVEIO_MAX_JOBS)
+		FCEU_SaveIOFlush();
+	if(freeJobs.empty())
+	{
+		freeJobs.push_back(new SaveIOJob());
+		jobCount++;
+	}
+
+	current = freeJobs.back();
+	freeJobs.pop_back();
+	current->snapshot.set_len(0);
+	current->snapshot.unfail();
+	return &current->snapshot;
+}
+
+void FCEU_SaveIOCommit(const char *fname, FCEU_SAVEIO_ENCODER encode, int level, int codec, FCEU_SAVEIO_DONE done, int tag)
+{
+	if(!current) return;
+
+	current->fname = fname;
+	current->encode = encode;
+	current->level = level;
+	current->codec = codec;
+	current->done = done;
+	current->tag = tag;
+	current->ok = false;
+
+	ioLock.lock();
+	queued.push_back(current);
+	bool start = !draining;
+	draining = true;
+	ioLock.unlock();
+	current = 0;
+
+	if(!start) return;
+
+	if(!ioTask)
+	{
+		ioTask = new Task();
+		ioTask->start(false);
+	}
+	//the last SaveIOProc has cleared draining, so this only waits for it to return
+	if(ioTaskRunning)
+		ioTask->finish();
+	ioTask->execute(SaveIOProc, 0);
+	ioTaskRunning = true;
+}
+
+void FCEU_SaveIOCancel()
+{
+	if(!current) return;
+	freeJobs.push_back(current);
+	current = 0;
+}
+
+void FCEU_SaveIOPoll()
+{
+	std::vector<SaveIOJob*> jobs;
+	ioLock.lock();
+	jobs.swap(finished);
+	ioLock.unlock();
+
+	for(size_t i = 0; i < jobs.size(); i++)
+	{
+		SaveIOJob *job = jobs[i];
+		if(job->done)
+			job->done(job->fname.c_str(), job->ok, job->tag);
+		freeJobs.push_back(job);
+	}
+}
+
+void FCEU_SaveIOFlush()
+{
+	if(ioTaskRunning)
+	{
+		ioTask->finish();
+		ioTaskRunning = false;
+	}
+	FCEU_SaveIOPoll();
+}
+
+void FCEU_SaveIOKill()
+{
+	FCEU_SaveIOCancel();
+	FCEU_SaveIOFlush();
+
+	if(ioTask)
+	{
+		ioTask->shutdown();
+		delete ioTask;
+		ioTask = 0;
+	}
+
+	for(size_t i = 0; i < freeJobs.size(); i++)
+		delete freeJobs[i];
+	freeJobs.clear();
+	jobCount = 0;
+}
@@ -0,0 +1,33 @@
+#ifndef _SAVEIO_H_
+#define _SAVEIO_H_
+
+#include <vector>
+
+#include "types.h"
+#include "emufile.h"
+
+//savestate and battery ram writes, off the emulation thread.
+//the emulation thread takes a snapshot into a reused buffer and queues it; an i/o thread encodes it,
+//writes it to a temporary file, syncs that to disk and renames it over the destination.
+
+//turns a snapshot into the bytes of the file; runs on the i/o thread, so may only use its arguments
+typedef bool (*FCEU_SAVEIO_ENCODER)(EMUFILE *os, EMUFILE_MEMORY *snapshot, int level, int codec, std::vector<uint8> &scratch);
+//called on the emulation thread, from FCEU_SaveIOPoll, once a queued write is finished
+typedef void (*FCEU_SAVEIO_DONE)(const char *fname, bool ok, int tag);
+
+//returns an empty buffer for the next snapshot, waiting for earlier writes if too many are queued
+EMUFILE_MEMORY *FCEU_SaveIOBegin();
+//queues the snapshot taken since FCEU_SaveIOBegin to be written to fname, through encode if given, which gets level and codec
+void FCEU_SaveIOCommit(const char *fname, FCEU_SAVEIO_ENCODER encode, int level, int codec, FCEU_SAVEIO_DONE done, int tag);
+//drops the snapshot taken since FCEU_SaveIOBegin
+void FCEU_SaveIOCancel();
+
+//runs the callbacks of the finished writes; called once a frame
+void FCEU_SaveIOPoll();
+//waits for all queued writes to be on disk, then runs their callbacks.
+//call before reading or renaming a file which may still be being written
+void FCEU_SaveIOFlush();
+//flushes and stops the i/o thread
+void FCEU_SaveIOKill();
+
+#endif
@@ -27,6 +27,7 @@
 #include "state.h"
 #include "wave.h"
 #include "debug.h"
+#include "perfstats.h"
 
 #include <cstdlib>
 #include <cstdio>
@@ -147,12 +148,6 @@ static uint32 ChannelBC[5];
 //savestate sync hack stuff
 int movieSyncHackOn=0,resetDMCacc=0,movieConvertOffset1,movieConvertOffset2;
 
-#ifdef WIN32
-extern volatile int datacount, undefinedcount;
-extern int debug_loggingCD;
-extern unsigned char *cdloggerdata;
-#endif
-
 static void LoadDMCPeriod(uint8 V)
 {
  if(PAL)
@@ -166,30 +161,10 @@ static void PrepDPCM()
  DMCAddress=0x4000+(DMCAddressLatch<<6);
  DMCSize=(DMCSizeLatch<<4)+1;
 
- #ifdef WIN32
  if(debug_loggingCD)LogDPCM(0x8000+DMCAddress, DMCSize);
- #endif
 
 }
 
-void LogDPCM(int romaddress, int dpcmsize){
-	int i = GetPRGAddress(romaddress);
-
-	if(i == -1)return;
-
-	for (int dpcmstart = i; dpcmstart < (i + dpcmsize); dpcmstart++) {
-		if(!(cdloggerdata[dpcmstart] & 0x40)) {
-			cdloggerdata[dpcmstart] |= 0x40;
-
-			if(!(cdloggerdata[dpcmstart] & 2)){
-				datacount++;
-				cdloggerdata[dpcmstart] |= 2;
-				if(!(cdloggerdata[dpcmstart] & 1))undefinedcount--;
-			}
-		}
-	}
-}
-
 /* Instantaneous?  Maybe the new freq value is being calculated all of the time... */
 
 /*static*/ int CheckFreq(uint32 cf, uint8 sr)
@@ -575,6 +550,81 @@ fhcnt-=cycles*48;
  }
 }
 
+int FCEU_SoundCPUHookIdle(void)
+{
+ int32 frame=(fhcnt-1)/48;
+ if(!DMCSize)
+  return frame;
+ //a DMC fetch is due
+ if(!DMCHaveDMA)
+  return 0;
+
+ //up to the bit which empties the sample buffer, after which the next fetch is due
+ int32 dmc=DMCacc-1+(7-DMCBitCount)*DMCPeriod;
+ return frame<dmc?frame:dmc;
+}
+
+//what of the sound output isn't in savestates
+static struct {
+ void (*DoNoise)(void), (*DoTriangle)(void), (*DoPCM)(void), (*DoSQ1)(void), (*DoSQ2)(void);
+ uint32 ChannelBC[5];
+ int32 RectDutyCount[2];
+ int32 wlcount[4];
+ int32 tristep;
+ int32 sqacc[2];
+ uint16 nreg;
+ int32 Wave[2048+512];
+} held;
+static bool holding=false;
+
+void FCEU_SoundHold(bool hold)
+{
+ if(hold==holding)
+  return;
+ holding=hold;
+
+ if(hold)
+ {
+  held.DoNoise=DoNoise;
+  held.DoTriangle=DoTriangle;
+  held.DoPCM=DoPCM;
+  held.DoSQ1=DoSQ1;
+  held.DoSQ2=DoSQ2;
+  DoNoise=DoTriangle=DoPCM=DoSQ1=DoSQ2=Dummyfunc;
+  memcpy(held.ChannelBC,ChannelBC,sizeof(ChannelBC));
+  memcpy(held.RectDutyCount,RectDutyCount,sizeof(RectDutyCount));
+  memcpy(held.wlcount,wlcount,sizeof(wlcount));
+  held.tristep=tristep;
+  memcpy(held.sqacc,sqacc,sizeof(sqacc));
+  held.nreg=nreg;
+  if(!FSettings.soundq)
+   memcpy(held.Wave,Wave,sizeof(Wave));
+ }
+ else
+ {
+  DoNoise=held.DoNoise;
+  DoTriangle=held.DoTriangle;
+  DoPCM=held.DoPCM;
+  DoSQ1=held.DoSQ1;
+  DoSQ2=held.DoSQ2;
+  memcpy(ChannelBC,held.ChannelBC,sizeof(ChannelBC));
+  memcpy(RectDutyCount,held.RectDutyCount,sizeof(RectDutyCount));
+  memcpy(wlcount,held.wlcount,sizeof(wlcount));
+  tristep=held.tristep;
+  memcpy(sqacc,held.sqacc,sizeof(sqacc));
+  nreg=held.nreg;
+  //expansion sound renders as its registers are written, which can't be held; what it put in the buffers is
+  //thrown away and its channels are lined up with the rest again
+  if(FSettings.soundq>=1)
+  {
+   memset(WaveHi+soundtsoffs,0,sizeof(WaveHi)-soundtsoffs*sizeof(uint32));
+   if(GameExpSound.HiSync) GameExpSound.HiSync(soundtsoffs);
+  }
+  else
+   memcpy(Wave,held.Wave,sizeof(Wave));
+ }
+}
+
 void RDoPCM(void)
 {
  uint32 V; //mbg merge 7/17/06 made uint32
@@ -1029,6 +1079,7 @@ void SetNESSoundMap(void)
 static int32 inbuf=0;
 int FlushEmulateSound(void)
 {
+  FCEU_PERF_SCOPE(FCEU_PERF_APU);
   int x;
   int32 end,left;
 
@@ -1339,6 +1390,10 @@ SFORMAT FCEUSND_STATEINFO[]={
  { &EnvUnits[1].decvolume, 1, "E1DV"},
  { &EnvUnits[2].decvolume, 1, "E2DV"},
 
+ { &EnvUnits[0].reloaddec, 4|FCEUSTATE_RLSB, "E0RL"},
+ { &EnvUnits[1].reloaddec, 4|FCEUSTATE_RLSB, "E1RL"},
+ { &EnvUnits[2].reloaddec, 4|FCEUSTATE_RLSB, "E2RL"},
+
  { &lengthcount[0], 4|FCEUSTATE_RLSB, "LEN0"},
  { &lengthcount[1], 4|FCEUSTATE_RLSB, "LEN1"},
  { &lengthcount[2], 4|FCEUSTATE_RLSB, "LEN2"},
@@ -1355,6 +1410,7 @@ SFORMAT FCEUSND_STATEINFO[]={
  { &DMCAddress, 4|FCEUSTATE_RLSB, "5ADD"},
  { &DMCSize, 4|FCEUSTATE_RLSB, "5SIZ"},
  { &DMCShift, 1, "5SHF"},
+ { &DMCDMABuf, 1, "5DMB"},
 
  { &DMCHaveDMA, 1, "5HVDM"},
  { &DMCHaveSample, 1, "5HVSP"},
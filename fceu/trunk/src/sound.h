@@ -51,11 +51,9 @@ extern int32 WaveFinal[2048+512];
 extern int32 WaveHi[];
 extern uint32 soundtsinc;
 
-#ifdef WIN32
 extern volatile int datacount, undefinedcount;
 extern int debug_loggingCD;
 extern unsigned char *cdloggerdata;
-#endif
 
 extern uint32 soundtsoffs;
 #define SOUNDTS (timestamp + soundtsoffs)
@@ -69,6 +67,12 @@ void FCEUSND_SaveState(void);
 void FCEUSND_LoadState(int version);
 
 void FCEU_SoundCPUHook(int);
+//how many cycles FCEU_SoundCPUHook can be given at once without the frame counter stepping or the DMC fetching a
+//sample: the bits it only shifts out in between come out the same either way
+int FCEU_SoundCPUHookIdle(void);
+//holds the sound output over frames which are emulated only to be thrown away again by loading a state (run-ahead):
+//they are neither rendered nor flushed, and what the output keeps between frames is as it was when they're over
+void FCEU_SoundHold(bool hold);
 void Write_IRQFM (uint32 A, uint8 V); //mbg merge 7/17/06 brought over from latest mmbuild
 
 void LogDPCM(int romaddress, int dpcmsize);
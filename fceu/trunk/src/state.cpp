@@ -28,6 +28,7 @@
 #include "utils/endian.h"
 #include "utils/memory.h"
 #include "utils/xstring.h"
+#include "utils/lz.h"
 #include "file.h"
 #include "fds.h"
 #include "state.h"
@@ -38,6 +39,7 @@
 #include "input.h"
 #include "zlib.h"
 #include "driver.h"
+#include "saveio.h"
 #ifdef _S9XLUA_H
 #include "fceulua.h"
 #endif
@@ -81,6 +83,7 @@ bool internalSaveLoad = false;
 
 bool backupSavestates = true;
 bool compressSavestates = true;  //By default FCEUX compresses savestates when a movie is inactive.
+int savestateCodec = FCEUSS_CODEC_ZLIB;
 
 // a temp memory stream. We'll be dumping some data here and then compress
 EMUFILE_MEMORY memory_savestate;
@@ -99,6 +102,7 @@ extern SFORMAT FCEU_NEWPPU_STATEINFO[];
 extern SFORMAT FCEUSND_STATEINFO[];
 extern SFORMAT FCEUCTRL_STATEINFO[];
 extern SFORMAT FCEUMOV_STATEINFO[];
+extern uint8 SPRAM[0x100];
 
 //why two separate CPU structs?? who knows
 
@@ -280,6 +284,10 @@ static bool ReadStateChunks(EMUFILE* is, int32 totalsize)
 					ret=false;
 			}
 			break;
+		case 9:
+			if(!FCEUMOV_ReadStateRef(is,size))
+				ret=false;
+			break;
 		case 0x10:
 			if(!ReadStateChunk(is,SFMDATA,size)) 
 				ret=false; 
@@ -363,14 +371,10 @@ int CurrentState=0;
 extern int geniestage;
 
 
-bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel)
+bool FCEUSS_SnapshotMS(EMUFILE_MEMORY* os)
 {
-	// reinit memory_savestate
-	// memory_savestate is global variable which already has its vector of bytes, so no need to allocate memory every time we use save/loadstate
-	memory_savestate.set_len(0);	// this also seeks to the beginning
-	memory_savestate.unfail();
-
-	EMUFILE* os = &memory_savestate;
+	os->set_len(0);	// this also seeks to the beginning
+	os->unfail();
 
 	uint32 totalsize = 0;
 
@@ -393,7 +397,7 @@ bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel)
 			os->fseek(5,SEEK_CUR);
 			int size = FCEUMOV_WriteState(os);
 			os->fseek(-(size+5),SEEK_CUR);
-			os->fputc(7);
+			os->fputc(9);
 			write32le(size, os);
 			os->fseek(size,SEEK_CUR);
 
@@ -414,46 +418,217 @@ bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel)
 	totalsize+=WriteStateChunk(os,0x10,SFMDATA);
 	if(SPreSave) SPostSave();
 
-	//save the length of the file
-	int len = memory_savestate.size();
-
-	//sanity check: len and totalsize should be the same
-	if(len != totalsize)
+	//sanity check: the length of the snapshot and totalsize should be the same
+	if(os->size() != totalsize)
 	{
 		FCEUD_PrintError("sanity violation: len != totalsize");
 		return false;
 	}
 
+	return true;
+}
+
+bool FCEUSS_WriteSnapshot(EMUFILE* outstream, EMUFILE_MEMORY* snapshot, int compressionLevel, int codec, std::vector<uint8> &scratch)
+{
+	uint32 totalsize = snapshot->size();
+
 	int error = Z_OK;
-	uint8* cbuf = (uint8*)memory_savestate.buf();
+	uint8* cbuf = (uint8*)snapshot->buf();
 	uLongf comprlen = -1;
-	if(compressionLevel != Z_NO_COMPRESSION && (compressSavestates || FCEUMOV_Mode(MOVIEMODE_TASEDITOR)))
+	if(compressionLevel != Z_NO_COMPRESSION && codec == FCEUSS_CODEC_LZ)
+	{
+		comprlen = FCEU_LZBound(totalsize);
+		if (scratch.size() < comprlen) scratch.resize(comprlen);
+		cbuf = &scratch[0];
+		comprlen = FCEU_LZCompress((uint8*)snapshot->buf(), totalsize, cbuf, comprlen);
+		if(!comprlen)
+			error = Z_BUF_ERROR;
+	}
+	else if(compressionLevel != Z_NO_COMPRESSION)
 	{
+		codec = FCEUSS_CODEC_ZLIB;
 		// worst case compression: zlib says "0.1% larger than sourceLen plus 12 bytes"
-		comprlen = (len>>9)+12 + len;
-		if (compressed_buf.size() < comprlen) compressed_buf.resize(comprlen);
-		cbuf = &compressed_buf[0];
+		comprlen = (totalsize>>9)+12 + totalsize;
+		if (scratch.size() < comprlen) scratch.resize(comprlen);
+		cbuf = &scratch[0];
 		// do compression
-		error = compress2(cbuf, &comprlen, (uint8*)memory_savestate.buf(), len, compressionLevel);
+		error = compress2(cbuf, &comprlen, (uint8*)snapshot->buf(), totalsize, compressionLevel);
 	}
 
-	//dump the header
-	uint8 header[16]="FCSX";
+	//dump the header. states which are uncompressed or zlib keep the one older versions read,
+	//the others say "FCSC" and add the codec id after it
+	uint8 header[20]="FCSX";
+	int headersize = 16;
+	if(comprlen != -1 && codec != FCEUSS_CODEC_ZLIB)
+	{
+		header[3] = 'C';
+		FCEU_en32lsb(header+16, codec);
+		headersize = 20;
+	}
 	FCEU_en32lsb(header+4, totalsize);
 	FCEU_en32lsb(header+8, FCEU_VERSION_NUMERIC);
 	FCEU_en32lsb(header+12, comprlen);
 
 	//dump it to the destination file
-	outstream->fwrite((char*)header,16);
+	outstream->fwrite((char*)header,headersize);
 	outstream->fwrite((char*)cbuf,comprlen==-1?totalsize:comprlen);
 
 	return error == Z_OK;
 }
 
+//the level FCEUSS_WriteSnapshot is given for a state saved at compressionLevel
+static int SnapshotCompressionLevel(int compressionLevel)
+{
+	if(compressSavestates || FCEUMOV_Mode(MOVIEMODE_TASEDITOR))
+		return compressionLevel;
+	return Z_NO_COMPRESSION;
+}
+
+bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel, int codec)
+{
+	// memory_savestate is global variable which already has its vector of bytes, so no need to allocate memory every time we use save/loadstate
+	if(!FCEUSS_SnapshotMS(&memory_savestate))
+		return false;
+	return FCEUSS_WriteSnapshot(outstream, &memory_savestate, SnapshotCompressionLevel(compressionLevel), codec, compressed_buf);
+}
+
+static bool FirstDifference(const uint8 *a, const uint8 *b, uint32 size, uint32 &offset)
+{
+	for(offset = 0; offset < size; offset++)
+		if(a[offset] != b[offset])
+			return true;
+	return false;
+}
+
+bool FCEUSS_FirstDifference(EMUFILE_MEMORY &a, EMUFILE_MEMORY &b, char desc[5], uint32 &offset)
+{
+	if(a.size() == b.size() && !memcmp(a.buf(), b.buf(), a.size()))
+		return false;
+
+	//chunks of a type byte and a size, each a list of named variables but for the back buffer and the movie
+	uint8 *pa = a.buf(), *pb = b.buf();
+	uint32 len = a.size() < b.size() ? a.size() : b.size();
+	uint32 pos = 16;
+	while(pos + 5 <= len)
+	{
+		int type = pa[pos];
+		uint32 size = FCEU_de32lsb(pa + pos + 1);
+		if(type != pb[pos] || size != FCEU_de32lsb(pb + pos + 1) || pos + 5 + size > len)
+			break;
+		pos += 5;
+		uint32 end = pos + size;
+		if(type == 8 || type == 9)
+		{
+			if(FirstDifference(pa + pos, pb + pos, size, offset))
+			{
+				strcpy(desc, type == 8 ? "BACK" : "MOVI");
+				return true;
+			}
+		}
+		else while(pos + 8 <= end)
+		{
+			uint32 vsize = FCEU_de32lsb(pa + pos + 4);
+			memcpy(desc, pa + pos, 4);
+			desc[4] = 0;
+			offset = 0;
+			if(memcmp(pa + pos, pb + pos, 8) || pos + 8 + vsize > end)
+				return true;
+			if(FirstDifference(pa + pos + 8, pb + pos + 8, vsize, offset))
+				return true;
+			pos += 8 + vsize;
+		}
+		pos = end;
+	}
+	strcpy(desc, "?");
+	offset = 0;
+	return true;
+}
+
+static const char *partNames[FCEUSS_PART_COUNT] = {
+	"cpu", "ram", "ppu", "spram", "apu", "input", "mapper"
+};
+
+//folds the variables of a list into a crc, following links, but for the one named skip
+static uint32 SubChecksum(uint32 crc, SFORMAT *sf, const char *skip)
+{
+	while(sf->v)
+	{
+		if(sf->s==~0)		//Link to another struct
+		{
+			crc=SubChecksum(crc,(SFORMAT *)sf->v,skip);
+			sf++;
+			continue;
+		}
+		if(!skip || memcmp(sf->desc,skip,4))
+		{
+			uint32 size=sf->s&(~FCEUSTATE_FLAGS);
+			uint8 *data=(sf->s&FCEUSTATE_INDIRECT)?*(uint8 **)sf->v:(uint8 *)sf->v;
+#ifndef LSB_FIRST
+			if(sf->s&RLSB)
+				FlipByteOrder(data,size);
+#endif
+			crc=crc32(crc,data,size);
+#ifndef LSB_FIRST
+			if(sf->s&RLSB)
+				FlipByteOrder(data,size);
+#endif
+		}
+		sf++;
+	}
+	return crc;
+}
+
+void FCEUSS_PartChecksums(uint32 crc[FCEUSS_PART_COUNT])
+{
+	FCEUPPU_SaveState();
+	FCEUSND_SaveState();
+	crc[FCEUSS_PART_CPU]=SubChecksum(SubChecksum(0,SFCPU,"RAM"),SFCPUC,0);
+	crc[FCEUSS_PART_RAM]=crc32(0,RAM,0x800);
+	crc[FCEUSS_PART_PPU]=SubChecksum(0,FCEUPPU_STATEINFO,"SPRA");
+	crc[FCEUSS_PART_SPRAM]=crc32(0,SPRAM,0x100);
+	crc[FCEUSS_PART_APU]=SubChecksum(0,FCEUSND_STATEINFO,0);
+	crc[FCEUSS_PART_INPUT]=SubChecksum(0,FCEUCTRL_STATEINFO,0);
+	if(SPreSave) SPreSave();
+	crc[FCEUSS_PART_MAPPER]=SubChecksum(0,SFMDATA,0);
+	if(SPostSave) SPostSave();
+}
+
+const char *FCEUSS_PartName(int part)
+{
+	if(part < 0 || part >= FCEUSS_PART_COUNT)
+		return "";
+	return partNames[part];
+}
+
+//tag is the slot the state was saved to, or -1 for a state saved to a named file
+static void StateSaveDone(bool ok, int tag, bool display_message)
+{
+	if(!ok)
+	{
+		if (display_message)
+			FCEU_DispMessage("State %d save error.", 0, tag >= 0 ? tag : CurrentState);
+		return;
+	}
+	if(tag >= 0)
+	{
+		SaveStateStatus[tag] = 1;
+		if (display_message)
+			FCEU_DispMessage("State %d saved.", 0, tag);
+	}
+}
+
+static void StateSaved(const char *fname, bool ok, int tag)
+{
+	StateSaveDone(ok, tag, true);
+}
+
+static void StateSavedQuietly(const char *fname, bool ok, int tag)
+{
+	StateSaveDone(ok, tag, false);
+}
 
 void FCEUSS_Save(const char *fname, bool display_message)
 {
-	EMUFILE* st = 0;
 	char fn[2048];
 
 	if (geniestage==1)
@@ -465,7 +640,6 @@ void FCEUSS_Save(const char *fname, bool display_message)
 
 	if(fname)	//If filename is given use it.
 	{
-		st = FCEUD_UTF8_fstream(fname, "wb");
 		strcpy(fn, fname);
 	}
 	else		//Else, generate one
@@ -476,21 +650,13 @@ void FCEUSS_Save(const char *fname, bool display_message)
 		//backup existing savestate first
 		if (CheckFileExists(fn) && backupSavestates)	//adelikat:  If the files exists and we are allowed to make backup savestates
 		{
+			FCEU_SaveIOFlush();				//the state being backed up may still be being written
 			CreateBackupSaveState(fn);		//Make a backup of previous savestate before overwriting it
 			strcpy(lastSavestateMade,fn);	//Remember what the last savestate filename was (for undoing later)
 			undoSS = true;					//Backup was created so undo is possible
 		}
 		else
 			undoSS = false;					//so backup made so lastSavestateMade does have a backup file, so no undo
-
-		st = FCEUD_UTF8_fstream(fn,"wb");
-	}
-
-	if (st == NULL || st->get_fp() == NULL)
-	{
-		if (display_message)
-			FCEU_DispMessage("State %d save error.", 0, CurrentState);
-		return;
 	}
 
 	#ifdef _S9XLUA_H
@@ -519,19 +685,16 @@ void FCEUSS_Save(const char *fname, bool display_message)
 	}
 	#endif
 
-	if(FCEUMOV_Mode(MOVIEMODE_INACTIVE))
-		FCEUSS_SaveMS(st,-1);
-	else
-		FCEUSS_SaveMS(st,0);
-
-	delete st;
-
-	if(!fname)
+	//only the snapshot is taken here; the i/o thread compresses and writes it, and StateSaved reports it
+	if(!FCEUSS_SnapshotMS(FCEU_SaveIOBegin()))
 	{
-		SaveStateStatus[CurrentState] = 1;
-		if (display_message)
-			FCEU_DispMessage("State %d saved.", 0, CurrentState);
+		FCEU_SaveIOCancel();
+		StateSaveDone(false, fname ? -1 : CurrentState, display_message);
+		return;
 	}
+	int level = SnapshotCompressionLevel(FCEUMOV_Mode(MOVIEMODE_INACTIVE) ? -1 : 0);
+	FCEU_SaveIOCommit(fn, FCEUSS_WriteSnapshot, level, savestateCodec, display_message ? StateSaved : StateSavedQuietly, fname ? -1 : CurrentState);
+
 	redoSS = false;					//we have a new savestate so redo is not possible
 }
 
@@ -642,9 +805,16 @@ bool FCEUSS_LoadFP(EMUFILE* is, ENUM_SSLOADPARAMS params)
 	}
 
 	uint8 header[16];
+	int codec = FCEUSS_CODEC_ZLIB;
 	//read and analyze the header
 	is->fread((char*)&header,16);
-	if(memcmp(header,"FCSX",4)) {
+	if(!memcmp(header,"FCSC",4)) {
+		uint8 id[4];
+		is->fread((char*)id,4);
+		codec = FCEU_de32lsb(id);
+		if(codec < 0 || codec >= FCEUSS_CODEC_COUNT)
+			return false;
+	} else if(memcmp(header,"FCSX",4)) {
 		//its not an fceux save file.. perhaps it is an fceu savefile
 		is->fseek(0,SEEK_SET);
 		FCEU_state_loading_old_format = true;
@@ -672,10 +842,17 @@ bool FCEUSS_LoadFP(EMUFILE* is, ENUM_SSLOADPARAMS params)
 		if ((int)compressed_buf.size() < comprlen) compressed_buf.resize(comprlen);
 		is->fread(&compressed_buf[0], comprlen);
 
-		uLongf uncomprlen = totalsize;
-		int error = uncompress(memory_savestate.buf(), &uncomprlen, &compressed_buf[0], comprlen);
-		if(error != Z_OK || uncomprlen != totalsize)
-			return false;	// we dont need to restore the backup here because we havent messed with the emulator state yet
+		if(codec == FCEUSS_CODEC_LZ)
+		{
+			if(!FCEU_LZDecompress(&compressed_buf[0], comprlen, memory_savestate.buf(), totalsize))
+				return false;
+		} else
+		{
+			uLongf uncomprlen = totalsize;
+			int error = uncompress(memory_savestate.buf(), &uncomprlen, &compressed_buf[0], comprlen);
+			if(error != Z_OK || uncomprlen != totalsize)
+				return false;	// we dont need to restore the backup here because we havent messed with the emulator state yet
+		}
 	} else
 	{
 		// the savestate is not compressed: just read from is to memory_savestate.vec
@@ -727,6 +904,10 @@ bool FCEUSS_Load(const char *fname, bool display_message)
 			FCEU_DispMessage("Cannot load FCS in GG screen.",0);
 		return false;
 	}
+
+	//the state may still be being written
+	FCEU_SaveIOFlush();
+
 	if (fname)
 	{
 		st = FCEUD_UTF8_fstream(fname, "rb");
@@ -1065,6 +1246,7 @@ void SwapSaveState()
 	//--------------------------------------------------------------------------------------------
 	//So both exists, now swap the last savestate and its backup
 	//--------------------------------------------------------------------------------------------
+	FCEU_SaveIOFlush();						//Let the last savestate finish being written
 	string temp = backup;					//Put backup filename in temp
 	temp.append("x");						//Add x
 
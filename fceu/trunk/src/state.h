@@ -27,11 +27,46 @@ enum ENUM_SSLOADPARAMS
 void FCEUSS_Save(const char *, bool display_message=true);
 bool FCEUSS_Load(const char *, bool display_message=true);
 
- //zlib values: 0 (none) through 9 (max) or -1 (default)
-bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel);
+//the codecs a savestate can be compressed with; the id is kept in the header, so any of them loads
+enum
+{
+	FCEUSS_CODEC_ZLIB,	//small, and the only one versions before the codec id can load
+	FCEUSS_CODEC_LZ,	//utils/lz, several times faster both ways, for states taken every frame
+	FCEUSS_CODEC_COUNT
+};
+
+ //zlib values: 0 (none) through 9 (max) or -1 (default). the lz codec has no levels, so anything but 0 compresses
+bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel, int codec = FCEUSS_CODEC_ZLIB);
+
+//FCEUSS_SaveMS in two steps, so the second can run off the emulation thread:
+//the chunks of the state, uncompressed and without the header, into a snapshot
+bool FCEUSS_SnapshotMS(EMUFILE_MEMORY* os);
+//then the header and the snapshot, compressed into scratch unless compressionLevel is 0
+bool FCEUSS_WriteSnapshot(EMUFILE* outstream, EMUFILE_MEMORY* snapshot, int compressionLevel, int codec, std::vector<uint8> &scratch);
 
 bool FCEUSS_LoadFP(EMUFILE* is, ENUM_SSLOADPARAMS params);
 
+//compares two states saved by FCEUSS_SaveMS without compression. false if they are the same; else true, with the name
+//of the first thing in them which differs in desc ("RAM", "PC", ..., "BACK" for the back buffer) and the byte of it in offset
+bool FCEUSS_FirstDifference(EMUFILE_MEMORY &a, EMUFILE_MEMORY &b, char desc[5], uint32 &offset);
+
+//the parts of the state which FCEUSS_PartChecksums hashes apart, so two runs can be compared frame by frame
+//without saving a whole state. the new ppu's own variables are left out, to compare it with the old one
+enum
+{
+	FCEUSS_PART_CPU,	//registers and timing, without the RAM
+	FCEUSS_PART_RAM,
+	FCEUSS_PART_PPU,	//registers, nametables and palette, without the sprite RAM
+	FCEUSS_PART_SPRAM,
+	FCEUSS_PART_APU,
+	FCEUSS_PART_INPUT,
+	FCEUSS_PART_MAPPER,	//everything added with AddExState
+	FCEUSS_PART_COUNT
+};
+
+void FCEUSS_PartChecksums(uint32 crc[FCEUSS_PART_COUNT]);
+const char *FCEUSS_PartName(int part);
+
 extern int CurrentState;
 void FCEUSS_CheckStates(void);
 
@@ -77,3 +112,4 @@ extern bool backupSavestates;		 //Whether or not to make backups, true by defaul
 bool CheckBackupSaveStateExist();	 //Checks if backupsavestate exists
 
 extern bool compressSavestates;		//Whether or not to compress non-movie savestates (by default, yes)
+extern int savestateCodec;			//The codec savestate files are compressed with (by default, zlib)
@@ -0,0 +1,390 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief per-frame savestate history with chunks shared between frames
+
+#include "types.h"
+#include "fceu.h"
+#include "state.h"
+#include "movie.h"
+#include "emufile.h"
+#include "statehistory.h"
+#include "utils/crc32.h"
+#include "utils/endian.h"
+#include "utils/lz.h"
+#include "zlib.h"
+
+#include <cstring>
+#include <algorithm>
+
+//the savestate header is cut off as a section of its own
+#define SECTION_HEADER 0xFF
+//whatever doesn't parse as sections
+#define SECTION_UNKNOWN 0xFE
+
+StateHistory::StateHistory()
+	: stateCount(0)
+	, capacity(1)
+	, budget(0)
+	, memoryUsed(0)
+	, capturesSinceThin(0)
+{
+}
+
+StateHistory::~StateHistory()
+{
+}
+
+void StateHistory::setRetention(int capacity, uint32 budget)
+{
+	this->capacity = std::max(capacity, 1);
+	this->budget = budget;
+}
+
+void StateHistory::clear()
+{
+	states.clear();
+	stateCount = 0;
+	chunks.clear();
+	freeChunks.clear();
+	index.clear();
+	prevState.clear();
+	prevPieces.clear();
+	memoryUsed = 0;
+	capturesSinceThin = 0;
+}
+
+int StateHistory::addChunk(const uint8* data, int size)
+{
+	uint32 hash = CalcCRC32(0, (uint8*)data, size);
+	std::pair<std::multimap<uint32,int>::iterator,std::multimap<uint32,int>::iterator> range = index.equal_range(hash);
+	for(std::multimap<uint32,int>::iterator it = range.first; it != range.second; ++it)
+	{
+		if(chunkEquals(it->second, data, size))
+		{
+			chunks[it->second].refs++;
+			return it->second;
+		}
+	}
+
+	int id;
+	if(freeChunks.empty())
+	{
+		id = (int)chunks.size();
+		chunks.push_back(Chunk());
+	}
+	else
+	{
+		id = freeChunks.back();
+		freeChunks.pop_back();
+	}
+
+	Chunk& chunk = chunks[id];
+	chunk.hash = hash;
+	chunk.refs = 1;
+	chunk.size = size;
+
+	//kept as it is when it doesn't get any smaller
+	uint8 buf[CHUNK_SIZE];
+	uint32 len = FCEU_LZCompress(data, size, buf, size);
+	chunk.compressed = len != 0;
+	if(chunk.compressed)
+		chunk.data.assign(buf, buf + len);
+	else
+		chunk.data.assign(data, data + size);
+
+	index.insert(std::make_pair(hash, id));
+	memoryUsed += chunk.data.size() + sizeof(Chunk);
+	return id;
+}
+
+bool StateHistory::chunkEquals(int id, const uint8* data, int size)
+{
+	Chunk& chunk = chunks[id];
+	if(chunk.size != size)
+		return false;
+	if(!chunk.compressed)
+		return !memcmp(&chunk.data[0], data, size);
+	uint8 buf[CHUNK_SIZE];
+	unpackChunk(id, buf);
+	return !memcmp(buf, data, size);
+}
+
+void StateHistory::unpackChunk(int id, uint8* out)
+{
+	Chunk& chunk = chunks[id];
+	if(chunk.compressed)
+		FCEU_LZDecompress(&chunk.data[0], chunk.data.size(), out, chunk.size);
+	else
+		memcpy(out, &chunk.data[0], chunk.size);
+}
+
+void StateHistory::releaseChunk(int id)
+{
+	Chunk& chunk = chunks[id];
+	if(--chunk.refs)
+		return;
+
+	std::pair<std::multimap<uint32,int>::iterator,std::multimap<uint32,int>::iterator> range = index.equal_range(chunk.hash);
+	for(std::multimap<uint32,int>::iterator it = range.first; it != range.second; ++it)
+	{
+		if(it->second == id)
+		{
+			index.erase(it);
+			break;
+		}
+	}
+	memoryUsed -= chunk.data.size() + sizeof(Chunk);
+	std::vector<uint8>().swap(chunk.data);
+	freeChunks.push_back(id);
+}
+
+void StateHistory::releaseState(int frame)
+{
+	if(frame >= (int)states.size() || states[frame].empty())
+		return;
+	std::vector<int>& pieces = states[frame];
+	for(int i=0;i<(int)pieces.size();i++)
+		releaseChunk(pieces[i]);
+	memoryUsed -= pieces.size() * sizeof(int);
+	std::vector<int>().swap(pieces);
+	stateCount--;
+}
+
+void StateHistory::store(int frame, const uint8* state, int size)
+{
+	if(frame < 0)
+		return;
+	if((int)states.size() <= frame)
+		states.resize(frame+1);
+	releaseState(frame);
+
+	std::vector<int>& pieces = states[frame];
+	std::map<uint32,PrevPiece> nextPieces;
+
+	//the 16 byte header, then the sections, each being a type byte and a 32bit size before the data.
+	//chunks are cut from the start of each section, so a section changing size doesn't shift the ones after it
+	uint32 section = SECTION_HEADER;
+	int sectionStart = 0;
+	int sectionEnd = std::min(16, size);
+	int pos = 0;
+	while(pos < size)
+	{
+		if(pos == sectionEnd)
+		{
+			section = state[pos];
+			sectionStart = pos;
+			uint32 len = pos + 5 <= size ? FCEU_de32lsb((uint8*)state+pos+1) : 0xFFFFFFFF;
+			if(len > (uint32)(size - pos - 5))
+			{
+				section = SECTION_UNKNOWN;
+				sectionEnd = size;
+			}
+			else
+				sectionEnd = pos + 5 + (int)len;
+		}
+
+		int len = std::min((int)CHUNK_SIZE, sectionEnd - pos);
+		uint32 key = (section << 24) | (uint32)((pos - sectionStart) / CHUNK_SIZE);
+
+		//most chunks are the same as in the previous frame, which is cheaper to check than to look them up
+		int id;
+		std::map<uint32,PrevPiece>::iterator prev = prevPieces.find(key);
+		if(prev != prevPieces.end() && chunks[prev->second.chunk].size == len
+			&& !memcmp(&prevState[prev->second.pos], state+pos, len))
+		{
+			id = prev->second.chunk;
+			chunks[id].refs++;
+		}
+		else
+			id = addChunk(state+pos, len);
+		pieces.push_back(id);
+
+		PrevPiece piece;
+		piece.pos = pos;
+		piece.chunk = id;
+		if(nextPieces.insert(std::make_pair(key, piece)).second)
+			chunks[id].refs++;
+
+		pos += len;
+	}
+
+	//the previous state's chunks are held on to until now, so none of them can have been reused for something else
+	for(std::map<uint32,PrevPiece>::iterator it = prevPieces.begin(); it != prevPieces.end(); ++it)
+		releaseChunk(it->second.chunk);
+	prevPieces.swap(nextPieces);
+	prevState.assign(state, state + size);
+
+	memoryUsed += pieces.size() * sizeof(int);
+	stateCount++;
+}
+
+void StateHistory::capture(int frame)
+{
+	captured.clear();
+	EMUFILE_MEMORY ms(&captured);
+	if(!FCEUSS_SaveMS(&ms, Z_NO_COMPRESSION))
+		return;
+	store(frame, (uint8*)ms.buf(), ms.size());
+
+	//thinning looks at every frame, so it is only done once in a while, or when over budget
+	bool overBudget = budget && memoryUsed > budget;
+	if(++capturesSinceThin >= capacity || overBudget)
+	{
+		//free a quarter more than needed, so it isn't done again on the very next frame
+		thin(frame, overBudget ? budget - budget/4 : budget);
+		capturesSinceThin = 0;
+	}
+}
+
+bool StateHistory::has(int frame) const
+{
+	return frame >= 0 && frame < (int)states.size() && !states[frame].empty();
+}
+
+int StateHistory::findAtOrBefore(int frame) const
+{
+	for(frame = std::min(frame, (int)states.size() - 1); frame >= 0; frame--)
+	{
+		if(!states[frame].empty())
+			return frame;
+	}
+	return -1;
+}
+
+bool StateHistory::get(int frame, std::vector<uint8>& out)
+{
+	if(!has(frame))
+		return false;
+	std::vector<int>& pieces = states[frame];
+	int size = 0;
+	for(int i=0;i<(int)pieces.size();i++)
+		size += chunks[pieces[i]].size;
+	out.resize(size);
+	int pos = 0;
+	for(int i=0;i<(int)pieces.size();i++)
+	{
+		unpackChunk(pieces[i], &out[pos]);
+		pos += chunks[pieces[i]].size;
+	}
+	return true;
+}
+
+bool StateHistory::load(int frame)
+{
+	std::vector<uint8> state;
+	if(!get(frame, state))
+		return false;
+	EMUFILE_MEMORY ms(&state);
+	return FCEUSS_LoadFP(&ms, SSLOADPARAM_NOBACKUP);
+}
+
+void StateHistory::invalidate(int after)
+{
+	for(int i=after+1;i<(int)states.size();i++)
+		releaseState(i);
+	if((int)states.size() > after+1)
+		states.resize(std::max(after+1, 0));
+}
+
+//drops the states the retention tiers don't keep, shrinking the tiers until no more than target bytes are used
+void StateHistory::thin(int newest, uint32 target)
+{
+	int i;
+	for(int span = capacity; ; span /= 2)
+	{
+		i = newest - span;
+		for(int tier=1;tier<=4 && i > 0;tier++)
+		{
+			int mask = (1<<tier) - 1;
+			int limit = std::max(i - (span<<tier), 0);
+			for(;i > limit;i--)
+			{
+				if(i & mask)
+					releaseState(i);
+			}
+		}
+		//the zeroth frame stays, like in the TAS Editor's greenzone
+		for(;i > 0;i--)
+			releaseState(i);
+
+		if(!target || memoryUsed <= target || span <= 1)
+			break;
+	}
+
+	//still too much: drop the oldest states, all but the newest
+	for(i=0;target && memoryUsed > target && i < newest;i++)
+		releaseState(i);
+}
+
+static StateHistory* history = 0;
+
+void FCEUI_SetStateHistory(int capacity, int budgetKB)
+{
+	if(capacity <= 0)
+	{
+		delete history;
+		history = 0;
+		return;
+	}
+	if(!history)
+		history = new StateHistory();
+	history->setRetention(capacity, (uint32)budgetKB * 1024);
+}
+
+bool FCEUI_StateHistoryEnabled()
+{
+	return history != 0;
+}
+
+StateHistory* FCEU_GetStateHistory()
+{
+	return history;
+}
+
+int FCEUI_StateHistoryLoad(int frame)
+{
+	if(!history || !GameInfo)
+		return -1;
+	frame = history->findAtOrBefore(frame);
+	if(frame < 0 || !history->load(frame))
+		return -1;
+	//savestates only carry the frame counter while a movie is active
+	currFrameCounter = frame;
+	return frame;
+}
+
+void FCEU_StateHistoryFrameAdvance()
+{
+	if(!history || !GameInfo)
+		return;
+	int frame = FCEUMOV_GetFrame();
+	history->capture(frame);
+	//unless a movie is playing back, the frames after this one haven't happened yet
+	if(!FCEUMOV_Mode(MOVIEMODE_PLAY))
+		history->invalidate(frame);
+}
+
+void FCEU_StateHistoryGameClosed()
+{
+	if(history)
+		history->clear();
+}
@@ -0,0 +1,108 @@
+#ifndef _STATEHISTORY_H_
+#define _STATEHISTORY_H_
+
+#include "types.h"
+
+#include <vector>
+#include <deque>
+#include <map>
+
+//---------StateHistory
+//keeps a savestate for (nearly) every frame in little memory.
+//states are cut into chunks along the savestate's sections and the chunks are stored once each, by content:
+//whatever didn't change from one frame to the next (CHR RAM, untouched WRAM, most of the PPU) costs nothing.
+//chunks which are new get compressed with utils/lz. older frames are thinned out in tiers, and more of them once a memory budget is hit.
+class StateHistory
+{
+public:
+	enum { CHUNK_SIZE = 1024 };
+
+	StateHistory();
+	~StateHistory();
+
+	//keeps every frame of the last `capacity` frames, every 2nd of the 2*capacity before those, every 4th of the 4*capacity
+	//before those and so on up to every 16th; older ones are dropped. when more than `budget` bytes are used (0 for no limit),
+	//the tiers shrink until enough is freed
+	void setRetention(int capacity, uint32 budget);
+
+	//stores the current emulation state as the state of `frame`
+	void capture(int frame);
+	//stores a (uncompressed) savestate as the state of `frame`
+	void store(int frame, const uint8* state, int size);
+	//puts the savestate of `frame` back together. returns false if there is none
+	bool get(int frame, std::vector<uint8>& out);
+	//loads the savestate of `frame` into the emulator
+	bool load(int frame);
+
+	bool has(int frame) const;
+	//the last frame up to and including `frame` which has a state, or -1
+	int findAtOrBefore(int frame) const;
+	//drops the states of all frames after `after`
+	void invalidate(int after);
+	void clear();
+
+	uint32 getMemoryUsed() const { return memoryUsed; }
+	int getStateCount() const { return stateCount; }
+
+private:
+	struct Chunk
+	{
+		uint32 hash;
+		int refs;
+		int size;
+		bool compressed;
+		std::vector<uint8> data;
+	};
+
+	//a chunk of the last captured state and where it was in it
+	struct PrevPiece
+	{
+		int pos;
+		int chunk;
+	};
+
+	//not copyable
+	StateHistory(const StateHistory&);
+	StateHistory& operator=(const StateHistory&);
+
+	int addChunk(const uint8* data, int size);
+	bool chunkEquals(int id, const uint8* data, int size);
+	void unpackChunk(int id, uint8* out);
+	void releaseChunk(int id);
+	void releaseState(int frame);
+	void thin(int newest, uint32 target);
+
+	//the chunks of each frame's state; empty when the frame has none
+	std::vector< std::vector<int> > states;
+	int stateCount;
+	std::deque<Chunk> chunks;
+	std::vector<int> freeChunks;
+	//chunk hash -> chunk
+	std::multimap<uint32,int> index;
+
+	//the last captured state, which the next one is mostly the same as
+	std::vector<uint8> prevState;
+	std::map<uint32,PrevPiece> prevPieces;
+
+	std::vector<uint8> captured;
+	int capacity;
+	uint32 budget;
+	uint32 memoryUsed;
+	int capturesSinceThin;
+};
+
+//the history the emulator keeps of the running game, captured after every frame.
+//a capacity of 0 turns it off; the budget is in kilobytes, 0 for no limit
+void FCEUI_SetStateHistory(int capacity, int budgetKB);
+bool FCEUI_StateHistoryEnabled();
+//goes back to the last frame up to and including `frame` which has a state. returns that frame, or -1 if there is none
+int FCEUI_StateHistoryLoad(int frame);
+StateHistory* FCEU_GetStateHistory();
+
+//called once per emulated frame
+void FCEU_StateHistoryFrameAdvance();
+//called when the game is closed
+void FCEU_StateHistoryGameClosed();
+//-------
+
+#endif
@@ -0,0 +1,338 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief binary cpu trace capture and its offline decoder
+
+#include "types.h"
+#include "x6502.h"
+#include "fceu.h"
+#include "debug.h"
+#include "ppu.h"
+#include "asm.h"
+#include "trace.h"
+#include "utils/task.h"
+#include "utils/endian.h"
+#include "zlib.h"
+
+#include <cstdio>
+#include <cstring>
+
+//the file starts with this magic, then the record size as a 32bit lsb value, then the records
+static const char TRACE_MAGIC[4] = {'F','C','T','R'};
+
+//must be a power of two
+#define TRACE_RING_SIZE (1<<16)
+#define TRACE_RING_MASK (TRACE_RING_SIZE-1)
+//how many records the writer serializes per gzwrite
+#define TRACE_WRITE_BATCH 4096
+
+bool FCEU_binaryTracing = false;
+
+//single producer (the emulation thread), single consumer (the writer thread).
+//only the producer advances ringHead and only the consumer advances ringTail.
+static FCEU_TRACE_RECORD *ring = 0;
+static volatile uint32 ringHead = 0;
+static volatile uint32 ringTail = 0;
+static volatile bool writerStop = false;
+
+static gzFile traceFile = 0;
+static Task *writerTask = 0;
+
+static void SerializeRecord(uint8 *buf, const FCEU_TRACE_RECORD &rec)
+{
+	FCEU_en32lsb(buf, (uint32)rec.cycle);
+	FCEU_en32lsb(buf+4, (uint32)(rec.cycle>>32));
+	FCEU_en16lsb(buf+8, rec.pc);
+	buf[10] = rec.opcode[0];
+	buf[11] = rec.opcode[1];
+	buf[12] = rec.opcode[2];
+	buf[13] = rec.a;
+	buf[14] = rec.x;
+	buf[15] = rec.y;
+	buf[16] = rec.s;
+	buf[17] = rec.p;
+	FCEU_en16lsb(buf+18, (uint16)rec.scanline);
+	FCEU_en16lsb(buf+20, (uint16)rec.bank);
+	buf[22] = 0;
+	buf[23] = 0;
+}
+
+static void DeserializeRecord(FCEU_TRACE_RECORD &rec, uint8 *buf)
+{
+	rec.cycle = FCEU_de64lsb(buf);
+	rec.pc = FCEU_de16lsb(buf+8);
+	rec.opcode[0] = buf[10];
+	rec.opcode[1] = buf[11];
+	rec.opcode[2] = buf[12];
+	rec.a = buf[13];
+	rec.x = buf[14];
+	rec.y = buf[15];
+	rec.s = buf[16];
+	rec.p = buf[17];
+	rec.scanline = (int16)FCEU_de16lsb(buf+18);
+	rec.bank = (int16)FCEU_de16lsb(buf+20);
+}
+
+//runs on the writer thread until FCEUI_TraceEnd asks it to stop and the ring is empty
+static void* TraceWriterProc(void *)
+{
+	static uint8 buf[TRACE_WRITE_BATCH*FCEU_TRACE_RECORD_SIZE];
+
+	for(;;)
+	{
+		uint32 head = ringHead;
+		FCEU_MemoryBarrier();
+		uint32 tail = ringTail;
+
+		if(head == tail)
+		{
+			if(writerStop) break;
+			FCEU_ThreadSleep(1);
+			continue;
+		}
+
+		int count = 0;
+		while(tail != head && count < TRACE_WRITE_BATCH)
+		{
+			SerializeRecord(buf + count*FCEU_TRACE_RECORD_SIZE, ring[tail & TRACE_RING_MASK]);
+			tail++;
+			count++;
+		}
+
+		//release the slots before the (slow) compression so the producer can keep going
+		FCEU_MemoryBarrier();
+		ringTail = tail;
+
+		gzwrite(traceFile, buf, count*FCEU_TRACE_RECORD_SIZE);
+	}
+
+	return 0;
+}
+
+bool FCEUI_TraceBegin(const char *fname)
+{
+	FCEUI_TraceEnd();
+
+	traceFile = gzopen(fname, "wb1");
+	if(!traceFile)
+	{
+		FCEU_PrintError("Error opening trace file %s", fname);
+		return false;
+	}
+
+	uint8 header[8];
+	memcpy(header, TRACE_MAGIC, 4);
+	FCEU_en32lsb(header+4, FCEU_TRACE_RECORD_SIZE);
+	gzwrite(traceFile, header, 8);
+
+	if(!ring)
+		ring = new FCEU_TRACE_RECORD[TRACE_RING_SIZE];
+	ringHead = ringTail = 0;
+	writerStop = false;
+
+	writerTask = new Task();
+	writerTask->start(false);
+	writerTask->execute(TraceWriterProc, 0);
+
+	FCEU_binaryTracing = true;
+	FCEU_DispMessage("Binary trace started.",0);
+	return true;
+}
+
+void FCEUI_TraceEnd()
+{
+	if(!writerTask) return;
+
+	FCEU_binaryTracing = false;
+
+	FCEU_MemoryBarrier();
+	writerStop = true;
+	writerTask->finish();
+	writerTask->shutdown();
+	delete writerTask;
+	writerTask = 0;
+
+	gzclose(traceFile);
+	traceFile = 0;
+
+	FCEU_DispMessage("Binary trace stopped.",0);
+}
+
+bool FCEUI_TraceIsActive()
+{
+	return FCEU_binaryTracing;
+}
+
+void FCEU_TraceCapture()
+{
+	uint32 head = ringHead;
+
+	//never drop records: if the writer has fallen a whole ring behind, wait for it
+	while(head - ringTail >= TRACE_RING_SIZE)
+		FCEU_ThreadSleep(0);
+
+	FCEU_TRACE_RECORD &rec = ring[head & TRACE_RING_MASK];
+	rec.cycle = timestampbase + (uint64)timestamp;
+	rec.pc = X.PC;
+
+	fceuindbg = 1;
+	rec.opcode[0] = GetMem(X.PC);
+	int size = opsize[rec.opcode[0]];
+	rec.opcode[1] = size > 1 ? GetMem(X.PC+1) : 0;
+	rec.opcode[2] = size > 2 ? GetMem(X.PC+2) : 0;
+	fceuindbg = 0;
+
+	rec.a = X.A;
+	rec.x = X.X;
+	rec.y = X.Y;
+	rec.s = X.S;
+	rec.p = X.P;
+	rec.scanline = (int16)scanline;
+	rec.bank = X.PC >= 0x8000 ? (int16)getBank(X.PC) : -1;
+
+	//publish the record only once it is completely written
+	FCEU_MemoryBarrier();
+	ringHead = head + 1;
+}
+
+void *FCEUI_TraceOpen(const char *fname)
+{
+	gzFile in = gzopen(fname, "rb");
+	if(!in)
+	{
+		FCEU_PrintError("Error opening trace file %s", fname);
+		return 0;
+	}
+
+	uint8 header[8];
+	if(gzread(in, header, 8) != 8 || memcmp(header, TRACE_MAGIC, 4) || FCEU_de32lsb(header+4) != FCEU_TRACE_RECORD_SIZE)
+	{
+		FCEU_PrintError("%s is not a binary trace file", fname);
+		gzclose(in);
+		return 0;
+	}
+	return in;
+}
+
+bool FCEUI_TraceRead(void *trace, FCEU_TRACE_RECORD &rec)
+{
+	uint8 buf[FCEU_TRACE_RECORD_SIZE];
+	if(gzread((gzFile)trace, buf, FCEU_TRACE_RECORD_SIZE) != FCEU_TRACE_RECORD_SIZE)
+		return false;
+	DeserializeRecord(rec, buf);
+	return true;
+}
+
+void FCEUI_TraceClose(void *trace)
+{
+	gzclose((gzFile)trace);
+}
+
+void FCEUI_TraceFormat(const FCEU_TRACE_RECORD &rec, char *line)
+{
+	//Disassemble looks at X.X and X.Y for indexed operands; point them at the traced values
+	uint8 savedX = X.X, savedY = X.Y;
+	X.X = rec.x;
+	X.Y = rec.y;
+
+	char str_data[16], str_procstatus[16];
+	uint8 opcode[3] = {rec.opcode[0], rec.opcode[1], rec.opcode[2]};
+	char *a;
+	int opbytes = opsize[rec.opcode[0]];
+	switch(opbytes)
+	{
+		case 0:
+			sprintf(str_data, "%02X        ", rec.opcode[0]);
+			a = (char*)"UNDEFINED";
+			break;
+		case 1:
+			sprintf(str_data, "%02X        ", rec.opcode[0]);
+			a = Disassemble(rec.pc + 1, opcode);
+			break;
+		case 2:
+			sprintf(str_data, "%02X %02X     ", rec.opcode[0], rec.opcode[1]);
+			a = Disassemble(rec.pc + 2, opcode);
+			break;
+		default:
+			sprintf(str_data, "%02X %02X %02X  ", rec.opcode[0], rec.opcode[1], rec.opcode[2]);
+			a = Disassemble(rec.pc + 3, opcode);
+			break;
+	}
+
+	X.X = savedX;
+	X.Y = savedY;
+
+	//memory was not captured, so drop the "@ $addr = #$val" annotations rather than print stale values
+	if(opbytes > 0)
+	{
+		char *annotation = strstr(a, " @ ");
+		if(!annotation) annotation = strstr(a, " = ");
+		if(annotation) *annotation = 0;
+	}
+
+	uint8 tmp = rec.p^0xFF;
+	sprintf(str_procstatus,"P:%c%c%c%c%c%c%c%c",
+		'N'|(tmp&0x80)>>2,
+		'V'|(tmp&0x40)>>1,
+		'U'|(tmp&0x20),
+		'B'|(tmp&0x10)<<1,
+		'D'|(tmp&0x08)<<2,
+		'I'|(tmp&0x04)<<3,
+		'Z'|(tmp&0x02)<<4,
+		'C'|(tmp&0x01)<<5
+		);
+
+	if(rec.bank >= 0)
+		sprintf(line, "c%-11llu sl%-4d %02X:%04X:%s%-28s A:%02X X:%02X Y:%02X S:%02X %s",
+			(unsigned long long)rec.cycle, rec.scanline, rec.bank, rec.pc, str_data, a, rec.a, rec.x, rec.y, rec.s, str_procstatus);
+	else
+		sprintf(line, "c%-11llu sl%-4d   $%04X:%s%-28s A:%02X X:%02X Y:%02X S:%02X %s",
+			(unsigned long long)rec.cycle, rec.scanline, rec.pc, str_data, a, rec.a, rec.x, rec.y, rec.s, str_procstatus);
+}
+
+int FCEUI_TraceDecode(const char *infname, const char *outfname)
+{
+	void *in = FCEUI_TraceOpen(infname);
+	if(!in)
+		return -1;
+
+	FILE *out = fopen(outfname, "w");
+	if(!out)
+	{
+		FCEU_PrintError("Error opening %s for writing", outfname);
+		FCEUI_TraceClose(in);
+		return -1;
+	}
+
+	FCEU_TRACE_RECORD rec;
+	char line[FCEU_TRACE_LINE_SIZE];
+	int count = 0;
+	while(FCEUI_TraceRead(in, rec))
+	{
+		FCEUI_TraceFormat(rec, line);
+		fprintf(out, "%s\n", line);
+		count++;
+	}
+
+	fclose(out);
+	FCEUI_TraceClose(in);
+	return count;
+}
@@ -0,0 +1,48 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "types.h"
+
+//binary cpu trace.
+//one fixed-size record is captured per executed instruction into a ring buffer,
+//which a writer thread drains into a gzip compressed file. use FCEUI_TraceDecode to turn it into text.
+
+//set while a binary trace is being captured; checked once per instruction by the cpu core
+extern bool FCEU_binaryTracing;
+
+//size of one serialized record, in bytes
+#define FCEU_TRACE_RECORD_SIZE 24
+
+struct FCEU_TRACE_RECORD
+{
+	uint64 cycle;     //timestampbase+timestamp when the instruction was fetched
+	uint16 pc;
+	uint8 opcode[3];  //only opsize[opcode[0]] bytes are meaningful
+	uint8 a, x, y, s, p;
+	int16 scanline;
+	int16 bank;       //prg bank of pc, or -1
+};
+
+//begins capturing to the given file. returns false if the file could not be opened
+bool FCEUI_TraceBegin(const char *fname);
+//flushes the remaining records and closes the trace file
+void FCEUI_TraceEnd();
+bool FCEUI_TraceIsActive();
+
+//called by the cpu core before each instruction while FCEU_binaryTracing is set
+void FCEU_TraceCapture();
+
+//converts a binary trace into a text log resembling the tracer's output.
+//returns the number of records decoded, or -1 on error
+int FCEUI_TraceDecode(const char *infname, const char *outfname);
+
+//reads a binary trace back one record at a time, for tools comparing two traces.
+//FCEUI_TraceOpen returns 0 if the file can't be opened or isn't a trace
+void *FCEUI_TraceOpen(const char *fname);
+bool FCEUI_TraceRead(void *trace, FCEU_TRACE_RECORD &rec);
+void FCEUI_TraceClose(void *trace);
+//formats one record the way FCEUI_TraceDecode writes it, without the newline, into FCEU_TRACE_LINE_SIZE chars
+#define FCEU_TRACE_LINE_SIZE 128
+void FCEUI_TraceFormat(const FCEU_TRACE_RECORD &rec, char *line);
+
+#endif
@@ -138,6 +138,13 @@ typedef uint8 (*readfunc)(uint32 A);
 #define CTASSERT(x)  typedef char __assert ## y[(x) ? 1 : -1];
 #endif
 
+//the initializer of a table worked out by the compiler: F(0), F(1), ... F(n-1), where F is a macro
+#define FCEU_TABLE4(F,i) F(i), F((i)+1), F((i)+2), F((i)+3)
+#define FCEU_TABLE16(F,i) FCEU_TABLE4(F,i), FCEU_TABLE4(F,(i)+4), FCEU_TABLE4(F,(i)+8), FCEU_TABLE4(F,(i)+12)
+#define FCEU_TABLE64(F,i) FCEU_TABLE16(F,i), FCEU_TABLE16(F,(i)+16), FCEU_TABLE16(F,(i)+32), FCEU_TABLE16(F,(i)+48)
+#define FCEU_TABLE128(F) FCEU_TABLE64(F,0), FCEU_TABLE64(F,64)
+#define FCEU_TABLE256(F) FCEU_TABLE128(F), FCEU_TABLE64(F,128), FCEU_TABLE64(F,192)
+
 #include "utils/endian.h"
 
 #endif
@@ -34,6 +34,7 @@
 #include "file.h"
 #include "input.h"
 #include "driver.h"
+#include "romdb.h"
 
 #include <cstdio>
 #include <cstdlib>
@@ -570,6 +571,67 @@ static void UNIFGI(GI h) {
 	}
 }
 
+//reads the chunks UNIFLoad would and hashes the PRG and CHR the same way, without loading anything
+bool UNIFIdentify(FCEUFILE *fp, RomInfo &info) {
+	UNIF_HEADER h;
+	if (FCEU_fread(&h, 1, 4, fp) != 4 || memcmp(&h, "UNIF", 4))
+		return false;
+	if (FCEU_fseek(fp, 0x20, SEEK_SET) < 0)
+		return false;
+
+	std::vector<uint8> roms[32];
+	info.format = RomInfo::FORMAT_UNIF;
+	info.mapper = info.headerMapper = -1;
+
+	for (;; ) {
+		int t = FCEU_fread(&h, 1, 4, fp);
+		if (t < 4) {
+			if (t > 0)
+				return false;
+			break;
+		}
+		if (!FCEU_read32le(&h.info, fp))
+			return false;
+
+		if (!memcmp(h.ID, "PRG", 3) || !memcmp(h.ID, "CHR", 3)) {
+			int z = h.ID[3] - '0';
+			if (z < 0 || z > 15)
+				return false;
+			if (h.ID[0] == 'C')
+				z += 16;
+			roms[z].assign(FixRomSize(h.info, z < 16 ? 2048 : 8192), 0xFF);
+			if (FCEU_fread(&roms[z][0], 1, h.info, fp) != h.info)
+				return false;
+		} else if (!memcmp(h.ID, "MAPR", 4)) {
+			std::vector<char> name(h.info + 1, 0);
+			FCEU_fread(&name[0], 1, h.info, fp);
+			info.board = &name[0];
+		} else if (!memcmp(h.ID, "MIRR", 4) && h.info == 1) {
+			if ((t = FCEU_fgetc(fp)) == EOF)
+				return false;
+			info.mirroring = t;
+		} else if (!memcmp(h.ID, "BATR", 4)) {
+			if (FCEU_fgetc(fp) == EOF)
+				return false;
+			info.battery = true;
+		} else if (FCEU_fseek(fp, h.info, SEEK_CUR) < 0)
+			return false;
+	}
+
+	struct md5_context md5;
+	md5_starts(&md5);
+	info.crc32 = 0;
+	for (int x = 0; x < 32; x++)
+		if (!roms[x].empty())
+			info.crc32 = FCEU_HashBlock(info.crc32, &md5, &roms[x][0], roms[x].size());
+	md5_finish(&md5, info.md5);
+
+	info.headerMirroring = info.mirroring;
+	info.headerBattery = info.battery;
+	info.headerCHR = !roms[16].empty();
+	return true;
+}
+
 int UNIFLoad(const char *name, FCEUFILE *fp) {
 	FCEU_fseek(fp, 0, SEEK_SET);
 	FCEU_fread(&unhead, 1, 4, fp);
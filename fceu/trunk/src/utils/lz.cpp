@@ -0,0 +1,236 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief a fast lz77 codec in the lz4 block format
+
+#include "lz.h"
+
+#include <cstring>
+
+//each sequence is a token (literal count << 4 | match length - 4), more literal count bytes if it was 15,
+//the literals, a 16bit lsb offset back to the match, and more match length bytes if it was 15.
+//the last sequence is literals alone.
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+//a match may not start in the last LZ_MFLIMIT bytes, nor run into the last LZ_LAST_LITERALS
+#define LZ_MFLIMIT 12
+#define LZ_LAST_LITERALS 5
+//the hash table of positions, by their next 4 bytes
+#define LZ_HASH_LOG 12
+//the longer the run without a match, the further each step skips
+#define LZ_SKIP_SHIFT 6
+
+static inline uint32 LZRead32(const uint8 *p)
+{
+	uint32 v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline uint64 LZRead64(const uint8 *p)
+{
+	uint64 v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline uint32 LZHash(uint32 v)
+{
+	return (v * 2654435761U) >> (32 - LZ_HASH_LOG);
+}
+
+static inline uint8 *LZWriteLength(uint8 *op, uint32 len)
+{
+	if(len < 15)
+		return op;
+	len -= 15;
+	while(len >= 255)
+	{
+		*op++ = 255;
+		len -= 255;
+	}
+	*op++ = (uint8)len;
+	return op;
+}
+
+uint32 FCEU_LZBound(uint32 size)
+{
+	return size + size / 255 + 16;
+}
+
+uint32 FCEU_LZCompress(const uint8 *src, uint32 size, uint8 *dst, uint32 capacity)
+{
+	const uint8 *ip = src;
+	const uint8 *anchor = src;
+	const uint8 *end = src + size;
+	uint8 *op = dst;
+	uint8 *oend = dst + capacity;
+
+	if(size > LZ_MFLIMIT)
+	{
+		uint32 table[1 << LZ_HASH_LOG];
+		memset(table, 0, sizeof(table));
+		const uint8 *mflimit = end - LZ_MFLIMIT;
+		const uint8 *matchlimit = end - LZ_LAST_LITERALS;
+
+		ip++;
+		while(ip <= mflimit)
+		{
+			uint32 seq = LZRead32(ip);
+			uint32 h = LZHash(seq);
+			const uint8 *ref = src + table[h];
+			table[h] = (uint32)(ip - src);
+			if(ip - ref > LZ_MAX_OFFSET || LZRead32(ref) != seq)
+			{
+				ip += 1 + ((ip - anchor) >> LZ_SKIP_SHIFT);
+				continue;
+			}
+
+			while(ip > anchor && ref > src && ip[-1] == ref[-1])
+			{
+				ip--;
+				ref--;
+			}
+
+			const uint8 *p = ip + LZ_MIN_MATCH;
+			const uint8 *r = ref + LZ_MIN_MATCH;
+			while(p + 8 <= matchlimit && LZRead64(p) == LZRead64(r))
+			{
+				p += 8;
+				r += 8;
+			}
+			while(p < matchlimit && *p == *r)
+			{
+				p++;
+				r++;
+			}
+
+			uint32 lit = (uint32)(ip - anchor);
+			uint32 mlen = (uint32)(p - ip) - LZ_MIN_MATCH;
+			if(op + 1 + lit + lit / 255 + 1 + 2 + mlen / 255 + 1 > oend)
+				return 0;
+
+			uint8 *token = op++;
+			*token = (uint8)((lit < 15 ? lit : 15) << 4);
+			op = LZWriteLength(op, lit);
+			memcpy(op, anchor, lit);
+			op += lit;
+
+			uint32 offset = (uint32)(ip - ref);
+			op[0] = (uint8)offset;
+			op[1] = (uint8)(offset >> 8);
+			op += 2;
+			*token |= (uint8)(mlen < 15 ? mlen : 15);
+			op = LZWriteLength(op, mlen);
+
+			ip = anchor = p;
+			//remember a position inside the match, so a repeat of its end is found
+			table[LZHash(LZRead32(ip - 2))] = (uint32)(ip - 2 - src);
+		}
+	}
+
+	uint32 lit = (uint32)(end - anchor);
+	if(op + 1 + lit + lit / 255 + 1 > oend)
+		return 0;
+	*op++ = (uint8)((lit < 15 ? lit : 15) << 4);
+	op = LZWriteLength(op, lit);
+	memcpy(op, anchor, lit);
+	op += lit;
+
+	return (uint32)(op - dst);
+}
+
+bool FCEU_LZDecompress(const uint8 *src, uint32 srclen, uint8 *dst, uint32 size)
+{
+	const uint8 *ip = src;
+	const uint8 *iend = src + srclen;
+	uint8 *op = dst;
+	uint8 *oend = dst + size;
+
+	while(ip < iend)
+	{
+		uint32 token = *ip++;
+
+		uint32 lit = token >> 4;
+		if(lit == 15)
+		{
+			uint32 b;
+			do {
+				if(ip >= iend) return false;
+				b = *ip++;
+				lit += b;
+			} while(b == 255);
+		}
+		if(lit > (uint32)(iend - ip) || lit > (uint32)(oend - op))
+			return false;
+		memcpy(op, ip, lit);
+		op += lit;
+		ip += lit;
+
+		//the last sequence has no match
+		if(ip == iend)
+			break;
+
+		if(iend - ip < 2)
+			return false;
+		uint32 offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if(offset == 0 || offset > (uint32)(op - dst))
+			return false;
+
+		uint32 mlen = token & 15;
+		if(mlen == 15)
+		{
+			uint32 b;
+			do {
+				if(ip >= iend) return false;
+				b = *ip++;
+				mlen += b;
+			} while(b == 255);
+		}
+		mlen += LZ_MIN_MATCH;
+		if(mlen > (uint32)(oend - op))
+			return false;
+
+		const uint8 *match = op - offset;
+		if(offset >= mlen)
+			memcpy(op, match, mlen);
+		else if(offset == 1)
+			memset(op, *match, mlen);
+		else
+		{
+			//overlapping: the match repeats every offset bytes, so what's been copied so far can be copied again after it
+			uint32 done = 0;
+			while(done < mlen)
+			{
+				uint32 n = offset + done;
+				if(n > mlen - done)
+					n = mlen - done;
+				memcpy(op + done, match, n);
+				done += n;
+			}
+		}
+		op += mlen;
+	}
+
+	return op == oend;
+}
@@ -0,0 +1,18 @@
+#ifndef _LZ_H_
+#define _LZ_H_
+
+#include "../types.h"
+
+//a fast lz77 codec for savestates, writing the lz4 block format.
+//it trades ratio for speed: the long runs of repeated bytes in a state go at memory speed.
+
+//the most FCEU_LZCompress can write for size bytes
+uint32 FCEU_LZBound(uint32 size);
+
+//compresses size bytes of src into dst; returns the compressed size, or 0 if it didn't fit in capacity
+uint32 FCEU_LZCompress(const uint8 *src, uint32 size, uint8 *dst, uint32 capacity);
+
+//decompresses srclen bytes into exactly size bytes of dst; false if the data is corrupt or doesn't come to size
+bool FCEU_LZDecompress(const uint8 *src, uint32 srclen, uint8 *dst, uint32 size);
+
+#endif
@@ -0,0 +1,133 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief read-only memory mapped files
+
+#include "mappedfile.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+	: ptr(0)
+	, len(0)
+#ifdef WIN32
+	, hFile(INVALID_HANDLE_VALUE)
+	, hMapping(0)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+#ifdef WIN32
+
+bool MappedFile::open(const char* fname)
+{
+	close();
+
+	hFile = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fsize;
+	if(!GetFileSizeEx(hFile, &fsize) || fsize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(!hMapping)
+	{
+		close();
+		return false;
+	}
+
+	ptr = (const uint8*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	if(!ptr)
+	{
+		close();
+		return false;
+	}
+	len = fsize.QuadPart;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if(ptr) UnmapViewOfFile(ptr);
+	if(hMapping) CloseHandle(hMapping);
+	if(hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+	ptr = 0;
+	len = 0;
+	hMapping = 0;
+	hFile = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::open(const char* fname)
+{
+	close();
+
+	int fd = ::open(fname, O_RDONLY);
+	if(fd == -1)
+		return false;
+
+	struct stat st;
+	if(fstat(fd, &st) == -1 || st.st_size == 0 || (uint64)st.st_size != (uint64)(size_t)st.st_size)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* p = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	//the mapping keeps the file referenced
+	::close(fd);
+	if(p == MAP_FAILED)
+		return false;
+
+	madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+	ptr = (const uint8*)p;
+	len = st.st_size;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if(ptr)
+		munmap((void*)ptr, (size_t)len);
+	ptr = 0;
+	len = 0;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include "../types.h"
+
+///a read-only view of a whole file mapped into memory.
+///the file's pages are only read in by the OS as they are touched, so this is cheap even for huge files.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const char* fname);
+	void close();
+
+	bool isOpen() const { return ptr != 0; }
+	const uint8* data() const { return ptr; }
+	uint64 size() const { return len; }
+
+private:
+	//not copyable
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	const uint8* ptr;
+	uint64 len;
+#ifdef WIN32
+	void* hFile;
+	void* hMapping;
+#endif
+};
+
+#endif
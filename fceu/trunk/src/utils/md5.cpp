@@ -42,6 +42,10 @@ void md5_process( struct md5_context *ctx, uint8 data[64] )
 {
     uint32 A, B, C, D, X[16];
 
+#ifdef LSB_FIRST
+    //the words are already in the right order; one copy instead of 64 byte loads and shifts
+    memcpy( X, data, 64 );
+#else
     GET_UINT32( X[0],  data,  0 );
     GET_UINT32( X[1],  data,  4 );
     GET_UINT32( X[2],  data,  8 );
@@ -58,6 +62,7 @@ void md5_process( struct md5_context *ctx, uint8 data[64] )
     GET_UINT32( X[13], data, 52 );
     GET_UINT32( X[14], data, 56 );
     GET_UINT32( X[15], data, 60 );
+#endif
 
 #define S(x,n) ((x << n) | ((x & 0xFFFFFFFF) >> (32 - n)))
 
@@ -92,7 +97,14 @@ void md5_process( struct md5_context *ctx, uint8 data[64] )
 
 #undef F
 
-#define F(x,y,z) (y ^ (z & (x ^ y)))
+/* (x & z) | (y & ~z), as two additions which don't wait on each other */
+#define G(x,y,z,a) { a += (y & ~z); a += (x & z); }
+
+#undef P
+#define P(a,b,c,d,k,s,t)        \
+{                   \
+    a += X[k] + t; G(b,c,d,a); a = S(a,s) + b;     \
+}
 
     P( A, B, C, D,  1,  5, 0xF61E2562 );
     P( D, A, B, C,  6,  9, 0xC040B340 );
@@ -111,8 +123,13 @@ void md5_process( struct md5_context *ctx, uint8 data[64] )
     P( C, D, A, B,  7, 14, 0x676F02D9 );
     P( B, C, D, A, 12, 20, 0x8D2A4C8A );
 
-#undef F
-    
+#undef G
+#undef P
+#define P(a,b,c,d,k,s,t)        \
+{                   \
+    a += F(b,c,d) + X[k] + t; a = S(a,s) + b;     \
+}
+
 #define F(x,y,z) (x ^ y ^ z)
 
     P( A, B, C, D,  5,  4, 0xFFFA3942 );
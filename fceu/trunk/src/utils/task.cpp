@@ -0,0 +1,361 @@
+/*  Copyright (C) 2009 DeSmuME team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief a minimal portable worker thread used by the core's background jobs
+
+#include "task.h"
+
+#include <stdio.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#endif
+
+#ifdef WIN32
+
+class Task::Impl {
+public:
+	Impl();
+	~Impl();
+
+	bool spinlock;
+
+	void start(bool spinlock);
+	void shutdown();
+
+	//the work function that shall be executed
+	TWork work;
+	void *param;
+
+	HANDLE incomingWork, workDone, hThread;
+	volatile bool bIncomingWork, bWorkDone, bKill;
+	bool bStarted;
+
+	static DWORD __stdcall s_taskProc(void *ptr);
+	void taskProc();
+	void init();
+
+	void* finish();
+	void execute(const TWork &work, void* param);
+
+	void* ret;
+};
+
+DWORD __stdcall Task::Impl::s_taskProc(void *ptr)
+{
+	//just past the buck to the instance method
+	((Task::Impl*)ptr)->taskProc();
+	return 0;
+}
+
+void Task::Impl::taskProc()
+{
+	for(;;) {
+		if(bKill) break;
+
+		//wait for a chunk of work
+		WaitForSingleObject(incomingWork,INFINITE);
+		if(bKill) break;
+		bIncomingWork = false;
+		//execute the work
+		ret = work(param);
+		//signal completion
+		bWorkDone = true;
+		SetEvent(workDone);
+	}
+}
+
+void* Task::Impl::finish()
+{
+	//just wait for the work to be done
+	WaitForSingleObject(workDone,INFINITE);
+	bWorkDone = false;
+	return ret;
+}
+
+Task::Impl::Impl()
+	: work(NULL)
+	, param(NULL)
+	, incomingWork(INVALID_HANDLE_VALUE)
+	, workDone(INVALID_HANDLE_VALUE)
+	, hThread(INVALID_HANDLE_VALUE)
+	, bIncomingWork(false)
+	, bWorkDone(false)
+	, bKill(false)
+	, bStarted(false)
+	, ret(NULL)
+{
+}
+
+Task::Impl::~Impl()
+{
+	shutdown();
+}
+
+void Task::Impl::start(bool spinlock)
+{
+	this->spinlock = spinlock;
+	bIncomingWork = false;
+	bWorkDone = true;
+	bKill = false;
+	bStarted = true;
+	incomingWork = CreateEvent(NULL,FALSE,FALSE,NULL);
+	workDone = CreateEvent(NULL,FALSE,TRUE,NULL);
+	hThread = CreateThread(NULL,0,Task::Impl::s_taskProc,(void*)this, 0, NULL);
+}
+
+void Task::Impl::shutdown()
+{
+	if(!bStarted) return;
+	bStarted = false;
+
+	bKill = true;
+	SetEvent(incomingWork);
+
+	WaitForSingleObject(hThread,INFINITE);
+
+	CloseHandle(incomingWork);
+	CloseHandle(workDone);
+	CloseHandle(hThread);
+}
+
+void Task::Impl::execute(const TWork &work, void* param)
+{
+	//setup the work
+	this->work = work;
+	this->param = param;
+	bWorkDone = false;
+	//signal it to start
+	SetEvent(incomingWork);
+}
+
+#else
+
+class Task::Impl {
+public:
+	Impl();
+	~Impl();
+
+	void start(bool spinlock);
+	void shutdown();
+
+	void* finish();
+	void execute(const TWork &work, void* param);
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t condWork;
+	TWork workFunc;
+	void *workFuncParam;
+	void *ret;
+	bool exitThread;
+	bool started;
+};
+
+static void* taskProc(void *arg)
+{
+	Task::Impl *ctx = (Task::Impl *)arg;
+
+	do {
+		pthread_mutex_lock(&ctx->mutex);
+
+		while (ctx->workFunc == NULL && !ctx->exitThread) {
+			pthread_cond_wait(&ctx->condWork, &ctx->mutex);
+		}
+
+		if (ctx->workFunc != NULL) {
+			ctx->ret = ctx->workFunc(ctx->workFuncParam);
+		} else {
+			ctx->ret = NULL;
+		}
+
+		ctx->workFunc = NULL;
+		pthread_cond_signal(&ctx->condWork);
+
+		pthread_mutex_unlock(&ctx->mutex);
+
+	} while(!ctx->exitThread);
+
+	return NULL;
+}
+
+Task::Impl::Impl()
+	: workFunc(NULL)
+	, workFuncParam(NULL)
+	, ret(NULL)
+	, exitThread(false)
+	, started(false)
+{
+	pthread_mutex_init(&mutex, NULL);
+	pthread_cond_init(&condWork, NULL);
+}
+
+Task::Impl::~Impl()
+{
+	shutdown();
+	pthread_mutex_destroy(&mutex);
+	pthread_cond_destroy(&condWork);
+}
+
+void Task::Impl::start(bool spinlock)
+{
+	pthread_mutex_lock(&mutex);
+
+	if (started) {
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+
+	workFunc = NULL;
+	workFuncParam = NULL;
+	ret = NULL;
+	exitThread = false;
+	started = true;
+
+	pthread_create(&thread, NULL, &taskProc, this);
+
+	pthread_mutex_unlock(&mutex);
+}
+
+void Task::Impl::execute(const TWork &work, void *param)
+{
+	pthread_mutex_lock(&mutex);
+
+	if (work == NULL || !started) {
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+
+	workFunc = work;
+	workFuncParam = param;
+	pthread_cond_signal(&condWork);
+
+	pthread_mutex_unlock(&mutex);
+}
+
+void* Task::Impl::finish()
+{
+	void *returnValue = NULL;
+
+	pthread_mutex_lock(&mutex);
+
+	if (!started) {
+		pthread_mutex_unlock(&mutex);
+		return returnValue;
+	}
+
+	while (workFunc != NULL) {
+		pthread_cond_wait(&condWork, &mutex);
+	}
+
+	returnValue = ret;
+
+	pthread_mutex_unlock(&mutex);
+
+	return returnValue;
+}
+
+void Task::Impl::shutdown()
+{
+	pthread_mutex_lock(&mutex);
+
+	if (!started) {
+		pthread_mutex_unlock(&mutex);
+		return;
+	}
+
+	exitThread = true;
+	workFunc = NULL;
+	pthread_cond_signal(&condWork);
+	pthread_mutex_unlock(&mutex);
+
+	pthread_join(thread, NULL);
+
+	pthread_mutex_lock(&mutex);
+	started = false;
+	pthread_mutex_unlock(&mutex);
+}
+
+#endif
+
+void Task::start(bool spinlock) { impl->start(spinlock); }
+void Task::shutdown() { impl->shutdown(); }
+Task::Task() : impl(new Task::Impl()) {}
+Task::~Task() { delete impl; }
+void Task::execute(const TWork &work, void* param) { impl->execute(work,param); }
+void* Task::finish() { return impl->finish(); }
+
+#ifdef WIN32
+
+class FCEU_Mutex::Impl {
+public:
+	CRITICAL_SECTION cs;
+};
+
+FCEU_Mutex::FCEU_Mutex() : impl(new FCEU_Mutex::Impl()) { InitializeCriticalSection(&impl->cs); }
+FCEU_Mutex::~FCEU_Mutex() { DeleteCriticalSection(&impl->cs); delete impl; }
+void FCEU_Mutex::lock() { EnterCriticalSection(&impl->cs); }
+void FCEU_Mutex::unlock() { LeaveCriticalSection(&impl->cs); }
+
+#else
+
+class FCEU_Mutex::Impl {
+public:
+	pthread_mutex_t mutex;
+};
+
+FCEU_Mutex::FCEU_Mutex() : impl(new FCEU_Mutex::Impl()) { pthread_mutex_init(&impl->mutex, NULL); }
+FCEU_Mutex::~FCEU_Mutex() { pthread_mutex_destroy(&impl->mutex); delete impl; }
+void FCEU_Mutex::lock() { pthread_mutex_lock(&impl->mutex); }
+void FCEU_Mutex::unlock() { pthread_mutex_unlock(&impl->mutex); }
+
+#endif
+
+void FCEU_ThreadSleep(int ms)
+{
+#ifdef WIN32
+	Sleep(ms);
+#else
+	if(ms <= 0)
+	{
+		sched_yield();
+		return;
+	}
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+int FCEU_GetCPUCount()
+{
+#ifdef WIN32
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+#endif
+}
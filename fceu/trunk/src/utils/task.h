@@ -0,0 +1,75 @@
+/*  Copyright (C) 2009 DeSmuME team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TASK_H_
+#define _TASK_H_
+
+///a single worker thread which runs one work item at a time.
+///execute() hands the work to the thread and returns immediately; finish() waits for it and returns its result.
+class Task
+{
+public:
+	Task();
+	~Task();
+
+	typedef void * (*TWork)(void *);
+
+	///starts the worker thread. (spinlock is accepted for compatibility and ignored)
+	void start(bool spinlock);
+
+	///execute some work
+	void execute(const TWork &work, void* param);
+
+	///wait for the work to complete
+	void* finish();
+
+	///stops the worker thread
+	void shutdown();
+
+	class Impl;
+	Impl *impl;
+};
+
+///a lock, for the queues the background jobs share with the emulation thread
+class FCEU_Mutex
+{
+public:
+	FCEU_Mutex();
+	~FCEU_Mutex();
+
+	void lock();
+	void unlock();
+
+	class Impl;
+	Impl *impl;
+};
+
+///sleeps the calling thread for the given number of milliseconds (0 just yields)
+void FCEU_ThreadSleep(int ms);
+
+///returns the number of hardware threads available, at least 1
+int FCEU_GetCPUCount();
+
+//full memory barrier, for handing data between threads without a lock
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define FCEU_MemoryBarrier() _mm_mfence()
+#else
+#define FCEU_MemoryBarrier() __sync_synchronize()
+#endif
+
+#endif
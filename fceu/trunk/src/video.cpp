@@ -32,6 +32,7 @@
 #include "vsuni.h"
 #include "drawing.h"
 #include "driver.h"
+#include "perfstats.h"
 #ifdef _S9XLUA_H
 #include "fceulua.h"
 #endif
@@ -130,9 +131,13 @@ int FCEU_InitVirtualVideo(void)
 		return 1;
 }
 
+bool FCEU_frameHidden = false;
+
 #ifdef FRAMESKIP
 void FCEU_PutImageDummy(void)
 {
+	if(FCEU_frameHidden)
+		return;
 	ShowFPS();
 	if(GameInfo->type!=GIT_NSF)
 	{
@@ -166,6 +171,8 @@ static void ReallySnap(void)
 
 void FCEU_PutImage(void)
 {
+	if(FCEU_frameHidden)
+		return;
 	if(dosnapsave==2)	//Save screenshot as, currently only flagged & run by the Win32 build. //TODO SDL: implement this?
 	{
 		char nameo[512];
@@ -199,7 +206,7 @@ void FCEU_PutImage(void)
 
 #ifdef _S9XLUA_H
 		// Lua gui should draw before the avi is dumped.
-		FCEU_LuaGui(XBuf);
+		FCEU_LuaGui(XBuf, dosnapsave==1 || FCEUI_AviIsRecording());
 #endif
 
 		//Save snapshot
@@ -220,6 +227,7 @@ void FCEU_PutImage(void)
 		FCEU_DrawNTSCControlBars(XBuf);
 		FCEU_DrawRecordingStatus(XBuf);
 		ShowFPS();
+		ShowPerfStats();
 	}
 
 	if(FCEUD_ShouldDrawInputAids())
@@ -777,3 +785,39 @@ void ShowFPS(void)
 	// It's not averaging FPS over exactly 1 second, but it's close enough.
 	boopcount = (boopcount + 1) % booplimit;
 }
+
+bool Show_PerfStats = false;
+// Control whether the share of the last frame's time each subsystem took is rendered (needs a build with PERFSTATS).
+bool FCEUI_ShowPerfStats()
+{
+	return Show_PerfStats;
+}
+void FCEUI_SetShowPerfStats(bool showPerfStats)
+{
+	Show_PerfStats = showPerfStats;
+}
+void FCEUI_ToggleShowPerfStats()
+{
+	Show_PerfStats ^= 1;
+}
+
+void ShowPerfStats(void)
+{
+	FCEUPerfStats stats;
+	if(Show_PerfStats == false || !FCEUI_GetPerfStats(stats))
+		return;
+
+	uint64 frame = 0;
+	for(int i = 0; i < FCEU_PERF_COUNT; i++)
+		frame += stats.frame[i];
+	if(!frame)
+		return;
+
+	// one line per subsystem, under the FPS
+	for(int i = 0; i < FCEU_PERF_COUNT; i++)
+	{
+		char perfmsg[24];
+		sprintf(perfmsg, "%s %d%%", FCEUI_PerfStatName(i), (int)(stats.frame[i] * 100 / frame));
+		DrawTextTrans(XBuf + ((256 - ClipSidesOffset) - 64) + (FSettings.FirstSLine + 14 + i * 9) * 256, 256, (uint8*)perfmsg, 0xA0);
+	}
+}
@@ -36,5 +36,9 @@ bool FCEUI_ShowFPS();
 void FCEUI_SetShowFPS(bool showFPS);
 void FCEUI_ToggleShowFPS();
 void ShowFPS();
+bool FCEUI_ShowPerfStats();
+void FCEUI_SetShowPerfStats(bool showPerfStats);
+void FCEUI_ToggleShowPerfStats();
+void ShowPerfStats();
 void snapAVI();
 #endif
@@ -337,6 +337,21 @@ void FCEU_VSUniCheck(uint64 md5partial, int *MapperNo, uint8 *Mirroring) {
 	}
 }
 
+//just the mapper and mirroring FCEU_VSUniCheck would set, for identifying a game without loading it
+bool FCEU_VSUniLookup(uint64 md5partial, int *MapperNo, uint8 *Mirroring) {
+	VSUNIENTRY *vs = VSUniGames;
+
+	while (vs->name) {
+		if (md5partial == vs->md5partial) {
+			*MapperNo = vs->mapper;
+			*Mirroring = vs->mirroring;
+			return true;
+		}
+		vs++;
+	}
+	return false;
+}
+
 void FCEU_VSUniDraw(uint8 *XBuf) {
 	uint32 *dest;
 	int y, x;
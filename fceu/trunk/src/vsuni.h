@@ -1,5 +1,6 @@
 void FCEU_VSUniPower(void);
 void FCEU_VSUniCheck(uint64 md5partial, int *, uint8 *);
+bool FCEU_VSUniLookup(uint64 md5partial, int *, uint8 *);
 void FCEU_VSUniDraw(uint8 *XBuf);
 
 void FCEU_VSUniToggleDIP(int);  /* For movies and netplay */
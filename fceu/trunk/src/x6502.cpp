@@ -23,6 +23,10 @@
 #include "fceu.h"
 #include "debug.h"
 #include "sound.h"
+#include "trace.h"
+#include "perfstats.h"
+#include "x6502jit.h"
+#include "utils/crc32.h"
 #ifdef _S9XLUA_H
 #include "fceulua.h"
 #endif
@@ -34,6 +38,37 @@ X6502 X;
 uint32 timestamp;
 void (*MapIRQHook)(int a);
 
+//whether the CPU has done anything since the last loop head that a pass of an idle loop can't do (see IdleLoop)
+static bool idleTouched = true;
+
+//hands the APU cycles run through in one go. what's in _tcount is the APU's only after them, so the DMC bits they
+//take in are put where the interpreter would have put them, one instruction at a time
+static void SoundCPUHookBatch(int32 cycles)
+{
+ timestamp-=_tcount;
+ FCEU_SoundCPUHook(cycles);
+ timestamp+=_tcount;
+}
+
+#ifdef FCEU_JIT
+//the recompiler hands the APU the cycles of its instructions in one go for as long as nothing can happen in it (see
+//FCEU_SoundCPUHookIdle), instead of one instruction at a time. what the APU is owed is handed over before anything
+//else may look at it: any read or write but of plain memory, the end of a block, an idle loop
+static int32 jitSound = 0;
+
+static INLINE void JitSoundSync(void)
+{
+ if(jitSound)
+ {
+  int32 cycles=jitSound;
+  jitSound=0;
+  SoundCPUHookBatch(cycles);
+ }
+}
+#else
+#define JitSoundSync()
+#endif
+
 #define ADDCYC(x) \
 {     \
  int __x=x;       \
@@ -45,13 +80,20 @@ void (*MapIRQHook)(int a);
 //normal memory read
 static INLINE uint8 RdMem(unsigned int A)
 {
- return(_DB=ARead[A](A));
+ const FCEU_ReadPage &p = ReadMap[A >> 8];
+ if(p.direct)
+  return(_DB=p.direct[A & 0xFF]);
+ idleTouched = true;
+ JitSoundSync();
+ return(_DB=p.func(A));
 }
 
 //normal memory write
 static INLINE void WrMem(unsigned int A, uint8 V)
 {
-	BWrite[A](A,V);
+	idleTouched = true;
+	JitSoundSync();
+	FCEU_CPUWrite(A,V);
 	#ifdef _S9XLUA_H
 	CallRegisteredLuaMemHook(A, 1, V, LUAMEMHOOK_WRITE);
 	#endif
@@ -60,12 +102,13 @@ static INLINE void WrMem(unsigned int A, uint8 V)
 static INLINE uint8 RdRAM(unsigned int A)
 {
   //bbit edited: this was changed so cheat substituion would work
-  return(_DB=ARead[A](A));
+  return(RdMem(A));
   // return(_DB=RAM[A]);
 }
 
 static INLINE void WrRAM(unsigned int A, uint8 V)
 {
+	idleTouched = true;
 	RAM[A]=V;
 	#ifdef _S9XLUA_H
 	CallRegisteredLuaMemHook(A, 1, V, LUAMEMHOOK_WRITE);
@@ -74,14 +117,16 @@ static INLINE void WrRAM(unsigned int A, uint8 V)
 
 uint8 X6502_DMR(uint32 A)
 {
+ idleTouched = true;
  ADDCYC(1);
- return(X.DB=ARead[A](A));
+ return(X.DB=FCEU_CPURead(A));
 }
 
 void X6502_DMW(uint32 A, uint8 V)
 {
+ idleTouched = true;
  ADDCYC(1);
- BWrite[A](A,V);
+ FCEU_CPUWrite(A,V);
  #ifdef _S9XLUA_H
  CallRegisteredLuaMemHook(A, 1, V, LUAMEMHOOK_WRITE);
  #endif
@@ -96,7 +141,93 @@ void X6502_DMW(uint32 A, uint8 V)
 
 #define POP() RdRAM(0x100+(++_S))
 
-static uint8 ZNTable[256];
+//---------idle loops
+//a game with nothing to do until the next interrupt often waits for it in a loop polling a flag in RAM, or in a JMP
+//to itself. when a pass of a loop comes back to the loop's head with the CPU just as it was the pass before, having
+//read nothing but plain memory and written nothing, every pass after it is going to be the same, until something
+//besides the CPU happens. so at the target of each backward jump, the passes up to then are skipped: up to the end
+//of the cycles X6502_Run was given, or the APU's next frame counter step or DMC fetch, whichever is first. the APU
+//gets the cycles of the skipped passes all at once, which comes to the same as getting them an instruction at a time.
+//boards with a MapIRQHook counting CPU cycles are never skipped, nor is the CPU while anything needs to see every
+//instruction it runs.
+static bool idleSkip = true;
+static struct {
+ uint16 PC;
+ uint8 A, X, Y, P, S, DB;
+ uint32 timestamp;
+ uint64 instructions;
+} idle;
+
+void X6502_ForgetIdleLoop(void)
+{
+ idleTouched = true;
+}
+
+void FCEUI_SetIdleLoopSkip(bool enable)
+{
+ idleSkip = enable;
+ idleTouched = true;
+}
+
+bool FCEUI_GetIdleLoopSkip()
+{
+ return idleSkip;
+}
+
+//whether anything needs to see every instruction the CPU runs, as only the interpreter shows it them
+static bool CPUWatched(void)
+{
+ if(debug_loggingCD || FCEU_binaryTracing)
+  return true;
+ #ifdef FCEUDEF_DEBUGGER
+ if(DebugCycleNeeded())
+  return true;
+ #endif
+ #ifdef _S9XLUA_H
+ if(IsLuaMemHookSet(LUAMEMHOOK_EXEC))
+  return true;
+ #endif
+ return false;
+}
+
+static void IdleLoop(void)
+{
+ if(!idleSkip)
+  return;
+
+ if(!idleTouched && _PC==idle.PC && _A==idle.A && _X==idle.X && _Y==idle.Y && _P==idle.P && _S==idle.S && _DB==idle.DB
+  && !_IRQlow && !_jammed && !MapIRQHook && !CPUWatched())
+ {
+  JitSoundSync();
+  int32 period=timestamp-idle.timestamp;
+  int32 passes=(_count-1)/(period*48);
+  int32 apu=(FCEU_SoundCPUHookIdle()-_tcount)/period;
+  if(apu<passes)
+   passes=apu;
+  if(passes>0)
+  {
+   int32 cycles=passes*period;
+   timestamp+=cycles;
+   _count-=cycles*48;
+   SoundCPUHookBatch(cycles);
+   AddInstructionsCounters((total_instructions-idle.instructions)*passes);
+  }
+ }
+
+ idle.PC=_PC;
+ idle.A=_A;
+ idle.X=_X;
+ idle.Y=_Y;
+ idle.P=_P;
+ idle.S=_S;
+ idle.DB=_DB;
+ idle.timestamp=timestamp;
+ idle.instructions=total_instructions;
+ idleTouched=false;
+}
+
+#define ZN(x) ((x) ? (x) & N_FLAG : Z_FLAG)
+static const uint8 ZNTable[256] = { FCEU_TABLE256(ZN) };
 /* Some of these operations will only make sense if you know what the flag
    constants are. */
 
@@ -116,6 +247,8 @@ static uint8 ZNTable[256];
   _PC+=disp;  \
   if((tmp^_PC)&0x100)  \
   ADDCYC(1);  \
+  if(disp<0)  \
+  IdleLoop();  \
  }  \
  else _PC++;  \
 }
@@ -353,6 +486,80 @@ static uint8 CycTable[256] =
 /*0xF0*/ 2,5,2,8,4,4,6,6,2,4,2,7,4,4,7,7,
 };
 
+//---------recompiler
+static bool recompiling = false;
+
+void X6502_UseRecompiler(bool use)
+{
+ recompiling = use;
+}
+
+static std::vector<X6502Checkpoint> *checkpoints = NULL;
+
+void X6502_LogCheckpoints(std::vector<X6502Checkpoint> *log)
+{
+ checkpoints = log;
+}
+
+#ifdef FCEU_JIT
+static uint8 JitRead(uint32 A)
+{
+ return RdMem(A);
+}
+
+static void JitWrite(uint32 A, uint8 V)
+{
+ WrMem(A,V);
+}
+
+void X6502_GetJitLinks(X6502JitLinks *links)
+{
+ links->idleTouched=&idleTouched;
+ links->sound=&jitSound;
+ links->znTable=ZNTable;
+ links->cycles=CycTable;
+ links->read=JitRead;
+ links->write=JitWrite;
+}
+
+static void LogCheckpoint(void)
+{
+ X6502Checkpoint c;
+ c.instructions=total_instructions;
+ c.timestamp=timestamp;
+ c.ram=CalcCRC32(0,RAM,0x800);
+ c.PC=_PC;
+ c.A=_A;
+ c.X=_X;
+ c.Y=_Y;
+ c.S=_S;
+ c.P=_P;
+ checkpoints->push_back(c);
+}
+
+//whether a block may run: no interrupt may come before its second instruction, and nothing may count its cycles
+//one instruction at a time
+static INLINE bool JitMayRun(void)
+{
+ if(_jammed || MapIRQHook)
+  return false;
+ if(!_IRQlow)
+  return true;
+ return !(_IRQlow&(FCEU_IQRESET|FCEU_IQNMI2|FCEU_IQNMI|FCEU_IQTEMP)) && (_PI&I_FLAG) && (_P&I_FLAG);
+}
+
+//whether anything needs to see the CPU's writes to RAM, which blocks do in place
+static bool JitWritesWatched(void)
+{
+ #ifdef _S9XLUA_H
+ if(IsLuaMemHookSet(LUAMEMHOOK_WRITE))
+  return true;
+ #endif
+ return false;
+}
+#endif
+//-------
+
 void X6502_IRQBegin(int w)
 {
  _IRQlow|=w;
@@ -376,32 +583,15 @@ void TriggerNMI2(void)
 void X6502_Reset(void)
 {
  _IRQlow=FCEU_IQRESET;
+ X6502_ForgetIdleLoop();
 }
 /**
 * Initializes the 6502 CPU
 **/
 void X6502_Init(void)
 {
-	unsigned int i;
-
 	// Initialize the CPU structure
 	memset((void *)&X,0,sizeof(X));
-
-	for(i = 0; i < sizeof(ZNTable); i++)
-	{
-		if(!i)
-		{
-			ZNTable[i] = Z_FLAG;
-		}
-		else if ( i & 0x80 )
-		{
-			ZNTable[i] = N_FLAG;
-		}
-		else
-		{
-			ZNTable[i] = 0;
-		}
-	}
 }
 
 void X6502_Power(void)
@@ -414,6 +604,8 @@ void X6502_Power(void)
 
 void X6502_Run(int32 cycles)
 {
+  FCEU_PERF_SCOPE(FCEU_PERF_CPU);
+
   if(PAL)
    cycles*=15;    // 15*4=60
   else
@@ -421,6 +613,10 @@ void X6502_Run(int32 cycles)
 
   _count+=cycles;
 extern int test; test++;
+#ifdef FCEU_JIT
+  //whatever starts watching the CPU from here on is seen to from the next call on
+  bool jit=recompiling && !CPUWatched() && !JitWritesWatched();
+#endif
   while(_count>0)
   {
    int32 temp;
@@ -430,7 +626,7 @@ extern int test; test++;
    {
     if(_IRQlow&FCEU_IQRESET)
     {
-	 DEBUG( if(debug_loggingCD) LogCDVectors(0xFFFC); )
+	 if(debug_loggingCD) LogCDVectors(0xFFFC);
      _PC=RdMem(0xFFFC);
      _PC|=RdMem(0xFFFD)<<8;
      _jammed=0;
@@ -451,7 +647,7 @@ extern int test; test++;
       PUSH(_PC);
       PUSH((_P&~B_FLAG)|(U_FLAG));
       _P|=I_FLAG;
-	  DEBUG( if(debug_loggingCD) LogCDVectors(0xFFFA) );
+	  if(debug_loggingCD) LogCDVectors(0xFFFA);
       _PC=RdMem(0xFFFA);
       _PC|=RdMem(0xFFFB)<<8;
       _IRQlow&=~FCEU_IQNMI;
@@ -466,7 +662,7 @@ extern int test; test++;
       PUSH(_PC);
       PUSH((_P&~B_FLAG)|(U_FLAG));
       _P|=I_FLAG;
-	  DEBUG( if(debug_loggingCD) LogCDVectors(0xFFFE) );
+	  if(debug_loggingCD) LogCDVectors(0xFFFE);
       _PC=RdMem(0xFFFE);
       _PC|=RdMem(0xFFFF)<<8;
      }
@@ -480,8 +676,53 @@ extern int test; test++;
               //major speed hit.
    }
 
+#ifdef FCEU_JIT
+   if(checkpoints)
+    LogCheckpoint();
+   if(jit && JitMayRun())
+   {
+    //the APU is handed what it's owed first, so the budget runs up to the next time it may do anything
+    JitSoundSync();
+    int32 budget=FCEU_SoundCPUHookIdle()-_tcount;
+    if(budget>(_count-1)/48)
+     budget=(_count-1)/48;
+    //then blocks are run one after another while it lasts: only a handler can raise an interrupt or change what
+    //the APU is up to, and a block which calls one leaves nothing of the budget
+    int ran=0;
+    while(budget>0)
+    {
+     bool back=false;
+     int n=X6502Jit_Run(budget,back);
+     if(!n)
+      break;
+     ran+=n;
+     AddInstructionsCounters(n);
+     if(back)
+     {
+      uint32 before=timestamp;
+      IdleLoop();
+      if(timestamp!=before)
+       break;
+     }
+     if(checkpoints || !JitMayRun())
+      break;
+    }
+    if(ran)
+    {
+     JitSoundSync();
+     continue;
+    }
+   }
+#endif
+
+#ifndef FCEUDEF_DEBUGGER
+   //DebugCycle does this itself, so that the instruction is only decoded once
+   if(debug_loggingCD) LogCDInstruction();
+#endif
+
 	//will probably cause a major speed decrease on low-end systems
    DEBUG( DebugCycle() );
+   if(FCEU_binaryTracing) FCEU_TraceCapture();
 
    IncrementInstructionsCounters();
 
@@ -492,7 +733,11 @@ extern int test; test++;
 
    temp=_tcount;
    _tcount=0;
-   if(MapIRQHook) MapIRQHook(temp);
+   if(MapIRQHook)
+   {
+    FCEU_PERF_SCOPE(FCEU_PERF_MAPPER);
+    MapIRQHook(temp);
+   }
    FCEU_SoundCPUHook(temp);
    #ifdef _S9XLUA_H
    CallRegisteredLuaMemHook(_PC, 1, 0, LUAMEMHOOK_EXEC);
@@ -87,5 +87,12 @@ void X6502_DMW(uint32 A, uint8 V);
 void X6502_IRQBegin(int w);
 void X6502_IRQEnd(int w);
 
+//forgets the idle loop the CPU may be in, for when memory or its mapping may have changed behind the CPU's back
+void X6502_ForgetIdleLoop(void);
+
+//whether X6502_Run runs the game through the recompiler, as far as it can (see x6502jit.h). the recompiler must have
+//been initialized
+void X6502_UseRecompiler(bool use);
+
 #define _X6502H
 #endif
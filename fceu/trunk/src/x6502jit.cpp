@@ -0,0 +1,1638 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * Copyright notice for this file:
+ *  Copyright (C) 2013 FCEUX team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/// \file
+/// \brief the recompiler, translating runs of 6502 code into x86-64 code
+
+#include "types.h"
+#include "x6502.h"
+#include "fceu.h"
+#include "x6502jit.h"
+
+#if defined(FCEU_JIT) && (defined(__x86_64__) || defined(_M_X64))
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include <stddef.h>
+#include <string.h>
+
+//the most instructions in a block, the most host code a block can take, and the most one instruction can add to it
+#define BLOCK_INSNS 64
+#define BLOCK_CODE 32768
+#define INSN_CODE 1024
+
+#define CODE_SIZE (4 << 20)
+#define CACHE_SIZE 16384
+//how many times the code at an address is found written over before it's left to the interpreter, and for how many
+//runs of it before it's tried again
+#define STALE_LIMIT 8
+#define STALE_RUNS 4096
+
+//the host registers. a block keeps X's address in rbx, the budget of cycles it has left in ebp, and A, X, Y and P
+//zero extended in r12d to r15d; S stays in X. the others are free for each instruction, but for a call to a handler
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+#define RA R12
+#define RX R13
+#define RY R14
+#define RP R15
+
+//the stack is kept aligned to 16 bytes for the calls, and the 64 bit windows ABI wants 32 more bytes for the callee
+#ifdef WIN32
+#define ARG0 RCX
+#define ARG1 RDX
+#define STACK_PAD 0x28
+#else
+#define ARG0 RDI
+#define ARG1 RSI
+#define STACK_PAD 0x08
+#endif
+
+//x86 condition codes
+enum { CC_O = 0, CC_C = 2, CC_NC = 3, CC_Z = 4, CC_NZ = 5, CC_S = 8 };
+//the x86 ALU ops, as in the /digit of their 0x81 and 0x83 forms
+enum { ALU_ADD, ALU_OR, ALU_ADC, ALU_SBB, ALU_AND, ALU_SUB, ALU_XOR, ALU_CMP };
+enum { SHL = 4, SHR = 5 };
+
+//what the budget is set to, to leave the block before its next instruction
+#define LEAVE ((int32)0xC0000000)
+
+//the 6502 flags
+#define C_FLAG 0x01
+#define Z_FLAG 0x02
+#define I_FLAG 0x04
+#define D_FLAG 0x08
+#define B_FLAG 0x10
+#define U_FLAG 0x20
+#define V_FLAG 0x40
+#define N_FLAG 0x80
+
+typedef int (*Block)(int32 budget);
+
+//blocks by where they were translated from. a block pushed out of the cache by another one is left behind in the
+//code memory until it fills up, when everything is thrown away
+static struct CacheEntry
+{
+	const uint8 *host;	//the memory the first opcode was read from
+	uint16 pc;
+	uint8 op;			//the first opcode, to tell code in RAM written over without going into the block
+	uint8 stale;		//how many times it's been translated anew
+	uint16 retry;		//once that's STALE_LIMIT, the runs left to the interpreter before it's translated again
+	Block block;		//NULL if the first opcode isn't translated, or it's written over too often to be worth it
+} cache[CACHE_SIZE];
+
+static uint8 *code = 0;
+static uint8 *codeTop;
+
+static X6502JitLinks links;
+
+//what a block keeps besides the 6502's state: the budget it had when its cycles were last counted (see
+//CountCycles), and what it has to keep over a call to a handler
+static struct
+{
+	int32 mark;
+	uint32 addr, value, ptr;
+} jit;
+
+//where everything a block works on is, from X
+static struct
+{
+	int32 tcount, count, pc, a, x, y, s, p, pi, db;
+	int32 timestamp, readMap, writeMap, ram, zn, idleTouched, sound;
+	int32 mark, addr, value, ptr;
+} off;
+
+static bool Offset(int32 &o, const void *p)
+{
+	ptrdiff_t d = (const uint8*)p - (const uint8*)&X;
+	o = (int32)d;
+	return o == d && o < 0x7FFF0000 && o > -0x7FFF0000;
+}
+
+//---------emitting
+//a block is emitted in two parts: the straight path through its instructions, right in the code memory, and the
+//code off it (calls to handlers, ways out), which is put after it when the block is done
+enum { HOT, COLD };
+static struct
+{
+	uint8 *base, *top;
+} seg[2];
+static int cur;
+static uint8 coldCode[BLOCK_CODE];
+
+#define MAX_LABELS 4096
+static struct
+{
+	int seg;
+	int32 pos;
+} labels[MAX_LABELS];
+static int nlabels;
+
+static struct
+{
+	int seg;
+	int32 pos;
+	int label;
+} fixups[MAX_LABELS];
+static int nfixups;
+
+//the bounds of a block's code in RAM, put in once the block is done (see CheckOwnCode)
+#define MAX_PATCHES 1024
+static struct
+{
+	int seg;
+	int32 pos;
+	bool hi;
+} patches[MAX_PATCHES];
+static int npatches;
+
+static INLINE void Emit8(uint8 b)
+{
+	*seg[cur].top++ = b;
+}
+
+static INLINE void Emit16(uint16 v)
+{
+	memcpy(seg[cur].top, &v, 2);
+	seg[cur].top += 2;
+}
+
+static INLINE void Emit32(uint32 v)
+{
+	memcpy(seg[cur].top, &v, 4);
+	seg[cur].top += 4;
+}
+
+static INLINE void Emit64(uint64 v)
+{
+	memcpy(seg[cur].top, &v, 8);
+	seg[cur].top += 8;
+}
+
+static INLINE int32 Pos(void)
+{
+	return (int32)(seg[cur].top - seg[cur].base);
+}
+
+static int NewLabel(void)
+{
+	labels[nlabels].pos = -1;
+	return nlabels++;
+}
+
+static void Bind(int label)
+{
+	labels[label].seg = cur;
+	labels[label].pos = Pos();
+}
+
+static void Rel32(int label)
+{
+	fixups[nfixups].seg = cur;
+	fixups[nfixups].pos = Pos();
+	fixups[nfixups].label = label;
+	nfixups++;
+	Emit32(0);
+}
+
+//code off the straight path. inside code which is already off it, it's put in place, jumped over
+static int BeginCold(void)
+{
+	if(cur == COLD)
+	{
+		int skip = NewLabel();
+		Emit8(0xE9);
+		Rel32(skip);
+		return skip;
+	}
+	cur = COLD;
+	return -1;
+}
+
+static void EndCold(int skip)
+{
+	if(skip < 0)
+		cur = HOT;
+	else
+		Bind(skip);
+}
+
+struct Mem
+{
+	int base, index;
+	int32 disp;
+};
+
+static INLINE Mem M(int base, int32 disp)
+{
+	Mem m = { base, -1, disp };
+	return m;
+}
+
+static INLINE Mem M(int base, int index, int32 disp)
+{
+	Mem m = { base, index, disp };
+	return m;
+}
+
+//an instruction on a register and memory, always with a 32 bit displacement. byteReg for the byte registers, which
+//for 4 to 7 need a REX prefix to be spl to dil
+static void OpM(int op, int w, int reg, const Mem &m, bool byteReg = false, int prefix = 0)
+{
+	if(prefix)
+		Emit8(prefix);
+	uint8 rex = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((m.base & 8) >> 3);
+	if(m.index >= 0)
+		rex |= (m.index & 8) >> 2;
+	if(rex != 0x40 || (byteReg && reg >= 4 && reg < 8))
+		Emit8(rex);
+	if(op > 0xFF)
+		Emit8(op >> 8);
+	Emit8(op & 0xFF);
+	if(m.index >= 0 || (m.base & 7) == RSP)
+	{
+		Emit8(0x84 | ((reg & 7) << 3));
+		Emit8((((m.index >= 0 ? m.index : RSP) & 7) << 3) | (m.base & 7));
+	}
+	else
+		Emit8(0x80 | ((reg & 7) << 3) | (m.base & 7));
+	Emit32(m.disp);
+}
+
+//an instruction on two registers, or a register and an opcode extension. bytes: 1 if rm is a byte register, 2 if
+//reg is
+static void OpR(int op, int w, int reg, int rm, int bytes = 0)
+{
+	uint8 rex = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+	if(rex != 0x40 || ((bytes & 1) && rm >= 4 && rm < 8) || ((bytes & 2) && reg >= 4 && reg < 8))
+		Emit8(rex);
+	if(op > 0xFF)
+		Emit8(op >> 8);
+	Emit8(op & 0xFF);
+	Emit8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void MovRR(int d, int s) { if(d != s) OpR(0x89, 0, s, d); }
+static void MovRM(int r, const Mem &m) { OpM(0x8B, 0, r, m); }
+static void MovMR(const Mem &m, int r) { OpM(0x89, 0, r, m); }
+static void MovRM64(int r, const Mem &m) { OpM(0x8B, 1, r, m); }
+static void MovzxRM8(int r, const Mem &m) { OpM(0x0FB6, 0, r, m); }
+static void MovzxRR8(int d, int s) { OpR(0x0FB6, 0, d, s, 1); }
+static void MovMR8(const Mem &m, int r) { OpM(0x88, 0, r, m, true); }
+static void MovMR16(const Mem &m, int r) { OpM(0x89, 0, r, m, false, 0x66); }
+static void MovMI8(const Mem &m, uint8 v) { OpM(0xC6, 0, 0, m); Emit8(v); }
+static void MovMI16(const Mem &m, uint16 v) { OpM(0xC7, 0, 0, m, false, 0x66); Emit16(v); }
+static void MovMI32(const Mem &m, uint32 v) { OpM(0xC7, 0, 0, m); Emit32(v); }
+static void LeaRM(int r, const Mem &m) { OpM(0x8D, 0, r, m); }
+
+static void MovRI(int r, uint32 v)
+{
+	if(r & 8)
+		Emit8(0x41);
+	Emit8(0xB8 | (r & 7));
+	Emit32(v);
+}
+
+static void MovRI64(int r, uint64 v)
+{
+	Emit8(0x48 | ((r & 8) >> 3));
+	Emit8(0xB8 | (r & 7));
+	Emit64(v);
+}
+
+static void AluRR(int alu, int d, int s) { OpR(alu * 8 + 1, 0, s, d); }
+static void AluRR8(int alu, int d, int s) { OpR(alu * 8, 0, s, d, 3); }
+static void AluRR64(int alu, int d, int s) { OpR(alu * 8 + 1, 1, s, d); }
+static void AluMR(int alu, const Mem &m, int r) { OpM(alu * 8 + 1, 0, r, m); }
+static void AluRM8(int alu, int r, const Mem &m) { OpM(alu * 8 + 2, 0, r, m, true); }
+
+static void AluRI(int alu, int r, int32 v)
+{
+	if(v >= -128 && v <= 127)
+	{
+		OpR(0x83, 0, alu, r);
+		Emit8((uint8)v);
+	}
+	else
+	{
+		OpR(0x81, 0, alu, r);
+		Emit32((uint32)v);
+	}
+}
+
+static void AluMI(int alu, const Mem &m, int32 v)
+{
+	if(v >= -128 && v <= 127)
+	{
+		OpM(0x83, 0, alu, m);
+		Emit8((uint8)v);
+	}
+	else
+	{
+		OpM(0x81, 0, alu, m);
+		Emit32((uint32)v);
+	}
+}
+
+static void Shift(int how, int r, int n) { OpR(0xC1, 0, how, r); Emit8(n); }
+static void IncR(int r) { OpR(0xFF, 0, 0, r); }
+static void DecR(int r) { OpR(0xFF, 0, 1, r); }
+static void DecM(const Mem &m) { OpM(0xFF, 0, 1, m); }
+static void IncM8(const Mem &m) { OpM(0xFE, 0, 0, m); }
+static void DecM8(const Mem &m) { OpM(0xFE, 0, 1, m); }
+static void TestRI(int r, uint32 v) { OpR(0xF7, 0, 0, r); Emit32(v); }
+static void TestRR64(int a, int b) { OpR(0x85, 1, b, a); }
+static void CmpRR64(int a, int b) { OpR(0x39, 1, b, a); }
+static void CmpMR64(const Mem &m, int r) { OpM(0x39, 1, r, m); }
+static void ImulRRI(int d, int s, int32 v) { OpR(0x69, 0, d, s); Emit32((uint32)v); }
+static void BtRI(int r, int bit) { OpR(0x0FBA, 0, 4, r); Emit8(bit); }
+static void Setcc(int cc, int r) { OpR(0x0F90 | cc, 0, 0, r, 1); }
+static void Cmc(void) { Emit8(0xF5); }
+static void CallRax(void) { Emit8(0xFF); Emit8(0xD0); }
+static void Ret(void) { Emit8(0xC3); }
+static void Jmp(int label) { Emit8(0xE9); Rel32(label); }
+static void Jcc(int cc, int label) { Emit8(0x0F); Emit8(0x80 | cc); Rel32(label); }
+
+static void PushR(int r)
+{
+	if(r & 8)
+		Emit8(0x41);
+	Emit8(0x50 | (r & 7));
+}
+
+static void PopR(int r)
+{
+	if(r & 8)
+		Emit8(0x41);
+	Emit8(0x58 | (r & 7));
+}
+
+//mov r64,imm64 with the bounds of the block's own code, put in when the block is done
+static void MovRIBound(int r, bool hi)
+{
+	Emit8(0x48 | ((r & 8) >> 3));
+	Emit8(0xB8 | (r & 7));
+	patches[npatches].seg = cur;
+	patches[npatches].pos = Pos();
+	patches[npatches].hi = hi;
+	npatches++;
+	Emit64(0);
+}
+//-------
+
+//---------translating
+//how far the translation has got, as the interpreter would have it at that point of the instruction
+static struct
+{
+	uint16 pc;			//_PC
+	int db;				//_DB, when it's a constant not stored yet; -1 when it's in X already
+	int insn;			//the number of the instruction in the block
+	bool extra;			//whether the instruction before may have left cycles in _tcount
+	bool ends;			//whether the instruction ends the block
+	bool ram;			//whether the block is code in RAM, which it may write over
+	int exit;			//the way out, with the PC in ecx and what the block returns in eax
+} t;
+
+//the bytes the block was translated from, checked on entry
+static struct
+{
+	const uint8 *host;
+	uint8 v;
+} src[BLOCK_INSNS * 3];
+static int nsrc;
+
+static bool InRAM(const uint8 *host)
+{
+	return RAM && host >= RAM && host < RAM + 0x800;
+}
+
+//the next byte of the instruction
+static uint8 Fetch(bool db = true)
+{
+	const uint8 *host = ReadMap[t.pc >> 8].direct + (t.pc & 0xFF);
+	src[nsrc].host = host;
+	src[nsrc].v = *host;
+	nsrc++;
+	t.pc++;
+	if(db)
+		t.db = *host;
+	return *host;
+}
+
+static uint16 FetchAB(void)
+{
+	uint16 lo = Fetch();
+	return lo | (Fetch() << 8);
+}
+
+static void StoreDB(void)
+{
+	if(t.db >= 0)
+		MovMI8(M(RBX, off.db), (uint8)t.db);
+}
+
+static void FlushDB(void)
+{
+	StoreDB();
+	t.db = -1;
+}
+
+//the cycles taken since they were last counted, the budget used up since then, are added to timestamp, _count and
+//what the APU is owed, as ADDCYC would have. edx is lost
+static void CountCycles(void)
+{
+	MovRM(RDX, M(RBX, off.mark));
+	AluRR(ALU_SUB, RDX, RBP);
+	MovMR(M(RBX, off.mark), RBP);
+	AluMR(ALU_ADD, M(RBX, off.timestamp), RDX);
+	AluMR(ALU_ADD, M(RBX, off.sound), RDX);
+	ImulRRI(RDX, RDX, 48);
+	AluMR(ALU_SUB, M(RBX, off.count), RDX);
+}
+
+//one more cycle for the instruction, the ADDCYC(1) of a page crossed: it's left in _tcount for the APU, as the
+//interpreter does, and taken from the budget without counting it again
+static void ExtraCycle(void)
+{
+	AluMI(ALU_ADD, M(RBX, off.tcount), 1);
+	AluMI(ALU_SUB, M(RBX, off.count), 48);
+	AluMI(ALU_ADD, M(RBX, off.timestamp), 1);
+	DecR(RBP);
+	DecM(M(RBX, off.mark));
+	t.extra = true;
+}
+
+//the block is left before its next instruction
+static void Leave(void)
+{
+	MovRI(RBP, (uint32)LEAVE);
+	MovMR(M(RBX, off.mark), RBP);
+}
+
+//calls RdMem(ecx) into eax, or WrMem(ecx,al), with X as the interpreter would have it. what the handler does may
+//raise an interrupt, so the block is left after the instruction. ecx and eax are kept
+static void CallHandler(bool write)
+{
+	StoreDB();
+	MovMI16(M(RBX, off.pc), t.pc);
+	MovMR8(M(RBX, off.a), RA);
+	MovMR8(M(RBX, off.x), RX);
+	MovMR8(M(RBX, off.y), RY);
+	MovMR8(M(RBX, off.p), RP);
+	CountCycles();
+	MovMR(M(RBX, off.addr), RCX);
+	if(write)
+	{
+		MovMR(M(RBX, off.value), RAX);
+		MovRR(ARG1, RAX);
+	}
+	MovRR(ARG0, RCX);
+	MovRI64(RAX, write ? (uint64)(size_t)links.write : (uint64)(size_t)links.read);
+	CallRax();
+	Leave();
+	MovRM(RCX, M(RBX, off.addr));
+	if(write)
+		MovRM(RAX, M(RBX, off.value));
+}
+
+//a native write to the RAM at rdx. in a block of code in RAM, one into the block's own code leaves the block after
+//the instruction, and the block is found stale when it's entered again
+static void CheckOwnCode(void)
+{
+	if(!t.ram)
+		return;
+	int ok = NewLabel(), hit = NewLabel();
+	MovRIBound(R8, false);
+	CmpRR64(RDX, R8);
+	Jcc(CC_C, ok);
+	MovRIBound(R8, true);
+	CmpRR64(RDX, R8);
+	Jcc(CC_C, hit);
+	Bind(ok);
+
+	int skip = BeginCold();
+	Bind(hit);
+	CountCycles();
+	Leave();
+	Jmp(ok);
+	EndCold(skip);
+}
+
+//RdMem(ecx) into eax: straight from the memory of the page if it has it, else through the handler. ecx is kept
+static void Read(void)
+{
+	int slow = NewLabel(), back = NewLabel();
+	MovRR(RDX, RCX);
+	Shift(SHR, RDX, 8);
+	Shift(SHL, RDX, 5);
+	MovRM64(RDX, M(RBX, RDX, off.readMap + (int32)offsetof(FCEU_ReadPage, direct)));
+	TestRR64(RDX, RDX);
+	Jcc(CC_Z, slow);
+	MovzxRR8(RAX, RCX);
+	MovzxRM8(RAX, M(RDX, RAX, 0));
+	Bind(back);
+	MovMR8(M(RBX, off.db), RAX);
+
+	int skip = BeginCold();
+	Bind(slow);
+	CallHandler(false);
+	Jmp(back);
+	EndCold(skip);
+	t.db = -1;
+}
+
+//RdMem(A) into eax, for an address known beforehand. ecx is lost
+static void ReadAt(uint16 A)
+{
+	int slow = NewLabel(), back = NewLabel();
+	MovRM64(RDX, M(RBX, off.readMap + (A >> 8) * (int32)sizeof(FCEU_ReadPage) + (int32)offsetof(FCEU_ReadPage, direct)));
+	TestRR64(RDX, RDX);
+	Jcc(CC_Z, slow);
+	MovzxRM8(RAX, M(RDX, A & 0xFF));
+	Bind(back);
+	MovMR8(M(RBX, off.db), RAX);
+
+	int skip = BeginCold();
+	Bind(slow);
+	MovRI(RCX, A);
+	CallHandler(false);
+	Jmp(back);
+	EndCold(skip);
+	t.db = -1;
+}
+
+//WrMem(ecx,al): straight to RAM if the page is RAM, else through the handler. ecx and eax are kept
+static void Write(void)
+{
+	FlushDB();
+	int slow = NewLabel(), back = NewLabel();
+	MovMI8(M(RBX, off.idleTouched), 1);
+	MovRR(RDX, RCX);
+	Shift(SHR, RDX, 8);
+	Shift(SHL, RDX, 5);
+	MovRM64(RDX, M(RBX, RDX, off.writeMap + (int32)offsetof(FCEU_WritePage, direct)));
+	TestRR64(RDX, RDX);
+	Jcc(CC_Z, slow);
+	MovzxRR8(R8, RCX);
+	AluRR64(ALU_ADD, RDX, R8);
+	MovMR8(M(RDX, 0), RAX);
+	CheckOwnCode();
+	Bind(back);
+
+	int skip = BeginCold();
+	Bind(slow);
+	CallHandler(true);
+	Jmp(back);
+	EndCold(skip);
+}
+
+//WrRAM(ecx,al), for the zero page and the stack. ecx and eax are kept
+static void WriteRAM(void)
+{
+	MovMI8(M(RBX, off.idleTouched), 1);
+	MovRM64(RDX, M(RBX, off.ram));
+	AluRR64(ALU_ADD, RDX, RCX);
+	MovMR8(M(RDX, 0), RAX);
+	CheckOwnCode();
+}
+
+static void Push(uint8 v)
+{
+	MovzxRM8(RCX, M(RBX, off.s));
+	AluRI(ALU_OR, RCX, 0x100);
+	MovRI(RAX, v);
+	WriteRAM();
+	DecM8(M(RBX, off.s));
+}
+
+static void PushReg(int r, uint8 or_)
+{
+	MovzxRM8(RCX, M(RBX, off.s));
+	AluRI(ALU_OR, RCX, 0x100);
+	MovRR(RAX, r);
+	if(or_)
+		AluRI(ALU_OR, RAX, or_);
+	WriteRAM();
+	DecM8(M(RBX, off.s));
+}
+
+static void Pop(void)
+{
+	IncM8(M(RBX, off.s));
+	MovzxRM8(RCX, M(RBX, off.s));
+	AluRI(ALU_OR, RCX, 0x100);
+	Read();
+}
+
+//ecx from the two bytes read into ptr and eax
+static void PtrToAddr(void)
+{
+	Shift(SHL, RAX, 8);
+	MovzxRM8(RCX, M(RBX, off.ptr));
+	AluRR(ALU_OR, RCX, RAX);
+}
+
+//X_ZN and X_ZNT
+static void SetZN(int r)
+{
+	AluRI(ALU_AND, RP, (uint8)~(Z_FLAG | N_FLAG));
+	AluRM8(ALU_OR, RP, M(RBX, r, off.zn));
+}
+
+static void OrZN(int r)
+{
+	AluRM8(ALU_OR, RP, M(RBX, r, off.zn));
+}
+
+//the way out with the PC known beforehand
+static void ExitTo(uint16 pc, int ret)
+{
+	StoreDB();
+	MovRI(RCX, pc);
+	MovRI(RAX, ret);
+	Jmp(t.exit);
+}
+
+enum { IMM, ZP, ZPX, ZPY, AB, ABX, ABY, IX, IY };
+
+//the indexed ways to an address, up to the page crossing of the reads
+static void IndexedAB(uint16 base, int reg, bool read)
+{
+	if(read)
+	{
+		//GetABIRD
+		FlushDB();
+		int cross = NewLabel(), back = NewLabel();
+		LeaRM(RCX, M(reg, base));
+		MovRR(RDX, RCX);
+		AluRI(ALU_XOR, RDX, base);
+		TestRI(RDX, 0x100);
+		Jcc(CC_NZ, cross);
+		Bind(back);
+
+		int skip = BeginCold();
+		Bind(cross);
+		AluRI(ALU_AND, RCX, 0xFFFF);
+		AluRI(ALU_XOR, RCX, 0x100);
+		Read();
+		AluRI(ALU_XOR, RCX, 0x100);
+		ExtraCycle();
+		Jmp(back);
+		EndCold(skip);
+	}
+	else
+	{
+		//GetABIWR: the read of the address before the carry into the high byte
+		LeaRM(RCX, M(reg, base));
+		AluRI(ALU_AND, RCX, 0xFF);
+		AluRI(ALU_OR, RCX, base & 0xFF00);
+		Read();
+		LeaRM(RCX, M(reg, base));
+		AluRI(ALU_AND, RCX, 0xFFFF);
+	}
+}
+
+//the address of an operand in ecx, reading what the addressing mode reads on the way
+static void Address(int mode, bool read)
+{
+	switch(mode)
+	{
+	case ZP:
+		MovRI(RCX, Fetch());
+		break;
+	case ZPX:
+	case ZPY:
+		LeaRM(RCX, M(mode == ZPX ? RX : RY, Fetch()));
+		AluRI(ALU_AND, RCX, 0xFF);
+		break;
+	case AB:
+		MovRI(RCX, FetchAB());
+		break;
+	case ABX:
+	case ABY:
+	{
+		uint16 base = FetchAB();
+		IndexedAB(base, mode == ABX ? RX : RY, read);
+		break;
+	}
+	case IX:
+		//GetIX
+		LeaRM(RCX, M(RX, Fetch()));
+		AluRI(ALU_AND, RCX, 0xFF);
+		Read();
+		MovMR8(M(RBX, off.ptr), RAX);
+		IncR(RCX);
+		AluRI(ALU_AND, RCX, 0xFF);
+		Read();
+		PtrToAddr();
+		break;
+	case IY:
+	{
+		//GetIYRD and GetIYWR
+		uint8 zp = Fetch();
+		ReadAt(zp);
+		MovMR8(M(RBX, off.ptr), RAX);
+		ReadAt((zp + 1) & 0xFF);
+		PtrToAddr();
+		if(read)
+		{
+			int cross = NewLabel(), back = NewLabel();
+			MovRR(RDX, RCX);
+			AluRR(ALU_ADD, RCX, RY);
+			AluRR(ALU_XOR, RDX, RCX);
+			TestRI(RDX, 0x100);
+			Jcc(CC_NZ, cross);
+			Bind(back);
+
+			int skip = BeginCold();
+			Bind(cross);
+			AluRI(ALU_AND, RCX, 0xFFFF);
+			AluRI(ALU_XOR, RCX, 0x100);
+			Read();
+			AluRI(ALU_XOR, RCX, 0x100);
+			ExtraCycle();
+			Jmp(back);
+			EndCold(skip);
+		}
+		else
+		{
+			MovMR(M(RBX, off.ptr), RCX);
+			MovRR(RDX, RCX);
+			AluRR(ALU_ADD, RDX, RY);
+			AluRI(ALU_AND, RDX, 0xFF);
+			AluRI(ALU_AND, RCX, 0xFF00);
+			AluRR(ALU_OR, RCX, RDX);
+			Read();
+			MovRM(RCX, M(RBX, off.ptr));
+			AluRR(ALU_ADD, RCX, RY);
+			AluRI(ALU_AND, RCX, 0xFFFF);
+		}
+		break;
+	}
+	}
+}
+
+enum { LDA, LDX, LDY, AND, ORA, EOR, ADC, SBC, CMP, CPX, CPY, BIT };
+enum { ASL, LSR, ROL, ROR, INC, DEC };
+
+//LD_*: the operand into eax, then the op on it
+static void Load(int mode, int op)
+{
+	if(mode == IMM)
+		MovRI(RAX, Fetch());
+	else if(mode == ZP)
+		ReadAt(Fetch());
+	else if(mode == AB)
+		ReadAt(FetchAB());
+	else
+	{
+		Address(mode, true);
+		Read();
+	}
+
+	switch(op)
+	{
+	case LDA: MovRR(RA, RAX); SetZN(RA); break;
+	case LDX: MovRR(RX, RAX); SetZN(RX); break;
+	case LDY: MovRR(RY, RAX); SetZN(RY); break;
+	case AND: AluRR(ALU_AND, RA, RAX); SetZN(RA); break;
+	case ORA: AluRR(ALU_OR, RA, RAX); SetZN(RA); break;
+	case EOR: AluRR(ALU_XOR, RA, RAX); SetZN(RA); break;
+	case ADC:
+	case SBC:
+		//the host's add and subtract with carry make the same carry and overflow as the 6502's, but for the carry
+		//being a borrow in the host's subtract
+		BtRI(RP, 0);
+		if(op == ADC)
+			AluRR8(ALU_ADC, RA, RAX);
+		else
+		{
+			Cmc();
+			AluRR8(ALU_SBB, RA, RAX);
+		}
+		Setcc(op == ADC ? CC_C : CC_NC, RDX);
+		Setcc(CC_O, RAX);
+		MovzxRR8(RDX, RDX);
+		MovzxRR8(RAX, RAX);
+		Shift(SHL, RAX, 6);
+		AluRI(ALU_AND, RP, (uint8)~(Z_FLAG | C_FLAG | N_FLAG | V_FLAG));
+		AluRR(ALU_OR, RP, RDX);
+		AluRR(ALU_OR, RP, RAX);
+		OrZN(RA);
+		break;
+	case CMP:
+	case CPX:
+	case CPY:
+		MovRR(RDX, op == CMP ? RA : op == CPX ? RX : RY);
+		AluRR8(ALU_SUB, RDX, RAX);
+		Setcc(CC_NC, RAX);
+		MovzxRR8(RAX, RAX);
+		MovzxRR8(RDX, RDX);
+		AluRI(ALU_AND, RP, (uint8)~(Z_FLAG | N_FLAG | C_FLAG));
+		AluRR(ALU_OR, RP, RAX);
+		OrZN(RDX);
+		break;
+	case BIT:
+		AluRI(ALU_AND, RP, (uint8)~(Z_FLAG | V_FLAG | N_FLAG));
+		MovRR(RDX, RAX);
+		AluRR(ALU_AND, RDX, RA);
+		MovzxRM8(RDX, M(RBX, RDX, off.zn));
+		AluRI(ALU_AND, RDX, Z_FLAG);
+		AluRR(ALU_OR, RP, RDX);
+		AluRI(ALU_AND, RAX, V_FLAG | N_FLAG);
+		AluRR(ALU_OR, RP, RAX);
+		break;
+	}
+}
+
+//ST_*
+static void Store(int mode, int r)
+{
+	Address(mode, false);
+	MovRR(RAX, r);
+	if(mode == ZP || mode == ZPX || mode == ZPY)
+		WriteRAM();
+	else
+		Write();
+}
+
+//the op of a read-modify-write on eax. ecx is kept
+static void Modify(int op)
+{
+	switch(op)
+	{
+	case ASL:
+		AluRI(ALU_AND, RP, (uint8)~C_FLAG);
+		MovRR(RDX, RAX);
+		Shift(SHR, RDX, 7);
+		AluRR(ALU_OR, RP, RDX);
+		AluRR(ALU_ADD, RAX, RAX);
+		AluRI(ALU_AND, RAX, 0xFF);
+		SetZN(RAX);
+		break;
+	case LSR:
+		AluRI(ALU_AND, RP, (uint8)~(C_FLAG | N_FLAG | Z_FLAG));
+		MovRR(RDX, RAX);
+		AluRI(ALU_AND, RDX, C_FLAG);
+		AluRR(ALU_OR, RP, RDX);
+		Shift(SHR, RAX, 1);
+		OrZN(RAX);
+		break;
+	case ROL:
+		MovRR(RDX, RAX);
+		Shift(SHR, RDX, 7);
+		AluRR(ALU_ADD, RAX, RAX);
+		MovRR(R8, RP);
+		AluRI(ALU_AND, R8, C_FLAG);
+		AluRR(ALU_OR, RAX, R8);
+		AluRI(ALU_AND, RAX, 0xFF);
+		AluRI(ALU_AND, RP, (uint8)~(Z_FLAG | N_FLAG | C_FLAG));
+		AluRR(ALU_OR, RP, RDX);
+		OrZN(RAX);
+		break;
+	case ROR:
+		MovRR(RDX, RAX);
+		AluRI(ALU_AND, RDX, 1);
+		Shift(SHR, RAX, 1);
+		MovRR(R8, RP);
+		AluRI(ALU_AND, R8, C_FLAG);
+		Shift(SHL, R8, 7);
+		AluRR(ALU_OR, RAX, R8);
+		AluRI(ALU_AND, RP, (uint8)~(Z_FLAG | N_FLAG | C_FLAG));
+		AluRR(ALU_OR, RP, RDX);
+		OrZN(RAX);
+		break;
+	case INC:
+	case DEC:
+		if(op == INC)
+			IncR(RAX);
+		else
+			DecR(RAX);
+		AluRI(ALU_AND, RAX, 0xFF);
+		SetZN(RAX);
+		break;
+	}
+}
+
+//RMW_*
+static void ReadModifyWrite(int mode, int op)
+{
+	switch(mode)
+	{
+	case -1:
+		MovRR(RAX, RA);
+		Modify(op);
+		MovRR(RA, RAX);
+		break;
+	case ZP:
+	{
+		uint8 A = Fetch();
+		ReadAt(A);
+		MovRI(RCX, A);
+		Modify(op);
+		WriteRAM();
+		break;
+	}
+	case ZPX:
+		Address(ZPX, true);
+		Read();
+		Modify(op);
+		WriteRAM();
+		break;
+	default:
+		Address(mode, false);
+		Read();
+		Write();
+		Modify(op);
+		Write();
+		break;
+	}
+}
+
+//JR: a branch not taken goes on with the block, one taken leaves it
+static void Branch(uint8 flag, bool set)
+{
+	int8 disp = (int8)Fetch(false);
+	uint16 next = t.pc;
+	uint16 target = next + disp;
+	int extra = 1 + (((next ^ target) & 0x100) ? 1 : 0);
+	int taken = NewLabel();
+	TestRI(RP, flag);
+	Jcc(set ? CC_NZ : CC_Z, taken);
+
+	int skip = BeginCold();
+	Bind(taken);
+	AluMI(ALU_ADD, M(RBX, off.tcount), extra);
+	AluMI(ALU_SUB, M(RBX, off.count), extra * 48);
+	AluMI(ALU_ADD, M(RBX, off.timestamp), extra);
+	MovMI8(M(RBX, off.db), (uint8)disp);
+	MovRI(RCX, target);
+	MovRI(RAX, (t.insn + 1) * 2 + (disp < 0 ? 1 : 0));
+	Jmp(t.exit);
+	EndCold(skip);
+}
+
+//what the interpreter does at the top of its loop for an instruction: the cycles are taken from the budget, the
+//block left if they aren't there, and the APU handed what's been left in _tcount
+static void BeginInsn(uint8 op)
+{
+	int stub = NewLabel();
+	AluRI(ALU_SUB, RBP, links.cycles[op]);
+	Jcc(CC_S, stub);
+	MovMR8(M(RBX, off.pi), RP);
+	if(t.insn == 0 || t.extra)
+	{
+		MovRM(RAX, M(RBX, off.tcount));
+		AluMR(ALU_ADD, M(RBX, off.sound), RAX);
+		MovMI32(M(RBX, off.tcount), 0);
+	}
+	t.extra = false;
+
+	int skip = BeginCold();
+	Bind(stub);
+	AluRI(ALU_ADD, RBP, links.cycles[op]);
+	ExitTo(t.pc, t.insn * 2);
+	EndCold(skip);
+
+	Fetch();
+}
+
+//the instruction at t.pc, as ops.inc does it. false for an opcode which isn't translated
+static bool Insn(uint8 op)
+{
+	BeginInsn(op);
+	switch(op)
+	{
+	case 0x40: //RTI
+		Pop();
+		MovRR(RP, RAX);
+		MovMR8(M(RBX, off.pi), RP);
+		Pop();
+		MovMR8(M(RBX, off.ptr), RAX);
+		Pop();
+		PtrToAddr();
+		MovRI(RAX, (t.insn + 1) * 2);
+		Jmp(t.exit);
+		t.ends = true;
+		break;
+	case 0x60: //RTS
+		Pop();
+		MovMR8(M(RBX, off.ptr), RAX);
+		Pop();
+		PtrToAddr();
+		IncR(RCX);
+		AluRI(ALU_AND, RCX, 0xFFFF);
+		MovRI(RAX, (t.insn + 1) * 2);
+		Jmp(t.exit);
+		t.ends = true;
+		break;
+	case 0x48: PushReg(RA, 0); break; //PHA
+	case 0x08: PushReg(RP, U_FLAG | B_FLAG); break; //PHP
+	case 0x68: Pop(); MovRR(RA, RAX); SetZN(RA); break; //PLA
+	case 0x28: //PLP, which may let an interrupt in
+		Pop();
+		MovRR(RP, RAX);
+		ExitTo(t.pc, (t.insn + 1) * 2);
+		t.ends = true;
+		break;
+	case 0x4C: //JMP absolute
+	{
+		uint16 ptmp = t.pc + 1;
+		uint16 npc = FetchAB();
+		ExitTo(npc, (t.insn + 1) * 2 + (npc < ptmp ? 1 : 0));
+		t.ends = true;
+		break;
+	}
+	case 0x6C: //JMP indirect
+	{
+		uint16 tmp = FetchAB();
+		ReadAt(tmp);
+		MovMR8(M(RBX, off.ptr), RAX);
+		ReadAt(((tmp + 1) & 0x00FF) | (tmp & 0xFF00));
+		PtrToAddr();
+		MovRI(RAX, (t.insn + 1) * 2);
+		Jmp(t.exit);
+		t.ends = true;
+		break;
+	}
+	case 0x20: //JSR
+	{
+		uint16 npc = Fetch();
+		Push(t.pc >> 8);
+		Push(t.pc & 0xFF);
+		npc |= Fetch() << 8;
+		ExitTo(npc, (t.insn + 1) * 2);
+		t.ends = true;
+		break;
+	}
+
+	case 0xAA: MovRR(RX, RA); SetZN(RA); break; //TAX
+	case 0x8A: MovRR(RA, RX); SetZN(RA); break; //TXA
+	case 0xA8: MovRR(RY, RA); SetZN(RA); break; //TAY
+	case 0x98: MovRR(RA, RY); SetZN(RA); break; //TYA
+	case 0xBA: MovzxRM8(RX, M(RBX, off.s)); SetZN(RX); break; //TSX
+	case 0x9A: MovMR8(M(RBX, off.s), RX); break; //TXS
+
+	case 0xCA: DecR(RX); AluRI(ALU_AND, RX, 0xFF); SetZN(RX); break; //DEX
+	case 0x88: DecR(RY); AluRI(ALU_AND, RY, 0xFF); SetZN(RY); break; //DEY
+	case 0xE8: IncR(RX); AluRI(ALU_AND, RX, 0xFF); SetZN(RX); break; //INX
+	case 0xC8: IncR(RY); AluRI(ALU_AND, RY, 0xFF); SetZN(RY); break; //INY
+
+	case 0x18: AluRI(ALU_AND, RP, (uint8)~C_FLAG); break; //CLC
+	case 0xD8: AluRI(ALU_AND, RP, (uint8)~D_FLAG); break; //CLD
+	case 0x58: //CLI, which may let an interrupt in
+		AluRI(ALU_AND, RP, (uint8)~I_FLAG);
+		ExitTo(t.pc, (t.insn + 1) * 2);
+		t.ends = true;
+		break;
+	case 0xB8: AluRI(ALU_AND, RP, (uint8)~V_FLAG); break; //CLV
+	case 0x38: AluRI(ALU_OR, RP, C_FLAG); break; //SEC
+	case 0xF8: AluRI(ALU_OR, RP, D_FLAG); break; //SED
+	case 0x78: AluRI(ALU_OR, RP, I_FLAG); break; //SEI
+	case 0xEA: break; //NOP
+
+	case 0x0A: ReadModifyWrite(-1, ASL); break;
+	case 0x06: ReadModifyWrite(ZP, ASL); break;
+	case 0x16: ReadModifyWrite(ZPX, ASL); break;
+	case 0x0E: ReadModifyWrite(AB, ASL); break;
+	case 0x1E: ReadModifyWrite(ABX, ASL); break;
+
+	case 0xC6: ReadModifyWrite(ZP, DEC); break;
+	case 0xD6: ReadModifyWrite(ZPX, DEC); break;
+	case 0xCE: ReadModifyWrite(AB, DEC); break;
+	case 0xDE: ReadModifyWrite(ABX, DEC); break;
+
+	case 0xE6: ReadModifyWrite(ZP, INC); break;
+	case 0xF6: ReadModifyWrite(ZPX, INC); break;
+	case 0xEE: ReadModifyWrite(AB, INC); break;
+	case 0xFE: ReadModifyWrite(ABX, INC); break;
+
+	case 0x4A: ReadModifyWrite(-1, LSR); break;
+	case 0x46: ReadModifyWrite(ZP, LSR); break;
+	case 0x56: ReadModifyWrite(ZPX, LSR); break;
+	case 0x4E: ReadModifyWrite(AB, LSR); break;
+	case 0x5E: ReadModifyWrite(ABX, LSR); break;
+
+	case 0x2A: ReadModifyWrite(-1, ROL); break;
+	case 0x26: ReadModifyWrite(ZP, ROL); break;
+	case 0x36: ReadModifyWrite(ZPX, ROL); break;
+	case 0x2E: ReadModifyWrite(AB, ROL); break;
+	case 0x3E: ReadModifyWrite(ABX, ROL); break;
+
+	case 0x6A: ReadModifyWrite(-1, ROR); break;
+	case 0x66: ReadModifyWrite(ZP, ROR); break;
+	case 0x76: ReadModifyWrite(ZPX, ROR); break;
+	case 0x6E: ReadModifyWrite(AB, ROR); break;
+	case 0x7E: ReadModifyWrite(ABX, ROR); break;
+
+	case 0x69: Load(IMM, ADC); break;
+	case 0x65: Load(ZP, ADC); break;
+	case 0x75: Load(ZPX, ADC); break;
+	case 0x6D: Load(AB, ADC); break;
+	case 0x7D: Load(ABX, ADC); break;
+	case 0x79: Load(ABY, ADC); break;
+	case 0x61: Load(IX, ADC); break;
+	case 0x71: Load(IY, ADC); break;
+
+	case 0x29: Load(IMM, AND); break;
+	case 0x25: Load(ZP, AND); break;
+	case 0x35: Load(ZPX, AND); break;
+	case 0x2D: Load(AB, AND); break;
+	case 0x3D: Load(ABX, AND); break;
+	case 0x39: Load(ABY, AND); break;
+	case 0x21: Load(IX, AND); break;
+	case 0x31: Load(IY, AND); break;
+
+	case 0x24: Load(ZP, BIT); break;
+	case 0x2C: Load(AB, BIT); break;
+
+	case 0xC9: Load(IMM, CMP); break;
+	case 0xC5: Load(ZP, CMP); break;
+	case 0xD5: Load(ZPX, CMP); break;
+	case 0xCD: Load(AB, CMP); break;
+	case 0xDD: Load(ABX, CMP); break;
+	case 0xD9: Load(ABY, CMP); break;
+	case 0xC1: Load(IX, CMP); break;
+	case 0xD1: Load(IY, CMP); break;
+
+	case 0xE0: Load(IMM, CPX); break;
+	case 0xE4: Load(ZP, CPX); break;
+	case 0xEC: Load(AB, CPX); break;
+
+	case 0xC0: Load(IMM, CPY); break;
+	case 0xC4: Load(ZP, CPY); break;
+	case 0xCC: Load(AB, CPY); break;
+
+	case 0x49: Load(IMM, EOR); break;
+	case 0x45: Load(ZP, EOR); break;
+	case 0x55: Load(ZPX, EOR); break;
+	case 0x4D: Load(AB, EOR); break;
+	case 0x5D: Load(ABX, EOR); break;
+	case 0x59: Load(ABY, EOR); break;
+	case 0x41: Load(IX, EOR); break;
+	case 0x51: Load(IY, EOR); break;
+
+	case 0xA9: Load(IMM, LDA); break;
+	case 0xA5: Load(ZP, LDA); break;
+	case 0xB5: Load(ZPX, LDA); break;
+	case 0xAD: Load(AB, LDA); break;
+	case 0xBD: Load(ABX, LDA); break;
+	case 0xB9: Load(ABY, LDA); break;
+	case 0xA1: Load(IX, LDA); break;
+	case 0xB1: Load(IY, LDA); break;
+
+	case 0xA2: Load(IMM, LDX); break;
+	case 0xA6: Load(ZP, LDX); break;
+	case 0xB6: Load(ZPY, LDX); break;
+	case 0xAE: Load(AB, LDX); break;
+	case 0xBE: Load(ABY, LDX); break;
+
+	case 0xA0: Load(IMM, LDY); break;
+	case 0xA4: Load(ZP, LDY); break;
+	case 0xB4: Load(ZPX, LDY); break;
+	case 0xAC: Load(AB, LDY); break;
+	case 0xBC: Load(ABX, LDY); break;
+
+	case 0x09: Load(IMM, ORA); break;
+	case 0x05: Load(ZP, ORA); break;
+	case 0x15: Load(ZPX, ORA); break;
+	case 0x0D: Load(AB, ORA); break;
+	case 0x1D: Load(ABX, ORA); break;
+	case 0x19: Load(ABY, ORA); break;
+	case 0x01: Load(IX, ORA); break;
+	case 0x11: Load(IY, ORA); break;
+
+	case 0xE9: Load(IMM, SBC); break;
+	case 0xE5: Load(ZP, SBC); break;
+	case 0xF5: Load(ZPX, SBC); break;
+	case 0xED: Load(AB, SBC); break;
+	case 0xFD: Load(ABX, SBC); break;
+	case 0xF9: Load(ABY, SBC); break;
+	case 0xE1: Load(IX, SBC); break;
+	case 0xF1: Load(IY, SBC); break;
+
+	case 0x85: Store(ZP, RA); break;
+	case 0x95: Store(ZPX, RA); break;
+	case 0x8D: Store(AB, RA); break;
+	case 0x9D: Store(ABX, RA); break;
+	case 0x99: Store(ABY, RA); break;
+	case 0x81: Store(IX, RA); break;
+	case 0x91: Store(IY, RA); break;
+
+	case 0x86: Store(ZP, RX); break;
+	case 0x96: Store(ZPY, RX); break;
+	case 0x8E: Store(AB, RX); break;
+
+	case 0x84: Store(ZP, RY); break;
+	case 0x94: Store(ZPX, RY); break;
+	case 0x8C: Store(AB, RY); break;
+
+	case 0x90: Branch(C_FLAG, false); break; //BCC
+	case 0xB0: Branch(C_FLAG, true); break; //BCS
+	case 0xF0: Branch(Z_FLAG, true); break; //BEQ
+	case 0xD0: Branch(Z_FLAG, false); break; //BNE
+	case 0x30: Branch(N_FLAG, true); break; //BMI
+	case 0x10: Branch(N_FLAG, false); break; //BPL
+	case 0x50: Branch(V_FLAG, false); break; //BVC
+	case 0x70: Branch(V_FLAG, true); break; //BVS
+
+	//BRK, and the undocumented instructions
+	default:
+		return false;
+	}
+	return true;
+}
+
+//the code memory is only ever writable or executable, not both
+static void Protect(bool writable)
+{
+#ifdef WIN32
+	DWORD old;
+	VirtualProtect(code, CODE_SIZE, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old);
+	if(!writable)
+		FlushInstructionCache(GetCurrentProcess(), code, CODE_SIZE);
+#else
+	mprotect(code, CODE_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC);
+#endif
+}
+
+static void Flush(void)
+{
+	memset(cache, 0, sizeof(cache));
+	codeTop = code;
+}
+
+//the block's way in: it checks that the memory it was translated from is still mapped in and unchanged, and
+//returns -1 if it isn't
+static void EmitEntry(int body, int stale)
+{
+	PushR(RBX);
+	PushR(RBP);
+	PushR(R12);
+	PushR(R13);
+	PushR(R14);
+	PushR(R15);
+	OpR(0x83, 1, ALU_SUB, RSP);
+	Emit8(STACK_PAD);
+	MovRI64(RBX, (uint64)(size_t)&X);
+	MovRR(RBP, ARG0);
+
+	//the pages after the first one, which the cache found the block by
+	int lastPage = -1;
+	uint16 pc = X.PC;
+	for(int i = 0; i < nsrc; i++, pc++)
+	{
+		int page = pc >> 8;
+		if(page == (X.PC >> 8) || page == lastPage)
+			continue;
+		lastPage = page;
+		MovRM64(RAX, M(RBX, off.readMap + page * (int32)sizeof(FCEU_ReadPage) + (int32)offsetof(FCEU_ReadPage, direct)));
+		MovRI64(RDX, (uint64)(size_t)ReadMap[page].direct);
+		CmpRR64(RAX, RDX);
+		Jcc(CC_NZ, stale);
+	}
+
+	//the bytes, in runs of memory one after the other
+	for(int i = 0; i < nsrc; )
+	{
+		int n = 1;
+		while(i + n < nsrc && src[i + n].host == src[i].host + n)
+			n++;
+		uint8 bytes[BLOCK_INSNS * 3];
+		for(int k = 0; k < n; k++)
+			bytes[k] = src[i + k].v;
+		MovRI64(RDX, (uint64)(size_t)src[i].host);
+		int o = 0;
+		while(o < n)
+		{
+			int left = n - o;
+			if(left >= 8 || n >= 8)
+			{
+				if(left < 8)
+					o = n - 8;
+				uint64 v;
+				memcpy(&v, bytes + o, 8);
+				MovRI64(RAX, v);
+				CmpMR64(M(RDX, o), RAX);
+				o += 8;
+			}
+			else if(left >= 4)
+			{
+				uint32 v;
+				memcpy(&v, bytes + o, 4);
+				OpM(0x81, 0, ALU_CMP, M(RDX, o));
+				Emit32(v);
+				o += 4;
+			}
+			else if(left >= 2)
+			{
+				uint16 v;
+				memcpy(&v, bytes + o, 2);
+				OpM(0x81, 0, ALU_CMP, M(RDX, o), false, 0x66);
+				Emit16(v);
+				o += 2;
+			}
+			else
+			{
+				OpM(0x80, 0, ALU_CMP, M(RDX, o));
+				Emit8(bytes[o]);
+				o++;
+			}
+			Jcc(CC_NZ, stale);
+		}
+		i += n;
+	}
+
+	MovMR(M(RBX, off.mark), RBP);
+	MovzxRM8(RA, M(RBX, off.a));
+	MovzxRM8(RX, M(RBX, off.x));
+	MovzxRM8(RY, M(RBX, off.y));
+	MovzxRM8(RP, M(RBX, off.p));
+	Jmp(body);
+}
+
+//the block at the PC, which is in memory read straight from. NULL if its first opcode isn't translated
+static Block Translate(void)
+{
+	if(codeTop + BLOCK_CODE > code + CODE_SIZE)
+		Flush();
+	Protect(true);
+
+	seg[HOT].base = seg[HOT].top = codeTop;
+	seg[COLD].base = seg[COLD].top = coldCode;
+	cur = HOT;
+	nlabels = nfixups = npatches = nsrc = 0;
+
+	int body = NewLabel();
+	Bind(body);
+	t.pc = X.PC;
+	t.db = -1;
+	t.extra = false;
+	t.ends = false;
+	t.exit = NewLabel();
+	t.ram = InRAM(ReadMap[X.PC >> 8].direct + (X.PC & 0xFF));
+
+	int n;
+	for(n = 0; n < BLOCK_INSNS && !t.ends; n++)
+	{
+		//room for the instruction's code
+		if(Pos() + (seg[COLD].top - seg[COLD].base) + INSN_CODE > BLOCK_CODE
+			|| nlabels > MAX_LABELS - 64 || nfixups > MAX_LABELS - 64 || npatches > MAX_PATCHES - 16)
+			break;
+
+		//all of the instruction in memory read straight from, and all of the block in RAM or none of it
+		const uint8 *d = ReadMap[t.pc >> 8].direct;
+		if(!d)
+			break;
+		uint8 op = d[t.pc & 0xFF];
+		bool ok = opsize[op] != 0;
+		for(int i = 0; ok && i < opsize[op]; i++)
+		{
+			uint16 A = t.pc + i;
+			const uint8 *p = ReadMap[A >> 8].direct;
+			ok = p && InRAM(p + (A & 0xFF)) == t.ram;
+		}
+		//a JSR reads its high byte after pushing, which may write over it
+		if(!ok || (op == 0x20 && t.ram))
+			break;
+
+		//an opcode which isn't translated is taken back
+		uint8 *hotTop = seg[HOT].top, *coldTop = seg[COLD].top;
+		int labels0 = nlabels, fixups0 = nfixups, patches0 = npatches, src0 = nsrc;
+		uint16 pc = t.pc;
+		int db = t.db;
+		bool extra = t.extra;
+		t.insn = n;
+		if(!Insn(op))
+		{
+			seg[HOT].top = hotTop;
+			seg[COLD].top = coldTop;
+			cur = HOT;
+			nlabels = labels0;
+			nfixups = fixups0;
+			npatches = patches0;
+			nsrc = src0;
+			t.pc = pc;
+			t.db = db;
+			t.extra = extra;
+			break;
+		}
+	}
+	if(!n)
+	{
+		Protect(false);
+		return NULL;
+	}
+	if(!t.ends)
+		ExitTo(t.pc, n * 2);
+
+	//the way out, and in
+	cur = COLD;
+	int epilogue = NewLabel(), stale = NewLabel();
+	Bind(t.exit);
+	MovMR16(M(RBX, off.pc), RCX);
+	MovMR8(M(RBX, off.a), RA);
+	MovMR8(M(RBX, off.x), RX);
+	MovMR8(M(RBX, off.y), RY);
+	MovMR8(M(RBX, off.p), RP);
+	CountCycles();
+	Bind(epilogue);
+	OpR(0x83, 1, ALU_ADD, RSP);
+	Emit8(STACK_PAD);
+	PopR(R15);
+	PopR(R14);
+	PopR(R13);
+	PopR(R12);
+	PopR(RBP);
+	PopR(RBX);
+	Ret();
+	Bind(stale);
+	MovRI(RAX, 0xFFFFFFFF);
+	Jmp(epilogue);
+	int32 entry = Pos();
+	EmitEntry(body, stale);
+
+	//the code off the straight path goes after it, and the jumps and bounds are put in
+	int32 hotSize = (int32)(seg[HOT].top - seg[HOT].base);
+	int32 coldSize = (int32)(seg[COLD].top - seg[COLD].base);
+	memcpy(codeTop + hotSize, coldCode, coldSize);
+	for(int i = 0; i < nfixups; i++)
+	{
+		int32 at = fixups[i].pos + (fixups[i].seg == COLD ? hotSize : 0);
+		int32 to = labels[fixups[i].label].pos + (labels[fixups[i].label].seg == COLD ? hotSize : 0);
+		int32 rel = to - (at + 4);
+		memcpy(codeTop + at, &rel, 4);
+	}
+	if(npatches)
+	{
+		const uint8 *lo = src[0].host, *hi = src[0].host + 1;
+		for(int i = 1; i < nsrc; i++)
+		{
+			if(src[i].host < lo)
+				lo = src[i].host;
+			if(src[i].host + 1 > hi)
+				hi = src[i].host + 1;
+		}
+		for(int i = 0; i < npatches; i++)
+		{
+			uint64 v = (uint64)(size_t)(patches[i].hi ? hi : lo);
+			memcpy(codeTop + patches[i].pos + (patches[i].seg == COLD ? hotSize : 0), &v, 8);
+		}
+	}
+
+	Block block = (Block)(void*)(codeTop + hotSize + entry);
+	codeTop += (hotSize + coldSize + 15) & ~15;
+	Protect(false);
+	return block;
+}
+
+bool X6502Jit_Init(void)
+{
+	if(code)
+		return true;
+	if(sizeof(FCEU_ReadPage) != 32 || sizeof(FCEU_WritePage) != 32)
+		return false;
+
+	X6502_GetJitLinks(&links);
+	bool ok = Offset(off.tcount, &X.tcount) && Offset(off.count, &X.count) && Offset(off.pc, &X.PC)
+		&& Offset(off.a, &X.A) && Offset(off.x, &X.X) && Offset(off.y, &X.Y) && Offset(off.s, &X.S)
+		&& Offset(off.p, &X.P) && Offset(off.pi, &X.mooPI) && Offset(off.db, &X.DB)
+		&& Offset(off.timestamp, &timestamp) && Offset(off.readMap, ReadMap) && Offset(off.writeMap, WriteMap)
+		&& Offset(off.ram, &RAM) && Offset(off.zn, links.znTable) && Offset(off.idleTouched, links.idleTouched)
+		&& Offset(off.sound, links.sound) && Offset(off.mark, &jit.mark) && Offset(off.addr, &jit.addr)
+		&& Offset(off.value, &jit.value) && Offset(off.ptr, &jit.ptr);
+	//what the block reaches from X has to be within 2GB of it
+	if(!ok)
+		return false;
+
+#ifdef WIN32
+	code = (uint8*)VirtualAlloc(0, CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	void *p = mmap(0, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	code = p == MAP_FAILED ? 0 : (uint8*)p;
+#endif
+	if(!code)
+		return false;
+	Protect(false);
+	Flush();
+	return true;
+}
+
+void X6502Jit_Kill(void)
+{
+	if(!code)
+		return;
+#ifdef WIN32
+	VirtualFree(code, 0, MEM_RELEASE);
+#else
+	munmap(code, CODE_SIZE);
+#endif
+	code = 0;
+}
+
+static void Fill(CacheEntry &e, const uint8 *host)
+{
+	e.block = Translate();
+	e.host = host;
+	e.pc = X.PC;
+	e.op = *host;
+	e.stale = 0;
+}
+
+//the code the block was translated from has changed. code in RAM written over again and again, as a loop unrolled
+//on the fly or an operand patched each pass, would be translated anew each time it runs
+static void Refill(CacheEntry &e, const uint8 *host)
+{
+	uint8 stale = e.stale + 1;
+	if(stale >= STALE_LIMIT)
+	{
+		e.block = 0;
+		e.op = *host;
+		e.stale = STALE_LIMIT;
+		e.retry = STALE_RUNS;
+		return;
+	}
+	Fill(e, host);
+	e.stale = stale;
+}
+
+int X6502Jit_Run(int32 &budget, bool &jumpedBack)
+{
+	const uint8 *d = ReadMap[X.PC >> 8].direct;
+	if(!d)
+		return 0;
+	const uint8 *host = d + (X.PC & 0xFF);
+	//what would only be gone into to find its first instruction doesn't fit
+	if(links.cycles[*host] > budget)
+		return 0;
+
+	CacheEntry &e = cache[((size_t)host ^ ((size_t)X.PC << 4)) & (CACHE_SIZE - 1)];
+	if(e.host != host || e.pc != X.PC)
+		Fill(e, host);
+	else if(e.op != *host)
+		Refill(e, host);
+	if(!e.block)
+	{
+		if(e.stale < STALE_LIMIT || --e.retry)
+			return 0;
+		//one more time written over, and it's left alone again
+		Fill(e, host);
+		e.stale = STALE_LIMIT - 1;
+		if(!e.block)
+			return 0;
+	}
+	uint32 start = timestamp;
+	int r = e.block(budget);
+	if(r < 0)
+	{
+		//the code has changed since it was translated
+		Refill(e, host);
+		if(!e.block)
+			return 0;
+		r = e.block(budget);
+		if(r < 0)
+			return 0;
+	}
+	//what's left of the budget: the cycles taken by the block, or all of it if the block was left for a handler
+	budget = jit.mark < 0 ? 0 : budget - (int32)(timestamp - start);
+	jumpedBack = (r & 1) != 0;
+	return r >> 1;
+}
+
+#else
+
+bool X6502Jit_Init(void)
+{
+	return false;
+}
+
+void X6502Jit_Kill(void)
+{
+}
+
+int X6502Jit_Run(int32 &budget, bool &jumpedBack)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _X6502JIT_H_
+#define _X6502JIT_H_
+
+#include "types.h"
+
+#include <vector>
+
+//---------recompiler
+//an optional second way for X6502_Run to run the game, compiled in with FCEU_JIT (scons JIT=1) and working on
+//x86-64 hosts. a straight run of 6502 code is translated into host code doing what the interpreter does for each
+//instruction: A, X, Y and P are kept in host registers and the flags worked out as ops.inc does, memory read straight
+//from (see FCEU_ReadPage) and RAM are read and written in place, and only other addresses go through their handlers.
+//the cycles are counted down against the budget the block is entered with: up to where X6502_Run has to stop, or
+//where the APU may next do anything (see FCEU_SoundCPUHookIdle), whichever is first. a block ends at a jump, at a
+//taken branch, and at an instruction which may let an interrupt in; it's left early when the budget runs out, and
+//after an instruction which went through a handler, as the handler may have raised an interrupt. either way, the
+//cycles and the state are those after exactly the instructions run, so the interpreter takes over from there.
+//blocks are kept by the memory they were translated from and their address, so that switching banks back and forth
+//finds them again. a block checks on entry that its code is still the code mapped in, and a block of code in RAM
+//which writes over its own code is left after that instruction, so neither a bank switch nor code written over ever
+//runs a stale block; it's translated anew, or, when the code there keeps being written over, left to the
+//interpreter for a while.
+
+//what the translated code needs of x6502.cpp
+struct X6502JitLinks
+{
+	bool *idleTouched;			//see IdleLoop
+	int32 *sound;				//the cycles the APU is owed (see jitSound)
+	const uint8 *znTable;
+	const uint8 *cycles;		//CycTable
+	uint8 (*read)(uint32 A);	//RdMem and WrMem
+	void (*write)(uint32 A, uint8 V);
+};
+void X6502_GetJitLinks(X6502JitLinks *links);
+
+//allocates the memory for the host code. false if the recompiler isn't available: not compiled in, not for this
+//host, or the memory can't be had
+bool X6502Jit_Init(void);
+void X6502Jit_Kill(void);
+
+//runs the block at the PC for no more than budget cycles, translating it first if need be, and returns how many
+//instructions it ran, leaving in budget what's left of it: 0 if the block was left after a handler, which may have
+//raised an interrupt. 0, having done nothing, if there is no block there (the PC isn't in memory read straight
+//from, or its opcode isn't translated) or the budget is too small for its first instruction. jumpedBack is set when
+//the last instruction was a jump back, where X6502_Run looks for an idle loop. the caller sees to it that no
+//interrupt is due, now or after the first instruction
+int X6502Jit_Run(int32 &budget, bool &jumpedBack);
+
+//the state of the CPU at the top of X6502_Run's loop, which the interpreter comes through before each instruction
+//and the recompiler before each block: where the two can be compared
+struct X6502Checkpoint
+{
+	uint64 instructions;
+	uint32 timestamp;
+	uint32 ram;			//the CRC of RAM
+	uint16 PC;
+	uint8 A, X, Y, S, P;
+};
+
+//while log isn't NULL, X6502_Run adds each checkpoint it comes through to it
+void X6502_LogCheckpoints(std::vector<X6502Checkpoint> *log);
+//-------
+
+#endif
@@ -0,0 +1,166 @@
+/////////////////////////////////////////////////////////////////
+// vrc7bench.c
+//
+// Micro-benchmark for the VRC7 sound (emu2413). Plays a few
+//  seconds of busy six channel music through two chips: one
+//  rendered a sample at a time with OPLL_calc, as the emulator
+//  used to, and one rendered in blocks with OPLL_fillbuf.
+//  Checks that both give the same samples and end up in the
+//  same state, and prints how long each took.
+//
+/////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/boards/emu2413.h"
+
+#define CLOCK 3579545
+#define RATE 44100
+#define FRAME (RATE / 60)
+
+static uint32 seed;
+// where each chip was left, which should be the same
+static OPLL calcstate, fillstate;
+
+static uint32 Random(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7FFF;
+}
+
+// what a game writes during one frame: new notes, volume and
+// instrument changes, key ups, and now and then a new custom instrument
+static void PlayFrame(OPLL *opll, int frame)
+{
+	int ch;
+
+	if (frame % 120 == 0)
+	{
+		int i;
+		for (i = 0; i < 8; i++)
+			OPLL_writeReg(opll, i, Random() & 0xFF);
+	}
+
+	for (ch = 0; ch < 6; ch++)
+	{
+		uint32 r = Random();
+		if (r & 0x700)
+			continue;
+		if (r & 1)
+		{
+			OPLL_writeReg(opll, 0x30 + ch, Random() & 0xFF);
+			OPLL_writeReg(opll, 0x10 + ch, Random() & 0xFF);
+			OPLL_writeReg(opll, 0x20 + ch, 0x10 | (Random() & 0x2F));
+		}
+		else
+			OPLL_writeReg(opll, 0x20 + ch, Random() & 0x2F);
+	}
+}
+
+static OPLL *NewChip(void)
+{
+	OPLL *opll = OPLL_new(CLOCK, RATE);
+	OPLL_reset(opll);
+	OPLL_reset(opll);
+	return opll;
+}
+
+static double Seconds(void)
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+// renders the song a sample at a time, as the emulator used to
+static void RenderCalc(int32 *out, int frames)
+{
+	OPLL *opll = NewChip();
+	int frame, i, pos = 0;
+
+	seed = 1;
+	for (frame = 0; frame < frames; frame++)
+	{
+		PlayFrame(opll, frame);
+		for (i = 0; i < FRAME; i++)
+			out[pos++] = OPLL_calc(opll) + 32768;
+	}
+	memcpy(&calcstate, opll, sizeof(OPLL));
+	OPLL_delete(opll);
+}
+
+// renders the song in blocks, flushed in uneven pieces the way the sound code does it
+static void RenderFill(int32 *out, int frames)
+{
+	OPLL *opll = NewChip();
+	int frame, pos = 0;
+
+	seed = 1;
+	memset(out, 0, sizeof(int32) * frames * FRAME);
+	for (frame = 0; frame < frames; frame++)
+	{
+		int left = FRAME;
+		PlayFrame(opll, frame);
+		while (left)
+		{
+			int len = 1 + (frame * 7 + left) % 300;
+			if (len > left)
+				len = left;
+			OPLL_fillbuf(opll, &out[pos], len, 0);
+			pos += len;
+			left -= len;
+		}
+	}
+	memcpy(&fillstate, opll, sizeof(OPLL));
+	OPLL_delete(opll);
+}
+
+int main(int argc, char **argv)
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : 60;
+	int runs = argc > 2 ? atoi(argv[2]) : 5;
+	int frames = seconds * 60, samples = frames * FRAME;
+	int32 *calcbuf = (int32*)malloc(sizeof(int32) * samples);
+	int32 *fillbuf = (int32*)malloc(sizeof(int32) * samples);
+	double calctime = 1e9, filltime = 1e9, start;
+	int run, i, mismatches = 0;
+
+	// best of a few runs, as the machine may be busy with other things
+	for (run = 0; run < runs; run++)
+	{
+		start = Seconds();
+		RenderCalc(calcbuf, frames);
+		if (Seconds() - start < calctime)
+			calctime = Seconds() - start;
+
+		start = Seconds();
+		RenderFill(fillbuf, frames);
+		if (Seconds() - start < filltime)
+			filltime = Seconds() - start;
+	}
+
+	for (i = 0; i < samples; i++)
+		if (calcbuf[i] != fillbuf[i])
+		{
+			if (!mismatches)
+				printf("first difference at sample %d: %d != %d\n", i, calcbuf[i], fillbuf[i]);
+			mismatches++;
+		}
+	if (memcmp(&calcstate, &fillstate, sizeof(OPLL)))
+	{
+		printf("the chips ended up in different states\n");
+		mismatches++;
+	}
+
+	printf("%d seconds of audio, %d samples, best of %d runs\n", seconds, samples, runs);
+	printf("OPLL_calc:    %.3fs (%.1f ns/sample)\n", calctime, calctime * 1e9 / samples);
+	printf("OPLL_fillbuf: %.3fs (%.1f ns/sample)\n", filltime, filltime * 1e9 / samples);
+	if (filltime > 0)
+		printf("speedup: %.2fx\n", calctime / filltime);
+	printf(mismatches ? "output DIFFERS\n" : "output identical\n");
+
+	free(calcbuf);
+	free(fillbuf);
+	return mismatches ? 1 : 0;
+}